@@ -0,0 +1,109 @@
+#include <stdio.h>
+#include <math.h>
+#include <time.h>
+
+#include "../smolar.h"
+
+float seconds_since(clock_t start)
+{
+    return ((float)(clock() - start)) / CLOCKS_PER_SEC;
+}
+
+int main()
+{
+    const char *names[] = {"float", "double", "compensated"};
+    int n = 1 << 24;
+    int rows = 16, cols = 1 << 16;
+
+    // large values of alternating sign with a small positive part, so
+    // most of every partial sum cancels out
+    Array *x = smRandom((int[]){n}, 1);
+    Array *y = smRandom((int[]){n}, 1);
+    for (int i = 0; i < n; i++)
+    {
+        x->data[i] = 1000.0f * x->data[i] + ((i % 2) ? 1e4f : -1e4f);
+        y->data[i] = y->data[i] + 1.0f;
+    }
+
+    Array *a = smRandom((int[]){rows, cols}, 2);
+    Array *v = smRandom((int[]){cols}, 1);
+    Array *b = smRandom((int[]){cols, rows}, 2);
+
+    // references in long double
+    long double dot_ref = 0.0L, sum_ref = 0.0L, asum_ref = 0.0L;
+    for (int i = 0; i < n; i++)
+    {
+        dot_ref += (long double)x->data[i] * y->data[i];
+        sum_ref += x->data[i];
+        asum_ref += fabsl(x->data[i]);
+    }
+
+    long double gemv_ref[16], gemm_ref[16 * 16];
+    for (int i = 0; i < rows; i++)
+    {
+        gemv_ref[i] = 0.0L;
+        for (int k = 0; k < cols; k++)
+            gemv_ref[i] += (long double)a->data[i * cols + k] * v->data[k];
+
+        for (int j = 0; j < rows; j++)
+        {
+            gemm_ref[i * rows + j] = 0.0L;
+            for (int k = 0; k < cols; k++)
+                gemm_ref[i * rows + j] += (long double)a->data[i * cols + k] * b->data[k * rows + j];
+        }
+    }
+
+    printf("\nbenchmarking accumulation modes (relative error against long double)...\n\n");
+
+    for (int mode = SM_ACCUM_FLOAT; mode <= SM_ACCUM_COMPENSATED; mode++)
+    {
+        smSetAccumulation((Accumulation)mode);
+
+        clock_t start = clock();
+        Array *dot = smDot(x, y);
+        float t = seconds_since(start);
+        printf("%-12s dot    (%d): %f seconds, error %e\n", names[mode], n, t,
+               (double)fabsl((dot->data[0] - dot_ref) / dot_ref));
+        smCleanup(dot);
+
+        start = clock();
+        Array *sum = smSum(x, 0);
+        t = seconds_since(start);
+        printf("%-12s sum    (%d): %f seconds, error %e\n", names[mode], n, t,
+               (double)fabsl((sum->data[0] - sum_ref) / sum_ref));
+        smCleanup(sum);
+
+        start = clock();
+        float asum = smAsum(x);
+        t = seconds_since(start);
+        printf("%-12s asum   (%d): %f seconds, error %e\n", names[mode], n, t,
+               (double)fabsl((asum - asum_ref) / asum_ref));
+
+        start = clock();
+        Array *gemv = smGemv(a, v, false);
+        t = seconds_since(start);
+        double err = 0.0;
+        for (int i = 0; i < rows; i++)
+            err = fmax(err, (double)fabsl((gemv->data[i] - gemv_ref[i]) / gemv_ref[i]));
+        printf("%-12s gemv   (%d x %d): %f seconds, error %e\n", names[mode], rows, cols, t, err);
+        smCleanup(gemv);
+
+        start = clock();
+        Array *gemm = smMatMul(a, b);
+        t = seconds_since(start);
+        err = 0.0;
+        for (int i = 0; i < rows * rows; i++)
+            err = fmax(err, (double)fabsl((gemm->data[i] - gemm_ref[i]) / gemm_ref[i]));
+        printf("%-12s matmul (%d x %d x %d): %f seconds, error %e\n\n", names[mode], rows, cols, rows, t, err);
+        smCleanup(gemm);
+    }
+
+    smSetAccumulation(SM_ACCUM_FLOAT);
+
+    smCleanup(b);
+    smCleanup(v);
+    smCleanup(a);
+    smCleanup(y);
+    smCleanup(x);
+    return 0;
+}
@@ -0,0 +1,62 @@
+#include <stdio.h>
+#include <math.h>
+#include <time.h>
+
+#include "../smolar.h"
+
+float seconds_since(clock_t start)
+{
+    return ((float)(clock() - start)) / CLOCKS_PER_SEC;
+}
+
+int main()
+{
+    int batch = 2, heads = 8, len = 1024, d = 64;
+    int shape[] = {batch, heads, len, d};
+    float flops = 4.0f * batch * heads * len * len * d;
+
+    Array *q = smRandom(shape, 4);
+    Array *k = smRandom(shape, 4);
+    Array *v = smRandom(shape, 4);
+
+    printf("\nbenchmarking attention over (%d, %d, %d, %d)...\n\n", batch, heads, len, d);
+
+    // scores materialized: q @ k.T, softmax, @ v
+    clock_t start = clock();
+    Array *kt = smTransposeView(k, (int[]){0, 1, 3, 2});
+    Array *scores = smMatMul(q, kt);
+    float scale = 1.0f / sqrtf((float)d);
+    for (int i = 0; i < scores->totalsize; i++)
+        scores->data[i] *= scale;
+    Array *probs = smSoftmax(scores, -1);
+    Array *ref = smMatMul(probs, v);
+    float t = seconds_since(start);
+    printf("matmul + softmax + matmul: %f seconds, %6.2f GFLOPS, %ld MB of scores\n",
+           t, flops / t / 1e9f, (long)scores->totalsize * 4 / (1 << 20));
+
+    start = clock();
+    Array *res = smAttention(q, k, v, NULL, false);
+    t = seconds_since(start);
+    printf("smAttention:               %f seconds, %6.2f GFLOPS\n", t, flops / t / 1e9f);
+
+    float err = 0.0f;
+    for (int i = 0; i < ref->totalsize; i++)
+        err = fmaxf(err, fabsf(res->data[i] - ref->data[i]));
+    printf("max difference:            %e\n", err);
+
+    start = clock();
+    Array *causal = smAttention(q, k, v, NULL, true);
+    t = seconds_since(start);
+    printf("smAttention, causal:       %f seconds\n\n", t);
+
+    smCleanup(causal);
+    smCleanup(res);
+    smCleanup(ref);
+    smCleanup(probs);
+    smCleanup(scores);
+    smCleanup(kt);
+    smCleanup(v);
+    smCleanup(k);
+    smCleanup(q);
+    return 0;
+}
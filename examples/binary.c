@@ -0,0 +1,93 @@
+#include <stdio.h>
+#include <math.h>
+#include <time.h>
+
+#include "../smolar.h"
+
+float seconds_since(clock_t start)
+{
+    return ((float)(clock() - start)) / CLOCKS_PER_SEC;
+}
+
+int main()
+{
+    int n = 1 << 22;
+    int rows = 1 << 11, cols = 1 << 11;
+
+    Array *a = smRandom((int[]){n}, 1);
+    Array *b = smRandom((int[]){n}, 1);
+    for (int i = 0; i < n; i++)
+    {
+        a->data[i] = 2.0f * a->data[i] - 1.0f;
+        b->data[i] = 2.0f * b->data[i] - 1.0f;
+    }
+
+    printf("\nbenchmarking binary ops (%d elements)...\n\n", n);
+
+    // a - b through a negated temporary, then in one pass
+    clock_t start = clock();
+    Array *neg = smMulScalar(b, -1.0f);
+    Array *sub_old = smAdd(a, neg);
+    float t = seconds_since(start);
+    printf("sub as add(a, -b): %f seconds\n", t);
+
+    start = clock();
+    Array *sub = smSub(a, b);
+    t = seconds_since(start);
+    printf("sub              : %f seconds\n", t);
+
+    int mismatches = 0;
+    for (int i = 0; i < n; i++)
+        mismatches += sub->data[i] != sub_old->data[i];
+    printf("mismatches       : %d\n\n", mismatches);
+
+    const char *names[] = {"div", "pow", "minimum", "maximum", "atan2"};
+    Array *(*ops[])(Array *, Array *) = {smDiv, smPow, smMinimum, smMaximum, smAtan2};
+    for (int k = 0; k < 5; k++)
+    {
+        start = clock();
+        Array *res = ops[k](a, b);
+        t = seconds_since(start);
+        printf("%-17s: %f seconds\n", names[k], t);
+        smCleanup(res);
+    }
+
+    // atan2 against libm over a full turn
+    double err = 0.0;
+    Array *angle = smAtan2(a, b);
+    for (int i = 0; i < n; i++)
+        err = fmax(err, fabs(angle->data[i] - atan2(a->data[i], b->data[i])));
+    printf("atan2 max abs err: %e\n\n", err);
+
+    // broadcast a row and a scalar, no expanded copies are made
+    Array *m = smRandom((int[]){rows, cols}, 2);
+    Array *row = smRandom((int[]){cols}, 1);
+
+    start = clock();
+    Array *centered = smSub(m, row);
+    t = seconds_since(start);
+    printf("sub row   (%d x %d): %f seconds\n", rows, cols, t);
+
+    start = clock();
+    Array *squared = smPowScalar(centered, 2.0f);
+    t = seconds_since(start);
+    printf("pow 2     (%d x %d): %f seconds\n", rows, cols, t);
+
+    start = clock();
+    Array *clamped = smMinimumScalar(squared, 0.25f);
+    t = seconds_since(start);
+    printf("minimum s (%d x %d): %f seconds\n\n", rows, cols, t);
+
+    smCleanup(clamped);
+    smCleanup(squared);
+    smCleanup(centered);
+    smCleanup(row);
+    smCleanup(m);
+    smCleanup(angle);
+    smCleanup(sub);
+    smCleanup(sub_old);
+    smCleanup(neg);
+    smCleanup(b);
+    smCleanup(a);
+    return 0;
+}
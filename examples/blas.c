@@ -0,0 +1,116 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <time.h>
+
+#include "../smolar.h"
+
+float seconds_since(clock_t start)
+{
+    return ((float)(clock() - start)) / CLOCKS_PER_SEC;
+}
+
+float max_error(const float *a, const double *b, long n)
+{
+    float err = 0.0f;
+    for (long i = 0; i < n; i++)
+        err = fmaxf(err, (float)(fabs(a[i] - b[i]) / (1.0 + fabs(b[i]))));
+    return err;
+}
+
+int main()
+{
+    int n = 4096;
+    int shape[] = {n, n};
+
+    // A and its transposed view, which every call below reads in place
+    Array *a = smRandom(shape, 2);
+    Array *at = smTransposeView(a, (int[]){1, 0});
+    Array *x = smRandom((int[]){n}, 1);
+    Array *y = smRandom((int[]){n}, 1);
+    double *ref = malloc(sizeof(double) * n);
+    double s;
+
+    printf("\nlevel 1 on %d floats, reductions on a %d x %d transposed view...\n\n", n, n, n);
+
+    // y = 0.5 * (y + 2 x)
+    for (int i = 0; i < n; i++)
+        ref[i] = 0.5 * ((double)y->data[i] + 2.0 * x->data[i]);
+    smAxpy(2.0f, x, y);
+    smScal(0.5f, y);
+    printf("axpy + scal:      max error %e\n", max_error(y->data, ref, n));
+
+    s = 0.0;
+    for (long i = 0; i < a->totalsize; i++)
+        s += (double)a->data[i] * a->data[i];
+    printf("nrm2 (strided):   %f, reference %f\n", smNrm2(at), sqrt(s));
+
+    s = 0.0;
+    for (long i = 0; i < a->totalsize; i++)
+        s += fabs(a->data[i]);
+    printf("asum (strided):   %f, reference %f\n", smAsum(at), s);
+
+    // row i of A against column i of A
+    for (int i = 0; i < n; i++)
+    {
+        s = 0.0;
+        for (int k = 0; k < n; k++)
+            s += (double)a->data[(long)i * n + k] * a->data[(long)k * n + i];
+        ref[i] = s;
+    }
+    clock_t start = clock();
+    Array *d = smDotAxis(a, at, -1);
+    float t = seconds_since(start);
+    printf("dot axis (A, A.T): %f seconds, max error %e\n", t, max_error(d->data, ref, n));
+    smCleanup(d);
+
+    printf("\nmatrix-vector products on %d x %d...\n\n", n, n);
+
+    for (int i = 0; i < n; i++)
+    {
+        s = 0.0;
+        for (int k = 0; k < n; k++)
+            s += (double)a->data[(long)i * n + k] * x->data[k];
+        ref[i] = s;
+    }
+    start = clock();
+    Array *g = smGemv(a, x, false);
+    t = seconds_since(start);
+    printf("gemv A @ x:         %f seconds, max error %e\n", t, max_error(g->data, ref, n));
+    smCleanup(g);
+
+    // the same product as a matmul with a column, which dispatches to gemv
+    Array *xc = smExpandDims(x, 1);
+    start = clock();
+    g = smMatMul(a, xc);
+    t = seconds_since(start);
+    printf("matmul A @ x[:, None]: %f seconds, max error %e\n", t, max_error(g->data, ref, n));
+    smCleanup(g);
+
+    for (int i = 0; i < n; i++)
+    {
+        s = 0.0;
+        for (int k = 0; k < n; k++)
+            s += (double)a->data[(long)k * n + i] * x->data[k];
+        ref[i] = s;
+    }
+    start = clock();
+    g = smGemv(a, x, true);
+    t = seconds_since(start);
+    printf("gemv A.T @ x:       %f seconds, max error %e\n", t, max_error(g->data, ref, n));
+    smCleanup(g);
+
+    start = clock();
+    g = smGemv(at, x, false);
+    t = seconds_since(start);
+    printf("gemv (A.T view) @ x: %f seconds, max error %e\n\n", t, max_error(g->data, ref, n));
+    smCleanup(g);
+
+    free(ref);
+    smCleanup(xc);
+    smCleanup(y);
+    smCleanup(x);
+    smCleanup(at);
+    smCleanup(a);
+    return 0;
+}
@@ -0,0 +1,103 @@
+#include <stdio.h>
+#include <math.h>
+#include <time.h>
+
+#include "../smolar.h"
+
+/*
+textbook convolution, stride 1 and "same" padding
+*/
+void conv2d_naive(int c, int h, int w, int o, int k, const float *x, const float *wt, float *y)
+{
+    int p = k / 2;
+    for (int oc = 0; oc < o; oc++)
+        for (int i = 0; i < h; i++)
+            for (int j = 0; j < w; j++)
+            {
+                float acc = 0.0f;
+                for (int ic = 0; ic < c; ic++)
+                    for (int u = 0; u < k; u++)
+                        for (int v = 0; v < k; v++)
+                        {
+                            int iy = i + u - p, ix = j + v - p;
+                            if (iy >= 0 && iy < h && ix >= 0 && ix < w)
+                                acc += wt[((oc * c + ic) * k + u) * k + v] * x[(ic * h + iy) * w + ix];
+                        }
+                y[(oc * h + i) * w + j] = acc;
+            }
+}
+
+float seconds_since(clock_t start)
+{
+    return ((float)(clock() - start)) / CLOCKS_PER_SEC;
+}
+
+void bench(const char *name, int n, int c, int h, int w, int o, int k, int stride, int groups)
+{
+    Array *x = smRandom((int[]){n, c, h, w}, 4);
+    Array *wt = smRandom((int[]){o, c / groups, k, k}, 4);
+    Array *bias = smRandom((int[]){o}, 1);
+
+    clock_t start = clock();
+    Array *y = smConv2d(x, wt, bias, stride, k / 2, 1, groups);
+    float t = seconds_since(start);
+
+    float flops = 2.0f * y->totalsize * (c / groups) * k * k;
+    printf("%-28s %f seconds, %6.2f GFLOPS\n", name, t, flops / t / 1e9f);
+
+    smCleanup(y);
+    smCleanup(bias);
+    smCleanup(wt);
+    smCleanup(x);
+}
+
+int main()
+{
+    int c = 64, h = 56, w = 56, o = 64, k = 3;
+
+    printf("\nbenchmarking convolutions...\n\n");
+
+    Array *x = smRandom((int[]){1, c, h, w}, 4);
+    Array *wt = smRandom((int[]){o, c, k, k}, 4);
+    Array *ref = smCreate((int[]){1, o, h, w}, 4);
+
+    clock_t start = clock();
+    conv2d_naive(c, h, w, o, k, x->data, wt->data, ref->data);
+    float t = seconds_since(start);
+    float flops = 2.0f * o * h * w * c * k * k;
+    printf("%-28s %f seconds, %6.2f GFLOPS\n", "textbook 64 -> 64, 3x3", t, flops / t / 1e9f);
+
+    start = clock();
+    Array *y = smConv2d(x, wt, NULL, 1, 1, 1, 1);
+    t = seconds_since(start);
+
+    float err = 0.0f;
+    for (int i = 0; i < y->totalsize; i++)
+        err = fmaxf(err, fabsf(y->data[i] - ref->data[i]));
+    printf("%-28s %f seconds, %6.2f GFLOPS, max difference %e\n\n", "smConv2d 64 -> 64, 3x3", t, flops / t / 1e9f, err);
+
+    bench("rgb 3 -> 64, 7x7 stride 2", 4, 3, 224, 224, 64, 7, 2, 1);
+    bench("rgb 3 -> 16, 3x3", 4, 3, 224, 224, 16, 3, 1, 1);
+    bench("depthwise 128, 3x3", 4, 128, 56, 56, 128, 3, 1, 128);
+    bench("pointwise 128 -> 256, 1x1", 4, 128, 28, 28, 256, 1, 1, 1);
+
+    Array *big = smRandom((int[]){4, 64, 112, 112}, 4);
+    start = clock();
+    Array *pooled = smMaxPool2d(big, 3, 2, 1);
+    t = seconds_since(start);
+    printf("\n%-28s %f seconds\n", "max pool 3x3 stride 2", t);
+    smCleanup(pooled);
+
+    start = clock();
+    pooled = smAvgPool2d(big, 2, 2, 0);
+    t = seconds_since(start);
+    printf("%-28s %f seconds\n\n", "average pool 2x2 stride 2", t);
+    smCleanup(pooled);
+
+    smCleanup(big);
+    smCleanup(y);
+    smCleanup(ref);
+    smCleanup(wt);
+    smCleanup(x);
+    return 0;
+}
@@ -0,0 +1,132 @@
+#include <stdio.h>
+#include <math.h>
+#include <time.h>
+
+#include "../smolar.h"
+
+float seconds_since(clock_t start)
+{
+    return ((float)(clock() - start)) / CLOCKS_PER_SEC;
+}
+
+float max_error(Array *a, Array *b)
+{
+    Array *ac = smContiguous(a), *bc = smContiguous(b);
+    float err = 0.0f;
+    for (long i = 0; i < ac->totalsize; i++)
+        err = fmaxf(err, fabsf(ac->data[i] - bc->data[i]) / (1.0f + fabsf(bc->data[i])));
+    smCleanup(ac);
+    smCleanup(bc);
+    return err;
+}
+
+void report(const char *name, Array *res, Array *ref, float t)
+{
+    printf("%-22s %f seconds, max error %e\n", name, t, max_error(res, ref));
+    smCleanup(res);
+    smCleanup(ref);
+}
+
+int main()
+{
+    int n = 512;
+    Array *a = smRandom((int[]){n, n}, 2);
+    Array *b = smRandom((int[]){n, n}, 2);
+    Array *v = smRandom((int[]){n}, 1);
+    Array *at = smTransposeView(a, (int[]){1, 0});
+
+    printf("\neinsum on %d x %d against the direct calls...\n\n", n, n);
+
+    // dot products per row, and matrix-vector products
+    clock_t start = clock();
+    Array *res = smEinsum("ij,ij->i", (Array *[]){a, b}, 2);
+    float t = seconds_since(start);
+    report("ij,ij->i", res, smDotAxis(a, b, -1), t);
+
+    start = clock();
+    res = smEinsum("ij,j->i", (Array *[]){a, v}, 2);
+    t = seconds_since(start);
+    report("ij,j->i", res, smGemv(a, v, false), t);
+
+    start = clock();
+    res = smEinsum("ji,j->i", (Array *[]){a, v}, 2);
+    t = seconds_since(start);
+    report("ji,j->i", res, smGemv(a, v, true), t);
+
+    start = clock();
+    res = smEinsum("i,i->", (Array *[]){v, v}, 2);
+    t = seconds_since(start);
+    report("i,i->", res, smDot(v, v), t);
+
+    // matmul, with the implicit output and a transposed operand
+    start = clock();
+    res = smEinsum("ij,jk", (Array *[]){a, b}, 2);
+    t = seconds_since(start);
+    report("ij,jk (implicit)", res, smMatMul(a, b), t);
+
+    start = clock();
+    res = smEinsum("ji,jk->ik", (Array *[]){a, b}, 2);
+    t = seconds_since(start);
+    report("ji,jk->ik", res, smMatMul(at, b), t);
+
+    // batched matmul over the leading axis
+    int batch = 16, m = 64;
+    Array *x = smRandom((int[]){batch, m, m}, 3);
+    Array *y = smRandom((int[]){batch, m, m}, 3);
+    start = clock();
+    res = smEinsum("bij,bjk->bik", (Array *[]){x, y}, 2);
+    t = seconds_since(start);
+    report("bij,bjk->bik", res, smMatMul(x, y), t);
+
+    // trace and diagonal are stride views, the trace of a product a dot
+    Array *trace = smCreate((int[]){1}, 1);
+    Array *diag = smCreate((int[]){n}, 1);
+    trace->data[0] = 0.0f;
+    for (int i = 0; i < n; i++)
+    {
+        diag->data[i] = a->data[(long)i * n + i];
+        trace->data[0] += diag->data[i];
+    }
+    start = clock();
+    res = smEinsum("ii->i", (Array *[]){a}, 1);
+    t = seconds_since(start);
+    report("ii->i", res, diag, t);
+
+    start = clock();
+    res = smEinsum("ii", (Array *[]){a}, 1);
+    t = seconds_since(start);
+    report("ii (implicit)", res, trace, t);
+
+    Array *ab = smMatMul(a, b);
+    trace = smCreate((int[]){1}, 1);
+    trace->data[0] = 0.0f;
+    for (int i = 0; i < n; i++)
+        trace->data[0] += ab->data[(long)i * n + i];
+    start = clock();
+    res = smEinsum("ij,ji->", (Array *[]){a, b}, 2);
+    t = seconds_since(start);
+    report("ij,ji->", res, trace, t);
+
+    // three operands: the cheapest pair is contracted first
+    Array *c = smRandom((int[]){n, 8}, 2);
+    start = clock();
+    res = smEinsum("ij,jk,kl->il", (Array *[]){a, b, c}, 3);
+    t = seconds_since(start);
+    report("ij,jk,kl->il", res, smMatMul(ab, c), t);
+
+    start = clock();
+    res = smEinsum("ij,jk,kl", (Array *[]){a, b, c}, 3);
+    t = seconds_since(start);
+    report("ij,jk,kl (implicit)", res, smMatMul(ab, c), t);
+
+    printf("\n");
+    smCleanup(c);
+    smCleanup(ab);
+    smCleanup(y);
+    smCleanup(x);
+    smCleanup(at);
+    smCleanup(v);
+    smCleanup(b);
+    smCleanup(a);
+    return 0;
+}
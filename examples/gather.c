@@ -0,0 +1,126 @@
+#include <stdio.h>
+#include <math.h>
+#include <time.h>
+
+#include "../smolar.h"
+
+float seconds_since(clock_t start)
+{
+    return ((float)(clock() - start)) / CLOCKS_PER_SEC;
+}
+
+void show(const char *name, Array *arr)
+{
+    Array *c = smContiguous(arr);
+    printf("%-37s", name);
+    for (long i = 0; i < c->totalsize; i++)
+        printf(" %g", c->data[i]);
+    printf("\n");
+    smCleanup(c);
+}
+
+int main()
+{
+    // x is 3 x 4: x[i][j] = 10 i + j
+    Array *x = smCreate((int[]){3, 4}, 2);
+    for (int i = 0; i < 3; i++)
+        for (int j = 0; j < 4; j++)
+            x->data[i * 4 + j] = 10.0f * i + j;
+
+    printf("\ngathers and scatters on a 3 x 4 Array, x[i][j] = 10 i + j...\n\n");
+
+    // rows 2, 0 and -1 (the last one)
+    Array *idx = smCreate((int[]){3}, 1);
+    smFromValues(idx, (float[]){2, 0, -1});
+    Array *rows = smTake(x, idx, 0);
+    show("take rows [2, 0, -1]:", rows);
+    printf("%-37s 20 21 22 23 0 1 2 3 20 21 22 23\n", "  expected:");
+
+    // columns along the last axis
+    Array *cidx = smCreate((int[]){2}, 1);
+    smFromValues(cidx, (float[]){-1, 1});
+    Array *cols = smTake(x, cidx, -1);
+    show("take columns [-1, 1]:", cols);
+    printf("%-37s 3 1 13 11 23 21\n", "  expected:");
+
+    // one index per row, -4 is the first column
+    Array *per_row = smCreate((int[]){3, 1}, 2);
+    smFromValues(per_row, (float[]){3, -4, 1});
+    Array *picked = smTakeAlongAxis(x, per_row, -1);
+    show("take along last axis [3, -4, 1]:", picked);
+    printf("%-37s 3 10 21\n", "  expected:");
+
+    // repeated indices accumulate, negative ones count from the end
+    Array *out = smCreate((int[]){3, 4}, 2);
+    for (int i = 0; i < out->totalsize; i++)
+        out->data[i] = 0.0f;
+    Array *src = smCreate((int[]){4, 4}, 2);
+    for (int i = 0; i < src->totalsize; i++)
+        src->data[i] = 1.0f;
+    Array *sidx = smCreate((int[]){4}, 1);
+    smFromValues(sidx, (float[]){0, 2, 0, -3});
+    smScatterAdd(out, sidx, src, 0);
+    show("scatter add rows [0, 2, 0, -3]:", out);
+    printf("%-37s 3 3 3 3 0 0 0 0 1 1 1 1\n", "  expected:");
+
+    // into a transposed (non-contiguous) view: columns of `base` get the rows
+    Array *base = smCreate((int[]){4, 3}, 2);
+    for (int i = 0; i < base->totalsize; i++)
+        base->data[i] = 0.0f;
+    Array *view = smTransposeView(base, (int[]){1, 0});
+    smScatterAdd(view, sidx, src, 0);
+    show("scatter add into a transposed view:", base);
+    printf("%-37s 3 0 1 3 0 1 3 0 1 3 0 1\n", "  expected:");
+
+    // odd elements, in C order
+    Array *mask = smCreate((int[]){3, 4}, 2);
+    for (int i = 0; i < mask->totalsize; i++)
+        mask->data[i] = (float)((int)x->data[i] % 2);
+    Array *odd = smMaskSelect(x, mask);
+    show("mask select (odd):", odd);
+    printf("%-37s 1 3 11 13 21 23\n", "  expected:");
+
+    // an embedding style scatter: many updates into few rows
+    int nrows = 1000, dim = 64, n = 200000;
+    Array *table = smCreate((int[]){nrows, dim}, 2);
+    for (int i = 0; i < table->totalsize; i++)
+        table->data[i] = 0.0f;
+    Array *grads = smRandom((int[]){n, dim}, 2);
+    Array *ids = smCreate((int[]){n}, 1);
+    for (int j = 0; j < n; j++)
+        ids->data[j] = (float)((j * 7919) % nrows);
+
+    clock_t start = clock();
+    smScatterAdd(table, ids, grads, 0);
+    float t = seconds_since(start);
+
+    float err = 0.0f;
+    for (int r = 0; r < 3; r++)
+    {
+        double ref = 0.0;
+        for (int j = 0; j < n; j++)
+            if ((j * 7919) % nrows == r)
+                ref += grads->data[(long)j * dim];
+        err = fmaxf(err, fabsf(table->data[(long)r * dim] - (float)ref));
+    }
+    printf("\nscatter add of %d x %d into %d rows: %f seconds, max error %e\n\n", n, dim, nrows, t, err);
+
+    smCleanup(ids);
+    smCleanup(grads);
+    smCleanup(table);
+    smCleanup(odd);
+    smCleanup(mask);
+    smCleanup(view);
+    smCleanup(base);
+    smCleanup(sidx);
+    smCleanup(src);
+    smCleanup(out);
+    smCleanup(picked);
+    smCleanup(per_row);
+    smCleanup(cols);
+    smCleanup(cidx);
+    smCleanup(rows);
+    smCleanup(idx);
+    smCleanup(x);
+    return 0;
+}
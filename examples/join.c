@@ -0,0 +1,85 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "../smolar.h"
+
+void show(const char *name, Array *arr)
+{
+    Array *c = smContiguous(arr);
+    printf("%-30s (", name);
+    for (int d = 0; d < c->ndim; d++)
+        printf(d ? ", %d" : "%d", c->shape[d]);
+    printf(") ");
+    for (long i = 0; i < c->totalsize; i++)
+        printf(" %g", c->data[i]);
+    printf("\n");
+    smCleanup(c);
+}
+
+int main()
+{
+    // a is 2 x 3 with a[i][j] = 10 i + j, b is the transposed view of a
+    // 3 x 2 Array, so its rows are strided
+    Array *a = smCreate((int[]){2, 3}, 2);
+    Array *bt = smCreate((int[]){3, 2}, 2);
+    for (int i = 0; i < 2; i++)
+        for (int j = 0; j < 3; j++)
+        {
+            a->data[i * 3 + j] = 10.0f * i + j;
+            bt->data[j * 2 + i] = 100.0f + 10.0f * i + j;
+        }
+    Array *b = smTransposeView(bt, (int[]){1, 0});
+
+    printf("\njoining a contiguous and a strided 2 x 3 Array...\n\n");
+
+    Array *rows = smConcat((Array *[]){a, b}, 2, 0);
+    show("concat axis 0:", rows);
+    printf("%-30s (4, 3)  0 1 2 10 11 12 100 101 102 110 111 112\n", "  expected:");
+
+    Array *cols = smConcat((Array *[]){a, b}, 2, -1);
+    show("concat axis -1:", cols);
+    printf("%-30s (2, 6)  0 1 2 100 101 102 10 11 12 110 111 112\n", "  expected:");
+
+    Array *pairs = smStack((Array *[]){a, b}, 2, -1);
+    show("stack axis -1:", pairs);
+    printf("%-30s (2, 3, 2)  0 100 1 101 2 102 10 110 11 111 12 112\n", "  expected:");
+
+    Array *planes = smStack((Array *[]){a, b}, 2, 0);
+    show("stack axis 0:", planes);
+    printf("%-30s (2, 2, 3)  0 1 2 10 11 12 100 101 102 110 111 112\n\n", "  expected:");
+
+    // 6 columns into 4 views: 2, 2, 1, 1
+    Array **parts = smSplit(cols, 4, -1);
+    for (int i = 0; i < 4; i++)
+        show(i ? "" : "split axis -1 in 4:", parts[i]);
+    printf("%-30s (2, 2) (2, 2) (2, 1) (2, 1)\n", "  expected:");
+
+    // more sections than elements: the last ones are empty views
+    Array **rparts = smSplit(rows, 6, 0);
+    for (int i = 0; i < 6; i++)
+        show(i ? "" : "split axis 0 in 6:", rparts[i]);
+    printf("%-30s (1, 3) x 4, then (0, 3) x 2\n", "  expected:");
+
+    // joining the pieces back, empty ones included, gives the input
+    Array *back = smConcat(rparts, 6, 0);
+    int same = smCheckShapesEqual(back, rows);
+    for (long i = 0; same && i < rows->totalsize; i++)
+        same = (back->data[i] == rows->data[i]);
+    printf("\nconcat of the 6 pieces equals the input: %s\n\n", same ? "yes" : "no");
+
+    smCleanup(back);
+    for (int i = 0; i < 6; i++)
+        smCleanup(rparts[i]);
+    free(rparts);
+    for (int i = 0; i < 4; i++)
+        smCleanup(parts[i]);
+    free(parts);
+    smCleanup(planes);
+    smCleanup(pairs);
+    smCleanup(cols);
+    smCleanup(rows);
+    smCleanup(b);
+    smCleanup(bt);
+    smCleanup(a);
+    return 0;
+}
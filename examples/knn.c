@@ -0,0 +1,54 @@
+#include <stdio.h>
+#include <time.h>
+
+#include "../smolar.h"
+
+float seconds_since(clock_t start)
+{
+    return ((float)(clock() - start)) / CLOCKS_PER_SEC;
+}
+
+int main()
+{
+    int n = 100000, m = 256, d = 128, k = 10;
+
+    Array *base = smRandom((int[]){n, d}, 2);
+    Array *queries = smRandom((int[]){m, d}, 2);
+
+    printf("\nbenchmarking %d-nearest neighbours of %d queries in %d x %d vectors...\n\n", k, m, n, d);
+
+    // the whole (m, n) distance matrix, then a top-k of every row
+    clock_t start = clock();
+    Array *dist = smCdist(queries, base, SM_DIST_SQEUCLIDEAN);
+    float t = seconds_since(start);
+    printf("smCdist:         %f seconds, %6.2f GFLOPS\n", t, 2.0f * m * n * d / t / 1e9f);
+
+    for (int i = 0; i < dist->totalsize; i++)
+        dist->data[i] = -dist->data[i];
+
+    Array *ref_indices;
+    start = clock();
+    Array *ref = smTopK(dist, k, 1, &ref_indices);
+    float t_topk = seconds_since(start);
+    printf("  + smTopK:      %f seconds, %.1f MB of distances\n", t_topk, (float)m * n * 4 / 1e6f);
+
+    Array *indices;
+    start = clock();
+    Array *nearest = smKnn(queries, base, k, SM_DIST_SQEUCLIDEAN, &indices);
+    t = seconds_since(start);
+
+    int mismatches = 0;
+    for (int i = 0; i < m * k; i++)
+        mismatches += indices->data[i] != ref_indices->data[i];
+    printf("smKnn (fused):   %f seconds, %d neighbours differ, nearest of query 0: %f\n\n",
+           t, mismatches, nearest->data[0]);
+
+    smCleanup(nearest);
+    smCleanup(indices);
+    smCleanup(ref);
+    smCleanup(ref_indices);
+    smCleanup(dist);
+    smCleanup(queries);
+    smCleanup(base);
+    return 0;
+}
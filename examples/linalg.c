@@ -0,0 +1,135 @@
+#include <stdio.h>
+#include <math.h>
+#include <time.h>
+
+#include "../smolar.h"
+
+/*
+textbook versions, one column at a time, for comparison
+*/
+void cholesky_unblocked(int n, float *a)
+{
+    for (int j = 0; j < n; j++)
+    {
+        float d = a[j * n + j];
+        for (int t = 0; t < j; t++)
+            d -= a[j * n + t] * a[j * n + t];
+        d = sqrtf(d);
+        a[j * n + j] = d;
+
+        for (int i = j + 1; i < n; i++)
+        {
+            float s = a[i * n + j];
+            for (int t = 0; t < j; t++)
+                s -= a[i * n + t] * a[j * n + t];
+            a[i * n + j] = s / d;
+        }
+    }
+}
+
+void lu_unblocked(int n, float *a)
+{
+    for (int j = 0; j < n; j++)
+    {
+        int p = j;
+        for (int i = j + 1; i < n; i++)
+            if (fabsf(a[i * n + j]) > fabsf(a[p * n + j]))
+                p = i;
+
+        for (int c = 0; c < n; c++)
+        {
+            float tmp = a[j * n + c];
+            a[j * n + c] = a[p * n + c];
+            a[p * n + c] = tmp;
+        }
+
+        for (int i = j + 1; i < n; i++)
+        {
+            a[i * n + j] /= a[j * n + j];
+            for (int c = j + 1; c < n; c++)
+                a[i * n + c] -= a[i * n + j] * a[j * n + c];
+        }
+    }
+}
+
+float seconds_since(clock_t start)
+{
+    return ((float)(clock() - start)) / CLOCKS_PER_SEC;
+}
+
+int main()
+{
+    int n = 1024;
+    int shape[] = {n, n};
+    float flops_chol = (float)n * n * n / 3.0f;
+    float flops_lu = 2.0f * n * n * n / 3.0f;
+
+    // symmetric positive definite: X @ X.T + n * I
+    Array *x = smRandom(shape, 2);
+    Array *xt = smTransposeView(x, (int[]){1, 0});
+    Array *spd = smMatMul(x, xt);
+    for (int i = 0; i < n; i++)
+        spd->data[i * n + i] += n;
+
+    Array *a = smRandom(shape, 2);
+
+    printf("\nbenchmarking factorizations of %d x %d matrices...\n\n", n, n);
+
+    Array *work = smContiguous(spd);
+    clock_t start = clock();
+    cholesky_unblocked(n, work->data);
+    float t = seconds_since(start);
+    printf("cholesky  unblocked: %f seconds, %6.2f GFLOPS\n", t, flops_chol / t / 1e9f);
+    smCleanup(work);
+
+    start = clock();
+    Array *l = smCholesky(spd);
+    t = seconds_since(start);
+    printf("cholesky  blocked:   %f seconds, %6.2f GFLOPS\n", t, flops_chol / t / 1e9f);
+    smCleanup(l);
+
+    work = smContiguous(a);
+    start = clock();
+    lu_unblocked(n, work->data);
+    t = seconds_since(start);
+    printf("lu        unblocked: %f seconds, %6.2f GFLOPS\n", t, flops_lu / t / 1e9f);
+    smCleanup(work);
+
+    start = clock();
+    Array *lu = smLU(a, NULL);
+    t = seconds_since(start);
+    printf("lu        blocked:   %f seconds, %6.2f GFLOPS\n", t, flops_lu / t / 1e9f);
+    smCleanup(lu);
+
+    // residual of a solve with a few right hand sides
+    int rhs_shape[] = {n, 8};
+    Array *b = smRandom(rhs_shape, 2);
+    start = clock();
+    Array *sol = smSolve(a, b);
+    t = seconds_since(start);
+    Array *check = smMatMul(a, sol);
+
+    float err = 0.0f;
+    for (int i = 0; i < b->totalsize; i++)
+        err = fmaxf(err, fabsf(check->data[i] - b->data[i]));
+    printf("\nsolve with 8 right hand sides: %f seconds, max residual %e\n", t, err);
+
+    // a batch of right hand sides broadcasts the matrix, factored once
+    int batch_shape[] = {16, n, 8};
+    Array *bb = smRandom(batch_shape, 3);
+    start = clock();
+    Array *bsol = smSolve(a, bb);
+    t = seconds_since(start);
+    printf("solve with 16 x 8 right hand sides: %f seconds\n\n", t);
+
+    smCleanup(bsol);
+    smCleanup(bb);
+    smCleanup(check);
+    smCleanup(sol);
+    smCleanup(b);
+    smCleanup(a);
+    smCleanup(spd);
+    smCleanup(xt);
+    smCleanup(x);
+    return 0;
+}
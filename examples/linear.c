@@ -0,0 +1,65 @@
+#include <stdio.h>
+#include <math.h>
+#include <time.h>
+
+#include "../smolar.h"
+
+float relu(float x)
+{
+    return (x > 0.0f) ? x : 0.0f;
+}
+
+float seconds_since(clock_t start)
+{
+    return ((float)(clock() - start)) / CLOCKS_PER_SEC;
+}
+
+int main()
+{
+    int batch = 16, tokens = 128, k = 512, n = 2048;
+    float flops = 2.0f * batch * tokens * k * n;
+
+    Array *x = smRandom((int[]){batch, tokens, k}, 3);
+    Array *w = smRandom((int[]){k, n}, 2);
+    Array *bias = smRandom((int[]){n}, 1);
+
+    printf("\nbenchmarking a (%d, %d, %d) @ (%d, %d) layer with bias and relu...\n\n", batch, tokens, k, k, n);
+
+    // matmul, broadcasted add and activation one after the other
+    clock_t start = clock();
+    Array *y = smMatMul(x, w);
+    Array *ref = smAdd(y, bias);
+    smApplyInplace(ref, relu);
+    float t = seconds_since(start);
+    printf("matmul + add + apply: %f seconds, %6.2f GFLOPS\n", t, flops / t / 1e9f);
+
+    start = clock();
+    Array *res = smLinear(x, w, bias, SM_ACT_RELU);
+    t = seconds_since(start);
+    printf("smLinear:             %f seconds, %6.2f GFLOPS\n", t, flops / t / 1e9f);
+
+    float err = 0.0f;
+    for (int i = 0; i < ref->totalsize; i++)
+        err = fmaxf(err, fabsf(res->data[i] - ref->data[i]));
+    printf("max difference:       %e\n", err);
+
+    const char *names[] = {"gelu", "tanh", "sigmoid"};
+    Activation acts[] = {SM_ACT_GELU, SM_ACT_TANH, SM_ACT_SIGMOID};
+    for (int i = 0; i < 3; i++)
+    {
+        start = clock();
+        Array *out = smLinear(x, w, bias, acts[i]);
+        t = seconds_since(start);
+        printf("smLinear, %-7s:    %f seconds, %6.2f GFLOPS\n", names[i], t, flops / t / 1e9f);
+        smCleanup(out);
+    }
+    printf("\n");
+
+    smCleanup(res);
+    smCleanup(ref);
+    smCleanup(y);
+    smCleanup(bias);
+    smCleanup(w);
+    smCleanup(x);
+    return 0;
+}
@@ -0,0 +1,95 @@
+#include <stdio.h>
+#include <time.h>
+
+#include "../smolar.h"
+
+float seconds_since(clock_t start)
+{
+    return ((float)(clock() - start)) / CLOCKS_PER_SEC;
+}
+
+int main()
+{
+    int rows = 4096, cols = 4096;
+    int shape[] = {rows, cols};
+
+    Array *x = smRandom(shape, 2);
+    Array *threshold = smCreate((int[]){1}, 1);
+    threshold->data[0] = 0.5f;
+
+    printf("\nbenchmarking masks over %d x %d elements...\n\n", rows, cols);
+
+    // thresholding one element at a time
+    Array *ref = smCreate(shape, 2);
+    clock_t start = clock();
+    for (int i = 0; i < x->totalsize; i++)
+        smSet(ref, i, smGet(x, i) > 0.5f ? 1.0f : 0.0f);
+    float t = seconds_since(start);
+    printf("smGet/smSet loop:  %f seconds\n", t);
+
+    start = clock();
+    Array *mask = smGreater(x, threshold);
+    t = seconds_since(start);
+    printf("smGreater:         %f seconds, %6.1f MB float mask\n", t, mask->totalsize * 4.0f / 1e6f);
+
+    start = clock();
+    BitMask *packed = smComparePacked(x, threshold, SM_CMP_GT);
+    t = seconds_since(start);
+    printf("smComparePacked:   %f seconds, %6.1f MB packed mask, %ld set\n\n",
+           t, packed->totalsize / 8.0f / 1e6f, smMaskCount(packed));
+
+    Array *zero = smCreate((int[]){1}, 1);
+    zero->data[0] = 0.0f;
+
+    start = clock();
+    Array *kept = smWhere(mask, x, zero);
+    t = seconds_since(start);
+    printf("smWhere:           %f seconds\n", t);
+
+    start = clock();
+    Array *kept_packed = smWherePacked(packed, x, zero);
+    t = seconds_since(start);
+
+    int mismatches = 0;
+    for (int i = 0; i < kept->totalsize; i++)
+        mismatches += kept->data[i] != kept_packed->data[i];
+    printf("smWherePacked:     %f seconds, %d mismatches\n", t, mismatches);
+
+    start = clock();
+    Array *clipped = smClip(x, 0.25f, 0.75f);
+    t = seconds_since(start);
+    printf("smClip:            %f seconds\n", t);
+
+    start = clock();
+    Array *mean = smMaskedMean(x, mask, 1);
+    t = seconds_since(start);
+    printf("smMaskedMean:      %f seconds, row 0: %f (expected about 0.75)\n", t, mean->data[0]);
+
+    // one column mask shared by every row, broadcast without a copy
+    Array *even = smCreate((int[]){cols}, 1);
+    for (int j = 0; j < cols; j++)
+        even->data[j] = (j % 2 == 0) ? 1.0f : 0.0f;
+
+    start = clock();
+    Array *even_sum = smMaskedSum(x, even, 1);
+    t = seconds_since(start);
+
+    float expected = 0.0f;
+    for (int j = 0; j < cols; j += 2)
+        expected += x->data[j];
+    printf("smMaskedSum (row): %f seconds, row 0: %f (expected %f)\n\n", t, even_sum->data[0], expected);
+
+    smCleanup(even_sum);
+    smCleanup(even);
+    smCleanup(mean);
+    smCleanup(clipped);
+    smCleanup(kept_packed);
+    smCleanup(kept);
+    smCleanup(zero);
+    smCleanupMask(packed);
+    smCleanup(mask);
+    smCleanup(ref);
+    smCleanup(threshold);
+    smCleanup(x);
+    return 0;
+}
@@ -0,0 +1,63 @@
+#include <stdio.h>
+#include <math.h>
+#include <time.h>
+
+#include "../smolar.h"
+
+float seconds_since(clock_t start)
+{
+    return ((float)(clock() - start)) / CLOCKS_PER_SEC;
+}
+
+int main()
+{
+    int m = 256, k = 1024, n = 1024;
+    float ops = 2.0f * m * k * n;
+
+    // activations after a ReLU and weights around 0
+    Array *x = smRandom((int[]){m, k}, 2);
+    Array *w = smRandom((int[]){k, n}, 2);
+    for (int i = 0; i < w->totalsize; i++)
+        w->data[i] = 2.0f * w->data[i] - 1.0f;
+
+    printf("\nbenchmarking (%d, %d) @ (%d, %d)...\n\n", m, k, k, n);
+
+    clock_t start = clock();
+    Array *ref = smMatMul(x, w);
+    float t = seconds_since(start);
+    printf("float matmul:              %f seconds, %6.2f GFLOPS\n", t, ops / t / 1e9f);
+
+    // weights are quantized once, per output column
+    QArray *qw = smQuantize(w, 1, false);
+
+    start = clock();
+    QArray *qx = smQuantize(x, SM_NONE, true);
+    float tq = seconds_since(start);
+
+    start = clock();
+    Array *res = smMatMulQ8(qx, qw);
+    t = seconds_since(start);
+    printf("int8 matmul:               %f seconds, %6.2f GOPS (+ %f seconds to quantize x)\n", t, ops / t / 1e9f, tq);
+
+    float err = 0.0f, scale = 0.0f;
+    for (int i = 0; i < ref->totalsize; i++)
+    {
+        err = fmaxf(err, fabsf(res->data[i] - ref->data[i]));
+        scale = fmaxf(scale, fabsf(ref->data[i]));
+    }
+    printf("max error against float:   %e (largest value %f)\n", err, scale);
+
+    start = clock();
+    QArray *qy = smMatMulQ8Requantize(qx, qw, scale / 127.0f, 64);
+    t = seconds_since(start);
+    printf("int8 matmul, requantized:  %f seconds, %6.2f GOPS\n\n", t, ops / t / 1e9f);
+
+    smCleanupQ8(qy);
+    smCleanup(res);
+    smCleanupQ8(qx);
+    smCleanupQ8(qw);
+    smCleanup(ref);
+    smCleanup(w);
+    smCleanup(x);
+    return 0;
+}
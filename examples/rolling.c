@@ -0,0 +1,94 @@
+#include <stdio.h>
+#include <math.h>
+#include <time.h>
+
+#include "../smolar.h"
+
+float seconds_since(clock_t start)
+{
+    return ((float)(clock() - start)) / CLOCKS_PER_SEC;
+}
+
+int main()
+{
+    int n = 1 << 22, window = 256;
+
+    Array *x = smRandom((int[]){n}, 1);
+
+    printf("\nbenchmarking rolling statistics (%d elements, window of %d)...\n\n", n, window);
+
+    // reducing every window of the zero-copy view is O(n * window)
+    Array *windows = smSlidingWindowView(x, window, 0);
+    printf("sliding window view: shape (%d, %d), sharing the buffer of x\n\n",
+           windows->shape[0], windows->shape[1]);
+
+    clock_t start = clock();
+    Array *mean_ref = smMean(windows, 1);
+    float t = seconds_since(start);
+    printf("mean over the view:  %f seconds\n", t);
+
+    start = clock();
+    Array *mean = smRollingMean(x, window, 0);
+    t = seconds_since(start);
+
+    float err = 0.0f;
+    for (int i = 0; i < mean->totalsize; i++)
+        err = fmaxf(err, fabsf(mean->data[i] - mean_ref->data[i]));
+    printf("smRollingMean:       %f seconds, max difference %e\n\n", t, err);
+
+    start = clock();
+    Array *max_ref = smMax(windows, 1);
+    t = seconds_since(start);
+    printf("max over the view:   %f seconds\n", t);
+
+    start = clock();
+    Array *max = smRollingMax(x, window, 0);
+    t = seconds_since(start);
+
+    int mismatches = 0;
+    for (int i = 0; i < max->totalsize; i++)
+        mismatches += max->data[i] != max_ref->data[i];
+    printf("smRollingMax:        %f seconds, %d mismatches\n\n", t, mismatches);
+
+    start = clock();
+    Array *var = smRollingVar(x, window, 0);
+    t = seconds_since(start);
+    printf("smRollingVar:        %f seconds, first window %f (uniform: %f)\n\n",
+           t, var->data[0], 1.0f / 12.0f);
+
+    // a NaN, an inf and a spike only touch the windows that hold them,
+    // max skips the NaN like smMax
+    printf("non finite values and a spike (window of 3):\n");
+    Array *special = smCreate((int[]){11}, 1);
+    smFromValues(special, (float[]){1, 2, NAN, 4, 5, INFINITY, 7, 1e30f, 9, 10, 11});
+
+    Array *sum = smRollingSum(special, 3, 0);
+    Array *svar = smRollingVar(special, 3, 0);
+    Array *smax = smRollingMax(special, 3, 0);
+    printf("  x:   ");
+    for (int i = 0; i < special->totalsize; i++)
+        printf(" %g", special->data[i]);
+    printf("\n  sum: ");
+    for (int i = 0; i < sum->totalsize; i++)
+        printf(" %g", sum->data[i]);
+    printf("   (last window: 30)\n  var: ");
+    for (int i = 0; i < svar->totalsize; i++)
+        printf(" %g", svar->data[i]);
+    printf("   (last window: %g)\n  max: ", 2.0f / 3.0f);
+    for (int i = 0; i < smax->totalsize; i++)
+        printf(" %g", smax->data[i]);
+    printf("\n\n");
+
+    smCleanup(smax);
+    smCleanup(svar);
+    smCleanup(sum);
+    smCleanup(special);
+    smCleanup(var);
+    smCleanup(max);
+    smCleanup(max_ref);
+    smCleanup(mean);
+    smCleanup(mean_ref);
+    smCleanup(windows);
+    smCleanup(x);
+    return 0;
+}
@@ -0,0 +1,86 @@
+#include <stdio.h>
+#include <math.h>
+#include <time.h>
+
+#include "../smolar.h"
+
+/*
+textbook serial cumulative sum, for comparison
+*/
+void cumsum_naive(long n, const float *x, float *y)
+{
+    float acc = 0.0f;
+    for (long i = 0; i < n; i++)
+    {
+        acc += x[i];
+        y[i] = acc;
+    }
+}
+
+double wall_seconds_since(struct timespec start)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start.tv_sec) + (now.tv_nsec - start.tv_nsec) * 1e-9;
+}
+
+int main()
+{
+    int n = 1 << 26;
+    int rows = 4096, cols = 4096;
+
+    // a zero-sum pattern keeps every partial sum exact in float
+    Array *x = smRandom((int[]){n}, 1);
+    for (int i = 0; i < n; i++)
+        x->data[i] = (float)(i % 4) - 1.5f;
+
+    printf("\nbenchmarking scans over %d elements (wall clock)...\n\n", n);
+
+    Array *ref = smCreate((int[]){n}, 1);
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    cumsum_naive(n, x->data, ref->data);
+    double t = wall_seconds_since(start);
+    printf("cumsum textbook: %f seconds, %6.2f GB/s\n", t, 8.0 * n / t / 1e9);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    Array *sum = smCumsum(x, 0);
+    t = wall_seconds_since(start);
+
+    int mismatches = 0;
+    for (int i = 0; i < n; i++)
+        mismatches += sum->data[i] != ref->data[i];
+    printf("smCumsum:        %f seconds, %6.2f GB/s, %d mismatches\n", t, 8.0 * n / t / 1e9, mismatches);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    Array *max = smCummax(x, 0);
+    t = wall_seconds_since(start);
+    printf("smCummax:        %f seconds, %6.2f GB/s\n\n", t, 8.0 * n / t / 1e9);
+
+    // along the rows and down the columns of a matrix, and on a transposed view
+    Array *m = smRandom((int[]){rows, cols}, 2);
+    Array *mt = smTransposeView(m, (int[]){1, 0});
+    const char *names[] = {"rows", "columns"};
+    for (int axis = 0; axis < 2; axis++)
+    {
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        Array *s = smCumsum(m, 1 - axis);
+        t = wall_seconds_since(start);
+        printf("smCumsum along the %-7s of a %d x %d matrix: %f seconds\n", names[axis], rows, cols, t);
+        smCleanup(s);
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    Array *p = smCumprod(mt, 1);
+    t = wall_seconds_since(start);
+    printf("smCumprod along the rows of its transposed view: %f seconds\n\n", t);
+
+    smCleanup(p);
+    smCleanup(mt);
+    smCleanup(m);
+    smCleanup(max);
+    smCleanup(sum);
+    smCleanup(ref);
+    smCleanup(x);
+    return 0;
+}
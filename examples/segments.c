@@ -0,0 +1,82 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <time.h>
+
+#include "../smolar.h"
+
+float seconds_since(clock_t start)
+{
+    return ((float)(clock() - start)) / CLOCKS_PER_SEC;
+}
+
+int main()
+{
+    int n = 1 << 20, features = 16, segments = 1000;
+
+    Array *data = smRandom((int[]){n, features}, 2);
+    Array *values = smRandom((int[]){n}, 1);
+    Array *sorted = smCreate((int[]){n}, 1);
+    Array *shuffled = smCreate((int[]){n}, 1);
+    for (int i = 0; i < n; i++)
+    {
+        sorted->data[i] = (float)((long)i * segments / n);
+        shuffled->data[i] = (float)(rand() % segments);
+    }
+
+    printf("\nbenchmarking segment reductions (%d x %d rows, %d segments)...\n\n", n, features, segments);
+
+    Array *ids[] = {sorted, shuffled};
+    const char *names[] = {"sorted", "unsorted"};
+    for (int k = 0; k < 2; k++)
+    {
+        clock_t start = clock();
+        Array *sum = smSegmentSum(data, ids[k], segments);
+        float t = seconds_since(start);
+        printf("%-8s segment sum : %f seconds\n", names[k], t);
+
+        start = clock();
+        Array *max = smSegmentMax(data, ids[k], segments);
+        t = seconds_since(start);
+        printf("%-8s segment max : %f seconds\n", names[k], t);
+
+        // against a serial loop in double
+        double *ref = (double *)calloc((long)segments * features, sizeof(double));
+        for (long r = 0; r < n; r++)
+            for (int c = 0; c < features; c++)
+                ref[(long)ids[k]->data[r] * features + c] += data->data[r * features + c];
+        double err = 0.0;
+        for (long i = 0; i < (long)segments * features; i++)
+            err = fmax(err, fabs(sum->data[i] - ref[i]) / fabs(ref[i]));
+        printf("%-8s max rel err : %e\n\n", names[k], err);
+
+        free(ref);
+        smCleanup(max);
+        smCleanup(sum);
+    }
+
+    clock_t start = clock();
+    Array *counts = smBincount(shuffled, NULL, 0);
+    float t = seconds_since(start);
+    printf("bincount  (%d values): %f seconds\n", n, t);
+
+    start = clock();
+    Array *weighted = smBincount(shuffled, values, 0);
+    t = seconds_since(start);
+    printf("weighted  (%d values): %f seconds\n", n, t);
+
+    start = clock();
+    Array *hist = smHistogram(values, 10, 0.0f, 1.0f);
+    t = seconds_since(start);
+    printf("histogram (%d values): %f seconds\n", n, t);
+    smShow(hist);
+
+    smCleanup(hist);
+    smCleanup(weighted);
+    smCleanup(counts);
+    smCleanup(shuffled);
+    smCleanup(sorted);
+    smCleanup(values);
+    smCleanup(data);
+    return 0;
+}
@@ -0,0 +1,35 @@
+#include <stdio.h>
+#include "../smolar.h"
+
+int main()
+{
+    int shape[] = {4, 5};
+    Array *a = smArange(0, 20, 1);
+    smReshapeInplace(a, shape, 2);
+
+    // a[1:3, ::-2]
+    SmSlice rows_rev[] = {SM_SLICE(1, 3, 1), SM_SLICE(SM_NONE, SM_NONE, -2)};
+    Array *b = smSlice(a, rows_rev);
+
+    // a[:, 2] (the column axis is dropped)
+    SmSlice column[] = {SM_ALL, SM_INDEX(2)};
+    Array *c = smSlice(a, column);
+
+    printf("Array a:\n");
+    smShow(a);
+    printf("a[1:3, ::-2]:\n");
+    smShow(b);
+    printf("a[:, 2]:\n");
+    smShow(c);
+
+    // views share the buffer of a, the sum below reads it in place
+    Array *d = smAdd(b, b);
+    printf("a[1:3, ::-2] * 2:\n");
+    smShow(d);
+
+    smCleanup(b);
+    smCleanup(c);
+    smCleanup(d);
+    smCleanup(a);
+    return 0;
+}
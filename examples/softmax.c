@@ -0,0 +1,90 @@
+#include <stdio.h>
+#include <math.h>
+#include <time.h>
+
+#include "../smolar.h"
+
+/*
+textbook softmax over the rows: max, exp and sum, divide
+*/
+void softmax_rows(int rows, int cols, const float *x, float *y)
+{
+    for (int i = 0; i < rows; i++)
+    {
+        const float *xi = x + (long)i * cols;
+        float *yi = y + (long)i * cols;
+
+        float max = -INFINITY;
+        for (int j = 0; j < cols; j++)
+            max = fmaxf(max, xi[j]);
+
+        float sum = 0.0f;
+        for (int j = 0; j < cols; j++)
+        {
+            yi[j] = expf(xi[j] - max);
+            sum += yi[j];
+        }
+
+        for (int j = 0; j < cols; j++)
+            yi[j] /= sum;
+    }
+}
+
+float seconds_since(clock_t start)
+{
+    return ((float)(clock() - start)) / CLOCKS_PER_SEC;
+}
+
+int main()
+{
+    int rows = 4096, cols = 1024;
+    int shape[] = {rows, cols};
+
+    Array *x = smRandom(shape, 2);
+    for (int i = 0; i < x->totalsize; i++)
+        x->data[i] = 20.0f * x->data[i] - 10.0f;
+
+    printf("\nbenchmarking axis ops on a %d x %d Array...\n\n", rows, cols);
+
+    Array *ref = smCreate(shape, 2);
+    clock_t start = clock();
+    softmax_rows(rows, cols, x->data, ref->data);
+    float t = seconds_since(start);
+    printf("textbook softmax,   axis 1: %f seconds\n", t);
+
+    start = clock();
+    Array *y = smSoftmax(x, 1);
+    t = seconds_since(start);
+
+    float err = 0.0f;
+    for (int i = 0; i < y->totalsize; i++)
+        err = fmaxf(err, fabsf(y->data[i] - ref->data[i]));
+    printf("smSoftmax,          axis 1: %f seconds, max difference %e\n", t, err);
+    smCleanup(y);
+
+    start = clock();
+    y = smSoftmax(x, 0);
+    t = seconds_since(start);
+    printf("smSoftmax,          axis 0: %f seconds\n", t);
+    smCleanup(y);
+
+    start = clock();
+    y = smLogSoftmax(x, 1);
+    t = seconds_since(start);
+    printf("smLogSoftmax,       axis 1: %f seconds\n", t);
+    smCleanup(y);
+
+    Array *gamma = smRandom((int[]){cols}, 1);
+    Array *beta = smRandom((int[]){cols}, 1);
+    start = clock();
+    y = smLayerNorm(x, gamma, beta, 1, 1e-5f);
+    t = seconds_since(start);
+    printf("smLayerNorm,        axis 1: %f seconds\n\n", t);
+    smCleanup(y);
+
+    smCleanup(beta);
+    smCleanup(gamma);
+    smCleanup(ref);
+    smCleanup(x);
+    return 0;
+}
@@ -0,0 +1,76 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../smolar.h"
+
+int compare_floats(const void *a, const void *b)
+{
+    float x = *(const float *)a, y = *(const float *)b;
+    return (x > y) - (x < y);
+}
+
+float seconds_since(clock_t start)
+{
+    return ((float)(clock() - start)) / CLOCKS_PER_SEC;
+}
+
+int main()
+{
+    int rows = 4096, cols = 1024, n = 1 << 24, k = 10;
+
+    Array *scores = smRandom((int[]){rows, cols}, 2);
+    Array *x = smRandom((int[]){n}, 1);
+
+    printf("\nbenchmarking sorts...\n\n");
+
+    // copying every row out into qsort, what smSort replaces
+    Array *ref = smContiguous(scores);
+    clock_t start = clock();
+    for (int i = 0; i < rows; i++)
+        qsort(ref->data + (long)i * cols, cols, sizeof(float), compare_floats);
+    float t = seconds_since(start);
+    printf("qsort    %d rows of %d: %f seconds\n", rows, cols, t);
+
+    start = clock();
+    Array *sorted = smSort(scores, 1);
+    t = seconds_since(start);
+    printf("smSort   %d rows of %d: %f seconds, %s\n", rows, cols, t,
+           memcmp(sorted->data, ref->data, (size_t)rows * cols * sizeof(float)) ? "MISMATCH" : "same as qsort");
+
+    start = clock();
+    Array *order = smArgSort(scores, 1);
+    t = seconds_since(start);
+    printf("smArgSort %d rows of %d: %f seconds\n", rows, cols, t);
+
+    Array *indices;
+    start = clock();
+    Array *top = smTopK(scores, k, 1, &indices);
+    t = seconds_since(start);
+    printf("smTopK   k = %d of every row: %f seconds, best of row 0: %f (qsort %f)\n\n",
+           k, t, top->data[0], ref->data[cols - 1]);
+
+    Array *flat = smContiguous(x);
+    start = clock();
+    qsort(flat->data, n, sizeof(float), compare_floats);
+    t = seconds_since(start);
+    printf("qsort    %d elements: %f seconds\n", n, t);
+
+    start = clock();
+    Array *big = smSort(x, 0);
+    t = seconds_since(start);
+    printf("smSort   %d elements: %f seconds, %s\n\n", n, t,
+           memcmp(big->data, flat->data, (size_t)n * sizeof(float)) ? "MISMATCH" : "same as qsort");
+
+    smCleanup(big);
+    smCleanup(flat);
+    smCleanup(indices);
+    smCleanup(top);
+    smCleanup(order);
+    smCleanup(sorted);
+    smCleanup(ref);
+    smCleanup(x);
+    smCleanup(scores);
+    return 0;
+}
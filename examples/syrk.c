@@ -0,0 +1,103 @@
+#include <stdio.h>
+#include <math.h>
+#include <time.h>
+
+#include "../smolar.h"
+
+float seconds_since(clock_t start)
+{
+    return ((float)(clock() - start)) / CLOCKS_PER_SEC;
+}
+
+// largest difference to `ref`, and whether `c` is exactly symmetric
+float compare(Array *c, Array *ref, int *symmetric)
+{
+    int m = c->shape[c->ndim - 1];
+    long nmat = c->totalsize / ((long)m * m);
+    float err = 0.0f;
+    *symmetric = 1;
+
+    for (long b = 0; b < nmat; b++)
+    {
+        const float *x = c->data + b * m * m, *r = ref->data + b * m * m;
+        for (int i = 0; i < m; i++)
+            for (int j = 0; j < m; j++)
+            {
+                err = fmaxf(err, fabsf(x[i * m + j] - r[i * m + j]) / (1.0f + fabsf(r[i * m + j])));
+                if (x[i * m + j] != x[j * m + i])
+                    *symmetric = 0;
+            }
+    }
+    return err;
+}
+
+void run(const char *name, Array *x)
+{
+    int nd = x->ndim;
+    int axes[SM_MAXDIMS];
+    for (int d = 0; d < nd; d++)
+        axes[d] = d;
+    axes[nd - 2] = nd - 1;
+    axes[nd - 1] = nd - 2;
+    Array *xt = smTransposeView(x, axes);
+
+    // smMatMul spots X @ X.T on one buffer and computes half of it too,
+    // a copy of X.T makes it a plain GEMM
+    Array *xtc = smContiguous(xt);
+    clock_t start = clock();
+    Array *gemm = smMatMul(x, xtc);
+    float tg = seconds_since(start);
+
+    start = clock();
+    Array *full = smMatMul(x, xt);
+    float tm = seconds_since(start);
+
+    start = clock();
+    Array *upper = smSyrk(x, true);
+    float tu = seconds_since(start);
+
+    start = clock();
+    Array *lower = smSyrk(x, false);
+    float tl = seconds_since(start);
+
+    int sym_gemm, sym_full, sym_upper, sym_lower;
+    float eg = compare(gemm, full, &sym_gemm);
+    compare(full, full, &sym_full);
+    float eu = compare(upper, full, &sym_upper);
+    float el = compare(lower, full, &sym_lower);
+
+    printf("%s\n", name);
+    printf("  smMatMul(X, copy): %f seconds, symmetric: %s, max error %e\n", tg, sym_gemm ? "yes" : "no", eg);
+    printf("  smMatMul(X, X.T):  %f seconds, symmetric: %s\n", tm, sym_full ? "yes" : "no");
+    printf("  smSyrk upper:      %f seconds, symmetric: %s, max error %e\n", tu, sym_upper ? "yes" : "no", eu);
+    printf("  smSyrk lower:      %f seconds, symmetric: %s, max error %e\n\n", tl, sym_lower ? "yes" : "no", el);
+
+    smCleanup(lower);
+    smCleanup(upper);
+    smCleanup(full);
+    smCleanup(gemm);
+    smCleanup(xtc);
+    smCleanup(xt);
+}
+
+int main()
+{
+    printf("\nX @ X.T through smMatMul and smSyrk...\n\n");
+
+    Array *x = smRandom((int[]){1024, 512}, 2);
+    run("1024 x 512:", x);
+
+    // the rows of a transposed view are strided
+    Array *base = smRandom((int[]){256, 700}, 2);
+    Array *xv = smTransposeView(base, (int[]){1, 0});
+    run("700 x 256, a transposed view:", xv);
+
+    Array *batch = smRandom((int[]){32, 48, 64}, 3);
+    run("batch of 32 x (48 x 64):", batch);
+
+    smCleanup(batch);
+    smCleanup(xv);
+    smCleanup(base);
+    smCleanup(x);
+    return 0;
+}
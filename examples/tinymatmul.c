@@ -0,0 +1,123 @@
+#include <stdio.h>
+#include <math.h>
+#include <time.h>
+
+#include "../smolar.h"
+
+float seconds_since(clock_t start)
+{
+    return ((float)(clock() - start)) / CLOCKS_PER_SEC;
+}
+
+/*
+textbook batched product on strided operands, for comparison
+*/
+Array *matmul_loops(Array *a, Array *b)
+{
+    int nd = a->ndim;
+    long batch = a->totalsize / ((long)a->shape[nd - 2] * a->shape[nd - 1]);
+    int m = a->shape[nd - 2], n = a->shape[nd - 1], p = b->shape[nd - 1];
+    long sa = a->strides[0] / 4, ra = a->strides[nd - 2] / 4, ca = a->strides[nd - 1] / 4;
+    long sb = b->strides[0] / 4, rb = b->strides[nd - 2] / 4, cb = b->strides[nd - 1] / 4;
+
+    Array *c = smCreate((int[]){(int)batch, m, p}, 3);
+    for (long t = 0; t < batch; t++)
+        for (int i = 0; i < m; i++)
+            for (int j = 0; j < p; j++)
+            {
+                float s = 0.0f;
+                for (int k = 0; k < n; k++)
+                    s += a->data[t * sa + i * ra + k * ca] * b->data[t * sb + k * rb + j * cb];
+                c->data[(t * m + i) * p + j] = s;
+            }
+    return c;
+}
+
+float max_error(Array *res, Array *ref)
+{
+    Array *c = smContiguous(res);
+    float err = 0.0f;
+    for (long i = 0; i < c->totalsize; i++)
+        err = fmaxf(err, fabsf(c->data[i] - ref->data[i]));
+    smCleanup(c);
+    return err;
+}
+
+int main()
+{
+    int batch = 20000;
+
+    printf("\nbatches of %d tiny matrices, smMatMul against plain loops...\n\n", batch);
+    printf("size   matmul               matvec               transposed A\n");
+
+    for (int s = 2; s <= 8; s++)
+    {
+        Array *a = smRandom((int[]){batch, s, s}, 3);
+        Array *b = smRandom((int[]){batch, s, s}, 3);
+        Array *v = smRandom((int[]){batch, s, 1}, 3);
+        Array *at = smTransposeView(a, (int[]){0, 2, 1});
+
+        clock_t start = clock();
+        Array *res = smMatMul(a, b);
+        float t = seconds_since(start);
+        Array *ref = matmul_loops(a, b);
+        printf("%d x %d  %f s (%.0e)", s, s, t, max_error(res, ref));
+        smCleanup(res);
+        smCleanup(ref);
+
+        start = clock();
+        res = smMatMul(a, v);
+        t = seconds_since(start);
+        ref = matmul_loops(a, v);
+        printf("   %f s (%.0e)", t, max_error(res, ref));
+        smCleanup(res);
+        smCleanup(ref);
+
+        // a strided operand takes the general path
+        start = clock();
+        res = smMatMul(at, b);
+        t = seconds_since(start);
+        ref = matmul_loops(at, b);
+        printf("   %f s (%.0e)\n", t, max_error(res, ref));
+        smCleanup(res);
+        smCleanup(ref);
+
+        smCleanup(at);
+        smCleanup(v);
+        smCleanup(b);
+        smCleanup(a);
+    }
+
+    // (N, 4, 4): the usual batch of transforms, against the loops
+    Array *a = smRandom((int[]){batch, 4, 4}, 3);
+    Array *b = smRandom((int[]){batch, 4, 4}, 3);
+
+    clock_t start = clock();
+    Array *ref = matmul_loops(a, b);
+    float t = seconds_since(start);
+    printf("\n(%d, 4, 4) @ (%d, 4, 4): loops %f s", batch, batch, t);
+
+    start = clock();
+    Array *res = smMatMul(a, b);
+    t = seconds_since(start);
+    printf(", smMatMul %f s, max error %e\n", t, max_error(res, ref));
+    smCleanup(res);
+    smCleanup(ref);
+
+    // both transposed per matrix: not F order as a whole, the general path
+    Array *at = smTransposeView(a, (int[]){0, 2, 1});
+    Array *bt = smTransposeView(b, (int[]){0, 2, 1});
+    ref = matmul_loops(at, bt);
+    start = clock();
+    res = smMatMul(at, bt);
+    t = seconds_since(start);
+    printf("both operands transposed:     smMatMul %f s, max error %e\n\n", t, max_error(res, ref));
+
+    smCleanup(res);
+    smCleanup(ref);
+    smCleanup(bt);
+    smCleanup(at);
+    smCleanup(b);
+    smCleanup(a);
+    return 0;
+}
@@ -0,0 +1,81 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "../smolar.h"
+
+float seconds_since(clock_t start)
+{
+    return ((float)(clock() - start)) / CLOCKS_PER_SEC;
+}
+
+int main()
+{
+    int n = 1 << 22;
+    int ranges[] = {1000, 1 << 20, 1 << 30};
+
+    printf("\nbenchmarking unique (%d ids)...\n\n", n);
+
+    for (int r = 0; r < 3; r++)
+    {
+        Array *ids = smCreate((int[]){n}, 1);
+        for (int i = 0; i < n; i++)
+            ids->data[i] = (float)(((long)rand() * RAND_MAX + rand()) % ranges[r]);
+
+        // sort based: sort everything, then keep the first of every run
+        clock_t start = clock();
+        Array *sorted = smSort(ids, 0);
+        int distinct = 0;
+        for (int i = 0; i < n; i++)
+            if (i == 0 || sorted->data[i] != sorted->data[i - 1])
+                sorted->data[distinct++] = sorted->data[i];
+        float t = seconds_since(start);
+        printf("range %-10d sort + scan  : %f seconds, %d distinct\n", ranges[r], t, distinct);
+
+        start = clock();
+        Array *unique = smUnique(ids, NULL, NULL);
+        t = seconds_since(start);
+        printf("range %-10d unique       : %f seconds, %d distinct\n", ranges[r], t, unique->totalsize);
+
+        int mismatches = (unique->totalsize != distinct);
+        for (int j = 0; j < distinct && j < unique->totalsize; j++)
+            mismatches += (unique->data[j] != sorted->data[j]);
+        printf("range %-10d mismatches   : %d\n", ranges[r], mismatches);
+
+        Array *counts, *inverse;
+        start = clock();
+        Array *full = smUnique(ids, &counts, &inverse);
+        t = seconds_since(start);
+        printf("range %-10d with counts  : %f seconds\n\n", ranges[r], t);
+
+        smCleanup(inverse);
+        smCleanup(counts);
+        smCleanup(full);
+        smCleanup(unique);
+        smCleanup(sorted);
+        smCleanup(ids);
+    }
+
+    Array *a = smCreate((int[]){n}, 1);
+    Array *b = smCreate((int[]){n / 16}, 1);
+    for (int i = 0; i < n; i++)
+        a->data[i] = (float)(rand() % (1 << 20));
+    for (int i = 0; i < n / 16; i++)
+        b->data[i] = (float)(rand() % (1 << 20));
+
+    clock_t start = clock();
+    Array *mask = smIsIn(a, b);
+    float t = seconds_since(start);
+    printf("isin      (%d in %d): %f seconds\n", n, n / 16, t);
+
+    start = clock();
+    Array *common = smIntersect(a, b);
+    t = seconds_since(start);
+    printf("intersect (%d and %d): %f seconds, %d common\n\n", n, n / 16, t, common->totalsize);
+
+    smCleanup(common);
+    smCleanup(mask);
+    smCleanup(b);
+    smCleanup(a);
+    return 0;
+}
@@ -3,25 +3,89 @@
 #include <stdbool.h>
 #include <string.h>
 #include <time.h>
+#include <math.h>
+#include <limits.h>
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#endif
+#ifdef PARALLEL
+#include <omp.h>
+#endif
 
 #include "smolar.h"
 
+// tile edge (in elements) used by blocked copies/transposes
+#define SM_TILE 64
+// elements handed to a strided inner loop at once
+#define SM_CHUNK 16384
+// below this many elements loops are not worth spreading over threads
+#define SM_PARALLEL_MIN 32768
+// largest matrix size with unrolled batched kernels
+#define SM_TINY_MAX 8
+// blocked GEMM: microkernel tile (SM_MR x SM_NR), panel depth, rows of A
+// kept in L2, columns of B per slice and column panels per thread task
+#define SM_MR 6
+#define SM_NR 16
+#define SM_KC 256
+#define SM_MC 120
+#define SM_NC 3072
+#define SM_JG 4
+// panel width of the blocked factorizations and triangular solves
+#define SM_NB 64
+// quantized GEMM: microkernel tile (SM_QMR x SM_QNR int32 sums), panel
+// depth in bytes and the largest uint8 value
+#define SM_QMR 4
+#define SM_QNR 16
+#define SM_QKC 1024
+#define SM_Q8_UMAX 255
+// convolutions reducing over at most this many (channel, kernel) taps
+// use the direct kernel instead of im2col + GEMM, which keeps tiles of up
+// to SM_CONV_TILE outputs in AVX registers across the taps
+#define SM_CONV_DIRECT 32
+#define SM_CONV_TILE 64
+// attention: query rows per task and keys per step of the online softmax
+#define SM_ATT_BQ 64
+#define SM_ATT_BK 64
+// sorts: runs up to this long use insertion sort, top-k uses a heap when
+// k is at most 1/SM_TOPK_HEAP of the axis
+#define SM_SORT_SMALL 64
+#define SM_TOPK_HEAP 16
+// nearest neighbours: queries per task and base rows per distance tile
+#define SM_KNN_QB 64
+#define SM_KNN_NB 1024
+// hash tables: keys per probed group (one __m256i) and keys hashed and
+// prefetched ahead of their probes
+#define SM_HASH_GROUP 8
+#define SM_HASH_BATCH 16
+#define SM_HASH_EMPTY 0xFFFFFFFFu
+// rolling sums: a window is summed again when an element leaving it was
+// this many times larger than the magnitude left (its rounding would show)
+#define SM_ROLLING_RESCAN 65536.0
+// lanes of the axis ops (softmax, layernorm) handled together, one __m256
+#define SM_AXIS_COLS 8
+// matrices processed side by side by the tiny kernels (one vector register)
+#if defined(__AVX512F__)
+#define SM_LANES 16
+#else
+#define SM_LANES 8
+#endif
+
+// accumulation of dot products, matmuls and sums, see smSetAccumulation
+Accumulation __accumulation__ = SM_ACCUM_FLOAT;
+
 /*
 free all the memory allocated by an Array
 */
 void smCleanup(Array *arr)
 {
-    free(arr->data);
+    // views do not own their buffer, the parent frees it
+    if (arr->OWNDATA)
+        free(arr->data);
     free(arr->shape);
     free(arr->strides);
     free(arr->backstrides);
-    // clean up indices
-    for (int i = 0; i < arr->idxs->count; i++)
-    {
-        free(arr->idxs->indices[i]);
-    }
-    free(arr->idxs->indices);
-    free(arr->idxs);
+    __freeArrayIndices__(arr);
     free(arr);
 }
 
@@ -65,8 +129,7 @@ set C-order flag for an array
 */
 void __checkOrderC__(Array *arr)
 {
-    bool val = (arr->strides[arr->ndim - 1] == arr->itemsize) ? true : false;
-    arr->C_ORDER = val;
+    arr->C_ORDER = __isContiguousC__(arr);
 }
 
 /*
@@ -74,8 +137,7 @@ set F-order flag for an array
 */
 void __checkOrderF__(Array *arr)
 {
-    bool val = (arr->strides[0] == arr->itemsize) ? true : false;
-    arr->F_ORDER = val;
+    arr->F_ORDER = __isContiguousF__(arr);
 }
 
 /*
@@ -110,6 +172,29 @@ void __recalculateBackstrides__(Array *arr)
     }
 }
 
+/*
+free the index tables of an Array (if they were ever built)
+*/
+void __freeArrayIndices__(Array *arr)
+{
+    if (arr->idxs != NULL)
+    {
+        for (int i = 0; i < arr->idxs->count; i++)
+        {
+            free(arr->idxs->indices[i]);
+        }
+        free(arr->idxs->indices);
+        free(arr->idxs);
+        arr->idxs = NULL;
+    }
+    if (arr->lidxs != NULL)
+    {
+        free(arr->lidxs->indices);
+        free(arr->lidxs);
+        arr->lidxs = NULL;
+    }
+}
+
 ArrayIndices *__getArrayIndicesFromShape__(const int *shape, int ndim)
 {
     ArrayIndices *idxs = (ArrayIndices *)malloc(sizeof(ArrayIndices));
@@ -155,16 +240,7 @@ function to create the arrayIndices
 */
 void __createArrayIndices__(Array *arr)
 {
-    if (arr->idxs != NULL)
-    {
-        // clean up indices
-        for (int i = 0; i < arr->idxs->count; i++)
-        {
-            free(arr->idxs->indices[i]);
-        }
-        free(arr->idxs->indices);
-        free(arr->idxs);
-    }
+    __freeArrayIndices__(arr);
 
     arr->idxs = (ArrayIndices *)malloc(sizeof(ArrayIndices));
     _checkNull(arr->idxs);
@@ -206,6 +282,14 @@ void __createArrayIndices__(Array *arr)
 */
 void __createLinearIndices__(Array *arr)
 {
+    if (arr->idxs == NULL)
+        __createArrayIndices__(arr);
+    if (arr->lidxs != NULL)
+    {
+        free(arr->lidxs->indices);
+        free(arr->lidxs);
+    }
+
     arr->lidxs = (LinearIndices *)malloc(sizeof(LinearIndices));
     _checkNull(arr->lidxs);
     arr->lidxs->count = arr->totalsize;
@@ -222,20 +306,39 @@ void __createLinearIndices__(Array *arr)
     }
 }
 
+/*
+offset (in elements) of the `index`-th element in C order,
+computed from shape and strides so views work without index tables
+*/
+int __linearToOffset__(Array *arr, int index)
+{
+    int offset = 0;
+    for (int d = arr->ndim - 1; d >= 0; d--)
+    {
+        offset += (index % arr->shape[d]) * arr->strides[d];
+        index /= arr->shape[d];
+    }
+
+    return offset / arr->itemsize;
+}
+
 // return the element present at index in linear indices
 float smGet(Array *arr, int index)
 {
-    return arr->data[arr->lidxs->indices[index]];
+    return arr->data[__linearToOffset__(arr, index)];
 }
 
 void smSet(Array *arr, int index, float value)
 {
-    arr->data[arr->lidxs->indices[index]] = value;
+    arr->data[__linearToOffset__(arr, index)] = value;
 }
 
 // helper function to print ArrayIndices (for debugging)
 void printArrayIndices(Array *arr)
 {
+    if (arr->idxs == NULL)
+        __createArrayIndices__(arr);
+
     for (int i = 0; i < arr->idxs->count; i++)
     {
         printf("{");
@@ -251,11 +354,14 @@ void printArrayIndices(Array *arr)
     }
 }
 
+/*
+index tables are only built on demand (see `printArrayIndices`),
+a 16k x 16k array would otherwise need 256M of them
+*/
 void __setArrayMetadata__(Array *arr) {
     __recalculateStrides__(arr);
     __recalculateBackstrides__(arr);
-    __createArrayIndices__(arr);
-    __createLinearIndices__(arr);
+    __freeArrayIndices__(arr);
     __setArrayFlags__(arr);
 }
 
@@ -264,6 +370,15 @@ assume that the shape and number of dims are given,
 create a new Array from that.
 */
 Array *smCreate(const int *shape, int ndim)
+{
+    return smCreateOrder(shape, ndim, SM_C_ORDER);
+}
+
+/*
+same as `smCreate`, but the memory layout can be chosen:
+SM_C_ORDER (last axis fastest) or SM_F_ORDER (first axis fastest)
+*/
+Array *smCreateOrder(const int *shape, int ndim, ArrayOrder order)
 {
     if (ndim <= 0)
     {
@@ -285,6 +400,9 @@ Array *smCreate(const int *shape, int ndim)
 
     arr->itemsize = sizeof(float);
     arr->totalsize = 1;
+    arr->idxs = NULL;
+    arr->lidxs = NULL;
+    arr->OWNDATA = true;
 
     for (int i = 0; i < arr->ndim; i++)
     {
@@ -293,6 +411,12 @@ Array *smCreate(const int *shape, int ndim)
     }
 
     __setArrayMetadata__(arr);
+    if (order == SM_F_ORDER)
+    {
+        __recalculateStridesF__(arr);
+        __recalculateBackstrides__(arr);
+        __setArrayFlags__(arr);
+    }
 
     // allocate data
     arr->data = (float *)malloc(arr->totalsize * arr->itemsize);
@@ -315,13 +439,22 @@ bool __checkShapeCompatible__(Array *arr, const int *shape, int ndim)
 /*
 initialize the Array's data with values (has to be 1D in memory)
 assume values length the same as Array's totalsize
+
+for contiguous Arrays (C or F order) values are copied as they are laid
+out in memory, so Fortran-ordered data goes into an F-order Array as is.
 */
 void smFromValues(Array *arr, float *values)
 {
-    for (int i = 0; i < arr->totalsize; i++)
+    if (__isContiguousC__(arr) || __isContiguousF__(arr))
     {
-        arr->data[i] = values[i];
+        memcpy(arr->data, values, (size_t)arr->totalsize * sizeof(float));
+        return;
     }
+
+    // values are in C order, arr may be any view
+    Array *view = __contiguousView__(arr, values, arr->shape, arr->ndim);
+    __copyStrided__(arr, view);
+    smCleanup(view);
 }
 
 /*
@@ -545,7 +678,10 @@ int *__broadcastFinalShape__(Array *a, Array *b)
         if (lf_shape[i] == 1 || rf_shape[i] == 1 || lf_shape[i] == rf_shape[i])
             res_shape[i] = (lf_shape[i] > rf_shape[i]) ? lf_shape[i] : rf_shape[i];
         else
+        {
+            free(res_shape);
             return NULL;
+        }
     }
 
     return res_shape;
@@ -563,24 +699,9 @@ Array *__broadcastArray__(Array *arr, const int *shape, int ndim)
 {
     Array *res = smCreate(shape, ndim);
 
-    int n_prepend = ndim - arr->ndim;
+    // the copy engine reads broadcasted axes with a stride of 0
+    __copyStrided__(res, arr);
 
-    for (int i = 0; i < res->totalsize; i++)
-    {
-        int src_idx = 0;
-        for (int dim = 0; dim < arr->ndim; dim++)
-        {
-            if (arr->shape[dim] > 1)
-            {
-                src_idx += (
-                    res->idxs->indices[i][n_prepend + dim] % arr->shape[dim]
-                ) * arr->strides[dim];
-            }
-        }
-
-        // copy the value from source index to res
-        res->data[res->lidxs->indices[i]] = arr->data[src_idx / arr->itemsize];
-    }
     return res;
 }
 
@@ -597,7 +718,7 @@ Array *smReshapeNew(Array *arr, const int *shape, int ndim)
     }
 
     Array *res = smCreate(shape, ndim);
-    smFromValues(res, arr->data);
+    __copyToBuffer__(res->data, arr);
 
     return res;
 }
@@ -617,6 +738,32 @@ void smReshapeInplace(Array *arr, const int *shape, int ndim)
         exit(1);
     }
 
+    // reshaping works on C order, bring the data into it first
+    if (!__isContiguousC__(arr))
+    {
+        if (!arr->OWNDATA)
+        {
+            fprintf(stderr, ">> error: cannot reshape a non-contiguous view inplace.\n");
+            exit(1);
+        }
+
+        float *data = (float *)malloc((size_t)arr->totalsize * arr->itemsize);
+        _checkNull(data);
+        __copyToBuffer__(data, arr);
+        free(arr->data);
+        arr->data = data;
+    }
+
+    if (ndim > arr->ndim)
+    {
+        arr->shape = (int *)realloc(arr->shape, ndim * sizeof(int));
+        arr->strides = (int *)realloc(arr->strides, ndim * sizeof(int));
+        arr->backstrides = (int *)realloc(arr->backstrides, ndim * sizeof(int));
+        _checkNull(arr->shape);
+        _checkNull(arr->strides);
+        _checkNull(arr->backstrides);
+    }
+
     arr->ndim = ndim;
     for (int i = 0; i < ndim; i++)
     {
@@ -633,14 +780,11 @@ assume axes is a valid permutation
 Array *smTransposeNew(Array *arr, const int *axes)
 {
     Array *res = smCreate(arr->shape, arr->ndim);
+
+    // set data (in logical order, arr may itself be a view)
+    __copyToBuffer__(res->data, arr);
     if (arr->ndim == 1)
-    {
-        smFromValues(res, arr->data);
         return res;
-    }
-
-    // set data
-    smFromValues(res, arr->data);
 
     int *_axes = (int *)malloc(res->ndim * sizeof(int));
     _checkNull(_axes);
@@ -673,365 +817,9441 @@ Array *smTransposeNew(Array *arr, const int *axes)
     free(_axes);
 
     __recalculateBackstrides__(res);
-    __createArrayIndices__(res);
-    __createLinearIndices__(res);
     __setArrayFlags__(res);
 
     return res;
 }
 
+// ------------------- Views and memory layout -------------------
+
 /*
-can be parallelized.
+F-order counterpart of `__recalculateStrides__`, first axis is the fastest
 */
-Array *__PaddArrays__(Array *a, Array *b)
+void __recalculateStridesF__(Array *arr)
 {
-    Array *res = smCreate(a->shape, a->ndim);
-
-    for (int i = 0; i < a->totalsize; i++)
+    arr->strides[0] = arr->itemsize;
+    for (int i = 1; i < arr->ndim; i++)
     {
-        float value = smGet(a, i) + smGet(b, i);
-        smSet(res, i, value);
+        arr->strides[i] = arr->strides[i - 1] * arr->shape[i - 1];
     }
-
-    return res;
 }
 
-Array *__PmulArrays__(Array *a, Array *b)
+/*
+true if the elements of the Array are laid out without gaps in C order.
+axes of length 1 can have any stride.
+*/
+bool __isContiguousC__(Array *arr)
 {
-    Array *res = smCreate(a->shape, a->ndim);
-
-    for (int i = 0; i < a->totalsize; i++)
+    int expected = arr->itemsize;
+    for (int i = arr->ndim - 1; i >= 0; i--)
     {
-        float value = smGet(a, i) * smGet(b, i);
-        smSet(res, i, value);
+        if (arr->shape[i] != 1 && arr->strides[i] != expected)
+            return false;
+        expected *= arr->shape[i];
     }
 
-    return res;
+    return true;
 }
 
 /*
-add the elements of two Arrays elementwise
-if the shapes are not equal but broadcastable,
-then broadcasting will take place.
+true if the elements of the Array are laid out without gaps in F order.
 */
-Array *smAdd(Array *a, Array *b)
+bool __isContiguousF__(Array *arr)
 {
-    if (smCheckShapesEqual(a, b))
-        return __PaddArrays__(a, b);
-
-    int *res_shape = __broadcastFinalShape__(a, b);
-
-    if (res_shape == NULL)
+    int expected = arr->itemsize;
+    for (int i = 0; i < arr->ndim; i++)
     {
-        fprintf(stderr, "Cannot add Arrays of non-broadcastable shapes.\n");
-        exit(1);
+        if (arr->shape[i] != 1 && arr->strides[i] != expected)
+            return false;
+        expected *= arr->shape[i];
     }
 
-    // broadcast shapes
-    // free broadcasts
-    int res_ndim = (a->ndim > b->ndim) ? a->ndim : b->ndim;
-
-    Array *afinal = __broadcastArray__(a, res_shape, res_ndim);
-    Array *bfinal = __broadcastArray__(b, res_shape, res_ndim);
-
-    Array *res = __PaddArrays__(afinal, bfinal);
-
-    smCleanup(afinal);
-    smCleanup(bfinal);
-    free(res_shape);
-
-    return res;
+    return true;
 }
 
 /*
--1 * arr->data
+create a view: a new Array header that points into `data`, which
+belongs to `arr` (or to whatever `arr` itself is a view of).
+
+no data is copied. the view must not outlive the Array owning the buffer,
+and cleaning up the view leaves the buffer alone.
+strides are in bytes, just like `arr->strides`.
 */
-Array *__PnegArray__(Array *arr)
+Array *__createView__(Array *arr, float *data, const int *shape, const int *strides, int ndim)
 {
-    Array *res = smCreate(arr->shape, arr->ndim);
+    Array *view = (Array *)malloc(sizeof(Array));
+    _checkNull(view);
 
-    for (int i = 0; i < res->totalsize; i++)
+    view->ndim = ndim;
+    view->shape = (int *)malloc(ndim * sizeof(int));
+    view->strides = (int *)malloc(ndim * sizeof(int));
+    view->backstrides = (int *)malloc(ndim * sizeof(int));
+
+    _checkNull(view->shape);
+    _checkNull(view->strides);
+    _checkNull(view->backstrides);
+
+    view->itemsize = arr->itemsize;
+    view->totalsize = 1;
+    for (int i = 0; i < ndim; i++)
     {
-        res->data[i] = -1 * arr->data[i];
+        view->shape[i] = shape[i];
+        view->strides[i] = strides[i];
+        view->totalsize *= shape[i];
     }
 
-    return res;
+    view->data = data;
+    view->idxs = NULL;
+    view->lidxs = NULL;
+    view->OWNDATA = false;
+
+    __recalculateBackstrides__(view);
+    __setArrayFlags__(view);
+
+    return view;
 }
 
 /*
-this is basically a + (-1 * b) elementwise
+zero-copy transpose: same as `smTransposeNew` but the result shares
+the buffer of `arr`, only shape and strides are permuted.
+if `axes` is NULL the axes are reversed, otherwise it must be a
+permutation of the axes (a repeated axis would alias elements).
 */
-Array *__PsubArrays__(Array *a, Array *b)
+Array *smTransposeView(Array *arr, const int *axes)
 {
-    Array *bneg = __PnegArray__(b);
+    int shape[arr->ndim], strides[arr->ndim];
+    bool used[arr->ndim];
+    memset(used, 0, sizeof(used));
 
-    Array *res = smAdd(a, bneg);
+    for (int i = 0; i < arr->ndim; i++)
+    {
+        int axis = (axes != NULL) ? axes[i] : arr->ndim - 1 - i;
+        if (axis < 0 || axis >= arr->ndim || used[axis])
+        {
+            fprintf(stderr, ">> error: axes for transpose must be a permutation, got axis %d.\n", axis);
+            exit(1);
+        }
+        used[axis] = true;
+        shape[i] = arr->shape[axis];
+        strides[i] = arr->strides[axis];
+    }
 
-    smCleanup(bneg);
-    return res;
+    return __createView__(arr, arr->data, shape, strides, arr->ndim);
 }
 
 /*
-multiply the elements of two Arrays elementwise
-for now, assume shapes of both are same
+resolve a slice against an axis of length `n` (numpy semantics):
+negative start/stop count from the end, missing ones (SM_NONE) cover
+the whole axis in the direction of `step`, out of range values are clipped.
 
-TODO: implement broadcasting
+writes the first index and returns the number of selected elements.
 */
-Array *smMul(Array *a, Array *b)
+int __resolveSlice__(SmSlice slice, int n, int *first)
 {
-    if (smCheckShapesEqual(a, b))
-        return __PmulArrays__(a, b);
-
-    int *res_shape = __broadcastFinalShape__(a, b);
+    int start = slice.start, stop = slice.stop, step = slice.step;
 
-    if (res_shape == NULL)
+    if (step > 0)
     {
-        fprintf(stderr, "Cannot multiply Arrays of non-broadcastable shapes.\n");
-        exit(1);
+        if (start == SM_NONE)
+            start = 0;
+        else if (start < 0)
+            start = (start + n < 0) ? 0 : start + n;
+        else if (start > n)
+            start = n;
+
+        if (stop == SM_NONE)
+            stop = n;
+        else if (stop < 0)
+            stop = (stop + n < 0) ? 0 : stop + n;
+        else if (stop > n)
+            stop = n;
+
+        *first = start;
+        return (stop > start) ? (stop - start - 1) / step + 1 : 0;
     }
 
-    // broadcast shapes
-    // free broadcasts
-    int res_ndim = (a->ndim > b->ndim) ? a->ndim : b->ndim;
-
-    Array *afinal = __broadcastArray__(a, res_shape, res_ndim);
-    Array *bfinal = __broadcastArray__(b, res_shape, res_ndim);
-
-    Array *res = __PmulArrays__(afinal, bfinal);
-
-    smCleanup(afinal);
-    smCleanup(bfinal);
-    free(res_shape);
-
-    return res;
+    if (start == SM_NONE)
+        start = n - 1;
+    else if (start < 0)
+        start = (start + n < 0) ? -1 : start + n;
+    else if (start >= n)
+        start = n - 1;
+
+    if (stop == SM_NONE)
+        stop = -1;
+    else if (stop < 0)
+        stop = (stop + n < 0) ? -1 : stop + n;
+    else if (stop >= n)
+        stop = n - 1;
+
+    *first = start;
+    return (start > stop) ? (start - stop - 1) / (-step) + 1 : 0;
 }
 
 /*
-Expand any axis in an array.
-For example: If arr->shape is (3,) then
-smExpandAxis(arr, 0)->shape will be (1, 3)
-smExpandAxis(arr, 1)->shape will be (3, 1) and so on...
+zero-copy slicing, one SmSlice per axis of `arr`:
+```
+SM_ALL                    -> arr[:]
+SM_SLICE(1, SM_NONE, 2)   -> arr[1::2]
+SM_SLICE(SM_NONE, SM_NONE, -1) -> arr[::-1]
+SM_INDEX(-1)              -> arr[-1] (the axis is dropped)
+```
+the result is a strided view into the buffer of `arr`. if every axis
+is indexed the result has shape {1}.
 */
-Array *smExpandDims(Array *arr, int axis)
+Array *smSlice(Array *arr, const SmSlice *slices)
 {
-    // handle negative values
-    if (axis < 0)
-        axis = arr->ndim + axis + 1;
+    int shape[SM_MAXDIMS], strides[SM_MAXDIMS];
+    int ndim = 0;
+    long offset = 0; // bytes
+    bool empty = false;
 
-    if (axis < 0 || axis > arr->ndim)
+    for (int i = 0; i < arr->ndim; i++)
     {
-        fprintf(stderr, ">> error: axis out of bounds for expanding.\n");
-        exit(1);
-    }
+        SmSlice slice = slices[i];
 
-    int new_ndim = arr->ndim + 1;
-    int *new_shape = (int *)malloc(new_ndim * sizeof(int));
-    _checkNull(new_shape);
+        if (slice.isindex)
+        {
+            int index = (slice.start < 0) ? slice.start + arr->shape[i] : slice.start;
+            if (index < 0 || index >= arr->shape[i])
+            {
+                fprintf(stderr, ">> error: index %d out of bounds for axis %d with size %d.\n",
+                        slice.start, i, arr->shape[i]);
+                exit(1);
+            }
+            offset += (long)index * arr->strides[i];
+            continue;
+        }
 
-    // copy into new shape
-    int j = 0;
-    for (int i = 0; i < new_ndim; i++)
-    {
-        if (i == axis)
-            new_shape[i] = 1;
-        else
+        if (slice.step == 0)
         {
-            new_shape[i] = arr->shape[j];
-            j++;
+            fprintf(stderr, ">> error: slice step cannot be zero.\n");
+            exit(1);
         }
+
+        int first;
+        int len = __resolveSlice__(slice, arr->shape[i], &first);
+        if (len == 0)
+            empty = true;
+        else
+            offset += (long)first * arr->strides[i];
+
+        shape[ndim] = len;
+        strides[ndim] = arr->strides[i] * slice.step;
+        ndim++;
     }
 
-    // copy data
-    Array *result = smCreate(new_shape, new_ndim);
-    memcpy(result->data, arr->data, arr->totalsize * sizeof(float));
+    if (ndim == 0)
+    {
+        shape[0] = 1;
+        strides[0] = arr->itemsize;
+        ndim = 1;
+    }
 
-    free(new_shape);
-    return result;
+    float *data = empty ? arr->data : (float *)((char *)arr->data + offset);
+
+    return __createView__(arr, data, shape, strides, ndim);
 }
 
 /*
-Squeeze any axis in an array.
-For example: If arr->shape is (3, 1) then
-smExpandAxis(arr, 1)->shape will be (3, ) and so on...
+zero-copy sliding windows of length `window` along `axis`:
+```
+x of shape (..., n, ...) -> (..., n - window + 1, ..., window)
+```
+the axis shrinks to the number of windows and the window itself becomes
+a new last axis with the stride of `axis`, so consecutive windows
+overlap in the buffer of `arr`. writing into the view writes into `arr`
+(once per window the element appears in).
 */
-Array *smSqueeze(Array *arr, int axis)
+Array *smSlidingWindowView(Array *arr, int window, int axis)
 {
     if (axis < 0)
         axis = arr->ndim + axis;
-
-    if (axis < 0 || axis > arr->ndim)
+    if (axis < 0 || axis >= arr->ndim)
     {
-        fprintf(stderr, ">> error: axis out of bounds for expanding.\n");
+        fprintf(stderr, ">> error: axis out of bounds for sliding window.\n");
         exit(1);
     }
-    if (arr->ndim == 1)
+    if (window < 1 || window > arr->shape[axis])
     {
-        fprintf(stderr, ">> error: cannot squeeze Array with ndim 1.\n");
+        fprintf(stderr, ">> error: window %d does not fit an axis of size %d.\n", window, arr->shape[axis]);
+        exit(1);
+    }
+    if (arr->ndim + 1 > SM_MAXDIMS)
+    {
+        fprintf(stderr, ">> error: too many dimensions for sliding window.\n");
         exit(1);
     }
 
-    printf("axis is %d\n", axis);
-    int new_ndim = arr->ndim - 1;
-    int *new_shape = (int *)malloc(new_ndim * sizeof(int));
-    _checkNull(new_shape);
-
-    // copy into new shape
-    int j = 0;
+    int shape[SM_MAXDIMS], strides[SM_MAXDIMS];
     for (int i = 0; i < arr->ndim; i++)
     {
-        if (i == axis && arr->shape[i] != 1)
-        {
-            fprintf(stderr, ">> error: dimension of the axis to squeeze must be 1.\n");
-            exit(1);
-        }
-        else if (i == axis && arr->shape[i] == 1)
-            continue;
-        else
-        {
-            new_shape[j] = arr->shape[i];
-            j++;
-        }
+        shape[i] = arr->shape[i];
+        strides[i] = arr->strides[i];
     }
+    shape[axis] = arr->shape[axis] - window + 1;
+    shape[arr->ndim] = window;
+    strides[arr->ndim] = arr->strides[axis];
 
-    // copy data
-    Array *result = smCreate(new_shape, new_ndim);
-    memcpy(result->data, arr->data, arr->totalsize * sizeof(float));
+    return __createView__(arr, arr->data, shape, strides, arr->ndim + 1);
+}
 
-    free(new_shape);
-    return result;
+#if defined(__AVX__)
+/*
+transpose one 8x8 block entirely in registers:
+dst[j * ldd + i] = src[i * lds + j] for i, j < 8
+*/
+static inline void __transpose8x8__(const float *src, long lds, float *dst, long ldd)
+{
+    __m256 r0 = _mm256_loadu_ps(src + 0 * lds);
+    __m256 r1 = _mm256_loadu_ps(src + 1 * lds);
+    __m256 r2 = _mm256_loadu_ps(src + 2 * lds);
+    __m256 r3 = _mm256_loadu_ps(src + 3 * lds);
+    __m256 r4 = _mm256_loadu_ps(src + 4 * lds);
+    __m256 r5 = _mm256_loadu_ps(src + 5 * lds);
+    __m256 r6 = _mm256_loadu_ps(src + 6 * lds);
+    __m256 r7 = _mm256_loadu_ps(src + 7 * lds);
+
+    // interleave pairs of rows
+    __m256 t0 = _mm256_unpacklo_ps(r0, r1);
+    __m256 t1 = _mm256_unpackhi_ps(r0, r1);
+    __m256 t2 = _mm256_unpacklo_ps(r2, r3);
+    __m256 t3 = _mm256_unpackhi_ps(r2, r3);
+    __m256 t4 = _mm256_unpacklo_ps(r4, r5);
+    __m256 t5 = _mm256_unpackhi_ps(r4, r5);
+    __m256 t6 = _mm256_unpacklo_ps(r6, r7);
+    __m256 t7 = _mm256_unpackhi_ps(r6, r7);
+
+    // gather 4-element columns inside each 128-bit lane
+    __m256 s0 = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(1, 0, 1, 0));
+    __m256 s1 = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(3, 2, 3, 2));
+    __m256 s2 = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(1, 0, 1, 0));
+    __m256 s3 = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(3, 2, 3, 2));
+    __m256 s4 = _mm256_shuffle_ps(t4, t6, _MM_SHUFFLE(1, 0, 1, 0));
+    __m256 s5 = _mm256_shuffle_ps(t4, t6, _MM_SHUFFLE(3, 2, 3, 2));
+    __m256 s6 = _mm256_shuffle_ps(t5, t7, _MM_SHUFFLE(1, 0, 1, 0));
+    __m256 s7 = _mm256_shuffle_ps(t5, t7, _MM_SHUFFLE(3, 2, 3, 2));
+
+    // swap the 128-bit halves across rows
+    _mm256_storeu_ps(dst + 0 * ldd, _mm256_permute2f128_ps(s0, s4, 0x20));
+    _mm256_storeu_ps(dst + 1 * ldd, _mm256_permute2f128_ps(s1, s5, 0x20));
+    _mm256_storeu_ps(dst + 2 * ldd, _mm256_permute2f128_ps(s2, s6, 0x20));
+    _mm256_storeu_ps(dst + 3 * ldd, _mm256_permute2f128_ps(s3, s7, 0x20));
+    _mm256_storeu_ps(dst + 4 * ldd, _mm256_permute2f128_ps(s0, s4, 0x31));
+    _mm256_storeu_ps(dst + 5 * ldd, _mm256_permute2f128_ps(s1, s5, 0x31));
+    _mm256_storeu_ps(dst + 6 * ldd, _mm256_permute2f128_ps(s2, s6, 0x31));
+    _mm256_storeu_ps(dst + 7 * ldd, _mm256_permute2f128_ps(s3, s7, 0x31));
 }
+#endif
 
 /*
-Dot product between two vectors i.e. Arrays with dimension 1.
-Returns: Array with shape {1} i.e. only one element.
+out-of-place transpose of a small `rows x cols` block:
+dst[j * ldd + i] = src[i * lds + j]
+
+the caller keeps blocks small enough (SM_TILE) to stay in L1,
+full 8x8 sub-blocks are shuffled in registers when AVX is available.
 */
-Array *smDot(Array *a, Array *b)
+void __transposeBlock__(const float *src, long lds, float *dst, long ldd, int rows, int cols)
 {
-    if (a->ndim != 1 && b->ndim != 1)
+    int i = 0;
+#if defined(__AVX__)
+    for (; i + 8 <= rows; i += 8)
     {
-        fprintf(stderr, ">> error: both arrays should be vectors for dot product.");
-        exit(1);
+        int j = 0;
+        for (; j + 8 <= cols; j += 8)
+            __transpose8x8__(src + i * lds + j, lds, dst + j * ldd + i, ldd);
+
+        for (; j < cols; j++)
+            for (int ii = i; ii < i + 8; ii++)
+                dst[j * ldd + ii] = src[ii * lds + j];
     }
-    if (a->shape[0] != b->shape[0])
+#endif
+    for (; i < rows; i++)
+        for (int j = 0; j < cols; j++)
+            dst[j * ldd + i] = src[i * lds + j];
+}
+
+/*
+copy where dst is unit-stride along axis `p` and src along axis `q`,
+i.e. a (batched) transpose of the p-q plane.
+
+the plane is cut into SM_TILE x SM_TILE tiles, each one is read and
+written while it sits in cache. tiles of all outer indices are
+distributed among threads.
+*/
+void __copyTransposed__(
+    float *dst, const float *src, int np, int nq, long sp, long dq,
+    const int *oshape, const long *ods, const long *oss, int nouter)
+{
+    long outer = 1;
+    for (int d = 0; d < nouter; d++)
+        outer *= oshape[d];
+
+    long tp = (np + SM_TILE - 1) / SM_TILE;
+    long tq = (nq + SM_TILE - 1) / SM_TILE;
+    long ntiles = outer * tp * tq;
+
+#ifdef PARALLEL
+#pragma omp parallel for schedule(static)
+#endif
+    for (long t = 0; t < ntiles; t++)
     {
-        fprintf(stderr, ">> error: both vectors should have the same shape for dot product.");
-        exit(1);
+        long o = t / (tp * tq);
+        int p0 = (int)((t / tq) % tp) * SM_TILE;
+        int q0 = (int)(t % tq) * SM_TILE;
+
+        long rem = o, doff = 0, soff = 0;
+        for (int d = nouter - 1; d >= 0; d--)
+        {
+            long i = rem % oshape[d];
+            rem /= oshape[d];
+            doff += i * ods[d];
+            soff += i * oss[d];
+        }
+
+        int rows = (np - p0 < SM_TILE) ? np - p0 : SM_TILE;
+        int cols = (nq - q0 < SM_TILE) ? nq - q0 : SM_TILE;
+
+        // src rows run along p, dst rows run along q
+        __transposeBlock__(
+            src + soff + p0 * sp + q0, sp,
+            dst + doff + q0 * dq + p0, dq,
+            rows, cols);
     }
+}
 
-    float dot = 0.0f;
-    int shape[] = {1};
-    Array *result = smCreate(shape, 1);
+/*
+copy the elements of `src` into `dst` in logical (C) order, whatever
+the strides of both are. `src` has to be broadcastable to `dst`.
+
+the loop is planned over both operands (see `__planStrided__`), which
+turns matching layouts into one long memcpy. if the unit-stride axes of
+dst and src still differ afterwards (permuted axes), the copy becomes a
+tiled transpose of those two axes.
+*/
+void __copyStrided__(Array *dst, Array *src)
+{
+    StridedPlan plan;
+    Array *ops[] = {dst, src};
+    __planStrided__(&plan, dst->shape, dst->ndim, ops, 2);
 
-    for (int i = 0; i < a->totalsize; i++)
+    int inner = plan.ndim - 1;
+    long sp = plan.strides[1][inner];
+    if (plan.strides[0][inner] == 1 && sp != 1 && sp != 0)
     {
-        dot += (a->data[i] * b->data[i]);
+        for (int q = 0; q < inner; q++)
+        {
+            if (plan.strides[1][q] != 1)
+                continue;
+
+            int oshape[SM_MAXDIMS];
+            long ods[SM_MAXDIMS], oss[SM_MAXDIMS];
+            int nouter = 0;
+            for (int d = 0; d < inner; d++)
+            {
+                if (d == q)
+                    continue;
+                oshape[nouter] = plan.shape[d];
+                ods[nouter] = plan.strides[0][d];
+                oss[nouter] = plan.strides[1][d];
+                nouter++;
+            }
+
+            __copyTransposed__(
+                dst->data, src->data, plan.shape[inner], plan.shape[q], sp, plan.strides[0][q],
+                oshape, ods, oss, nouter);
+            return;
+        }
     }
-    result->data[0] = dot;
 
-    return result;
+    __runStrided__(&plan, __copyLoop__, NULL);
 }
 
 /*
-matrix multiplication of n-dimensional arrays.
-```
-for 2D arrays (m, n) @ (n, d) = (m, d)
-for nD arrays (..., m, n) @ (..., n, d) = (..., m, d)
-```
-when the dimensions of arrays are greater than 2, we do N matmuls
-on the last two axes of the operands. These N matmuls will be stacked
-in the shape of the higher dimensions.
+C-contiguous view of `shape` over a raw buffer (e.g. user values)
 */
-Array *smMatMul(Array *a, Array *b)
+Array *__contiguousView__(Array *arr, float *data, const int *shape, int ndim)
 {
-    if (a->ndim < 2 || b->ndim < 2)
+    int strides[ndim];
+    int stride = arr->itemsize;
+    for (int i = ndim - 1; i >= 0; i--)
     {
-        fprintf(stderr, ">> Error: both arrays must have at least 2 dimensions for matmul.\n");
-        return NULL;
+        strides[i] = stride;
+        stride *= shape[i];
+    }
+
+    return __createView__(arr, data, shape, strides, ndim);
+}
+
+/*
+copy `src` in logical (C) order into a flat buffer of `src->totalsize` floats
+*/
+void __copyToBuffer__(float *buf, Array *src)
+{
+    Array *view = __contiguousView__(src, buf, src->shape, src->ndim);
+    __copyStrided__(view, src);
+    smCleanup(view);
+}
+
+/*
+materialize any (strided) Array into a new C-contiguous Array.
+similar to numpy's `ascontiguousarray`.
+*/
+Array *smContiguous(Array *arr)
+{
+    Array *res = smCreate(arr->shape, arr->ndim);
+    __copyStrided__(res, arr);
+
+    return res;
+}
+
+/*
+materialize any (strided) Array into a new F-contiguous Array.
+similar to numpy's `asfortranarray`.
+*/
+Array *smAsFortran(Array *arr)
+{
+    Array *res = smCreateOrder(arr->shape, arr->ndim, SM_F_ORDER);
+    __copyStrided__(res, arr);
+
+    return res;
+}
+
+// ------------------- Strided loop engine -------------------
+
+/*
+decides if axis `a` has to be iterated outside of axis `b`.
+the first operand having a non-zero stride on both axes decides,
+broadcasted (0-stride) axes can go anywhere.
+*/
+bool __axisIsOuter__(long strides[][SM_MAXDIMS], int nop, int a, int b)
+{
+    for (int op = 0; op < nop; op++)
+    {
+        long sa = labs(strides[op][a]);
+        long sb = labs(strides[op][b]);
+        if (sa == 0 || sb == 0 || sa == sb)
+            continue;
+        return sa > sb;
+    }
+
+    return false;
+}
+
+/*
+element strides of `ops` along each axis of `shape` (right aligned,
+numpy style broadcasting gives a stride of 0).
+*/
+void __broadcastStrides__(
+    long strides[][SM_MAXDIMS], const int *shape, int ndim, Array **ops, int nop)
+{
+    if (ndim > SM_MAXDIMS || nop > SM_MAXOPS)
+    {
+        fprintf(stderr, ">> error: too many dimensions/operands for a strided loop.\n");
+        exit(1);
+    }
+
+    for (int op = 0; op < nop; op++)
+    {
+        Array *arr = ops[op];
+        for (int d = 0; d < ndim; d++)
+        {
+            int ad = d - (ndim - arr->ndim);
+            if (ad < 0 || arr->shape[ad] == 1)
+                strides[op][d] = 0;
+            else if (arr->shape[ad] != shape[d])
+            {
+                fprintf(stderr, ">> error: operand cannot be broadcast to the loop shape.\n");
+                exit(1);
+            }
+            else
+                strides[op][d] = arr->strides[ad] / arr->itemsize;
+        }
+    }
+}
+
+/*
+plan a loop over `shape` for the given operands (operand 0 is usually
+the output):
+
+1. axes of length 1 are dropped
+2. axes are sorted so that the smallest strides are innermost
+3. neighbouring axes that are contiguous in *all* operands are merged
+
+so that the innermost loop is as long (and as unit-strided) as possible.
+a transposed view then runs the same single loop as a flat array.
+*/
+void __planStrided__(StridedPlan *plan, const int *shape, int ndim, Array **ops, int nop)
+{
+    long st[SM_MAXOPS][SM_MAXDIMS];
+    __broadcastStrides__(st, shape, ndim, ops, nop);
+
+    plan->nop = nop;
+    for (int op = 0; op < nop; op++)
+        plan->data[op] = ops[op]->data;
+
+    int perm[SM_MAXDIMS];
+    int nd = 0;
+    for (int d = 0; d < ndim; d++)
+    {
+        if (shape[d] == 0)
+        {
+            // nothing to iterate over
+            plan->ndim = 1;
+            plan->shape[0] = 0;
+            for (int op = 0; op < nop; op++)
+                plan->strides[op][0] = 0;
+            return;
+        }
+        if (shape[d] != 1)
+            perm[nd++] = d;
+    }
+
+    // stable insertion sort, outermost axis first
+    for (int i = 1; i < nd; i++)
+    {
+        for (int j = i; j > 0 && __axisIsOuter__(st, nop, perm[j], perm[j - 1]); j--)
+        {
+            int tmp = perm[j];
+            perm[j] = perm[j - 1];
+            perm[j - 1] = tmp;
+        }
+    }
+
+    plan->ndim = 0;
+    for (int i = 0; i < nd; i++)
+    {
+        int ax = perm[i];
+        int last = plan->ndim - 1;
+
+        bool merge = (last >= 0);
+        for (int op = 0; op < nop && merge; op++)
+            merge = (plan->strides[op][last] == st[op][ax] * shape[ax]);
+
+        if (merge)
+        {
+            plan->shape[last] *= shape[ax];
+            for (int op = 0; op < nop; op++)
+                plan->strides[op][last] = st[op][ax];
+            continue;
+        }
+
+        plan->shape[plan->ndim] = shape[ax];
+        for (int op = 0; op < nop; op++)
+            plan->strides[op][plan->ndim] = st[op][ax];
+        plan->ndim++;
+    }
+
+    if (plan->ndim == 0)
+    {
+        // a single element
+        plan->ndim = 1;
+        plan->shape[0] = 1;
+        for (int op = 0; op < nop; op++)
+            plan->strides[op][0] = 0;
+    }
+}
+
+/*
+number of work items of a plan: (outer index, inner chunk) pairs
+*/
+long __stridedItems__(StridedPlan *plan)
+{
+    long outer = 1;
+    for (int d = 0; d < plan->ndim - 1; d++)
+        outer *= plan->shape[d];
+
+    return outer * ((plan->shape[plan->ndim - 1] + SM_CHUNK - 1) / SM_CHUNK);
+}
+
+/*
+run `loop` over the work items [start, end) of a plan, walking them with
+an index counter (no divisions per row).
+*/
+void __runStridedRange__(StridedPlan *plan, StridedLoop loop, void *ctx, long start, long end)
+{
+    int nouter = plan->ndim - 1;
+    long n = plan->shape[nouter];
+    if (n == 0 || start >= end)
+        return;
+
+    long nchunks = (n + SM_CHUNK - 1) / SM_CHUNK;
+
+    long idx[SM_MAXDIMS];
+    long rem = start / nchunks;
+    long chunk = start % nchunks;
+    for (int d = nouter - 1; d >= 0; d--)
+    {
+        idx[d] = rem % plan->shape[d];
+        rem /= plan->shape[d];
+    }
+
+    float *ptrs[SM_MAXOPS];
+    long steps[SM_MAXOPS];
+    for (int op = 0; op < plan->nop; op++)
+        steps[op] = plan->strides[op][nouter];
+
+    for (long it = start; it < end; it++)
+    {
+        long lo = chunk * SM_CHUNK;
+        long len = (n - lo < SM_CHUNK) ? n - lo : SM_CHUNK;
+
+        for (int op = 0; op < plan->nop; op++)
+        {
+            long offset = lo * steps[op];
+            for (int d = 0; d < nouter; d++)
+                offset += idx[d] * plan->strides[op][d];
+            ptrs[op] = plan->data[op] + offset;
+        }
+
+        loop(ptrs, steps, len, ctx);
+
+        if (++chunk == nchunks)
+        {
+            chunk = 0;
+            for (int d = nouter - 1; d >= 0; d--)
+            {
+                if (++idx[d] < plan->shape[d])
+                    break;
+                idx[d] = 0;
+            }
+        }
+    }
+}
+
+/*
+run `loop` over a plan. the innermost axis is cut into chunks of
+SM_CHUNK elements and the (outer index, chunk) pairs are split evenly
+among threads.
+
+the output (operand 0) must not be 0-strided along any axis, reductions
+go through `__runReduction__` instead.
+*/
+void __runStrided__(StridedPlan *plan, StridedLoop loop, void *ctx)
+{
+    long nitems = __stridedItems__(plan);
+
+    long total = 1;
+    for (int d = 0; d < plan->ndim; d++)
+        total *= plan->shape[d];
+
+#ifdef PARALLEL
+#pragma omp parallel if (total >= SM_PARALLEL_MIN)
+#endif
+    {
+        int nthreads = 1, tid = 0;
+#ifdef PARALLEL
+        nthreads = omp_get_num_threads();
+        tid = omp_get_thread_num();
+#endif
+        __runStridedRange__(
+            plan, loop, ctx,
+            nitems * tid / nthreads, nitems * (tid + 1) / nthreads);
+    }
+}
+
+/*
+create an Array of `shape` whose memory order follows the operands:
+axes are laid out in the same order the operands have them in memory.
+for C-contiguous operands this is a plain C-order Array, for transposed
+views it is the matching permutation, so the result does not force a
+strided inner loop on any of them.
+*/
+Array *__createLike__(const int *shape, int ndim, Array **ops, int nop)
+{
+    long st[SM_MAXOPS][SM_MAXDIMS];
+    __broadcastStrides__(st, shape, ndim, ops, nop);
+
+    // axes of length 1 take no part in the ordering
+    int perm[SM_MAXDIMS];
+    int nd = 0;
+    for (int i = 0; i < ndim; i++)
+        if (shape[i] != 1)
+            perm[nd++] = i;
+
+    for (int i = 1; i < nd; i++)
+    {
+        for (int j = i; j > 0 && __axisIsOuter__(st, nop, perm[j], perm[j - 1]); j--)
+        {
+            int tmp = perm[j];
+            perm[j] = perm[j - 1];
+            perm[j - 1] = tmp;
+        }
+    }
+
+    Array *res = smCreate(shape, ndim);
+
+    int stride = res->itemsize;
+    for (int i = nd - 1; i >= 0; i--)
+    {
+        res->strides[perm[i]] = stride;
+        stride *= shape[perm[i]];
+    }
+    for (int i = 0; i < ndim; i++)
+        if (shape[i] == 1)
+            res->strides[i] = stride;
+    __recalculateBackstrides__(res);
+    __setArrayFlags__(res);
+
+    return res;
+}
+
+// dst = src, src may be a scalar (step 0)
+void __copyLoop__(float **ptrs, const long *steps, long n, void *ctx)
+{
+    (void)ctx;
+    float *dst = ptrs[0];
+    const float *src = ptrs[1];
+
+    if (steps[0] == 1 && steps[1] == 1)
+        memcpy(dst, src, n * sizeof(float));
+    else if (steps[0] == 1 && steps[1] == 0)
+        for (long i = 0; i < n; i++)
+            dst[i] = src[0];
+    else
+        for (long i = 0; i < n; i++)
+            dst[i * steps[0]] = src[i * steps[1]];
+}
+
+/*
+binary loops, out = op(a, b) where either input may be a scalar (step 0).
+SM_BINARY_LOOP stamps one out per op from a scalar expression of `a` and
+`b` and an AVX one of `va` and `vb`, so every op gets its own tight loop
+with the op inlined: 8 lanes at a time over contiguous or scalar inputs,
+element by element over anything else.
+*/
+#if defined(__AVX2__) && defined(__FMA__)
+#define SM_BINARY_FAST(expr, vexpr)                                        \
+    if (steps[0] == 1 && steps[1] <= 1 && steps[2] <= 1)                   \
+    {                                                                      \
+        __m256 va = _mm256_broadcast_ss(pa), vb = _mm256_broadcast_ss(pb); \
+        for (; i + 8 <= n; i += 8)                                         \
+        {                                                                  \
+            if (steps[1])                                                  \
+                va = _mm256_loadu_ps(pa + i);                              \
+            if (steps[2])                                                  \
+                vb = _mm256_loadu_ps(pb + i);                              \
+            _mm256_storeu_ps(out + i, (vexpr));                            \
+        }                                                                  \
+    }
+#else
+#define SM_BINARY_FAST(expr, vexpr)                          \
+    if (steps[0] == 1 && steps[1] == 1 && steps[2] == 1)     \
+        for (; i < n; i++)                                   \
+        {                                                    \
+            float a = pa[i], b = pb[i];                      \
+            out[i] = (expr);                                 \
+        }
+#endif
+
+#define SM_BINARY_LOOP(name, expr, vexpr)                             \
+    void name(float **ptrs, const long *steps, long n, void *ctx)     \
+    {                                                                 \
+        (void)ctx;                                                    \
+        float *out = ptrs[0];                                         \
+        const float *pa = ptrs[1], *pb = ptrs[2];                     \
+        long i = 0;                                                   \
+        SM_BINARY_FAST(expr, vexpr)                                   \
+        for (; i < n; i++)                                            \
+        {                                                             \
+            float a = pa[i * steps[1]], b = pb[i * steps[2]];         \
+            out[i * steps[0]] = (expr);                               \
+        }                                                             \
+    }
+
+#if defined(__AVX2__) && defined(__FMA__)
+/*
+powf on every lane, except for squares (variances, L2 terms...) which
+are common enough to get a multiply. powf(x, 2) is x * x correctly
+rounded, so both give the same result.
+*/
+static inline __m256 __pow256__(__m256 a, __m256 b)
+{
+    __m256 two = _mm256_set1_ps(2.0f);
+    if (_mm256_movemask_ps(_mm256_cmp_ps(b, two, _CMP_EQ_OQ)) == 0xFF)
+        return _mm256_mul_ps(a, a);
+
+    float x[8], y[8];
+    _mm256_storeu_ps(x, a);
+    _mm256_storeu_ps(y, b);
+    for (int l = 0; l < 8; l++)
+        x[l] = powf(x[l], y[l]);
+    return _mm256_loadu_ps(x);
+}
+
+/*
+atan2(y, x) on 8 lanes: atan of t = min(|x|, |y|) / max(|x|, |y|) with
+the cephes polynomial (reduced to |t| <= tan(pi/8) around pi/4), then
+moved to the right octant and quadrant. zeros, infinities and NaNs
+anywhere in the register go to atan2f for their special cases.
+*/
+static inline __m256 __atan2256__(__m256 y, __m256 x)
+{
+    __m256 sign = _mm256_set1_ps(-0.0f);
+    __m256 ax = _mm256_andnot_ps(sign, x), ay = _mm256_andnot_ps(sign, y);
+    __m256 hi = _mm256_max_ps(ax, ay), lo = _mm256_min_ps(ax, ay);
+
+    __m256 ok = _mm256_and_ps(
+        _mm256_and_ps(_mm256_cmp_ps(lo, _mm256_setzero_ps(), _CMP_GT_OQ),
+                      _mm256_cmp_ps(hi, _mm256_set1_ps(INFINITY), _CMP_LT_OQ)),
+        _mm256_cmp_ps(x, y, _CMP_ORD_Q));
+    if (_mm256_movemask_ps(ok) != 0xFF)
+    {
+        float a[8], b[8];
+        _mm256_storeu_ps(a, y);
+        _mm256_storeu_ps(b, x);
+        for (int l = 0; l < 8; l++)
+            a[l] = atan2f(a[l], b[l]);
+        return _mm256_loadu_ps(a);
+    }
+
+    __m256 one = _mm256_set1_ps(1.0f);
+    __m256 t = _mm256_div_ps(lo, hi);
+    __m256 big = _mm256_cmp_ps(t, _mm256_set1_ps(0.4142135623730950f), _CMP_GT_OQ);
+    t = _mm256_blendv_ps(t, _mm256_div_ps(_mm256_sub_ps(t, one), _mm256_add_ps(t, one)), big);
+    __m256 r = _mm256_and_ps(big, _mm256_set1_ps(0.7853981633974483f));
+
+    __m256 z = _mm256_mul_ps(t, t);
+    __m256 p = _mm256_set1_ps(8.05374449538e-2f);
+    p = _mm256_fmadd_ps(p, z, _mm256_set1_ps(-1.38776856032e-1f));
+    p = _mm256_fmadd_ps(p, z, _mm256_set1_ps(1.99777106478e-1f));
+    p = _mm256_fmadd_ps(p, z, _mm256_set1_ps(-3.33329491539e-1f));
+    r = _mm256_add_ps(r, _mm256_fmadd_ps(_mm256_mul_ps(p, z), t, t));
+
+    // |y| > |x|: pi/2 - r, x < 0: pi - r, then the sign of y
+    r = _mm256_blendv_ps(r, _mm256_sub_ps(_mm256_set1_ps(1.5707963267948966f), r), _mm256_cmp_ps(ay, ax, _CMP_GT_OQ));
+    r = _mm256_blendv_ps(r, _mm256_sub_ps(_mm256_set1_ps(3.1415926535897932f), r), x);
+    return _mm256_or_ps(r, _mm256_and_ps(sign, y));
+}
+
+// NaN if either input is NaN, like numpy
+static inline __m256 __minimum256__(__m256 a, __m256 b)
+{
+    return _mm256_blendv_ps(_mm256_min_ps(a, b), a, _mm256_cmp_ps(a, a, _CMP_UNORD_Q));
+}
+
+static inline __m256 __maximum256__(__m256 a, __m256 b)
+{
+    return _mm256_blendv_ps(_mm256_max_ps(a, b), a, _mm256_cmp_ps(a, a, _CMP_UNORD_Q));
+}
+#endif
+
+SM_BINARY_LOOP(__addLoop__, a + b, _mm256_add_ps(va, vb))
+SM_BINARY_LOOP(__subLoop__, a - b, _mm256_sub_ps(va, vb))
+SM_BINARY_LOOP(__mulLoop__, a * b, _mm256_mul_ps(va, vb))
+SM_BINARY_LOOP(__divLoop__, a / b, _mm256_div_ps(va, vb))
+SM_BINARY_LOOP(__powLoop__, (b == 2.0f) ? a * a : powf(a, b), __pow256__(va, vb))
+SM_BINARY_LOOP(__minimumLoop__, (a != a || a < b) ? a : b, __minimum256__(va, vb))
+SM_BINARY_LOOP(__maximumLoop__, (a != a || a > b) ? a : b, __maximum256__(va, vb))
+SM_BINARY_LOOP(__atan2Loop__, atan2f(a, b), __atan2256__(va, vb))
+
+typedef struct
+{
+    ArrayFunc func;
+} ApplyContext;
+
+void __applyLoop__(float **ptrs, const long *steps, long n, void *ctx)
+{
+    ArrayFunc func = ((ApplyContext *)ctx)->func;
+    float *x = ptrs[0];
+
+    for (long i = 0; i < n; i++)
+        x[i * steps[0]] = func(x[i * steps[0]]);
+}
+
+/*
+elementwise `loop` over one Array into a new Array.
+*/
+Array *__PunaryOp__(Array *arr, StridedLoop loop, void *ctx)
+{
+    Array *res = __createLike__(arr->shape, arr->ndim, &arr, 1);
+
+    StridedPlan plan;
+    Array *ops[] = {res, arr};
+    __planStrided__(&plan, res->shape, res->ndim, ops, 2);
+    __runStrided__(&plan, loop, ctx);
+
+    return res;
+}
+
+/*
+elementwise `loop` over two Arrays into a new Array, broadcasting
+on the fly through 0-strides (no broadcasted copies are made).
+
+returns NULL if the shapes are not broadcastable.
+*/
+Array *__PbinaryOp__(Array *a, Array *b, StridedLoop loop, void *ctx)
+{
+    int *res_shape = __broadcastFinalShape__(a, b);
+    if (res_shape == NULL)
+        return NULL;
+
+    int res_ndim = (a->ndim > b->ndim) ? a->ndim : b->ndim;
+    Array *inputs[] = {a, b};
+    Array *res = __createLike__(res_shape, res_ndim, inputs, 2);
+    if (res_shape != a->shape)
+        free(res_shape);
+
+    StridedPlan plan;
+    Array *ops[] = {res, a, b};
+    __planStrided__(&plan, res->shape, res->ndim, ops, 3);
+    __runStrided__(&plan, loop, ctx);
+
+    return res;
+}
+
+/*
+a shape {1} Array holding `value`, the scalar operand of a broadcast
+*/
+Array *__scalar__(float value)
+{
+    Array *res = smCreate((int[]){1}, 1);
+    res->data[0] = value;
+    return res;
+}
+
+/*
+SM_BINARY_OP defines a broadcasting binary op and its scalar variant
+(`arr op value`) on top of a loop from SM_BINARY_LOOP
+*/
+#define SM_BINARY_OP(name, loop, verb)                                                   \
+    Array *name(Array *a, Array *b)                                                      \
+    {                                                                                    \
+        Array *res = __PbinaryOp__(a, b, loop, NULL);                                    \
+        if (res == NULL)                                                                 \
+        {                                                                                \
+            fprintf(stderr, "Cannot " verb " Arrays of non-broadcastable shapes.\n");    \
+            exit(1);                                                                     \
+        }                                                                                \
+        return res;                                                                      \
+    }                                                                                    \
+                                                                                         \
+    Array *name##Scalar(Array *arr, float value)                                         \
+    {                                                                                    \
+        Array *b = __scalar__(value);                                                    \
+        Array *res = __PbinaryOp__(arr, b, loop, NULL);                                  \
+        smCleanup(b);                                                                    \
+        return res;                                                                      \
+    }
+
+/*
+elementwise ops of two Arrays, broadcast if their shapes are not equal
+but broadcastable (no broadcasted copies are made):
+```
+smAdd(a, b)     a + b           smMinimum(a, b)   min(a, b), NaN wins
+smSub(a, b)     a - b           smMaximum(a, b)   max(a, b), NaN wins
+smMul(a, b)     a * b           smAtan2(y, x)     atan2(y, x)
+smDiv(a, b)     a / b
+smPow(a, b)     a ** b
+```
+and the same with a scalar second operand, e.g. smDivScalar(arr, 255.0f)
+*/
+SM_BINARY_OP(smAdd, __addLoop__, "add")
+SM_BINARY_OP(smSub, __subLoop__, "subtract")
+SM_BINARY_OP(smMul, __mulLoop__, "multiply")
+SM_BINARY_OP(smDiv, __divLoop__, "divide")
+SM_BINARY_OP(smPow, __powLoop__, "raise")
+SM_BINARY_OP(smMinimum, __minimumLoop__, "take the minimum of")
+SM_BINARY_OP(smMaximum, __maximumLoop__, "take the maximum of")
+SM_BINARY_OP(smAtan2, __atan2Loop__, "take atan2 of")
+
+/*
+Expand any axis in an array.
+For example: If arr->shape is (3,) then
+smExpandAxis(arr, 0)->shape will be (1, 3)
+smExpandAxis(arr, 1)->shape will be (3, 1) and so on...
+*/
+Array *smExpandDims(Array *arr, int axis)
+{
+    // handle negative values
+    if (axis < 0)
+        axis = arr->ndim + axis + 1;
+
+    if (axis < 0 || axis > arr->ndim)
+    {
+        fprintf(stderr, ">> error: axis out of bounds for expanding.\n");
+        exit(1);
+    }
+
+    int new_ndim = arr->ndim + 1;
+    int *new_shape = (int *)malloc(new_ndim * sizeof(int));
+    _checkNull(new_shape);
+
+    // copy into new shape
+    int j = 0;
+    for (int i = 0; i < new_ndim; i++)
+    {
+        if (i == axis)
+            new_shape[i] = 1;
+        else
+        {
+            new_shape[i] = arr->shape[j];
+            j++;
+        }
+    }
+
+    // copy data
+    Array *result = smCreate(new_shape, new_ndim);
+    __copyToBuffer__(result->data, arr);
+
+    free(new_shape);
+    return result;
+}
+
+/*
+Squeeze any axis in an array.
+For example: If arr->shape is (3, 1) then
+smExpandAxis(arr, 1)->shape will be (3, ) and so on...
+*/
+Array *smSqueeze(Array *arr, int axis)
+{
+    if (axis < 0)
+        axis = arr->ndim + axis;
+
+    if (axis < 0 || axis > arr->ndim)
+    {
+        fprintf(stderr, ">> error: axis out of bounds for expanding.\n");
+        exit(1);
+    }
+    if (arr->ndim == 1)
+    {
+        fprintf(stderr, ">> error: cannot squeeze Array with ndim 1.\n");
+        exit(1);
+    }
+
+    printf("axis is %d\n", axis);
+    int new_ndim = arr->ndim - 1;
+    int *new_shape = (int *)malloc(new_ndim * sizeof(int));
+    _checkNull(new_shape);
+
+    // copy into new shape
+    int j = 0;
+    for (int i = 0; i < arr->ndim; i++)
+    {
+        if (i == axis && arr->shape[i] != 1)
+        {
+            fprintf(stderr, ">> error: dimension of the axis to squeeze must be 1.\n");
+            exit(1);
+        }
+        else if (i == axis && arr->shape[i] == 1)
+            continue;
+        else
+        {
+            new_shape[j] = arr->shape[i];
+            j++;
+        }
+    }
+
+    // copy data
+    Array *result = smCreate(new_shape, new_ndim);
+    __copyToBuffer__(result->data, arr);
+
+    free(new_shape);
+    return result;
+}
+
+/*
+check that all `count` Arrays can be joined along `axis` and return the
+(normalized) axis. every axis other than `axis` has to match.
+*/
+int __checkJoinable__(Array **arrays, int count, int axis)
+{
+    if (count <= 0)
+    {
+        fprintf(stderr, ">> error: need at least one Array to join.\n");
+        exit(1);
+    }
+
+    Array *first = arrays[0];
+    if (axis < 0)
+        axis = first->ndim + axis;
+    if (axis < 0 || axis >= first->ndim)
+    {
+        fprintf(stderr, ">> error: axis out of bounds for joining.\n");
+        exit(1);
+    }
+
+    for (int i = 1; i < count; i++)
+    {
+        bool ok = (arrays[i]->ndim == first->ndim);
+        for (int d = 0; d < first->ndim && ok; d++)
+            ok = (d == axis || arrays[i]->shape[d] == first->shape[d]);
+
+        if (!ok)
+        {
+            fprintf(stderr, ">> error: Array %d has an incompatible shape for joining.\n", i);
+            exit(1);
+        }
+    }
+
+    return axis;
+}
+
+/*
+join a sequence of Arrays along an existing axis (numpy's `concatenate`).
+
+the output shape is computed once and every input is copied into its
+slab of the output through the strided copy engine: contiguous inputs
+joined along axis 0 are a single memcpy each, along inner axes they are
+memcpy'd row runs. many small inputs are spread over threads one input
+per thread, few big inputs are each copied by all threads.
+*/
+Array *smConcat(Array **arrays, int count, int axis)
+{
+    axis = __checkJoinable__(arrays, count, axis);
+
+    Array *first = arrays[0];
+    int shape[SM_MAXDIMS];
+    for (int d = 0; d < first->ndim; d++)
+        shape[d] = first->shape[d];
+
+    // where each input starts along the axis
+    int *offsets = (int *)malloc(count * sizeof(int));
+    _checkNull(offsets);
+
+    long total = 0;
+    shape[axis] = 0;
+    for (int i = 0; i < count; i++)
+    {
+        offsets[i] = shape[axis];
+        shape[axis] += arrays[i]->shape[axis];
+        total += arrays[i]->totalsize;
+    }
+
+    Array *res = smCreate(shape, first->ndim);
+
+#ifdef PARALLEL
+#pragma omp parallel for schedule(dynamic) if (count > 1 && total / count < SM_PARALLEL_MIN)
+#endif
+    for (int i = 0; i < count; i++)
+    {
+        Array *src = arrays[i];
+        if (src->totalsize == 0)
+            continue;
+
+        // the slab of the output this input goes to
+        float *data = (float *)((char *)res->data + (long)offsets[i] * res->strides[axis]);
+        Array *slab = __createView__(res, data, src->shape, res->strides, res->ndim);
+
+        __copyStrided__(slab, src);
+        smCleanup(slab);
+    }
+
+    free(offsets);
+    return res;
+}
+
+/*
+join a sequence of Arrays of the same shape along a new axis
+(numpy's `stack`). each input is seen as a view with a length-1 axis
+inserted at `axis`, then concatenated.
+*/
+Array *smStack(Array **arrays, int count, int axis)
+{
+    if (count <= 0)
+    {
+        fprintf(stderr, ">> error: need at least one Array to stack.\n");
+        exit(1);
+    }
+
+    int ndim = arrays[0]->ndim + 1;
+    if (axis < 0)
+        axis = ndim + axis;
+    if (axis < 0 || axis >= ndim)
+    {
+        fprintf(stderr, ">> error: axis out of bounds for stacking.\n");
+        exit(1);
+    }
+
+    Array **expanded = (Array **)malloc(count * sizeof(Array *));
+    _checkNull(expanded);
+
+    for (int i = 0; i < count; i++)
+    {
+        Array *arr = arrays[i];
+        if (!smCheckShapesEqual(arr, arrays[0]))
+        {
+            fprintf(stderr, ">> error: all Arrays must have the same shape for stacking.\n");
+            exit(1);
+        }
+
+        int shape[SM_MAXDIMS], strides[SM_MAXDIMS];
+        for (int d = 0, j = 0; d < ndim; d++)
+        {
+            if (d == axis)
+            {
+                shape[d] = 1;
+                strides[d] = arr->itemsize;
+                continue;
+            }
+            shape[d] = arr->shape[j];
+            strides[d] = arr->strides[j];
+            j++;
+        }
+        expanded[i] = __createView__(arr, arr->data, shape, strides, ndim);
+    }
+
+    Array *res = smConcat(expanded, count, axis);
+
+    for (int i = 0; i < count; i++)
+        smCleanup(expanded[i]);
+    free(expanded);
+
+    return res;
+}
+
+/*
+split an Array into `sections` zero-copy views along `axis`
+(numpy's `array_split`): if the axis does not divide evenly, the first
+`len % sections` views get one extra element.
+
+returns a malloc'd list of `sections` views, free every view with
+`smCleanup` and the list with `free`. the views share the buffer of `arr`.
+*/
+Array **smSplit(Array *arr, int sections, int axis)
+{
+    if (axis < 0)
+        axis = arr->ndim + axis;
+    if (axis < 0 || axis >= arr->ndim)
+    {
+        fprintf(stderr, ">> error: axis out of bounds for splitting.\n");
+        exit(1);
+    }
+    if (sections <= 0)
+    {
+        fprintf(stderr, ">> error: number of sections must be positive.\n");
+        exit(1);
+    }
+
+    Array **parts = (Array **)malloc(sections * sizeof(Array *));
+    _checkNull(parts);
+
+    SmSlice slices[SM_MAXDIMS];
+    for (int d = 0; d < arr->ndim; d++)
+        slices[d] = SM_ALL;
+
+    int len = arr->shape[axis];
+    int start = 0;
+    for (int i = 0; i < sections; i++)
+    {
+        int size = len / sections + ((i < len % sections) ? 1 : 0);
+        slices[axis] = SM_SLICE(start, start + size, 1);
+        parts[i] = smSlice(arr, slices);
+        start += size;
+    }
+
+    return parts;
+}
+
+// ------------------- Indexing -------------------
+
+/*
+true if `v` is a whole number in [lo, hi), checked before any cast to
+int (NaNs and values out of the int range are undefined there)
+*/
+static inline bool __isWholeIn__(float v, double lo, double hi)
+{
+    return v >= lo && v < hi && v == floorf(v);
+}
+
+/*
+read an Array of (integral) float indices into a malloc'd int buffer,
+in logical order. negative indices count from the end of an axis of
+length `len`, anything outside [-len, len) or not a whole number is an
+error.
+*/
+int *__indicesFromArray__(Array *indices, int len)
+{
+    int *idx = (int *)malloc((size_t)indices->totalsize * sizeof(int));
+    _checkNull(idx);
+
+    float *values = (float *)malloc((size_t)indices->totalsize * sizeof(float));
+    _checkNull(values);
+    __copyToBuffer__(values, indices);
+
+    bool bad = false;
+    for (int i = 0; i < indices->totalsize; i++)
+    {
+        if (!__isWholeIn__(values[i], -(double)len, (double)len))
+        {
+            bad = true;
+            continue;
+        }
+        int index = (int)values[i];
+        idx[i] = (index < 0) ? index + len : index;
+    }
+    free(values);
+
+    if (bad)
+    {
+        fprintf(stderr, ">> error: index out of bounds or not a whole number for axis with size %d.\n", len);
+        exit(1);
+    }
+
+    return idx;
+}
+
+/*
+dst[i] = src[idx[i]] for a contiguous source.
+uses the hardware gather instructions when available (16 lanes with
+AVX-512, 8 with AVX2).
+*/
+void __gatherFloats__(float *dst, const float *src, const int *idx, long n)
+{
+    long i = 0;
+#if defined(__AVX512F__)
+    for (; i + 16 <= n; i += 16)
+    {
+        __m512i vi = _mm512_loadu_si512((const void *)(idx + i));
+        _mm512_storeu_ps(dst + i, _mm512_i32gather_ps(vi, src, 4));
+    }
+#elif defined(__AVX2__)
+    for (; i + 8 <= n; i += 8)
+    {
+        __m256i vi = _mm256_loadu_si256((const __m256i *)(idx + i));
+        _mm256_storeu_ps(dst + i, _mm256_i32gather_ps(src, vi, 4));
+    }
+#endif
+    for (; i < n; i++)
+        dst[i] = src[idx[i]];
+}
+
+/*
+C-contiguous version of `arr`: arr itself if it already is, otherwise
+a copy (the caller cleans it up when it differs from `arr`)
+*/
+Array *__asContiguous__(Array *arr)
+{
+    return __isContiguousC__(arr) ? arr : smContiguous(arr);
+}
+
+/*
+take elements along an axis (numpy's `take`).
+
+the result has shape arr.shape[:axis] + indices.shape + arr.shape[axis+1:].
+everything after `axis` is a contiguous row that is memcpy'd as a whole,
+which for axis 0 turns an embedding lookup into one memcpy per index.
+gathering along the last axis uses SIMD gathers.
+*/
+Array *smTake(Array *arr, Array *indices, int axis)
+{
+    if (axis < 0)
+        axis = arr->ndim + axis;
+    if (axis < 0 || axis >= arr->ndim)
+    {
+        fprintf(stderr, ">> error: axis out of bounds for take.\n");
+        exit(1);
+    }
+
+    int len = arr->shape[axis];
+    int *idx = __indicesFromArray__(indices, len);
+    long n = indices->totalsize;
+
+    long outer = 1, inner = 1;
+    for (int d = 0; d < axis; d++)
+        outer *= arr->shape[d];
+    for (int d = axis + 1; d < arr->ndim; d++)
+        inner *= arr->shape[d];
+
+    int res_ndim = arr->ndim - 1 + indices->ndim;
+    int res_shape[SM_MAXDIMS];
+    int k = 0;
+    for (int d = 0; d < axis; d++)
+        res_shape[k++] = arr->shape[d];
+    for (int d = 0; d < indices->ndim; d++)
+        res_shape[k++] = indices->shape[d];
+    for (int d = axis + 1; d < arr->ndim; d++)
+        res_shape[k++] = arr->shape[d];
+
+    Array *res = smCreate(res_shape, res_ndim);
+    Array *src = __asContiguous__(arr);
+
+    if (inner == 1)
+    {
+#ifdef PARALLEL
+#pragma omp parallel for if (outer * n >= SM_PARALLEL_MIN)
+#endif
+        for (long o = 0; o < outer; o++)
+            __gatherFloats__(res->data + o * n, src->data + o * len, idx, n);
+    }
+    else
+    {
+#ifdef PARALLEL
+#pragma omp parallel for if (outer * n * inner >= SM_PARALLEL_MIN)
+#endif
+        for (long r = 0; r < outer * n; r++)
+        {
+            long o = r / n, j = r % n;
+            memcpy(res->data + r * inner,
+                   src->data + (o * len + idx[j]) * inner,
+                   inner * sizeof(float));
+        }
+    }
+
+    if (src != arr)
+        smCleanup(src);
+    free(idx);
+
+    return res;
+}
+
+/*
+pick values along an axis with one index per output element
+(numpy's `take_along_axis`). `indices` has the shape of `arr` except
+along `axis`, where it can have any length; the result has its shape.
+a typical use is gathering the top-k scores from argsort/argmax results.
+*/
+Array *smTakeAlongAxis(Array *arr, Array *indices, int axis)
+{
+    if (axis < 0)
+        axis = arr->ndim + axis;
+    if (axis < 0 || axis >= arr->ndim || indices->ndim != arr->ndim)
+    {
+        fprintf(stderr, ">> error: invalid axis or indices for take along axis.\n");
+        exit(1);
+    }
+    for (int d = 0; d < arr->ndim; d++)
+    {
+        if (d != axis && indices->shape[d] != arr->shape[d])
+        {
+            fprintf(stderr, ">> error: indices must match the Array shape except along the axis.\n");
+            exit(1);
+        }
+    }
+
+    int len = arr->shape[axis];
+    int *idx = __indicesFromArray__(indices, len);
+    long n = indices->shape[axis];
+
+    long outer = 1, inner = 1;
+    for (int d = 0; d < axis; d++)
+        outer *= arr->shape[d];
+    for (int d = axis + 1; d < arr->ndim; d++)
+        inner *= arr->shape[d];
+
+    Array *res = smCreate(indices->shape, indices->ndim);
+    Array *src = __asContiguous__(arr);
+
+    if (inner == 1)
+    {
+#ifdef PARALLEL
+#pragma omp parallel for if (outer * n >= SM_PARALLEL_MIN)
+#endif
+        for (long o = 0; o < outer; o++)
+            __gatherFloats__(res->data + o * n, src->data + o * len, idx + o * n, n);
+    }
+    else
+    {
+#ifdef PARALLEL
+#pragma omp parallel for if (outer * n * inner >= SM_PARALLEL_MIN)
+#endif
+        for (long r = 0; r < outer * n; r++)
+        {
+            long o = r / n;
+            const int *ri = idx + r * inner;
+            const float *base = src->data + o * len * inner;
+            float *dst = res->data + r * inner;
+            for (long i = 0; i < inner; i++)
+                dst[i] = base[ri[i] * inner + i];
+        }
+    }
+
+    if (src != arr)
+        smCleanup(src);
+    free(idx);
+
+    return res;
+}
+
+/*
+out[..., indices[j], ...] += src[..., j, ...] along `axis`, inplace
+(torch's `index_add_`). `indices` is a list of n positions, `src` has the
+shape of `out` with n along `axis`. repeated indices accumulate, in the
+order of `indices`. a non-contiguous `out` is updated through a copy.
+
+threads never write the same element: with long rows the row is split
+into column ranges, one per thread. otherwise the updates are bucketed
+by destination row (a stable counting sort) and every thread owns a
+contiguous range of destination rows and only walks their updates.
+a single thread just streams the updates in order.
+*/
+void smScatterAdd(Array *out, Array *indices, Array *src, int axis)
+{
+    if (axis < 0)
+        axis = out->ndim + axis;
+    if (axis < 0 || axis >= out->ndim || src->ndim != out->ndim)
+    {
+        fprintf(stderr, ">> error: invalid axis or source for scatter add.\n");
+        exit(1);
+    }
+    for (int d = 0; d < out->ndim; d++)
+    {
+        if (d != axis && src->shape[d] != out->shape[d])
+        {
+            fprintf(stderr, ">> error: source must match the output shape except along the axis.\n");
+            exit(1);
+        }
+    }
+    if (src->shape[axis] != indices->totalsize)
+    {
+        fprintf(stderr, ">> error: need one index per source entry along the axis.\n");
+        exit(1);
+    }
+
+    int len = out->shape[axis];
+    int *idx = __indicesFromArray__(indices, len);
+    long n = indices->totalsize;
+
+    long outer = 1, inner = 1;
+    for (int d = 0; d < axis; d++)
+        outer *= out->shape[d];
+    for (int d = axis + 1; d < out->ndim; d++)
+        inner *= out->shape[d];
+
+    // split columns when each thread still gets a decent run of them,
+    // else rows, which needs the updates bucketed by destination row
+    int maxthreads = 1;
+#ifdef PARALLEL
+    if (outer * n * inner >= SM_PARALLEL_MIN)
+        maxthreads = omp_get_max_threads();
+#endif
+    bool by_columns = (inner >= 64L * maxthreads);
+    bool bucketed = (maxthreads > 1 && !by_columns);
+
+    // rows[] holds the distinct destination rows, the updates of rows[u]
+    // are order[first[u]] .. order[first[u + 1] - 1]
+    long *count = NULL, *order = NULL, *first = NULL, nrows = 0;
+    int *rows = NULL;
+    if (bucketed)
+    {
+        count = (long *)calloc((size_t)len + 1, sizeof(long));
+        order = (long *)malloc((n + 1) * sizeof(long));
+        first = (long *)malloc((n + 1) * sizeof(long));
+        rows = (int *)malloc((n + 1) * sizeof(int));
+        _checkNull(count);
+        _checkNull(order);
+        _checkNull(first);
+        _checkNull(rows);
+
+        for (long j = 0; j < n; j++)
+            count[idx[j] + 1]++;
+        for (int r = 0; r < len; r++)
+        {
+            if (count[r + 1] > 0)
+            {
+                rows[nrows] = r;
+                first[nrows++] = count[r];
+            }
+            count[r + 1] += count[r];
+        }
+        first[nrows] = n;
+        for (long j = 0; j < n; j++)
+            order[count[idx[j]]++] = j;
+    }
+
+    Array *dst = __asContiguous__(out);
+    Array *s = __asContiguous__(src);
+
+#ifdef PARALLEL
+#pragma omp parallel num_threads(maxthreads) if (maxthreads > 1)
+#endif
+    {
+        int nthreads = 1, tid = 0;
+#ifdef PARALLEL
+        nthreads = omp_get_num_threads();
+        tid = omp_get_thread_num();
+#endif
+        long c0 = by_columns ? inner * tid / nthreads : 0;
+        long c1 = by_columns ? inner * (tid + 1) / nthreads : inner;
+
+        if (bucketed)
+        {
+            long total = outer * nrows;
+            for (long t = total * tid / nthreads; t < total * (tid + 1) / nthreads; t++)
+            {
+                long o = t / nrows, u = t % nrows;
+                float *row = dst->data + (o * len + rows[u]) * inner;
+                for (long b = first[u]; b < first[u + 1]; b++)
+                {
+                    const float *from = s->data + (o * n + order[b]) * inner;
+                    for (long i = c0; i < c1; i++)
+                        row[i] += from[i];
+                }
+            }
+        }
+        else
+        {
+            // src is streamed in order, rows are hit at random
+            for (long o = 0; o < outer; o++)
+            {
+                for (long j = 0; j < n; j++)
+                {
+                    float *row = dst->data + (o * len + idx[j]) * inner;
+                    const float *from = s->data + (o * n + j) * inner;
+                    for (long i = c0; i < c1; i++)
+                        row[i] += from[i];
+                }
+            }
+        }
+    }
+
+    if (dst != out)
+    {
+        __copyStrided__(out, dst);
+        smCleanup(dst);
+    }
+    if (s != src)
+        smCleanup(s);
+    free(rows);
+    free(first);
+    free(order);
+    free(count);
+    free(idx);
+}
+
+/*
+elements of `arr` where `mask` is non-zero, as a 1D Array in C order
+(numpy's `arr[mask]`). `mask` has the shape of `arr`.
+
+two passes over blocks: count the selected elements of every block,
+turn the counts into output offsets, then every block writes its
+elements to its own range of the output.
+*/
+Array *smMaskSelect(Array *arr, Array *mask)
+{
+    if (!smCheckShapesEqual(arr, mask))
+    {
+        fprintf(stderr, ">> error: mask must have the shape of the Array.\n");
+        exit(1);
+    }
+
+    Array *a = __asContiguous__(arr);
+    Array *m = __asContiguous__(mask);
+
+    long total = a->totalsize;
+    long nblocks = (total + SM_CHUNK - 1) / SM_CHUNK;
+    long *offsets = (long *)calloc(nblocks + 1, sizeof(long));
+    _checkNull(offsets);
+
+#ifdef PARALLEL
+#pragma omp parallel for if (total >= SM_PARALLEL_MIN)
+#endif
+    for (long blk = 0; blk < nblocks; blk++)
+    {
+        long lo = blk * SM_CHUNK, hi = (lo + SM_CHUNK < total) ? lo + SM_CHUNK : total;
+        long count = 0;
+        for (long i = lo; i < hi; i++)
+            count += (m->data[i] != 0.0f);
+        offsets[blk + 1] = count;
+    }
+    for (long blk = 0; blk < nblocks; blk++)
+        offsets[blk + 1] += offsets[blk];
+
+    int res_shape[] = {(int)offsets[nblocks]};
+    Array *res = smCreate(res_shape, 1);
+
+#ifdef PARALLEL
+#pragma omp parallel for if (total >= SM_PARALLEL_MIN)
+#endif
+    for (long blk = 0; blk < nblocks; blk++)
+    {
+        long lo = blk * SM_CHUNK, hi = (lo + SM_CHUNK < total) ? lo + SM_CHUNK : total;
+        float *dst = res->data + offsets[blk];
+        for (long i = lo; i < hi; i++)
+            if (m->data[i] != 0.0f)
+                *dst++ = a->data[i];
+    }
+
+    free(offsets);
+    if (a != arr)
+        smCleanup(a);
+    if (m != mask)
+        smCleanup(m);
+
+    return res;
+}
+
+/*
+Dot product between two vectors i.e. Arrays with dimension 1.
+Returns: Array with shape {1} i.e. only one element.
+*/
+Array *smDot(Array *a, Array *b)
+{
+    if (a->ndim != 1 || b->ndim != 1)
+    {
+        fprintf(stderr, ">> error: both arrays should be vectors for dot product.");
+        exit(1);
+    }
+    if (a->shape[0] != b->shape[0])
+    {
+        fprintf(stderr, ">> error: both vectors should have the same shape for dot product.");
+        exit(1);
+    }
+
+    // a reduction of a 1D product to one element: per-thread partials,
+    // each folded with the multi-accumulator dot kernel
+    return smDotAxis(a, b, 0);
+}
+
+// ------------------- Activations -------------------
+
+#if defined(__AVX2__) && defined(__FMA__)
+/*
+exp of 8 floats (cephes expf): x = n * ln2 + r with |r| <= ln2 / 2,
+exp(r) from a degree 6 polynomial, 2^n built directly in the exponent
+bits. inputs are clamped to the range where the result is finite and
+normal, below it the result is 0. NaN stays NaN.
+*/
+static inline __m256 __exp256__(__m256 x)
+{
+    __m256 x0 = x;
+    __m256 underflow = _mm256_cmp_ps(x, _mm256_set1_ps(-87.3f), _CMP_LT_OQ);
+    x = _mm256_min_ps(_mm256_max_ps(x, _mm256_set1_ps(-87.3f)), _mm256_set1_ps(88.3f));
+
+    __m256 n = _mm256_round_ps(
+        _mm256_mul_ps(x, _mm256_set1_ps(1.44269504f)), _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+    // ln2 in two parts so n * ln2 is subtracted without rounding error
+    __m256 r = _mm256_fnmadd_ps(n, _mm256_set1_ps(0.693359375f), x);
+    r = _mm256_fnmadd_ps(n, _mm256_set1_ps(-2.12194440e-4f), r);
+
+    __m256 y = _mm256_set1_ps(1.9875691500e-4f);
+    y = _mm256_fmadd_ps(y, r, _mm256_set1_ps(1.3981999507e-3f));
+    y = _mm256_fmadd_ps(y, r, _mm256_set1_ps(8.3334519073e-3f));
+    y = _mm256_fmadd_ps(y, r, _mm256_set1_ps(4.1665795894e-2f));
+    y = _mm256_fmadd_ps(y, r, _mm256_set1_ps(1.6666665459e-1f));
+    y = _mm256_fmadd_ps(y, r, _mm256_set1_ps(5.0000001201e-1f));
+    y = _mm256_fmadd_ps(y, _mm256_mul_ps(r, r), _mm256_add_ps(r, _mm256_set1_ps(1.0f)));
+
+    __m256i pow2n = _mm256_slli_epi32(_mm256_add_epi32(_mm256_cvtps_epi32(n), _mm256_set1_epi32(127)), 23);
+    y = _mm256_andnot_ps(underflow, _mm256_mul_ps(y, _mm256_castsi256_ps(pow2n)));
+
+    // the clamp above turned NaN into -87.3, put it back
+    return _mm256_blendv_ps(y, x0, _mm256_cmp_ps(x0, x0, _CMP_UNORD_Q));
+}
+
+/*
+tanh of 8 floats: an odd polynomial below 0.625 (cephes tanhf), where
+1 - 2 / (exp(2|x|) + 1) would lose the relative precision, that
+formula with the sign put back above.
+*/
+static inline __m256 __tanh256__(__m256 x)
+{
+    __m256 sign = _mm256_and_ps(x, _mm256_set1_ps(-0.0f));
+    __m256 ax = _mm256_andnot_ps(_mm256_set1_ps(-0.0f), x);
+
+    __m256 z = _mm256_mul_ps(x, x);
+    __m256 p = _mm256_set1_ps(-5.70498872745e-3f);
+    p = _mm256_fmadd_ps(p, z, _mm256_set1_ps(2.06390887954e-2f));
+    p = _mm256_fmadd_ps(p, z, _mm256_set1_ps(-5.37397155531e-2f));
+    p = _mm256_fmadd_ps(p, z, _mm256_set1_ps(1.33314422036e-1f));
+    p = _mm256_fmadd_ps(p, z, _mm256_set1_ps(-3.33332819422e-1f));
+    __m256 small = _mm256_fmadd_ps(_mm256_mul_ps(p, z), x, x);
+
+    __m256 e = __exp256__(_mm256_add_ps(ax, ax));
+    __m256 large = _mm256_sub_ps(
+        _mm256_set1_ps(1.0f), _mm256_div_ps(_mm256_set1_ps(2.0f), _mm256_add_ps(e, _mm256_set1_ps(1.0f))));
+    large = _mm256_or_ps(large, sign);
+
+    return _mm256_blendv_ps(large, small, _mm256_cmp_ps(ax, _mm256_set1_ps(0.625f), _CMP_LT_OQ));
+}
+
+static inline __m256 __activate256__(__m256 x, Activation act)
+{
+    if (act == SM_ACT_RELU)
+        return _mm256_max_ps(x, _mm256_setzero_ps());
+    if (act == SM_ACT_SIGMOID)
+    {
+        __m256 e = __exp256__(_mm256_sub_ps(_mm256_setzero_ps(), x));
+        return _mm256_div_ps(_mm256_set1_ps(1.0f), _mm256_add_ps(e, _mm256_set1_ps(1.0f)));
+    }
+    if (act == SM_ACT_TANH)
+        return __tanh256__(x);
+    if (act == SM_ACT_GELU)
+    {
+        // 0.5 x (1 + tanh(u)) = x / (1 + exp(-2u)), u = sqrt(2 / pi) (x + 0.044715 x^3)
+        __m256 x3 = _mm256_mul_ps(_mm256_mul_ps(x, x), x);
+        __m256 u2 = _mm256_mul_ps(_mm256_fmadd_ps(x3, _mm256_set1_ps(0.044715f), x), _mm256_set1_ps(-1.5957691216f));
+        return _mm256_div_ps(x, _mm256_add_ps(__exp256__(u2), _mm256_set1_ps(1.0f)));
+    }
+    return x;
+}
+#endif
+
+/*
+one activation, for strided elements and builds without AVX2
+*/
+float __activation__(float x, Activation act)
+{
+    if (act == SM_ACT_RELU)
+        return (x > 0.0f) ? x : 0.0f;
+    if (act == SM_ACT_SIGMOID)
+        return 1.0f / (1.0f + expf(-x));
+    if (act == SM_ACT_TANH)
+        return tanhf(x);
+    if (act == SM_ACT_GELU)
+        return x / (1.0f + expf(-1.5957691216f * (x + 0.044715f * x * x * x)));
+    return x;
+}
+
+/*
+apply an activation in place to `n` contiguous floats. the tail goes
+through the vector code too (padded), so every element of a row gets
+exactly the same function.
+*/
+void __activate__(float *x, long n, Activation act)
+{
+    if (act == SM_ACT_NONE)
+        return;
+
+#if defined(__AVX2__) && defined(__FMA__)
+    long i = 0;
+    for (; i + 8 <= n; i += 8)
+        _mm256_storeu_ps(x + i, __activate256__(_mm256_loadu_ps(x + i), act));
+    if (i < n)
+    {
+        float tail[8] = {0};
+        memcpy(tail, x + i, (n - i) * sizeof(float));
+        _mm256_storeu_ps(tail, __activate256__(_mm256_loadu_ps(tail), act));
+        memcpy(x + i, tail, (n - i) * sizeof(float));
+    }
+#else
+    for (long i = 0; i < n; i++)
+        x[i] = __activation__(x[i], act);
+#endif
+}
+
+// ------------------- Blocked GEMM -------------------
+
+/*
+C = alpha * A @ B + beta * C for (m, n) @ (n, p) operands with arbitrary
+element strides, blocked the usual way for caches:
+
+- B is cut into (SM_KC, SM_NC) slices, packed into SM_NR-wide column
+  panels that the microkernel streams from L1
+- A is packed into SM_MR-high row panels, SM_MC rows of them (one
+  block) stay in L2 while they are reused against every panel of B
+- the microkernel keeps an SM_MR x SM_NR tile of C in registers for the
+  whole SM_KC run, so C is touched once per slice
+
+packing also takes care of the layout, the kernels only ever see unit
+strides, whatever the operands look like.
+
+`uplo` restricts the work to one triangle of a square C (1: upper,
+-1: lower, 0: everything). tiles entirely on the other side of the
+diagonal are skipped, tiles crossing it are computed in full.
+*/
+void __sgemmKernel__(long kc, const float *ap, const float *bp, float *tile)
+{
+#if defined(__AVX2__) && defined(__FMA__)
+    __m256 c00 = _mm256_setzero_ps(), c01 = _mm256_setzero_ps();
+    __m256 c10 = _mm256_setzero_ps(), c11 = _mm256_setzero_ps();
+    __m256 c20 = _mm256_setzero_ps(), c21 = _mm256_setzero_ps();
+    __m256 c30 = _mm256_setzero_ps(), c31 = _mm256_setzero_ps();
+    __m256 c40 = _mm256_setzero_ps(), c41 = _mm256_setzero_ps();
+    __m256 c50 = _mm256_setzero_ps(), c51 = _mm256_setzero_ps();
+
+    for (long kk = 0; kk < kc; kk++)
+    {
+        __m256 b0 = _mm256_loadu_ps(bp);
+        __m256 b1 = _mm256_loadu_ps(bp + 8);
+        __m256 av;
+
+        av = _mm256_broadcast_ss(ap);
+        c00 = _mm256_fmadd_ps(av, b0, c00);
+        c01 = _mm256_fmadd_ps(av, b1, c01);
+        av = _mm256_broadcast_ss(ap + 1);
+        c10 = _mm256_fmadd_ps(av, b0, c10);
+        c11 = _mm256_fmadd_ps(av, b1, c11);
+        av = _mm256_broadcast_ss(ap + 2);
+        c20 = _mm256_fmadd_ps(av, b0, c20);
+        c21 = _mm256_fmadd_ps(av, b1, c21);
+        av = _mm256_broadcast_ss(ap + 3);
+        c30 = _mm256_fmadd_ps(av, b0, c30);
+        c31 = _mm256_fmadd_ps(av, b1, c31);
+        av = _mm256_broadcast_ss(ap + 4);
+        c40 = _mm256_fmadd_ps(av, b0, c40);
+        c41 = _mm256_fmadd_ps(av, b1, c41);
+        av = _mm256_broadcast_ss(ap + 5);
+        c50 = _mm256_fmadd_ps(av, b0, c50);
+        c51 = _mm256_fmadd_ps(av, b1, c51);
+
+        ap += SM_MR;
+        bp += SM_NR;
+    }
+
+    _mm256_storeu_ps(tile + 0 * SM_NR, c00);
+    _mm256_storeu_ps(tile + 0 * SM_NR + 8, c01);
+    _mm256_storeu_ps(tile + 1 * SM_NR, c10);
+    _mm256_storeu_ps(tile + 1 * SM_NR + 8, c11);
+    _mm256_storeu_ps(tile + 2 * SM_NR, c20);
+    _mm256_storeu_ps(tile + 2 * SM_NR + 8, c21);
+    _mm256_storeu_ps(tile + 3 * SM_NR, c30);
+    _mm256_storeu_ps(tile + 3 * SM_NR + 8, c31);
+    _mm256_storeu_ps(tile + 4 * SM_NR, c40);
+    _mm256_storeu_ps(tile + 4 * SM_NR + 8, c41);
+    _mm256_storeu_ps(tile + 5 * SM_NR, c50);
+    _mm256_storeu_ps(tile + 5 * SM_NR + 8, c51);
+#else
+    float acc[SM_MR][SM_NR] = {{0}};
+    for (long kk = 0; kk < kc; kk++)
+    {
+        for (int r = 0; r < SM_MR; r++)
+            for (int j = 0; j < SM_NR; j++)
+                acc[r][j] += ap[r] * bp[j];
+        ap += SM_MR;
+        bp += SM_NR;
+    }
+    memcpy(tile, acc, sizeof(acc));
+#endif
+}
+
+// copy `rows` rows of A into SM_MR-high panels, zero padded
+void __sgemmPackA__(int rows, int kc, const float *a, long rsa, long csa, float *ap)
+{
+    for (int i0 = 0; i0 < rows; i0 += SM_MR)
+    {
+        int mr = (rows - i0 < SM_MR) ? rows - i0 : SM_MR;
+        for (int kk = 0; kk < kc; kk++)
+        {
+            const float *src = a + i0 * rsa + kk * csa;
+            int r = 0;
+            for (; r < mr; r++)
+                ap[r] = src[r * rsa];
+            for (; r < SM_MR; r++)
+                ap[r] = 0.0f;
+            ap += SM_MR;
+        }
+    }
+}
+
+// copy SM_NR-wide column panels of B, zero padded
+void __sgemmPackB__(int kc, int cols, const float *b, long rsb, long csb, float *bp)
+{
+    for (int kk = 0; kk < kc; kk++)
+    {
+        const float *src = b + kk * rsb;
+        float *dst = bp + (long)kk * SM_NR;
+        int nr = (cols < SM_NR) ? cols : SM_NR;
+        int j = 0;
+        if (csb == 1)
+            for (; j < nr; j++)
+                dst[j] = src[j];
+        else
+            for (; j < nr; j++)
+                dst[j] = src[j * csb];
+        for (; j < SM_NR; j++)
+            dst[j] = 0.0f;
+    }
+}
+
+// add an (mr, nr) part of a tile into C
+void __sgemmStore__(
+    float *c, long rsc, long csc, const float *tile,
+    int mr, int nr, float alpha, float beta, bool first)
+{
+    for (int r = 0; r < mr; r++)
+    {
+        float *dst = c + r * rsc;
+        const float *src = tile + r * SM_NR;
+        if (!first || beta == 1.0f)
+            for (int j = 0; j < nr; j++)
+                dst[j * csc] += alpha * src[j];
+        else if (beta == 0.0f)
+            for (int j = 0; j < nr; j++)
+                dst[j * csc] = alpha * src[j];
+        else
+            for (int j = 0; j < nr; j++)
+                dst[j * csc] = beta * dst[j * csc] + alpha * src[j];
+    }
+}
+
+/*
+the microkernel for the accurate accumulation modes: the tile is
+accumulated in double, or in float with a compensation term per
+element (see `__dotAcc__`). loops run across the tile so they vectorize
+without reassociating anything.
+*/
+void __sgemmKernelAcc__(long kc, const float *ap, const float *bp, double *tile, Accumulation mode)
+{
+    if (mode == SM_ACCUM_DOUBLE)
+    {
+        double acc[SM_MR][SM_NR] = {{0}};
+        for (long kk = 0; kk < kc; kk++)
+        {
+            for (int r = 0; r < SM_MR; r++)
+            {
+                double ar = ap[r];
+                for (int j = 0; j < SM_NR; j++)
+                    acc[r][j] += ar * bp[j];
+            }
+            ap += SM_MR;
+            bp += SM_NR;
+        }
+        memcpy(tile, acc, sizeof(acc));
+        return;
+    }
+
+    float sum[SM_MR][SM_NR] = {{0}}, err[SM_MR][SM_NR] = {{0}};
+    for (long kk = 0; kk < kc; kk++)
+    {
+        for (int r = 0; r < SM_MR; r++)
+        {
+            for (int j = 0; j < SM_NR; j++)
+            {
+                float prod = ap[r] * bp[j];
+                float t = sum[r][j] + prod;
+                float z = t - sum[r][j];
+                err[r][j] += (sum[r][j] - (t - z)) + (prod - z);
+                sum[r][j] = t;
+            }
+        }
+        ap += SM_MR;
+        bp += SM_NR;
+    }
+    for (int r = 0; r < SM_MR; r++)
+        for (int j = 0; j < SM_NR; j++)
+            tile[r * SM_NR + j] = (double)sum[r][j] + err[r][j];
+}
+
+/*
+store a double tile: into C when the whole inner dimension fit in one
+slice, else into the double buffer `cacc` (leading dimension `ldacc`)
+that collects the slices and is written to C at the end.
+*/
+void __sgemmStoreAcc__(
+    float *c, long rsc, long csc, double *cacc, long ldacc,
+    const double *tile, int mr, int nr, float alpha, float beta)
+{
+    for (int r = 0; r < mr; r++)
+    {
+        const double *src = tile + r * SM_NR;
+        if (cacc)
+        {
+            for (int j = 0; j < nr; j++)
+                cacc[r * ldacc + j] += src[j];
+            continue;
+        }
+
+        float *dst = c + r * rsc;
+        for (int j = 0; j < nr; j++)
+            dst[j * csc] = (float)(alpha * src[j] + ((beta == 0.0f) ? 0.0 : (double)beta * dst[j * csc]));
+    }
+}
+
+/*
+bias (one per column, may be NULL) and activation on an (mr, nr) block
+of C, called on each tile right after its last store, while it is
+still in L1
+*/
+void __sgemmEpilogue__(float *c, long rsc, long csc, int mr, int nr, const float *bias, Activation act)
+{
+    if (!bias && act == SM_ACT_NONE)
+        return;
+
+    for (int r = 0; r < mr; r++)
+    {
+        float *row = c + r * rsc;
+        if (csc != 1)
+        {
+            for (int j = 0; j < nr; j++)
+                row[j * csc] = __activation__(row[j * csc] + (bias ? bias[j] : 0.0f), act);
+            continue;
+        }
+
+        if (bias)
+            for (int j = 0; j < nr; j++)
+                row[j] += bias[j];
+        __activate__(row, nr, act);
+    }
+}
+
+void __sgemm__(
+    int m, int n, int p, float alpha,
+    const float *a, long rsa, long csa,
+    const float *b, long rsb, long csb,
+    float beta, float *c, long rsc, long csc, int uplo, Accumulation mode)
+{
+    __sgemmFused__(m, n, p, alpha, a, rsa, csa, b, rsb, csb, beta, c, rsc, csc, uplo, NULL, SM_ACT_NONE, mode);
+}
+
+/*
+`__sgemm__` followed by `__sgemmEpilogue__` on every tile of C
+*/
+void __sgemmFused__(
+    int m, int n, int p, float alpha,
+    const float *a, long rsa, long csa,
+    const float *b, long rsb, long csb,
+    float beta, float *c, long rsc, long csc, int uplo,
+    const float *bias, Activation act, Accumulation mode)
+{
+    if (m == 0 || p == 0)
+        return;
+
+    if (n == 0)
+    {
+        // nothing to multiply, only the scaling of C is left
+        for (int i = 0; i < m; i++)
+            for (int j = 0; j < p; j++)
+                c[i * rsc + j * csc] = (beta == 0.0f) ? 0.0f : beta * c[i * rsc + j * csc];
+        __sgemmEpilogue__(c, rsc, csc, m, p, bias, act);
+        return;
+    }
+
+    int kcmax = (n < SM_KC) ? n : SM_KC;
+    int ncmax = (p < SM_NC) ? p : SM_NC;
+    long mpad = (m + SM_MR - 1) / SM_MR * SM_MR;
+    long npad = (ncmax + SM_NR - 1) / SM_NR * SM_NR;
+
+    float *ap = (float *)malloc(mpad * kcmax * sizeof(float));
+    float *bp = (float *)malloc(npad * kcmax * sizeof(float));
+    _checkNull(ap);
+    _checkNull(bp);
+
+    // accurate modes keep the sum over slices of the inner dimension in double
+    double *cacc = NULL;
+    if (mode != SM_ACCUM_FLOAT && n > SM_KC)
+    {
+        cacc = (double *)calloc((size_t)m * p, sizeof(double));
+        _checkNull(cacc);
+    }
+
+#ifdef PARALLEL
+    bool threaded = (double)m * n * p >= SM_PARALLEL_MIN;
+#endif
+
+    for (int jc = 0; jc < p; jc += SM_NC)
+    {
+        int nc = (p - jc < SM_NC) ? p - jc : SM_NC;
+        long npanels = (nc + SM_NR - 1) / SM_NR;
+
+        for (int pc = 0; pc < n; pc += SM_KC)
+        {
+            int kc = (n - pc < SM_KC) ? n - pc : SM_KC;
+            bool first = (pc == 0);
+            bool last = (pc + kc == n);
+
+#ifdef PARALLEL
+#pragma omp parallel for if (threaded)
+#endif
+            for (long jp = 0; jp < npanels; jp++)
+                __sgemmPackB__(
+                    kc, nc - (int)jp * SM_NR,
+                    b + pc * rsb + (jc + jp * SM_NR) * csb, rsb, csb,
+                    bp + jp * SM_NR * kc);
+
+            long mpanels = (m + SM_MR - 1) / SM_MR;
+#ifdef PARALLEL
+#pragma omp parallel for if (threaded)
+#endif
+            for (long ip = 0; ip < mpanels; ip++)
+                __sgemmPackA__(
+                    (m - ip * SM_MR < SM_MR) ? m - (int)ip * SM_MR : SM_MR, kc,
+                    a + ip * SM_MR * rsa + pc * csa, rsa, csa,
+                    ap + ip * SM_MR * kc);
+
+            // tasks: (block of SM_MC rows, group of SM_JG column panels)
+            long nblocks = (m + SM_MC - 1) / SM_MC;
+            long ngroups = (npanels + SM_JG - 1) / SM_JG;
+
+#ifdef PARALLEL
+#pragma omp parallel for schedule(dynamic) if (threaded)
+#endif
+            for (long t = 0; t < nblocks * ngroups; t++)
+            {
+                float tile[SM_MR * SM_NR];
+                long ib = t / ngroups, jg = t % ngroups;
+                long jp1 = (jg + 1) * SM_JG < npanels ? (jg + 1) * SM_JG : npanels;
+
+                for (long jp = jg * SM_JG; jp < jp1; jp++)
+                {
+                    int j0 = jc + (int)jp * SM_NR;
+                    int nr = (p - j0 < SM_NR) ? p - j0 : SM_NR;
+                    int i1 = (ib + 1) * SM_MC < m ? (int)(ib + 1) * SM_MC : m;
+
+                    for (int i0 = (int)ib * SM_MC; i0 < i1; i0 += SM_MR)
+                    {
+                        int mr = (m - i0 < SM_MR) ? m - i0 : SM_MR;
+                        if ((uplo > 0 && j0 + nr <= i0) || (uplo < 0 && i0 + mr <= j0))
+                            continue;
+
+                        if (mode == SM_ACCUM_FLOAT)
+                        {
+                            __sgemmKernel__(kc, ap + (long)i0 * kc, bp + jp * SM_NR * kc, tile);
+                            __sgemmStore__(c + i0 * rsc + j0 * csc, rsc, csc, tile, mr, nr, alpha, beta, first);
+                        }
+                        else
+                        {
+                            double dtile[SM_MR * SM_NR];
+                            __sgemmKernelAcc__(kc, ap + (long)i0 * kc, bp + jp * SM_NR * kc, dtile, mode);
+                            __sgemmStoreAcc__(
+                                c + i0 * rsc + j0 * csc, rsc, csc, cacc ? cacc + (long)i0 * p + j0 : NULL, p,
+                                dtile, mr, nr, alpha, beta);
+                        }
+
+                        if (last && !cacc)
+                            __sgemmEpilogue__(c + i0 * rsc + j0 * csc, rsc, csc, mr, nr, bias ? bias + j0 : NULL, act);
+                    }
+                }
+            }
+        }
+    }
+
+    if (cacc)
+    {
+#ifdef PARALLEL
+#pragma omp parallel for if ((long)m * p >= SM_PARALLEL_MIN)
+#endif
+        for (int i = 0; i < m; i++)
+        {
+            for (int j = 0; j < p; j++)
+            {
+                float *dst = c + i * rsc + j * csc;
+                *dst = (float)(alpha * cacc[(long)i * p + j] + ((beta == 0.0f) ? 0.0 : (double)beta * *dst));
+            }
+            __sgemmEpilogue__(c + i * rsc, rsc, csc, 1, p, bias, act);
+        }
+        free(cacc);
+    }
+
+    free(ap);
+    free(bp);
+}
+
+/*
+copy the computed triangle of a square (m, m) matrix over the other
+one, tile by tile so both sides are walked with cache-sized blocks.
+*/
+void __mirrorTriangle__(int m, float *c, long rsc, long csc, bool upper)
+{
+    long ntiles = (m + SM_TILE - 1) / SM_TILE;
+
+#ifdef PARALLEL
+#pragma omp parallel for schedule(dynamic) if ((long)m * m >= SM_PARALLEL_MIN)
+#endif
+    for (long ti = 0; ti < ntiles; ti++)
+    {
+        int i0 = (int)ti * SM_TILE, i1 = (i0 + SM_TILE < m) ? i0 + SM_TILE : m;
+        for (int j0 = 0; j0 <= i0; j0 += SM_TILE)
+        {
+            int j1 = (j0 + SM_TILE < m) ? j0 + SM_TILE : m;
+            for (int i = i0; i < i1; i++)
+                for (int j = j0; j < j1 && j < i; j++)
+                {
+                    // (i, j) is below the diagonal
+                    if (upper)
+                        c[i * rsc + j * csc] = c[j * rsc + i * csc];
+                    else
+                        c[j * rsc + i * csc] = c[i * rsc + j * csc];
+                }
+        }
+    }
+}
+
+/*
+C = A @ A.T for an (m, n) matrix A: one triangle with the blocked GEMM,
+then mirrored. that is half the multiply-adds of a full product.
+*/
+void __ssyrk__(
+    int m, int n, const float *a, long rsa, long csa, float *c, long rsc, long csc, bool upper, Accumulation mode)
+{
+    __sgemm__(m, n, m, 1.0f, a, rsa, csa, a, csa, rsa, 0.0f, c, rsc, csc, upper ? 1 : -1, mode);
+    __mirrorTriangle__(m, c, rsc, csc, upper);
+}
+
+typedef struct
+{
+    int m, n;
+    long rsa, csa, rsc, csc;
+    bool upper;
+    Accumulation mode;
+} SyrkContext;
+
+// batch loop of smSyrk, operand 0 is the result and 1 the input
+void __syrkLoop__(float **ptrs, const long *steps, long n, void *ctx)
+{
+    SyrkContext *sk = (SyrkContext *)ctx;
+    for (long l = 0; l < n; l++)
+        __ssyrk__(
+            sk->m, sk->n, ptrs[1] + l * steps[1], sk->rsa, sk->csa,
+            ptrs[0] + l * steps[0], sk->rsc, sk->csc, sk->upper, sk->mode);
+}
+
+/*
+symmetric rank-k update: X @ X.T for (..., m, k) Arrays, batched over
+the leading axes. the result is (..., m, m).
+
+only the upper (or lower) triangle is computed, then it is mirrored, so
+the result is the whole symmetric matrix either way: `upper` picks the
+half that is actually computed (and is exact to the last bit).
+this is what covariance and kernel matrices want, it costs half of the
+equivalent smMatMul.
+*/
+Array *smSyrk(Array *x, bool upper)
+{
+    if (x->ndim < 2)
+    {
+        fprintf(stderr, ">> error: syrk needs an Array with at least 2 dimensions.\n");
+        exit(1);
+    }
+
+    int nd = x->ndim;
+    int m = x->shape[nd - 2], n = x->shape[nd - 1];
+
+    int shape[SM_MAXDIMS];
+    for (int i = 0; i < nd; i++)
+        shape[i] = x->shape[i];
+    shape[nd - 1] = m;
+
+    Array *result = smCreate(shape, nd);
+
+    SyrkContext ctx = {
+        m, n,
+        x->strides[nd - 2] / x->itemsize, x->strides[nd - 1] / x->itemsize,
+        result->strides[nd - 2] / result->itemsize, result->strides[nd - 1] / result->itemsize,
+        upper, __accumulation__};
+
+    Array *batch[] = {__batchView__(result), __batchView__(x)};
+    StridedPlan plan;
+    __planStrided__(&plan, batch[0]->shape, batch[0]->ndim, batch, 2);
+    __runBatched__(&plan, __syrkLoop__, &ctx, (long)m * m * n / 2);
+
+    smCleanup(batch[0]);
+    smCleanup(batch[1]);
+
+    return result;
+}
+
+/*
+one (m, n) @ (n, p) product with arbitrary element strides (rs: row
+stride, cs: column stride).
+
+the loop order follows the layout of the output: rows are streamed for
+C-order outputs (i-k-j) and columns for F-order outputs (j-k-i), so the
+innermost loop runs along unit strides for row-major and column-major
+operands alike.
+
+products big enough to amortize the packing go through the blocked
+GEMM, A @ A.T (the same buffer read in transposed layout, a Gram
+matrix) is detected and only one triangle is computed. matrix-vector
+shapes (p == 1, or m == 1 as B.T @ a) go to GEMV.
+*/
+void __matmulStrided__(
+    int m, int n, int p,
+    const float *a, long rsa, long csa,
+    const float *b, long rsb, long csb,
+    float *c, long rsc, long csc, Accumulation mode)
+{
+    if (p == 1)
+    {
+        __sgemvStrided__(m, n, a, rsa, csa, b, rsb, c, rsc, mode);
+        return;
+    }
+    if (m == 1)
+    {
+        __sgemvStrided__(p, n, b, csb, rsb, a, csa, c, csc, mode);
+        return;
+    }
+
+    bool blocked = (long)m * n * p >= SM_PARALLEL_MIN && m >= SM_MR && p >= SM_NR;
+    if (blocked || mode != SM_ACCUM_FLOAT)
+    {
+        if (a == b && m == p && rsa == csb && csa == rsb)
+            __ssyrk__(m, n, a, rsa, csa, c, rsc, csc, true, mode);
+        else
+            __sgemm__(m, n, p, 1.0f, a, rsa, csa, b, rsb, csb, 0.0f, c, rsc, csc, 0, mode);
+        return;
+    }
+
+    if (labs(rsc) < labs(csc))
+    {
+#ifdef PARALLEL
+#pragma omp parallel for if ((long)m * n * p >= SM_PARALLEL_MIN)
+#endif
+        for (int j = 0; j < p; j++)
+        {
+            float *cj = c + j * csc;
+            for (int i = 0; i < m; i++)
+                cj[i * rsc] = 0.0f;
+
+            for (int k = 0; k < n; k++)
+            {
+                float bkj = b[k * rsb + j * csb];
+                const float *ak = a + k * csa;
+                for (int i = 0; i < m; i++)
+                    cj[i * rsc] += ak[i * rsa] * bkj;
+            }
+        }
+        return;
+    }
+
+#ifdef PARALLEL
+#pragma omp parallel for if ((long)m * n * p >= SM_PARALLEL_MIN)
+#endif
+    for (int i = 0; i < m; i++)
+    {
+        float *ci = c + i * rsc;
+        for (int j = 0; j < p; j++)
+            ci[j * csc] = 0.0f;
+
+        for (int k = 0; k < n; k++)
+        {
+            float aik = a[i * rsa + k * csa];
+            const float *bk = b + k * rsb;
+            for (int j = 0; j < p; j++)
+                ci[j * csc] += aik * bk[j * csb];
+        }
+    }
+}
+
+// ------------------- Tiny batched matmul -------------------
+
+/*
+batches of tiny matrices ((N, 4, 4) @ (N, 4, 4) and friends) are
+dominated by loop overhead when multiplied one by one. for square sizes
+2..8 the kernels below are generated per size, so every loop bound is a
+compile-time constant and the compiler unrolls them completely.
+
+SM_LANES matrices are moved into a struct-of-arrays block first
+(element e of lane l at [e][l]), the arithmetic then runs across the
+batch: each unrolled multiply-add works on SM_LANES matrices at once,
+which is exactly one vector register.
+
+they are StridedLoops over the batch: operand 0 is the output, 1 and 2
+the factors, and steps are the distances between consecutive matrices.
+*/
+#define __TINY_MATMUL__(S)                                                      \
+    void __tinyMatMul##S##__(float **ptrs, const long *steps, long n, void *ctx) \
+    {                                                                           \
+        (void)ctx;                                                              \
+        float at[S * S][SM_LANES], bt[S * S][SM_LANES], ct[S * S][SM_LANES];    \
+        for (long base = 0; base < n; base += SM_LANES)                         \
+        {                                                                       \
+            int lanes = (n - base < SM_LANES) ? (int)(n - base) : SM_LANES;     \
+            float *c = ptrs[0] + base * steps[0];                               \
+            const float *a = ptrs[1] + base * steps[1];                         \
+            const float *b = ptrs[2] + base * steps[2];                         \
+            if (lanes < SM_LANES)                                               \
+            {                                                                   \
+                memset(at, 0, sizeof(at));                                      \
+                memset(bt, 0, sizeof(bt));                                      \
+            }                                                                   \
+            for (int l = 0; l < lanes; l++)                                     \
+                for (int e = 0; e < S * S; e++)                                 \
+                {                                                               \
+                    at[e][l] = a[l * steps[1] + e];                             \
+                    bt[e][l] = b[l * steps[2] + e];                             \
+                }                                                               \
+            for (int i = 0; i < S; i++)                                         \
+                for (int j = 0; j < S; j++)                                     \
+                {                                                               \
+                    float acc[SM_LANES] = {0};                                  \
+                    for (int k = 0; k < S; k++)                                 \
+                        for (int l = 0; l < SM_LANES; l++)                      \
+                            acc[l] += at[i * S + k][l] * bt[k * S + j][l];      \
+                    for (int l = 0; l < SM_LANES; l++)                          \
+                        ct[i * S + j][l] = acc[l];                              \
+                }                                                               \
+            for (int l = 0; l < lanes; l++)                                     \
+                for (int e = 0; e < S * S; e++)                                 \
+                    c[l * steps[0] + e] = ct[e][l];                             \
+        }                                                                       \
+    }
+
+/*
+(S, S) @ (S, 1) for a batch: transforms of points/vectors. the vector
+and the result only need unit stride between their S elements.
+*/
+#define __TINY_MATVEC__(S)                                                      \
+    void __tinyMatVec##S##__(float **ptrs, const long *steps, long n, void *ctx) \
+    {                                                                           \
+        (void)ctx;                                                              \
+        float at[S * S][SM_LANES], xt[S][SM_LANES];                             \
+        for (long base = 0; base < n; base += SM_LANES)                         \
+        {                                                                       \
+            int lanes = (n - base < SM_LANES) ? (int)(n - base) : SM_LANES;     \
+            float *y = ptrs[0] + base * steps[0];                               \
+            const float *a = ptrs[1] + base * steps[1];                         \
+            const float *x = ptrs[2] + base * steps[2];                         \
+            if (lanes < SM_LANES)                                               \
+            {                                                                   \
+                memset(at, 0, sizeof(at));                                      \
+                memset(xt, 0, sizeof(xt));                                      \
+            }                                                                   \
+            for (int l = 0; l < lanes; l++)                                     \
+            {                                                                   \
+                for (int e = 0; e < S * S; e++)                                 \
+                    at[e][l] = a[l * steps[1] + e];                             \
+                for (int k = 0; k < S; k++)                                     \
+                    xt[k][l] = x[l * steps[2] + k];                             \
+            }                                                                   \
+            for (int i = 0; i < S; i++)                                         \
+            {                                                                   \
+                float acc[SM_LANES] = {0};                                      \
+                for (int k = 0; k < S; k++)                                     \
+                    for (int l = 0; l < SM_LANES; l++)                          \
+                        acc[l] += at[i * S + k][l] * xt[k][l];                  \
+                for (int l = 0; l < lanes; l++)                                 \
+                    y[l * steps[0] + i] = acc[l];                               \
+            }                                                                   \
+        }                                                                       \
+    }
+
+__TINY_MATMUL__(2)
+__TINY_MATMUL__(3)
+__TINY_MATMUL__(4)
+__TINY_MATMUL__(5)
+__TINY_MATMUL__(6)
+__TINY_MATMUL__(7)
+__TINY_MATMUL__(8)
+
+__TINY_MATVEC__(2)
+__TINY_MATVEC__(3)
+__TINY_MATVEC__(4)
+__TINY_MATVEC__(5)
+__TINY_MATVEC__(6)
+__TINY_MATVEC__(7)
+__TINY_MATVEC__(8)
+
+// indexed by the matrix size
+StridedLoop __tinyMatMulKernels__[SM_TINY_MAX + 1] = {
+    NULL, NULL,
+    __tinyMatMul2__, __tinyMatMul3__, __tinyMatMul4__,
+    __tinyMatMul5__, __tinyMatMul6__, __tinyMatMul7__, __tinyMatMul8__};
+
+StridedLoop __tinyMatVecKernels__[SM_TINY_MAX + 1] = {
+    NULL, NULL,
+    __tinyMatVec2__, __tinyMatVec3__, __tinyMatVec4__,
+    __tinyMatVec5__, __tinyMatVec6__, __tinyMatVec7__, __tinyMatVec8__};
+
+typedef struct
+{
+    int m, n, p;
+    long rsa, csa, rsb, csb, rsc, csc;
+    Accumulation mode;
+} MatMulContext;
+
+/*
+the general case as a StridedLoop over the batch: one strided product
+per matrix.
+*/
+void __matmulLoop__(float **ptrs, const long *steps, long n, void *ctx)
+{
+    MatMulContext *mm = (MatMulContext *)ctx;
+    for (long l = 0; l < n; l++)
+        __matmulStrided__(
+            mm->m, mm->n, mm->p,
+            ptrs[1] + l * steps[1], mm->rsa, mm->csa,
+            ptrs[2] + l * steps[2], mm->rsb, mm->csb,
+            ptrs[0] + l * steps[0], mm->rsc, mm->csc, mm->mode);
+}
+
+/*
+view of the batch axes of an Array (all but the last two), so the batch
+can be planned and broadcast like any elementwise loop.
+*/
+Array *__batchView__(Array *arr)
+{
+    if (arr->ndim == 2)
+    {
+        int shape[] = {1}, strides[] = {0};
+        return __createView__(arr, arr->data, shape, strides, 1);
+    }
+    return __createView__(arr, arr->data, arr->shape, arr->strides, arr->ndim - 2);
+}
+
+/*
+run a batch plan where every item costs `work` flops. big matrices are
+multiplied one after the other (each product is threaded on its own),
+batches of small ones are split among threads instead.
+*/
+void __runBatched__(StridedPlan *plan, StridedLoop loop, void *ctx, long work)
+{
+    // only used to decide on threading
+    (void)work;
+
+    long total = 1;
+    for (int d = 0; d < plan->ndim; d++)
+        total *= plan->shape[d];
+
+    if (total == 0)
+        return;
+
+#ifdef PARALLEL
+#pragma omp parallel if (work < SM_PARALLEL_MIN && total * work >= SM_PARALLEL_MIN)
+#endif
+    {
+        int nthreads = 1, tid = 0;
+#ifdef PARALLEL
+        nthreads = omp_get_num_threads();
+        tid = omp_get_thread_num();
+#endif
+        if (plan->ndim == 1)
+        {
+            // a flat batch is split by matrices, not by SM_CHUNK items
+            long lo = total * tid / nthreads, hi = total * (tid + 1) / nthreads;
+            float *ptrs[SM_MAXOPS];
+            long steps[SM_MAXOPS];
+            for (int op = 0; op < plan->nop; op++)
+            {
+                steps[op] = plan->strides[op][0];
+                ptrs[op] = plan->data[op] + lo * steps[op];
+            }
+            if (hi > lo)
+                loop(ptrs, steps, hi - lo, ctx);
+        }
+        else
+        {
+            long nitems = __stridedItems__(plan);
+            __runStridedRange__(
+                plan, loop, ctx,
+                nitems * tid / nthreads, nitems * (tid + 1) / nthreads);
+        }
+    }
+}
+
+/*
+matrix multiplication of n-dimensional arrays.
+```
+for 2D arrays (m, n) @ (n, d) = (m, d)
+for nD arrays (..., m, n) @ (..., n, d) = (..., m, d)
+```
+when the dimensions of arrays are greater than 2, we do N matmuls
+on the last two axes of the operands. These N matmuls will be stacked
+in the shape of the higher dimensions (broadcasted numpy style).
+
+if both operands are F-contiguous the result is F-contiguous too,
+and every product walks down columns instead of rows.
+
+batches of small matrices are spread over threads, square ones up to
+SM_TINY_MAX (and their matvecs) use the unrolled kernels above.
+*/
+Array *smMatMul(Array *a, Array *b)
+{
+    return __matmulBatched__(a, b, __accumulation__);
+}
+
+// smMatMul with the accumulation mode of the caller
+Array *__matmulBatched__(Array *a, Array *b, Accumulation mode)
+{
+    if (a->ndim < 2 || b->ndim < 2)
+    {
+        fprintf(stderr, ">> Error: both arrays must have at least 2 dimensions for matmul.\n");
+        return NULL;
     }
     if (a->shape[a->ndim - 1] != b->shape[b->ndim - 2])
     {
-        fprintf(stderr, ">> Error: last dimension of first array must match second-last dimension of second array.\n");
-        return NULL;
+        fprintf(stderr, ">> Error: last dimension of first array must match second-last dimension of second array.\n");
+        return NULL;
+    }
+
+    int result_ndim = (a->ndim > b->ndim) ? a->ndim : b->ndim;
+    int bnd = result_ndim - 2;
+    int result_shape[SM_MAXDIMS];
+
+    // broadcast result shape untill last two axes (right aligned)
+    for (int i = 0; i < bnd; i++)
+    {
+        int ia = i - (bnd - (a->ndim - 2));
+        int ib = i - (bnd - (b->ndim - 2));
+        int da = (ia >= 0) ? a->shape[ia] : 1;
+        int db = (ib >= 0) ? b->shape[ib] : 1;
+        if (da != db && da != 1 && db != 1)
+        {
+            fprintf(stderr, ">> Error: batch dimensions of the arrays are not broadcastable.\n");
+            return NULL;
+        }
+        result_shape[i] = (da > db) ? da : db;
+    }
+    result_shape[bnd] = a->shape[a->ndim - 2];
+    result_shape[bnd + 1] = b->shape[b->ndim - 1];
+
+    bool fortran = a->F_ORDER && b->F_ORDER && !(a->C_ORDER && b->C_ORDER);
+    Array *result = smCreateOrder(result_shape, result_ndim, fortran ? SM_F_ORDER : SM_C_ORDER);
+
+    int m = a->shape[a->ndim - 2];
+    int n = a->shape[a->ndim - 1];
+    int p = b->shape[b->ndim - 1];
+
+    long rsa = a->strides[a->ndim - 2] / a->itemsize, csa = a->strides[a->ndim - 1] / a->itemsize;
+    long rsb = b->strides[b->ndim - 2] / b->itemsize, csb = b->strides[b->ndim - 1] / b->itemsize;
+    long rsc = result->strides[bnd] / result->itemsize, csc = result->strides[bnd + 1] / result->itemsize;
+
+    // the batch axes are planned like an elementwise loop: broadcast
+    // batches get a 0 step and contiguous batches collapse to one axis
+    Array *batch[] = {__batchView__(result), __batchView__(a), __batchView__(b)};
+    StridedPlan plan;
+    __planStrided__(&plan, batch[0]->shape, batch[0]->ndim, batch, 3);
+
+    MatMulContext ctx = {m, n, p, rsa, csa, rsb, csb, rsc, csc, mode};
+    StridedLoop loop = __matmulLoop__;
+
+    // square tiny matrices with packed rows (or packed columns all
+    // around, which is the same product transposed) and tiny matvecs
+    if (m == n && m >= 2 && m <= SM_TINY_MAX && ctx.mode == SM_ACCUM_FLOAT)
+    {
+        int s = m;
+        bool rows = (rsa == s && csa == 1), cols = (rsa == 1 && csa == s);
+        if (p == s && rows && rsb == s && csb == 1 && rsc == s && csc == 1)
+            loop = __tinyMatMulKernels__[s];
+        else if (p == s && cols && rsb == 1 && csb == s && rsc == 1 && csc == s)
+        {
+            // C.T = B.T @ A.T, and the transposes are the row-major buffers
+            float *tmp = plan.data[1];
+            plan.data[1] = plan.data[2];
+            plan.data[2] = tmp;
+            for (int d = 0; d < plan.ndim; d++)
+            {
+                long st = plan.strides[1][d];
+                plan.strides[1][d] = plan.strides[2][d];
+                plan.strides[2][d] = st;
+            }
+            loop = __tinyMatMulKernels__[s];
+        }
+        else if (p == 1 && rows && rsb == 1 && rsc == 1)
+            loop = __tinyMatVecKernels__[s];
+    }
+
+    __runBatched__(&plan, loop, &ctx, (long)m * n * p);
+
+    for (int i = 0; i < 3; i++)
+        smCleanup(batch[i]);
+
+    return result;
+}
+
+/*
+Apply a given ArrayFunc element-wise to the array, inplace
+*/
+void smApplyInplace(Array *arr, ArrayFunc func)
+{
+    ApplyContext ctx = {func};
+    StridedPlan plan;
+    __planStrided__(&plan, arr->shape, arr->ndim, &arr, 1);
+    __runStrided__(&plan, __applyLoop__, &ctx);
+}
+
+// ------------------- Reductions -------------------
+
+/*
+reduction loops: operand 0 is the output, 0-strided along the reduced
+axis. when the reduced axis is the inner one the row is folded with
+8 independent accumulators, otherwise whole rows are accumulated
+elementwise (which is what walks F-order inputs along their fast axis).
+*/
+void __sumLoop__(float **ptrs, const long *steps, long n, void *ctx)
+{
+    (void)ctx;
+    float *out = ptrs[0];
+    const float *x = ptrs[1];
+
+    if (steps[0] == 0)
+    {
+        float acc[8] = {0};
+        long i = 0;
+        if (steps[1] == 1)
+            for (; i + 8 <= n; i += 8)
+                for (int u = 0; u < 8; u++)
+                    acc[u] += x[i + u];
+
+        float total = 0.0f;
+        for (; i < n; i++)
+            total += x[i * steps[1]];
+        for (int u = 0; u < 8; u++)
+            total += acc[u];
+        out[0] += total;
+    }
+    else if (steps[0] == 1 && steps[1] == 1)
+        for (long i = 0; i < n; i++)
+            out[i] += x[i];
+    else
+        for (long i = 0; i < n; i++)
+            out[i * steps[0]] += x[i * steps[1]];
+}
+
+void __maxLoop__(float **ptrs, const long *steps, long n, void *ctx)
+{
+    (void)ctx;
+    float *out = ptrs[0];
+    const float *x = ptrs[1];
+
+    if (steps[0] == 0)
+    {
+        float best = out[0];
+        for (long i = 0; i < n; i++)
+            best = (x[i * steps[1]] > best) ? x[i * steps[1]] : best;
+        out[0] = best;
+    }
+    else
+        for (long i = 0; i < n; i++)
+            if (x[i * steps[1]] > out[i * steps[0]])
+                out[i * steps[0]] = x[i * steps[1]];
+}
+
+void __minLoop__(float **ptrs, const long *steps, long n, void *ctx)
+{
+    (void)ctx;
+    float *out = ptrs[0];
+    const float *x = ptrs[1];
+
+    if (steps[0] == 0)
+    {
+        float best = out[0];
+        for (long i = 0; i < n; i++)
+            best = (x[i * steps[1]] < best) ? x[i * steps[1]] : best;
+        out[0] = best;
+    }
+    else
+        for (long i = 0; i < n; i++)
+            if (x[i * steps[1]] < out[i * steps[0]])
+                out[i * steps[0]] = x[i * steps[1]];
+}
+
+/*
+run a reduction plan (operand 0 is 0-strided along the reduced axes).
+
+threads split the outermost axis the output moves along, so no two
+threads accumulate into the same element. a reduction to a single
+element instead splits the outermost input axis into private partials,
+which are folded into the output with `combine` at the end (called
+with {output, partial} and steps {0, 1}).
+*/
+void __runReduction__(StridedPlan *plan, StridedLoop loop, StridedLoop combine, void *ctx, float init)
+{
+    long total = 1;
+    for (int d = 0; d < plan->ndim; d++)
+        total *= plan->shape[d];
+
+    int axis = -1;
+    for (int d = 0; d < plan->ndim && axis < 0; d++)
+        if (plan->strides[0][d] != 0)
+            axis = d;
+
+    bool scalar = (axis < 0);
+    if (scalar)
+        axis = 0;
+
+#ifdef PARALLEL
+#pragma omp parallel if (total >= SM_PARALLEL_MIN)
+#endif
+    {
+        int nthreads = 1, tid = 0;
+#ifdef PARALLEL
+        nthreads = omp_get_num_threads();
+        tid = omp_get_thread_num();
+#endif
+        long lo = (long)plan->shape[axis] * tid / nthreads;
+        long hi = (long)plan->shape[axis] * (tid + 1) / nthreads;
+
+        StridedPlan sub = *plan;
+        sub.shape[axis] = (int)(hi - lo);
+        for (int op = 0; op < plan->nop; op++)
+            sub.data[op] += lo * plan->strides[op][axis];
+
+        float partial = init;
+        if (scalar)
+            sub.data[0] = &partial;
+
+        if (hi > lo)
+            __runStridedRange__(&sub, loop, ctx, 0, __stridedItems__(&sub));
+
+        if (scalar)
+        {
+#ifdef PARALLEL
+#pragma omp critical
+#endif
+            {
+                float *ptrs[SM_MAXOPS] = {plan->data[0], &partial};
+                long steps[SM_MAXOPS] = {0, 1};
+                combine(ptrs, steps, 1, ctx);
+            }
+        }
+    }
+}
+
+/*
+reduce `inputs` (all of the same shape) along `axis` with `loop`,
+starting every output element at `init`; `combine` folds per-thread
+partials (see `__runReduction__`). the result has `axis` removed
+(shape {1} for 1D inputs) and keeps the memory order of F-order inputs.
+*/
+Array *__PreduceAxis__(Array **inputs, int nin, int axis, float init, StridedLoop loop, StridedLoop combine)
+{
+    Array *arr = inputs[0];
+    for (int i = 1; i < nin; i++)
+    {
+        if (!smCheckShapesEqual(arr, inputs[i]))
+        {
+            fprintf(stderr, ">> error: all Arrays of a reduction must have the same shape.\n");
+            exit(1);
+        }
+    }
+
+    if (axis < 0)
+        axis = arr->ndim + axis;
+
+    if (axis < 0 || axis >= arr->ndim)
+    {
+        fprintf(stderr, ">> error: axis out of bounds for reduction.\n");
+        exit(1);
+    }
+
+    int res_ndim = (arr->ndim > 1) ? arr->ndim - 1 : 1;
+    int res_shape[SM_MAXDIMS];
+    res_shape[0] = 1;
+    for (int i = 0, j = 0; i < arr->ndim; i++)
+        if (i != axis)
+            res_shape[j++] = arr->shape[i];
+
+    bool fortran = arr->F_ORDER && !arr->C_ORDER;
+    Array *res = smCreateOrder(res_shape, res_ndim, fortran ? SM_F_ORDER : SM_C_ORDER);
+    for (int i = 0; i < res->totalsize; i++)
+        res->data[i] = init;
+
+    // the result seen with arr's shape: 0-stride along the reduced axis
+    int keep_strides[SM_MAXDIMS];
+    for (int i = 0, j = 0; i < arr->ndim; i++)
+        keep_strides[i] = (i == axis || arr->ndim == 1) ? 0 : res->strides[j++];
+
+    Array *keep = __createView__(res, res->data, arr->shape, keep_strides, arr->ndim);
+
+    StridedPlan plan;
+    Array *ops[SM_MAXOPS] = {keep};
+    for (int i = 0; i < nin; i++)
+        ops[i + 1] = inputs[i];
+    __planStrided__(&plan, arr->shape, arr->ndim, ops, nin + 1);
+    __runReduction__(&plan, loop, combine, NULL, init);
+
+    smCleanup(keep);
+    return res;
+}
+
+/*
+sum of the elements along an axis
+*/
+Array *smSum(Array *arr, int axis)
+{
+    Accumulation mode = __accumulation__;
+    if (mode != SM_ACCUM_FLOAT)
+        return __PreduceAccurate__(&arr, 1, axis, mode);
+
+    return __PreduceAxis__(&arr, 1, axis, 0.0f, __sumLoop__, __sumLoop__);
+}
+
+/*
+mean of the elements along an axis
+*/
+Array *smMean(Array *arr, int axis)
+{
+    Array *res = smSum(arr, axis);
+
+    int n = arr->shape[(axis < 0) ? arr->ndim + axis : axis];
+    for (int i = 0; i < res->totalsize; i++)
+        res->data[i] /= (float)n;
+
+    return res;
+}
+
+/*
+maximum along an axis
+*/
+Array *smMax(Array *arr, int axis)
+{
+    return __PreduceAxis__(&arr, 1, axis, -INFINITY, __maxLoop__, __maxLoop__);
+}
+
+/*
+minimum along an axis
+*/
+Array *smMin(Array *arr, int axis)
+{
+    return __PreduceAxis__(&arr, 1, axis, INFINITY, __minLoop__, __minLoop__);
+}
+
+// ------------------- Comparisons and masks -------------------
+
+typedef struct
+{
+    Comparison op;
+} CompareContext;
+
+typedef struct
+{
+    float lo, hi;
+} ClipContext;
+
+static inline bool __compare__(float a, float b, Comparison op)
+{
+    if (op == SM_CMP_GT)
+        return a > b;
+    if (op == SM_CMP_GE)
+        return a >= b;
+    if (op == SM_CMP_LT)
+        return a < b;
+    if (op == SM_CMP_LE)
+        return a <= b;
+    if (op == SM_CMP_EQ)
+        return a == b;
+    return a != b;
+}
+
+#if defined(__AVX__)
+/*
+all-ones lanes where the comparison holds. NaNs compare false, except
+for "not equal", like the C operators.
+*/
+static inline __m256 __compare256__(__m256 a, __m256 b, Comparison op)
+{
+    if (op == SM_CMP_GT)
+        return _mm256_cmp_ps(a, b, _CMP_GT_OQ);
+    if (op == SM_CMP_GE)
+        return _mm256_cmp_ps(a, b, _CMP_GE_OQ);
+    if (op == SM_CMP_LT)
+        return _mm256_cmp_ps(a, b, _CMP_LT_OQ);
+    if (op == SM_CMP_LE)
+        return _mm256_cmp_ps(a, b, _CMP_LE_OQ);
+    if (op == SM_CMP_EQ)
+        return _mm256_cmp_ps(a, b, _CMP_EQ_OQ);
+    return _mm256_cmp_ps(a, b, _CMP_NEQ_UQ);
+}
+#endif
+
+// out = (a op b) as 1.0 or 0.0, a and b may be scalars (step 0)
+void __compareLoop__(float **ptrs, const long *steps, long n, void *ctx)
+{
+    Comparison op = ((CompareContext *)ctx)->op;
+    float *out = ptrs[0];
+    const float *a = ptrs[1], *b = ptrs[2];
+    long i = 0;
+
+#if defined(__AVX__)
+    if (steps[0] == 1 && steps[1] <= 1 && steps[2] <= 1)
+    {
+        __m256 one = _mm256_set1_ps(1.0f);
+        __m256 va = _mm256_broadcast_ss(a), vb = _mm256_broadcast_ss(b);
+        for (; i + 8 <= n; i += 8)
+        {
+            if (steps[1])
+                va = _mm256_loadu_ps(a + i);
+            if (steps[2])
+                vb = _mm256_loadu_ps(b + i);
+            _mm256_storeu_ps(out + i, _mm256_and_ps(__compare256__(va, vb, op), one));
+        }
+    }
+#endif
+
+    for (; i < n; i++)
+        out[i * steps[0]] = __compare__(a[i * steps[1]], b[i * steps[2]], op) ? 1.0f : 0.0f;
+}
+
+// out = (cond != 0) ? a : b
+void __whereLoop__(float **ptrs, const long *steps, long n, void *ctx)
+{
+    (void)ctx;
+    float *out = ptrs[0];
+    const float *cond = ptrs[1], *a = ptrs[2], *b = ptrs[3];
+    long i = 0;
+
+#if defined(__AVX__)
+    if (steps[0] == 1 && steps[1] == 1 && steps[2] <= 1 && steps[3] <= 1)
+    {
+        __m256 zero = _mm256_setzero_ps();
+        __m256 va = _mm256_broadcast_ss(a), vb = _mm256_broadcast_ss(b);
+        for (; i + 8 <= n; i += 8)
+        {
+            if (steps[2])
+                va = _mm256_loadu_ps(a + i);
+            if (steps[3])
+                vb = _mm256_loadu_ps(b + i);
+            __m256 m = _mm256_cmp_ps(_mm256_loadu_ps(cond + i), zero, _CMP_NEQ_UQ);
+            _mm256_storeu_ps(out + i, _mm256_blendv_ps(vb, va, m));
+        }
+    }
+#endif
+
+    for (; i < n; i++)
+        out[i * steps[0]] = (cond[i * steps[1]] != 0.0f) ? a[i * steps[2]] : b[i * steps[3]];
+}
+
+void __clipLoop__(float **ptrs, const long *steps, long n, void *ctx)
+{
+    ClipContext *c = (ClipContext *)ctx;
+    float *out = ptrs[0];
+    const float *x = ptrs[1];
+    long i = 0;
+
+#if defined(__AVX__)
+    if (steps[0] == 1 && steps[1] == 1)
+    {
+        // lo/hi as the first operand, so NaNs pass through
+        __m256 lo = _mm256_set1_ps(c->lo), hi = _mm256_set1_ps(c->hi);
+        for (; i + 8 <= n; i += 8)
+            _mm256_storeu_ps(out + i, _mm256_min_ps(hi, _mm256_max_ps(lo, _mm256_loadu_ps(x + i))));
+    }
+#endif
+
+    for (; i < n; i++)
+    {
+        float v = x[i * steps[1]];
+        v = (c->lo > v) ? c->lo : v;
+        out[i * steps[0]] = (c->hi < v) ? c->hi : v;
+    }
+}
+
+/*
+broadcast shape of `count` Arrays (numpy rules) written to `shape`.
+returns its ndim, or -1 if the Arrays are not broadcastable.
+*/
+int __broadcastShapeN__(Array **arrays, int count, int *shape)
+{
+    int ndim = 0;
+    for (int i = 0; i < count; i++)
+        ndim = (arrays[i]->ndim > ndim) ? arrays[i]->ndim : ndim;
+
+    for (int d = 0; d < ndim; d++)
+        shape[d] = 1;
+
+    for (int i = 0; i < count; i++)
+    {
+        int off = ndim - arrays[i]->ndim;
+        for (int d = 0; d < arrays[i]->ndim; d++)
+        {
+            int size = arrays[i]->shape[d];
+            if (size == shape[off + d] || size == 1)
+                continue;
+            if (shape[off + d] != 1)
+                return -1;
+            shape[off + d] = size;
+        }
+    }
+
+    return ndim;
+}
+
+/*
+true if `arr` can be broadcast to `shape` without changing the shape
+*/
+bool __broadcastsTo__(Array *arr, const int *shape, int ndim)
+{
+    if (arr->ndim > ndim)
+        return false;
+
+    int off = ndim - arr->ndim;
+    for (int d = 0; d < arr->ndim; d++)
+        if (arr->shape[d] != 1 && arr->shape[d] != shape[off + d])
+            return false;
+
+    return true;
+}
+
+/*
+zero-copy view of `arr` broadcast to `shape` (0-stride along the
+broadcast axes), assumes __broadcastsTo__ holds
+*/
+Array *__broadcastView__(Array *arr, const int *shape, int ndim)
+{
+    int strides[SM_MAXDIMS];
+    int off = ndim - arr->ndim;
+    for (int d = 0; d < ndim; d++)
+        strides[d] = (d < off || arr->shape[d - off] == 1) ? 0 : arr->strides[d - off];
+
+    return __createView__(arr, arr->data, shape, strides, ndim);
+}
+
+/*
+elementwise comparison with broadcasting, 1.0 where it holds
+*/
+Array *__Pcompare__(Array *a, Array *b, Comparison op)
+{
+    CompareContext ctx = {op};
+    Array *res = __PbinaryOp__(a, b, __compareLoop__, &ctx);
+
+    if (res == NULL)
+    {
+        fprintf(stderr, ">> error: cannot compare Arrays of non-broadcastable shapes.\n");
+        exit(1);
+    }
+
+    return res;
+}
+
+/*
+a > b elementwise, as a float mask of 1s and 0s. a and b are broadcast,
+use a shape {1} Array to compare with a scalar.
+*/
+Array *smGreater(Array *a, Array *b)
+{
+    return __Pcompare__(a, b, SM_CMP_GT);
+}
+
+/*
+a >= b elementwise
+*/
+Array *smGreaterEqual(Array *a, Array *b)
+{
+    return __Pcompare__(a, b, SM_CMP_GE);
+}
+
+/*
+a < b elementwise
+*/
+Array *smLess(Array *a, Array *b)
+{
+    return __Pcompare__(a, b, SM_CMP_LT);
+}
+
+/*
+a <= b elementwise
+*/
+Array *smLessEqual(Array *a, Array *b)
+{
+    return __Pcompare__(a, b, SM_CMP_LE);
+}
+
+/*
+a == b elementwise
+*/
+Array *smEqual(Array *a, Array *b)
+{
+    return __Pcompare__(a, b, SM_CMP_EQ);
+}
+
+/*
+a != b elementwise
+*/
+Array *smNotEqual(Array *a, Array *b)
+{
+    return __Pcompare__(a, b, SM_CMP_NE);
+}
+
+/*
+a where `cond` is nonzero, b elsewhere. the three are broadcast together.
+*/
+Array *smWhere(Array *cond, Array *a, Array *b)
+{
+    Array *inputs[] = {cond, a, b};
+    int shape[SM_MAXDIMS];
+    int ndim = __broadcastShapeN__(inputs, 3, shape);
+    if (ndim < 0)
+    {
+        fprintf(stderr, ">> error: cannot broadcast the operands of where.\n");
+        exit(1);
+    }
+
+    Array *res = __createLike__(shape, ndim, inputs, 3);
+
+    StridedPlan plan;
+    Array *ops[] = {res, cond, a, b};
+    __planStrided__(&plan, res->shape, res->ndim, ops, 4);
+    __runStrided__(&plan, __whereLoop__, NULL);
+
+    return res;
+}
+
+/*
+clamp every element to [lo, hi], NaNs stay NaN
+*/
+Array *smClip(Array *arr, float lo, float hi)
+{
+    if (lo > hi)
+    {
+        fprintf(stderr, ">> error: clip bounds %f > %f.\n", lo, hi);
+        exit(1);
+    }
+
+    ClipContext ctx = {lo, hi};
+    return __PunaryOp__(arr, __clipLoop__, &ctx);
+}
+
+/*
+masked reduction loops: operand 1 is the data and 2 the mask, elements
+with a mask of 0 are left out. same layout as `__sumLoop__`.
+*/
+void __maskedSumLoop__(float **ptrs, const long *steps, long n, void *ctx)
+{
+    (void)ctx;
+    float *out = ptrs[0];
+    const float *x = ptrs[1], *m = ptrs[2];
+
+    if (steps[0] == 0)
+    {
+        float total = 0.0f;
+        for (long i = 0; i < n; i++)
+            total += (m[i * steps[2]] != 0.0f) ? x[i * steps[1]] : 0.0f;
+        out[0] += total;
+    }
+    else
+        for (long i = 0; i < n; i++)
+            if (m[i * steps[2]] != 0.0f)
+                out[i * steps[0]] += x[i * steps[1]];
+}
+
+void __maskedMaxLoop__(float **ptrs, const long *steps, long n, void *ctx)
+{
+    (void)ctx;
+    float *out = ptrs[0];
+    const float *x = ptrs[1], *m = ptrs[2];
+
+    for (long i = 0; i < n; i++)
+        if (m[i * steps[2]] != 0.0f && x[i * steps[1]] > out[i * steps[0]])
+            out[i * steps[0]] = x[i * steps[1]];
+}
+
+void __maskedMinLoop__(float **ptrs, const long *steps, long n, void *ctx)
+{
+    (void)ctx;
+    float *out = ptrs[0];
+    const float *x = ptrs[1], *m = ptrs[2];
+
+    for (long i = 0; i < n; i++)
+        if (m[i * steps[2]] != 0.0f && x[i * steps[1]] < out[i * steps[0]])
+            out[i * steps[0]] = x[i * steps[1]];
+}
+
+// number of nonzero elements
+void __countLoop__(float **ptrs, const long *steps, long n, void *ctx)
+{
+    (void)ctx;
+    float *out = ptrs[0];
+    const float *m = ptrs[1];
+
+    if (steps[0] == 0)
+    {
+        long count = 0;
+        for (long i = 0; i < n; i++)
+            count += (m[i * steps[1]] != 0.0f);
+        out[0] += (float)count;
+    }
+    else
+        for (long i = 0; i < n; i++)
+            out[i * steps[0]] += (m[i * steps[1]] != 0.0f);
+}
+
+/*
+`mask` broadcast to the shape of `arr` for a masked reduction, a
+row or column mask is not copied
+*/
+Array *__maskView__(Array *arr, Array *mask)
+{
+    if (!__broadcastsTo__(mask, arr->shape, arr->ndim))
+    {
+        fprintf(stderr, ">> error: mask must broadcast to the shape of the Array.\n");
+        exit(1);
+    }
+    return __broadcastView__(mask, arr->shape, arr->ndim);
+}
+
+/*
+masked reduction along an axis, `mask` is broadcast to `arr`
+*/
+Array *__PmaskedReduce__(Array *arr, Array *mask, int axis, float init, StridedLoop loop, StridedLoop combine)
+{
+    Array *inputs[] = {arr, __maskView__(arr, mask)};
+    Array *res = __PreduceAxis__(inputs, 2, axis, init, loop, combine);
+    smCleanup(inputs[1]);
+    return res;
+}
+
+/*
+sum along an axis of the elements where `mask` is nonzero. `mask` has
+the shape of `arr` or broadcasts to it (e.g. one row mask for all rows).
+*/
+Array *smMaskedSum(Array *arr, Array *mask, int axis)
+{
+    return __PmaskedReduce__(arr, mask, axis, 0.0f, __maskedSumLoop__, __sumLoop__);
+}
+
+/*
+mean along an axis of the elements where `mask` is nonzero, NaN where
+there are none
+*/
+Array *smMaskedMean(Array *arr, Array *mask, int axis)
+{
+    Array *res = smMaskedSum(arr, mask, axis);
+    Array *m = __maskView__(arr, mask);
+    Array *count = __PreduceAxis__(&m, 1, axis, 0.0f, __countLoop__, __sumLoop__);
+
+    for (int i = 0; i < res->totalsize; i++)
+        res->data[i] = (count->data[i] > 0.0f) ? res->data[i] / count->data[i] : NAN;
+
+    smCleanup(count);
+    smCleanup(m);
+    return res;
+}
+
+/*
+maximum along an axis of the elements where `mask` is nonzero, -inf
+where there are none
+*/
+Array *smMaskedMax(Array *arr, Array *mask, int axis)
+{
+    return __PmaskedReduce__(arr, mask, axis, -INFINITY, __maskedMaxLoop__, __maxLoop__);
+}
+
+/*
+minimum along an axis of the elements where `mask` is nonzero, +inf
+where there are none
+*/
+Array *smMaskedMin(Array *arr, Array *mask, int axis)
+{
+    return __PmaskedReduce__(arr, mask, axis, INFINITY, __maskedMinLoop__, __minLoop__);
+}
+
+BitMask *__createMask__(const int *shape, int ndim)
+{
+    BitMask *mask = (BitMask *)malloc(sizeof(BitMask));
+    _checkNull(mask);
+
+    mask->shape = (int *)malloc(ndim * sizeof(int));
+    _checkNull(mask->shape);
+    mask->ndim = ndim;
+    mask->totalsize = 1;
+    for (int d = 0; d < ndim; d++)
+    {
+        mask->shape[d] = shape[d];
+        mask->totalsize *= shape[d];
+    }
+
+    // zeroed, so bits past the end never count
+    mask->bits = (unsigned char *)calloc(mask->totalsize / 8 + 1, 1);
+    _checkNull(mask->bits);
+    return mask;
+}
+
+/*
+free all the memory allocated by a BitMask
+*/
+void smCleanupMask(BitMask *mask)
+{
+    free(mask->bits);
+    free(mask->shape);
+    free(mask);
+}
+
+/*
+an operand of the packed kernels, which only read single elements or
+C-contiguous Arrays of the full shape: anything else is broadcast into a
+C-order copy first
+*/
+Array *__packedOperand__(Array *arr, const int *shape, int ndim)
+{
+    if (arr->totalsize == 1)
+        return arr;
+
+    bool full = (arr->ndim == ndim);
+    for (int d = 0; full && d < ndim; d++)
+        full = (arr->shape[d] == shape[d]);
+    if (full && __isContiguousC__(arr))
+        return arr;
+
+    return __broadcastArray__(arr, shape, ndim);
+}
+
+/*
+bits [lo, hi) of a packed comparison, `lo` a multiple of 8. steps are
+0 (a single element) or 1. every full group of 8 is one movemask.
+*/
+void __compareBits__(const float *a, long sa, const float *b, long sb, long lo, long hi, Comparison op, unsigned char *bits)
+{
+    long i = lo;
+
+#if defined(__AVX__)
+    __m256 va = _mm256_broadcast_ss(a), vb = _mm256_broadcast_ss(b);
+    for (; i + 8 <= hi; i += 8)
+    {
+        if (sa)
+            va = _mm256_loadu_ps(a + i);
+        if (sb)
+            vb = _mm256_loadu_ps(b + i);
+        bits[i / 8] = (unsigned char)_mm256_movemask_ps(__compare256__(va, vb, op));
+    }
+#endif
+
+    for (; i < hi; i++)
+        if (__compare__(a[i * sa], b[i * sb], op))
+            bits[i / 8] |= (unsigned char)(1 << (i % 8));
+}
+
+/*
+elements [lo, hi) of a select by a packed mask, `lo` a multiple of 8.
+a and b are single elements (step 0) or full C-order Arrays (step 1).
+*/
+void __whereBits__(const unsigned char *bits, const float *a, long sa, const float *b, long sb, long lo, long hi, float *out)
+{
+    long i = lo;
+
+#if defined(__AVX2__)
+    // lane l tests bit l of the byte
+    __m256i lanes = _mm256_setr_epi32(1, 2, 4, 8, 16, 32, 64, 128);
+    __m256 va = _mm256_broadcast_ss(a), vb = _mm256_broadcast_ss(b);
+    for (; i + 8 <= hi; i += 8)
+    {
+        if (sa)
+            va = _mm256_loadu_ps(a + i);
+        if (sb)
+            vb = _mm256_loadu_ps(b + i);
+        __m256i m = _mm256_and_si256(_mm256_set1_epi32(bits[i / 8]), lanes);
+        m = _mm256_cmpeq_epi32(m, lanes);
+        _mm256_storeu_ps(out + i, _mm256_blendv_ps(vb, va, _mm256_castsi256_ps(m)));
+    }
+#endif
+
+    for (; i < hi; i++)
+        out[i] = ((bits[i / 8] >> (i % 8)) & 1) ? a[i * sa] : b[i * sb];
+}
+
+/*
+elementwise comparison with broadcasting into a packed mask: 1 bit per
+element of the broadcast shape in C order, 32x smaller than a float mask
+*/
+BitMask *smComparePacked(Array *a, Array *b, Comparison op)
+{
+    Array *inputs[] = {a, b};
+    int shape[SM_MAXDIMS];
+    int ndim = __broadcastShapeN__(inputs, 2, shape);
+    if (ndim < 0)
+    {
+        fprintf(stderr, ">> error: cannot compare Arrays of non-broadcastable shapes.\n");
+        exit(1);
+    }
+
+    BitMask *mask = __createMask__(shape, ndim);
+    Array *ac = __packedOperand__(a, shape, ndim);
+    Array *bc = __packedOperand__(b, shape, ndim);
+    long sa = (ac->totalsize > 1), sb = (bc->totalsize > 1);
+
+    long total = mask->totalsize;
+    long nblocks = (total + SM_CHUNK - 1) / SM_CHUNK;
+#ifdef PARALLEL
+#pragma omp parallel for if (total >= SM_PARALLEL_MIN)
+#endif
+    for (long blk = 0; blk < nblocks; blk++)
+    {
+        long lo = blk * SM_CHUNK, hi = (lo + SM_CHUNK < total) ? lo + SM_CHUNK : total;
+        __compareBits__(ac->data, sa, bc->data, sb, lo, hi, op, mask->bits);
+    }
+
+    if (ac != a)
+        smCleanup(ac);
+    if (bc != b)
+        smCleanup(bc);
+    return mask;
+}
+
+/*
+pack a float mask (nonzero is true) into bits
+*/
+BitMask *smPackMask(Array *mask)
+{
+    Array *zero = __scalar__(0.0f);
+
+    BitMask *packed = smComparePacked(mask, zero, SM_CMP_NE);
+
+    smCleanup(zero);
+    return packed;
+}
+
+/*
+a where the packed `mask` is set, b elsewhere. a and b are broadcast to
+the shape of the mask, the result is in C order.
+*/
+Array *smWherePacked(BitMask *mask, Array *a, Array *b)
+{
+    if (!__broadcastsTo__(a, mask->shape, mask->ndim) || !__broadcastsTo__(b, mask->shape, mask->ndim))
+    {
+        fprintf(stderr, ">> error: operands of where do not broadcast to the mask.\n");
+        exit(1);
+    }
+
+    Array *res = smCreate(mask->shape, mask->ndim);
+    Array *ac = __packedOperand__(a, mask->shape, mask->ndim);
+    Array *bc = __packedOperand__(b, mask->shape, mask->ndim);
+    long sa = (ac->totalsize > 1), sb = (bc->totalsize > 1);
+
+    long total = mask->totalsize;
+    long nblocks = (total + SM_CHUNK - 1) / SM_CHUNK;
+#ifdef PARALLEL
+#pragma omp parallel for if (total >= SM_PARALLEL_MIN)
+#endif
+    for (long blk = 0; blk < nblocks; blk++)
+    {
+        long lo = blk * SM_CHUNK, hi = (lo + SM_CHUNK < total) ? lo + SM_CHUNK : total;
+        __whereBits__(mask->bits, ac->data, sa, bc->data, sb, lo, hi, res->data);
+    }
+
+    if (ac != a)
+        smCleanup(ac);
+    if (bc != b)
+        smCleanup(bc);
+    return res;
+}
+
+/*
+a packed mask back as a float mask of 1s and 0s
+*/
+Array *smUnpackMask(BitMask *mask)
+{
+    Array *one = __scalar__(1.0f), *zero = __scalar__(0.0f);
+
+    Array *res = smWherePacked(mask, one, zero);
+
+    smCleanup(zero);
+    smCleanup(one);
+    return res;
+}
+
+/*
+number of set elements of a packed mask
+*/
+long smMaskCount(BitMask *mask)
+{
+    long nbytes = mask->totalsize / 8 + 1, count = 0, i = 0;
+
+    for (; i + 8 <= nbytes; i += 8)
+    {
+        unsigned long long word;
+        memcpy(&word, mask->bits + i, sizeof(word));
+        count += __builtin_popcountll(word);
+    }
+    for (; i < nbytes; i++)
+        count += __builtin_popcount(mask->bits[i]);
+
+    return count;
+}
+
+// ------------------- Rolling windows -------------------
+
+typedef struct
+{
+    long window;
+    bool mean; // sum loop: divide by the window
+    bool max;  // extreme loop: max instead of min
+} RollingContext;
+
+/*
+running state of one lane of a rolling sum or variance. only finite
+values go in the sums, NaNs and infinities are counted apart so they
+leave the window without a trace. `s2` sums |x| (sums) or the squares of
+x - shift (variance), the magnitude the sums are made of, and `peak` is
+the largest term of it since the sums were last rebuilt.
+*/
+typedef struct
+{
+    double s1, s2, peak, shift;
+    long nan, pinf, ninf;
+    bool squares;
+} RollingLane;
+
+static inline void __rollingPush__(RollingLane *r, float v, int sign)
+{
+    if (v != v)
+        r->nan += sign;
+    else if (v == INFINITY)
+        r->pinf += sign;
+    else if (v == -INFINITY)
+        r->ninf += sign;
+    else
+    {
+        double d = (double)v - r->shift;
+        double m = r->squares ? d * d : fabs(d);
+        r->s1 += sign * d;
+        r->s2 += sign * m;
+        if (sign > 0 && m > r->peak)
+            r->peak = m;
+    }
+}
+
+/*
+rebuild a lane from the n elements of a window, the variance shift
+moves to its first finite element
+*/
+static inline void __rollingRescan__(RollingLane *r, const float *x, long n, long stride)
+{
+    r->s1 = r->s2 = r->peak = r->shift = 0.0;
+    r->nan = r->pinf = r->ninf = 0;
+    for (long i = 0; r->squares && i < n; i++)
+    {
+        if (isfinite(x[i * stride]))
+        {
+            r->shift = x[i * stride];
+            break;
+        }
+    }
+    for (long i = 0; i < n; i++)
+        __rollingPush__(r, x[i * stride], 1);
+}
+
+/*
+drop `v` leaving the window, which then starts at `next` (n elements).
+when a term much larger than what is left goes, the sums have lost
+that much precision to cancellation, so they are rebuilt.
+*/
+static inline void __rollingPop__(RollingLane *r, float v, const float *next, long n, long stride)
+{
+    __rollingPush__(r, v, -1);
+    if (isfinite(v) && r->peak > SM_ROLLING_RESCAN * r->s2)
+        __rollingRescan__(r, next, n, stride);
+}
+
+/*
+rolling sum (or mean) of each run in one pass: every step adds the
+element entering the window and drops the one leaving it. the running
+sums are doubles so the drift of the add/subtract chain stays far below
+float precision even on long series. a NaN, or both infinities, in a
+window give NaN, one infinity gives that infinity.
+*/
+void __rollingSumLoop__(const float *x, float *y, long n, long stride, int width, void *ctx)
+{
+    RollingContext *c = (RollingContext *)ctx;
+    long w = c->window;
+    double scale = c->mean ? 1.0 / (double)w : 1.0;
+    RollingLane r[SM_AXIS_COLS];
+
+    for (int l = 0; l < width; l++)
+    {
+        r[l].squares = false;
+        __rollingRescan__(r + l, x + l, w - 1, stride);
+    }
+
+    for (long i = w - 1; i < n; i++)
+    {
+        const float *in = x + i * stride, *out = x + (i - w + 1) * stride;
+        float *dst = y + (i - w + 1) * stride;
+        for (int l = 0; l < width; l++)
+        {
+            RollingLane *q = r + l;
+            __rollingPush__(q, in[l], 1);
+
+            if (q->nan > 0 || (q->pinf > 0 && q->ninf > 0))
+                dst[l] = NAN;
+            else if (q->pinf > 0 || q->ninf > 0)
+                dst[l] = (q->pinf > 0) ? INFINITY : -INFINITY;
+            else
+                dst[l] = (float)(q->s1 * scale);
+
+            __rollingPop__(q, out[l], out + stride + l, w - 1, stride);
+        }
+    }
+}
+
+/*
+rolling population variance of each run in one pass, from running sums
+of x - shift and its square (shifted like the layernorm sums, so a large
+mean does not cancel the spread away). the sums are rebuilt, with the
+shift moved into the window, when the spread gets small next to them.
+NaN for windows with a NaN or an infinity.
+*/
+void __rollingVarLoop__(const float *x, float *y, long n, long stride, int width, void *ctx)
+{
+    long w = ((RollingContext *)ctx)->window;
+    RollingLane r[SM_AXIS_COLS];
+
+    for (int l = 0; l < width; l++)
+    {
+        r[l].squares = true;
+        __rollingRescan__(r + l, x + l, w - 1, stride);
+    }
+
+    for (long i = w - 1; i < n; i++)
+    {
+        const float *in = x + i * stride, *out = x + (i - w + 1) * stride;
+        float *dst = y + (i - w + 1) * stride;
+        for (int l = 0; l < width; l++)
+        {
+            RollingLane *q = r + l;
+            __rollingPush__(q, in[l], 1);
+
+            if (q->nan > 0 || q->pinf > 0 || q->ninf > 0)
+                dst[l] = NAN;
+            else
+            {
+                double var = (q->s2 - q->s1 * q->s1 / (double)w) / (double)w;
+
+                // a shift far from the window cancels the spread away
+                if (q->s2 > SM_ROLLING_RESCAN * var * (double)w)
+                {
+                    __rollingRescan__(q, out + l, w, stride);
+                    var = (q->s2 - q->s1 * q->s1 / (double)w) / (double)w;
+                }
+                dst[l] = (var > 0.0) ? (float)var : 0.0f;
+            }
+
+            __rollingPop__(q, out[l], out + stride + l, w - 1, stride);
+        }
+    }
+}
+
+/*
+rolling max (or min) of each run in one pass with a monotonic deque per
+lane: it holds the indices of the elements that can still be the
+extreme of a later window, so its front is the extreme of the current
+one. every index is pushed and popped once, O(n) whatever the window.
+NaNs are skipped like in smMax: they never enter the deque, and a
+window of only NaNs gives -inf for max (inf for min).
+*/
+void __rollingExtremeLoop__(const float *x, float *y, long n, long stride, int width, void *ctx)
+{
+    RollingContext *c = (RollingContext *)ctx;
+    long w = c->window;
+    long head[SM_AXIS_COLS], size[SM_AXIS_COLS];
+    float empty = c->max ? -INFINITY : INFINITY;
+
+    long *deque = (long *)malloc(width * w * sizeof(long));
+    _checkNull(deque);
+
+    for (int l = 0; l < width; l++)
+        head[l] = size[l] = 0;
+
+    for (long i = 0; i < n; i++)
+    {
+        for (int l = 0; l < width; l++)
+        {
+            long *q = deque + l * w;
+            float v = x[i * stride + l];
+
+            // the front leaves the window
+            if (size[l] > 0 && q[head[l]] <= i - w)
+            {
+                head[l] = (head[l] + 1 == w) ? 0 : head[l] + 1;
+                size[l]--;
+            }
+
+            if (v == v)
+            {
+                // candidates that v beats can never be an extreme again
+                while (size[l] > 0)
+                {
+                    long back = head[l] + size[l] - 1;
+                    if (back >= w)
+                        back -= w;
+                    float b = x[q[back] * stride + l];
+                    if (c->max ? b > v : b < v)
+                        break;
+                    size[l]--;
+                }
+
+                long tail = head[l] + size[l];
+                q[(tail >= w) ? tail - w : tail] = i;
+                size[l]++;
+            }
+
+            if (i >= w - 1)
+                y[(i - w + 1) * stride + l] = (size[l] > 0) ? x[q[head[l]] * stride + l] : empty;
+        }
+    }
+
+    free(deque);
+}
+
+/*
+run a rolling loop over the windows of `arr` along `axis`, the result
+has n - window + 1 elements along it ("valid" windows, the same ones as
+smSlidingWindowView)
+*/
+Array *__rolling__(Array *arr, int window, int axis, AxisLoop loop, bool mean, bool max)
+{
+    if (axis < 0)
+        axis = arr->ndim + axis;
+    if (axis < 0 || axis >= arr->ndim)
+    {
+        fprintf(stderr, ">> error: axis out of bounds for rolling window.\n");
+        exit(1);
+    }
+    if (window < 1 || window > arr->shape[axis])
+    {
+        fprintf(stderr, ">> error: window %d does not fit an axis of size %d.\n", window, arr->shape[axis]);
+        exit(1);
+    }
+
+    RollingContext ctx = {window, mean, max};
+    return __PaxisOp__(arr, axis, window - 1, loop, &ctx);
+}
+
+/*
+sum of every window of `window` consecutive elements along an axis
+*/
+Array *smRollingSum(Array *arr, int window, int axis)
+{
+    return __rolling__(arr, window, axis, __rollingSumLoop__, false, false);
+}
+
+/*
+mean of every window along an axis
+*/
+Array *smRollingMean(Array *arr, int window, int axis)
+{
+    return __rolling__(arr, window, axis, __rollingSumLoop__, true, false);
+}
+
+/*
+population variance (divided by the window) of every window along an axis
+*/
+Array *smRollingVar(Array *arr, int window, int axis)
+{
+    return __rolling__(arr, window, axis, __rollingVarLoop__, false, false);
+}
+
+/*
+minimum of every window along an axis, NaNs are skipped like in smMin
+*/
+Array *smRollingMin(Array *arr, int window, int axis)
+{
+    return __rolling__(arr, window, axis, __rollingExtremeLoop__, false, false);
+}
+
+/*
+maximum of every window along an axis, NaNs are skipped like in smMax
+*/
+Array *smRollingMax(Array *arr, int window, int axis)
+{
+    return __rolling__(arr, window, axis, __rollingExtremeLoop__, false, true);
+}
+
+// ------------------- Scans -------------------
+
+/*
+starting value of a scan: the identity of its combine op
+*/
+float __scanIdentity__(ScanOp op)
+{
+    if (op == SM_SCAN_PROD)
+        return 1.0f;
+    if (op == SM_SCAN_MAX)
+        return -INFINITY;
+    return 0.0f;
+}
+
+static inline float __scanOp__(float a, float b, ScanOp op)
+{
+    if (op == SM_SCAN_PROD)
+        return a * b;
+    if (op == SM_SCAN_MAX)
+        return (a != a || a > b) ? a : b;
+    return a + b;
+}
+
+#if defined(__AVX2__) && defined(__FMA__)
+static inline __m256 __scanOp256__(__m256 a, __m256 b, ScanOp op)
+{
+    if (op == SM_SCAN_PROD)
+        return _mm256_mul_ps(a, b);
+    if (op == SM_SCAN_MAX)
+        return __maximum256__(a, b);
+    return _mm256_add_ps(a, b);
+}
+
+/*
+inclusive scan of the 8 lanes of a register in log2(8) steps: combine
+every lane with the one 1, 2 and then 4 lanes before it, shifting the
+identity in where there is none
+*/
+static inline __m256 __scan256__(__m256 v, ScanOp op)
+{
+    __m256 id = _mm256_set1_ps(__scanIdentity__(op));
+
+    __m256 t = _mm256_castsi256_ps(_mm256_slli_si256(_mm256_castps_si256(v), 4));
+    v = __scanOp256__(v, _mm256_blend_ps(t, id, 0x11), op);
+
+    t = _mm256_castsi256_ps(_mm256_slli_si256(_mm256_castps_si256(v), 8));
+    v = __scanOp256__(v, _mm256_blend_ps(t, id, 0x33), op);
+
+    // lane 3 of the low half goes to the whole high half
+    t = _mm256_permute2f128_ps(v, v, 0x08);
+    t = _mm256_permute_ps(t, 0xFF);
+    return __scanOp256__(v, _mm256_blend_ps(t, id, 0x0F), op);
+}
+#endif
+
+/*
+inclusive scan of a contiguous run, starting from `carry`
+*/
+void __scanRun__(const float *x, float *y, long n, float carry, ScanOp op)
+{
+    long i = 0;
+
+#if defined(__AVX2__) && defined(__FMA__)
+    __m256 c = _mm256_set1_ps(carry);
+    for (; i + 8 <= n; i += 8)
+    {
+        __m256 v = __scanOp256__(__scan256__(_mm256_loadu_ps(x + i), op), c, op);
+        _mm256_storeu_ps(y + i, v);
+        c = _mm256_permute_ps(_mm256_permute2f128_ps(v, v, 0x11), 0xFF);
+    }
+    carry = _mm256_cvtss_f32(c);
+#endif
+
+    for (; i < n; i++)
+    {
+        carry = __scanOp__(carry, x[i], op);
+        y[i] = carry;
+    }
+}
+
+/*
+combine of all the elements of a contiguous run, the first pass of the
+blocked scan
+*/
+float __scanReduce__(const float *x, long n, ScanOp op)
+{
+    float acc = __scanIdentity__(op);
+    long i = 0;
+
+#if defined(__AVX2__) && defined(__FMA__)
+    __m256 a0 = _mm256_set1_ps(acc), a1 = a0, a2 = a0, a3 = a0;
+    for (; i + 32 <= n; i += 32)
+    {
+        a0 = __scanOp256__(a0, _mm256_loadu_ps(x + i), op);
+        a1 = __scanOp256__(a1, _mm256_loadu_ps(x + i + 8), op);
+        a2 = __scanOp256__(a2, _mm256_loadu_ps(x + i + 16), op);
+        a3 = __scanOp256__(a3, _mm256_loadu_ps(x + i + 24), op);
+    }
+    a0 = __scanOp256__(__scanOp256__(a0, a1, op), __scanOp256__(a2, a3, op), op);
+
+    float lanes[8];
+    _mm256_storeu_ps(lanes, a0);
+    for (int l = 0; l < 8; l++)
+        acc = __scanOp__(acc, lanes[l], op);
+#endif
+
+    for (; i < n; i++)
+        acc = __scanOp__(acc, x[i], op);
+    return acc;
+}
+
+/*
+scan along a non-contiguous axis: `n` rows of `width` adjacent columns,
+`stride` apart. each row is combined with the previous output row, so
+the loops run along the rows and vectorize across the columns.
+*/
+void __scanColumns__(const float *x, float *y, long n, long stride, long width, ScanOp op)
+{
+    if (n == 0)
+        return;
+
+    memcpy(y, x, width * sizeof(float));
+    for (long i = 1; i < n; i++)
+    {
+        const float *prev = y + (i - 1) * stride, *row = x + i * stride;
+        float *dst = y + i * stride;
+
+        if (op == SM_SCAN_PROD)
+            for (long j = 0; j < width; j++)
+                dst[j] = prev[j] * row[j];
+        else if (op == SM_SCAN_MAX)
+            for (long j = 0; j < width; j++)
+                dst[j] = (prev[j] != prev[j] || prev[j] > row[j]) ? prev[j] : row[j];
+        else
+            for (long j = 0; j < width; j++)
+                dst[j] = prev[j] + row[j];
+    }
+}
+
+/*
+inclusive scan along an axis, any layout (strided views are made
+contiguous first). the result has the shape of `arr`.
+
+many runs along a contiguous axis go to threads whole. when there are
+fewer runs than threads, every run is split into one block per thread
+and scanned in two passes: each thread reduces its block, then scans it
+again starting from the combine of the totals of the blocks before it.
+along other axes threads take chunks of SM_CHUNK columns.
+*/
+Array *__Pscan__(Array *arr, int axis, ScanOp op)
+{
+    if (axis < 0)
+        axis = arr->ndim + axis;
+    if (axis < 0 || axis >= arr->ndim)
+    {
+        fprintf(stderr, ">> error: axis out of bounds for scan.\n");
+        exit(1);
+    }
+
+    long outer = 1, inner = 1, n = arr->shape[axis];
+    for (int d = 0; d < axis; d++)
+        outer *= arr->shape[d];
+    for (int d = axis + 1; d < arr->ndim; d++)
+        inner *= arr->shape[d];
+
+    Array *src = __asContiguous__(arr);
+    Array *result = smCreate(arr->shape, arr->ndim);
+    float identity = __scanIdentity__(op);
+
+    if (inner > 1)
+    {
+        long chunks = (inner + SM_CHUNK - 1) / SM_CHUNK;
+#ifdef PARALLEL
+#pragma omp parallel for if (src->totalsize >= SM_PARALLEL_MIN)
+#endif
+        for (long t = 0; t < outer * chunks; t++)
+        {
+            long o = t / chunks, j = t % chunks * SM_CHUNK;
+            long width = (inner - j < SM_CHUNK) ? inner - j : SM_CHUNK;
+            long off = o * n * inner + j;
+            __scanColumns__(src->data + off, result->data + off, n, inner, width, op);
+        }
+    }
+    else
+    {
+        bool blocked = false;
+        int maxthreads = 1;
+#ifdef PARALLEL
+        maxthreads = omp_get_max_threads();
+        blocked = (outer < maxthreads && src->totalsize >= SM_PARALLEL_MIN);
+#endif
+
+        if (blocked)
+        {
+            float *totals = (float *)malloc(outer * maxthreads * sizeof(float));
+            _checkNull(totals);
+
+#ifdef PARALLEL
+#pragma omp parallel num_threads(maxthreads)
+#endif
+            {
+                int nthreads = 1, tid = 0;
+#ifdef PARALLEL
+                nthreads = omp_get_num_threads();
+                tid = omp_get_thread_num();
+#endif
+                long lo = n * tid / nthreads, hi = n * (tid + 1) / nthreads;
+
+                for (long o = 0; o < outer; o++)
+                    totals[o * nthreads + tid] = __scanReduce__(src->data + o * n + lo, hi - lo, op);
+
+#ifdef PARALLEL
+#pragma omp barrier
+#endif
+                for (long o = 0; o < outer; o++)
+                {
+                    float carry = identity;
+                    for (int t = 0; t < tid; t++)
+                        carry = __scanOp__(carry, totals[o * nthreads + t], op);
+                    __scanRun__(src->data + o * n + lo, result->data + o * n + lo, hi - lo, carry, op);
+                }
+            }
+
+            free(totals);
+        }
+        else
+        {
+#ifdef PARALLEL
+#pragma omp parallel for schedule(dynamic, 16) if (src->totalsize >= SM_PARALLEL_MIN)
+#endif
+            for (long o = 0; o < outer; o++)
+                __scanRun__(src->data + o * n, result->data + o * n, n, identity, op);
+        }
+    }
+
+    if (src != arr)
+        smCleanup(src);
+    return result;
+}
+
+/*
+cumulative sum along an axis
+*/
+Array *smCumsum(Array *arr, int axis)
+{
+    return __Pscan__(arr, axis, SM_SCAN_SUM);
+}
+
+/*
+cumulative product along an axis
+*/
+Array *smCumprod(Array *arr, int axis)
+{
+    return __Pscan__(arr, axis, SM_SCAN_PROD);
+}
+
+/*
+running maximum along an axis. a NaN stays in every later output, like
+numpy's maximum.accumulate.
+*/
+Array *smCummax(Array *arr, int axis)
+{
+    return __Pscan__(arr, axis, SM_SCAN_MAX);
+}
+
+// ------------------- Sorting -------------------
+
+/*
+map a float to an unsigned key with the same order, so sorting can work
+on integers: negative floats have all their bits flipped, positive ones
+only the sign. every NaN becomes the same key, above +inf.
+*/
+static inline unsigned int __sortKey__(float v)
+{
+    unsigned int u;
+    if (v != v)
+        v = NAN;
+    memcpy(&u, &v, sizeof(u));
+    return (u & 0x80000000u) ? ~u : u | 0x80000000u;
+}
+
+static inline float __sortValue__(unsigned int key)
+{
+    unsigned int u = (key & 0x80000000u) ? key & 0x7FFFFFFFu : ~key;
+    float v;
+    memcpy(&v, &u, sizeof(v));
+    return v;
+}
+
+/*
+stable sort of `n` keys (and their indices, if `idx` is not NULL).
+short runs use insertion sort, longer ones an LSD radix sort on bytes:
+one pass builds all four histograms, then every byte that is not the
+same for all the keys is scattered through `tmpk`/`tmpi` and back.
+*/
+void __sortKeys__(unsigned int *keys, int *idx, long n, unsigned int *tmpk, int *tmpi)
+{
+    if (n <= SM_SORT_SMALL)
+    {
+        for (long i = 1; i < n; i++)
+        {
+            unsigned int key = keys[i];
+            int id = idx ? idx[i] : 0;
+            long j = i - 1;
+            for (; j >= 0 && keys[j] > key; j--)
+            {
+                keys[j + 1] = keys[j];
+                if (idx)
+                    idx[j + 1] = idx[j];
+            }
+            keys[j + 1] = key;
+            if (idx)
+                idx[j + 1] = id;
+        }
+        return;
+    }
+
+    long count[4][256];
+    memset(count, 0, sizeof(count));
+    for (long i = 0; i < n; i++)
+    {
+        unsigned int key = keys[i];
+        count[0][key & 0xFF]++;
+        count[1][(key >> 8) & 0xFF]++;
+        count[2][(key >> 16) & 0xFF]++;
+        count[3][key >> 24]++;
+    }
+
+    unsigned int *src = keys, *dst = tmpk;
+    int *isrc = idx, *idst = tmpi;
+    for (int pass = 0; pass < 4; pass++)
+    {
+        int shift = 8 * pass;
+        if (count[pass][(keys[0] >> shift) & 0xFF] == n)
+            continue;
+
+        long offset = 0;
+        for (int b = 0; b < 256; b++)
+        {
+            long c = count[pass][b];
+            count[pass][b] = offset;
+            offset += c;
+        }
+
+        for (long i = 0; i < n; i++)
+        {
+            long to = count[pass][(src[i] >> shift) & 0xFF]++;
+            dst[to] = src[i];
+            if (idx)
+                idst[to] = isrc[i];
+        }
+
+        unsigned int *t = src;
+        src = dst;
+        dst = t;
+        int *it = isrc;
+        isrc = idst;
+        idst = it;
+    }
+
+    if (src != keys)
+    {
+        memcpy(keys, src, n * sizeof(unsigned int));
+        if (idx)
+            memcpy(idx, isrc, n * sizeof(int));
+    }
+}
+
+// (key, index) pairs of the top-k heap, ties broken by the index
+static inline bool __heapLess__(const unsigned int *keys, const int *idx, long a, long b)
+{
+    return keys[a] < keys[b] || (keys[a] == keys[b] && idx[a] < idx[b]);
+}
+
+void __heapSiftDown__(unsigned int *keys, int *idx, long size, long i)
+{
+    for (;;)
+    {
+        long c = 2 * i + 1;
+        if (c >= size)
+            return;
+        if (c + 1 < size && __heapLess__(keys, idx, c + 1, c))
+            c++;
+        if (!__heapLess__(keys, idx, c, i))
+            return;
+
+        unsigned int tk = keys[i];
+        keys[i] = keys[c];
+        keys[c] = tk;
+        int ti = idx[i];
+        idx[i] = idx[c];
+        idx[c] = ti;
+        i = c;
+    }
+}
+
+/*
+sort a min-heap of `k` pairs in place into descending order, by popping
+the minimum to the back over and over
+*/
+void __heapSortDescending__(unsigned int *keys, int *idx, long k)
+{
+    for (long size = k - 1; size > 0; size--)
+    {
+        unsigned int tk = keys[0];
+        keys[0] = keys[size];
+        keys[size] = tk;
+        int ti = idx[0];
+        idx[0] = idx[size];
+        idx[size] = ti;
+        __heapSiftDown__(keys, idx, size, 0);
+    }
+}
+
+/*
+top-k of one run with a min-heap of the k largest (key, index) pairs
+seen so far: most elements only get compared with the root. leaves the
+k pairs in descending order in `keys`/`idx`.
+*/
+void __topkHeap__(const float *x, long n, long stride, int k, unsigned int *keys, int *idx)
+{
+    for (long i = 0; i < k; i++)
+    {
+        keys[i] = __sortKey__(x[i * stride]);
+        idx[i] = (int)i;
+    }
+    for (long i = k / 2 - 1; i >= 0; i--)
+        __heapSiftDown__(keys, idx, k, i);
+
+    for (long i = k; i < n; i++)
+    {
+        unsigned int key = __sortKey__(x[i * stride]);
+        if (key < keys[0])
+            continue;
+
+        // equal keys win too: the later index is the larger pair
+        keys[0] = key;
+        idx[0] = (int)i;
+        __heapSiftDown__(keys, idx, k, 0);
+    }
+
+    __heapSortDescending__(keys, idx, k);
+}
+
+// a top-k small enough next to its axis goes through the heap
+bool __topkUsesHeap__(int k, long n)
+{
+    return (long)k * SM_TOPK_HEAP <= n;
+}
+
+/*
+write a sorted run: all of it ascending, or the last k reversed for a
+top-k (the order of the heap)
+*/
+void __sortWrite__(const unsigned int *keys, const int *idx, long n, SortContext *c, float *y, long stride)
+{
+    long m = c->topk ? c->k : n;
+    for (long i = 0; i < m; i++)
+    {
+        long from = c->topk ? n - 1 - i : i;
+        y[i * stride] = c->indices ? (float)idx[from] : __sortValue__(keys[from]);
+    }
+}
+
+/*
+sort (or top-k) of each run, one lane at a time through a contiguous
+key buffer
+*/
+void __sortLoop__(const float *x, float *y, long n, long stride, int width, void *ctx)
+{
+    SortContext *c = (SortContext *)ctx;
+    bool heap = c->topk && __topkUsesHeap__(c->k, n);
+    bool needidx = c->indices || heap;
+
+    unsigned int *keys = (unsigned int *)malloc(2 * n * sizeof(unsigned int));
+    int *idx = needidx ? (int *)malloc(2 * n * sizeof(int)) : NULL;
+    _checkNull(keys);
+    if (needidx)
+        _checkNull(idx);
+
+    for (int l = 0; l < width; l++)
+    {
+        if (heap)
+        {
+            __topkHeap__(x + l, n, stride, c->k, keys, idx);
+            for (long i = 0; i < c->k; i++)
+                y[i * stride + l] = c->indices ? (float)idx[i] : __sortValue__(keys[i]);
+            continue;
+        }
+
+        for (long i = 0; i < n; i++)
+            keys[i] = __sortKey__(x[i * stride + l]);
+        if (needidx)
+            for (long i = 0; i < n; i++)
+                idx[i] = (int)i;
+
+        __sortKeys__(keys, idx, n, keys + n, needidx ? idx + n : NULL);
+        __sortWrite__(keys, idx, n, c, y + l, stride);
+    }
+
+    free(idx);
+    free(keys);
+}
+
+/*
+merge path: how many of the first `k` merged elements come from `a`.
+equal keys are taken from `a` first, which keeps the merge stable.
+*/
+long __mergeCoRank__(long k, const unsigned int *a, long na, const unsigned int *b, long nb)
+{
+    long lo = (k > nb) ? k - nb : 0, hi = (k < na) ? k : na;
+    while (lo < hi)
+    {
+        long i = (lo + hi) / 2;
+        if (b[k - i - 1] >= a[i])
+            lo = i + 1;
+        else
+            hi = i;
+    }
+    return lo;
+}
+
+/*
+elements [k0, k1) of the merge of a and b into `out`
+*/
+void __mergeRange__(
+    const unsigned int *a, const int *ia, long na,
+    const unsigned int *b, const int *ib, long nb,
+    unsigned int *out, int *iout, long k0, long k1)
+{
+    long i = __mergeCoRank__(k0, a, na, b, nb), j = k0 - i;
+    for (long k = k0; k < k1; k++)
+    {
+        bool froma = (j >= nb) || (i < na && a[i] <= b[j]);
+        if (froma)
+        {
+            out[k] = a[i];
+            if (iout)
+                iout[k] = ia[i];
+            i++;
+        }
+        else
+        {
+            out[k] = b[j];
+            if (iout)
+                iout[k] = ib[j];
+            j++;
+        }
+    }
+}
+
+/*
+sort of a single long run on all threads: every thread radix sorts one
+block, then the blocks are merged pairwise. each merge is cut into
+pieces of equal output size with merge path, so every round keeps all
+the threads busy, the last one included.
+*/
+Array *__PsortLarge__(Array *arr, SortContext *c)
+{
+    long n = arr->totalsize;
+    Array *src = __asContiguous__(arr);
+    bool needidx = c->indices;
+
+    int nthreads = 1;
+#ifdef PARALLEL
+    nthreads = omp_get_max_threads();
+#endif
+
+    unsigned int *keys = (unsigned int *)malloc(2 * n * sizeof(unsigned int));
+    int *idx = needidx ? (int *)malloc(2 * n * sizeof(int)) : NULL;
+    long *bounds = (long *)malloc((nthreads + 1) * sizeof(long));
+    _checkNull(keys);
+    _checkNull(bounds);
+    if (needidx)
+        _checkNull(idx);
+
+    for (int t = 0; t <= nthreads; t++)
+        bounds[t] = n * t / nthreads;
+
+#ifdef PARALLEL
+#pragma omp parallel for num_threads(nthreads)
+#endif
+    for (int t = 0; t < nthreads; t++)
+    {
+        long lo = bounds[t], len = bounds[t + 1] - lo;
+        for (long i = lo; i < lo + len; i++)
+        {
+            keys[i] = __sortKey__(src->data[i]);
+            if (needidx)
+                idx[i] = (int)i;
+        }
+        __sortKeys__(keys + lo, needidx ? idx + lo : NULL, len, keys + n + lo, needidx ? idx + n + lo : NULL);
+    }
+
+    unsigned int *from = keys, *to = keys + n;
+    int *ifrom = idx, *ito = needidx ? idx + n : NULL;
+    for (int runs = nthreads; runs > 1; runs = (runs + 1) / 2)
+    {
+        int pairs = runs / 2;
+        int parts = (nthreads + pairs - 1) / pairs;
+
+#ifdef PARALLEL
+#pragma omp parallel for num_threads(nthreads)
+#endif
+        for (int t = 0; t < pairs * parts; t++)
+        {
+            int p = t / parts, q = t % parts;
+            long a0 = bounds[2 * p], b0 = bounds[2 * p + 1], e = bounds[2 * p + 2];
+            long total = e - a0;
+            __mergeRange__(
+                from + a0, needidx ? ifrom + a0 : NULL, b0 - a0,
+                from + b0, needidx ? ifrom + b0 : NULL, e - b0,
+                to + a0, needidx ? ito + a0 : NULL,
+                total * q / parts, total * (q + 1) / parts);
+        }
+
+        // an odd run out is carried over as it is
+        if (runs % 2)
+        {
+            long lo = bounds[runs - 1], len = bounds[runs] - lo;
+            memcpy(to + lo, from + lo, len * sizeof(unsigned int));
+            if (needidx)
+                memcpy(ito + lo, ifrom + lo, len * sizeof(int));
+        }
+
+        for (int r = 0; r < (runs + 1) / 2; r++)
+            bounds[r + 1] = bounds[(2 * r + 2 < runs) ? 2 * r + 2 : runs];
+
+        unsigned int *t = from;
+        from = to;
+        to = t;
+        int *it = ifrom;
+        ifrom = ito;
+        ito = it;
+    }
+
+    int shape[1] = {c->topk ? c->k : (int)n};
+    Array *result = smCreate(shape, 1);
+    __sortWrite__(from, ifrom, n, c, result->data, 1);
+
+    free(bounds);
+    free(idx);
+    free(keys);
+    if (src != arr)
+        smCleanup(src);
+    return result;
+}
+
+/*
+sort, argsort or top-k along an axis. a 1D array (or any array with a
+single run along `axis`) long enough to be worth it is sorted on all
+threads with `__PsortLarge__`, otherwise the runs are spread over the
+threads by `__PaxisOp__`.
+*/
+Array *__Psort__(Array *arr, int axis, SortContext *c)
+{
+    if (axis < 0)
+        axis = arr->ndim + axis;
+    if (axis < 0 || axis >= arr->ndim)
+    {
+        fprintf(stderr, ">> error: axis out of bounds for sort.\n");
+        exit(1);
+    }
+
+    long n = arr->shape[axis];
+    if (c->topk && (c->k < 1 || c->k > n))
+    {
+        fprintf(stderr, ">> error: k = %d is out of range for an axis of size %ld.\n", c->k, n);
+        exit(1);
+    }
+
+#ifdef PARALLEL
+    bool heap = c->topk && __topkUsesHeap__(c->k, n);
+    if (arr->totalsize == n && n >= SM_PARALLEL_MIN && !heap && omp_get_max_threads() > 1)
+    {
+        Array *flat = __PsortLarge__(arr, c);
+        int shape[arr->ndim];
+        for (int d = 0; d < arr->ndim; d++)
+            shape[d] = arr->shape[d];
+        shape[axis] = flat->shape[0];
+        smReshapeInplace(flat, shape, arr->ndim);
+        return flat;
+    }
+#endif
+
+    return __PaxisOp__(arr, axis, c->topk ? (int)n - c->k : 0, __sortLoop__, c);
+}
+
+/*
+sort along an axis in ascending order, -0 before +0 and NaNs last
+*/
+Array *smSort(Array *arr, int axis)
+{
+    SortContext ctx = {0, false, false};
+    return __Psort__(arr, axis, &ctx);
+}
+
+/*
+positions along an axis that sort it, as floats (see smTake). the sort
+is stable: equal elements keep their order.
+*/
+Array *smArgSort(Array *arr, int axis)
+{
+    SortContext ctx = {0, true, false};
+    return __Psort__(arr, axis, &ctx);
+}
+
+/*
+the `k` largest elements along an axis in descending order. if `indices`
+is not NULL it receives their positions along the axis (a new Array of
+the same shape). among equal elements the later ones come first.
+*/
+Array *smTopK(Array *arr, int k, int axis, Array **indices)
+{
+    SortContext ctx = {k, indices != NULL, true};
+    Array *result = __Psort__(arr, axis, &ctx);
+    if (indices == NULL)
+        return result;
+
+    *indices = result;
+    return smTakeAlongAxis(arr, result, axis);
+}
+
+// ------------------- Distances and nearest neighbours -------------------
+
+/*
+what the distance epilogue needs per row: squared norms for squared L2,
+inverse norms (0 for zero rows) for cosine, nothing for inner products
+*/
+void __distanceNorms__(const float *x, int rows, int d, Distance metric, float *out)
+{
+    if (metric == SM_DIST_INNER)
+        return;
+
+#ifdef PARALLEL
+#pragma omp parallel for if ((long)rows * d >= SM_PARALLEL_MIN)
+#endif
+    for (int i = 0; i < rows; i++)
+    {
+        float s = __dotKernel__(x + (long)i * d, x + (long)i * d, d);
+        if (metric == SM_DIST_COSINE)
+            out[i] = (s > 0.0f) ? 1.0f / sqrtf(s) : 0.0f;
+        else
+            out[i] = s;
+    }
+}
+
+/*
+turn a (rows, cols) tile of dot products a . b into distances:
+||a||^2 + ||b||^2 - 2 a . b for squared L2 (clamped at 0, the expansion
+can cancel slightly below it for near points), 1 - cos for cosine.
+inner products stay as they are.
+*/
+void __distanceEpilogue__(float *c, long ldc, int rows, int cols, const float *na, const float *nb, Distance metric)
+{
+    if (metric == SM_DIST_INNER)
+        return;
+
+    for (int i = 0; i < rows; i++)
+    {
+        float *row = c + i * ldc;
+        if (metric == SM_DIST_COSINE)
+        {
+            for (int j = 0; j < cols; j++)
+                row[j] = 1.0f - row[j] * na[i] * nb[j];
+        }
+        else
+        {
+            for (int j = 0; j < cols; j++)
+            {
+                float v = na[i] + nb[j] - 2.0f * row[j];
+                row[j] = (v > 0.0f) ? v : 0.0f;
+            }
+        }
+    }
+}
+
+/*
+check the operands of smCdist/smKnn, both (rows, d), and make their rows
+contiguous
+*/
+void __distanceOperands__(Array *a, Array *b, Array **ac, Array **bc)
+{
+    if (a->ndim != 2 || b->ndim != 2)
+    {
+        fprintf(stderr, ">> error: distances need 2D Arrays of row vectors.\n");
+        exit(1);
+    }
+    if (a->shape[1] != b->shape[1])
+    {
+        fprintf(stderr, ">> error: vectors of size %d and %d cannot be compared.\n", a->shape[1], b->shape[1]);
+        exit(1);
+    }
+
+    *ac = __asContiguous__(a);
+    *bc = __asContiguous__(b);
+}
+
+/*
+distances between every row of `a` (m, d) and every row of `b` (n, d),
+an (m, n) Array. the dot products all come from one blocked GEMM with
+b transposed through its strides, the norms are added afterwards.
+*/
+Array *smCdist(Array *a, Array *b, Distance metric)
+{
+    Array *ac, *bc;
+    __distanceOperands__(a, b, &ac, &bc);
+
+    int m = a->shape[0], n = b->shape[0], d = a->shape[1];
+    float *na = (float *)malloc(((long)m + n + 1) * sizeof(float));
+    _checkNull(na);
+    float *nb = na + m;
+
+    __distanceNorms__(ac->data, m, d, metric, na);
+    __distanceNorms__(bc->data, n, d, metric, nb);
+
+    Array *result = smCreate((int[]){m, n}, 2);
+    __sgemm__(m, d, n, 1.0f, ac->data, d, 1, bc->data, 1, d, 0.0f, result->data, n, 1, 0, __accumulation__);
+
+#ifdef PARALLEL
+#pragma omp parallel for if (result->totalsize >= SM_PARALLEL_MIN)
+#endif
+    for (int i = 0; i < m; i++)
+        __distanceEpilogue__(result->data + (long)i * n, n, 1, n, na + i, nb, metric);
+
+    free(na);
+    if (ac != a)
+        smCleanup(ac);
+    if (bc != b)
+        smCleanup(bc);
+    return result;
+}
+
+/*
+offer a row of distances (columns j0, j0 + 1, ...) to the heap of one
+query. heap keys rank by closeness: the negated distance, or the inner
+product itself.
+*/
+void __knnPush__(const float *dist, int cols, int j0, Distance metric, unsigned int *keys, int *idx, int k)
+{
+    bool larger = (metric == SM_DIST_INNER);
+    for (int j = 0; j < cols; j++)
+    {
+        unsigned int key = __sortKey__(larger ? dist[j] : -dist[j]);
+        if (key < keys[0])
+            continue;
+
+        keys[0] = key;
+        idx[0] = j0 + j;
+        __heapSiftDown__(keys, idx, k, 0);
+    }
+}
+
+/*
+the `k` nearest rows of `base` (n, d) for every row of `queries` (m, d):
+distances in an (m, k) Array, nearest first (largest inner product
+first). `indices`, if not NULL, receives the matching rows of `base`.
+
+the distance matrix never exists as a whole: every task takes
+SM_KNN_QB queries, computes their distances to SM_KNN_NB base rows at a
+time with the blocked GEMM and pushes each tile straight into
+per-query heaps.
+*/
+Array *smKnn(Array *queries, Array *base, int k, Distance metric, Array **indices)
+{
+    Array *qc, *bc;
+    __distanceOperands__(queries, base, &qc, &bc);
+
+    int m = queries->shape[0], n = base->shape[0], d = queries->shape[1];
+    if (k < 1 || k > n)
+    {
+        fprintf(stderr, ">> error: k = %d is out of range for %d base vectors.\n", k, n);
+        exit(1);
+    }
+
+    float *nq = (float *)malloc(((long)m + n + 1) * sizeof(float));
+    unsigned int *keys = (unsigned int *)malloc((long)m * k * sizeof(unsigned int));
+    int *idx = (int *)malloc((long)m * k * sizeof(int));
+    _checkNull(nq);
+    _checkNull(keys);
+    _checkNull(idx);
+    float *nb = nq + m;
+
+    __distanceNorms__(qc->data, m, d, metric, nq);
+    __distanceNorms__(bc->data, n, d, metric, nb);
+
+    // key 0 is below every real key (NaNs included), so the heaps start full
+    for (long i = 0; i < (long)m * k; i++)
+    {
+        keys[i] = 0;
+        idx[i] = -1;
+    }
+
+    long qblocks = (m + SM_KNN_QB - 1) / SM_KNN_QB;
+    Accumulation mode = __accumulation__;
+#ifdef PARALLEL
+#pragma omp parallel for schedule(dynamic) if (qblocks > 1 && (double)m * n * d >= SM_PARALLEL_MIN)
+#endif
+    for (long qb = 0; qb < qblocks; qb++)
+    {
+        int i0 = (int)qb * SM_KNN_QB;
+        int rows = (m - i0 < SM_KNN_QB) ? m - i0 : SM_KNN_QB;
+
+        float *tile = (float *)malloc((long)rows * SM_KNN_NB * sizeof(float));
+        _checkNull(tile);
+
+        for (int j0 = 0; j0 < n; j0 += SM_KNN_NB)
+        {
+            int cols = (n - j0 < SM_KNN_NB) ? n - j0 : SM_KNN_NB;
+            __sgemm__(
+                rows, d, cols, 1.0f,
+                qc->data + (long)i0 * d, d, 1,
+                bc->data + (long)j0 * d, 1, d,
+                0.0f, tile, cols, 1, 0, mode);
+            __distanceEpilogue__(tile, cols, rows, cols, nq + i0, nb + j0, metric);
+
+            for (int r = 0; r < rows; r++)
+                __knnPush__(tile + (long)r * cols, cols, j0, metric,
+                            keys + (long)(i0 + r) * k, idx + (long)(i0 + r) * k, k);
+        }
+
+        for (int r = 0; r < rows; r++)
+            __heapSortDescending__(keys + (long)(i0 + r) * k, idx + (long)(i0 + r) * k, k);
+
+        free(tile);
+    }
+
+    Array *result = smCreate((int[]){m, k}, 2);
+    for (long i = 0; i < (long)m * k; i++)
+    {
+        float v = __sortValue__(keys[i]);
+        result->data[i] = (metric == SM_DIST_INNER) ? v : -v;
+    }
+
+    if (indices != NULL)
+    {
+        *indices = smCreate((int[]){m, k}, 2);
+        for (long i = 0; i < (long)m * k; i++)
+            (*indices)->data[i] = (float)idx[i];
+    }
+
+    free(idx);
+    free(keys);
+    free(nq);
+    if (qc != queries)
+        smCleanup(qc);
+    if (bc != base)
+        smCleanup(bc);
+    return result;
+}
+
+// ------------------- Segments and histograms -------------------
+
+/*
+read segment ids into a malloc'd int buffer, checked against
+[0, num_segments). counts the rows of every segment when `counts` is
+not NULL, and tells if the ids are sorted, i.e. every segment is one
+run of consecutive rows.
+*/
+int *__segmentIds__(Array *ids, int num_segments, long *counts, bool *sorted)
+{
+    long n = ids->totalsize;
+    int *idx = (int *)malloc(n * sizeof(int));
+    _checkNull(idx);
+
+    float *values = (float *)malloc(n * sizeof(float));
+    _checkNull(values);
+    __copyToBuffer__(values, ids);
+
+    bool bad = false;
+    *sorted = true;
+    for (long i = 0; i < n; i++)
+    {
+        int id = 0;
+        if (__isWholeIn__(values[i], 0.0, (double)num_segments))
+            id = (int)values[i];
+        else
+            bad = true;
+        if (counts != NULL)
+            counts[id]++;
+        if (i > 0 && id < idx[i - 1])
+            *sorted = false;
+        idx[i] = id;
+    }
+    free(values);
+
+    if (bad)
+    {
+        fprintf(stderr, ">> error: segment ids must be whole numbers in [0, %d).\n", num_segments);
+        exit(1);
+    }
+
+    return idx;
+}
+
+/*
+dst[c0:c1] += src[c0:c1], or the max of both, 8 columns at a time.
+a NULL source adds ones (bincount without weights). NaNs in the source
+are skipped by max.
+*/
+static inline void __segmentRow__(float *dst, const float *src, long c0, long c1, bool max)
+{
+    long i = c0;
+    if (src == NULL)
+    {
+        for (; i < c1; i++)
+            dst[i] += 1.0f;
+        return;
+    }
+
+#if defined(__AVX__)
+    if (max)
+        for (; i + 8 <= c1; i += 8)
+            _mm256_storeu_ps(dst + i, _mm256_max_ps(_mm256_loadu_ps(src + i), _mm256_loadu_ps(dst + i)));
+    else
+        for (; i + 8 <= c1; i += 8)
+            _mm256_storeu_ps(dst + i, _mm256_add_ps(_mm256_loadu_ps(dst + i), _mm256_loadu_ps(src + i)));
+#endif
+    if (max)
+        for (; i < c1; i++)
+            dst[i] = (src[i] > dst[i]) ? src[i] : dst[i];
+    else
+        for (; i < c1; i++)
+            dst[i] += src[i];
+}
+
+/*
+out[ids[r]] += data[r] (or max) for n rows of `inner` floats, `out` has
+num_segments rows. threads never write the same element:
+- sorted ids: every thread takes a range of rows moved to run
+  boundaries, so each segment belongs to one thread.
+- long rows: every thread takes a range of columns of all the rows.
+- fewer segments than rows: every thread adds its range of rows into a
+  private copy of `out`, then the copies are merged by ranges of `out`.
+- otherwise a segment is owned by one thread (id % nthreads), and each
+  thread only adds the rows of the segments it owns.
+*/
+void __PsegmentReduce__(const float *data, long n, long inner, const int *ids, int num_segments, bool sorted, bool max, float *out)
+{
+    long size = (long)num_segments * inner;
+    float identity = max ? -INFINITY : 0.0f;
+    for (long i = 0; i < size; i++)
+        out[i] = identity;
+
+    int maxthreads = 1;
+#ifdef PARALLEL
+    if (n * inner >= SM_PARALLEL_MIN)
+        maxthreads = omp_get_max_threads();
+#endif
+    bool by_columns = !sorted && inner >= 64L * maxthreads;
+    bool copies = !sorted && !by_columns && maxthreads > 1 && num_segments <= n;
+
+    float *priv = NULL;
+    if (copies)
+    {
+        priv = (float *)malloc((maxthreads - 1) * size * sizeof(float));
+        _checkNull(priv);
+    }
+
+#ifdef PARALLEL
+#pragma omp parallel num_threads(maxthreads) if (maxthreads > 1)
+#endif
+    {
+        int nthreads = 1, tid = 0;
+#ifdef PARALLEL
+        nthreads = omp_get_num_threads();
+        tid = omp_get_thread_num();
+#endif
+        long r0 = n * tid / nthreads, r1 = n * (tid + 1) / nthreads;
+        long c0 = 0, c1 = inner;
+        float *acc = out;
+        bool owned = false;
+
+        if (sorted)
+        {
+            while (r0 > 0 && r0 < n && ids[r0] == ids[r0 - 1])
+                r0++;
+            while (r1 > 0 && r1 < n && ids[r1] == ids[r1 - 1])
+                r1++;
+        }
+        else if (by_columns)
+        {
+            r0 = 0, r1 = n;
+            c0 = inner * tid / nthreads, c1 = inner * (tid + 1) / nthreads;
+        }
+        else if (copies)
+        {
+            if (tid > 0)
+            {
+                acc = priv + (tid - 1) * size;
+                for (long i = 0; i < size; i++)
+                    acc[i] = identity;
+            }
+        }
+        else
+        {
+            r0 = 0, r1 = n;
+            owned = (nthreads > 1);
+        }
+
+        for (long r = r0; r < r1; r++)
+        {
+            if (owned && ids[r] % nthreads != tid)
+                continue;
+            __segmentRow__(acc + ids[r] * inner, data ? data + r * inner : NULL, c0, c1, max);
+        }
+
+        if (copies)
+        {
+#ifdef PARALLEL
+#pragma omp barrier
+#endif
+            long e0 = size * tid / nthreads, e1 = size * (tid + 1) / nthreads;
+            for (int t = 1; t < nthreads; t++)
+                __segmentRow__(out, priv + (t - 1) * size, e0, e1, max);
+        }
+    }
+
+    free(priv);
+}
+
+/*
+segment reduction of the rows of `data` (along axis 0): row r goes to
+segment segment_ids[r]. the result has num_segments rows.
+*/
+Array *__Psegment__(Array *data, Array *segment_ids, int num_segments, bool mean, bool max)
+{
+    if (data->ndim < 1 || data->shape[0] != segment_ids->totalsize || num_segments < 1)
+    {
+        fprintf(stderr, ">> error: need one segment id per row of data and at least one segment.\n");
+        exit(1);
+    }
+
+    long n = data->shape[0];
+    long inner = (n > 0) ? data->totalsize / n : 0;
+
+    long *counts = NULL;
+    if (mean)
+    {
+        counts = (long *)calloc(num_segments, sizeof(long));
+        _checkNull(counts);
+    }
+    bool sorted;
+    int *ids = __segmentIds__(segment_ids, num_segments, counts, &sorted);
+
+    int *shape = (int *)malloc(data->ndim * sizeof(int));
+    _checkNull(shape);
+    memcpy(shape, data->shape, data->ndim * sizeof(int));
+    shape[0] = num_segments;
+    Array *result = smCreate(shape, data->ndim);
+    free(shape);
+
+    Array *src = __asContiguous__(data);
+    __PsegmentReduce__(src->data, n, inner, ids, num_segments, sorted, max, result->data);
+
+    if (mean)
+    {
+        for (long s = 0; s < num_segments; s++)
+        {
+            if (counts[s] == 0)
+                continue;
+            float scale = 1.0f / (float)counts[s];
+            for (long i = 0; i < inner; i++)
+                result->data[s * inner + i] *= scale;
+        }
+        free(counts);
+    }
+
+    if (src != data)
+        smCleanup(src);
+    free(ids);
+    return result;
+}
+
+/*
+sum of the rows of `data` in every segment (tensorflow's
+`unsorted_segment_sum`), segment_ids has one integral id in
+[0, num_segments) per row. ids in sorted order are detected and take a
+faster path with no private accumulators. empty segments are 0.
+```
+data = [[1, 2], [3, 4], [5, 6]], segment_ids = [0, 2, 0], num_segments = 3
+smSegmentSum(data, segment_ids, 3) = [[6, 8], [0, 0], [3, 4]]
+```
+*/
+Array *smSegmentSum(Array *data, Array *segment_ids, int num_segments)
+{
+    return __Psegment__(data, segment_ids, num_segments, false, false);
+}
+
+/*
+mean of the rows of `data` in every segment, empty segments are 0
+*/
+Array *smSegmentMean(Array *data, Array *segment_ids, int num_segments)
+{
+    return __Psegment__(data, segment_ids, num_segments, true, false);
+}
+
+/*
+max of the rows of `data` in every segment, empty segments are -inf
+*/
+Array *smSegmentMax(Array *data, Array *segment_ids, int num_segments)
+{
+    return __Psegment__(data, segment_ids, num_segments, false, true);
+}
+
+/*
+number of occurrences of every value of `x` (non negative integers),
+or the sum of their `weights` if not NULL (numpy's `bincount`). the
+result has max(x) + 1 entries, at least `minlength`.
+*/
+Array *smBincount(Array *x, Array *weights, int minlength)
+{
+    if (weights != NULL && weights->totalsize != x->totalsize)
+    {
+        fprintf(stderr, ">> error: need one weight per value for bincount.\n");
+        exit(1);
+    }
+
+    long n = x->totalsize;
+    float *values = (float *)malloc(n * sizeof(float));
+    _checkNull(values);
+    __copyToBuffer__(values, x);
+
+    int len = (minlength > 1) ? minlength : 1;
+    for (long i = 0; i < n; i++)
+    {
+        // len is max + 1, so the max must stay below INT_MAX
+        if (!__isWholeIn__(values[i], 0.0, (double)INT_MAX))
+        {
+            fprintf(stderr, ">> error: bincount needs non negative whole numbers.\n");
+            exit(1);
+        }
+        if ((int)values[i] >= len)
+            len = (int)values[i] + 1;
+    }
+    free(values);
+
+    bool sorted;
+    int *ids = __segmentIds__(x, len, NULL, &sorted);
+    Array *result = smCreate((int[]){len}, 1);
+
+    float *w = NULL;
+    if (weights != NULL)
+    {
+        w = (float *)malloc(n * sizeof(float));
+        _checkNull(w);
+        __copyToBuffer__(w, weights);
+    }
+    __PsegmentReduce__(w, n, 1, ids, len, sorted, false, result->data);
+
+    free(w);
+    free(ids);
+    return result;
+}
+
+/*
+counts of the elements of `arr` in `bins` equal bins over [lo, hi]
+(numpy's `histogram`): bin i holds lo + i * width <= x < lo + (i + 1) *
+width, the last bin also holds hi. elements outside and NaNs are not
+counted. if lo >= hi the range is the min and max of `arr`.
+
+every thread counts its part of the elements in private counters, which
+are summed at the end.
+*/
+Array *smHistogram(Array *arr, int bins, float lo, float hi)
+{
+    if (bins < 1)
+    {
+        fprintf(stderr, ">> error: histogram needs at least one bin.\n");
+        exit(1);
+    }
+
+    Array *src = __asContiguous__(arr);
+    long n = src->totalsize;
+
+    if (lo >= hi)
+    {
+        lo = INFINITY, hi = -INFINITY;
+        for (long i = 0; i < n; i++)
+        {
+            lo = (src->data[i] < lo) ? src->data[i] : lo;
+            hi = (src->data[i] > hi) ? src->data[i] : hi;
+        }
+        if (lo > hi)
+            lo = 0.0f, hi = 1.0f;
+        if (lo == hi)
+            lo -= 0.5f, hi += 0.5f;
+    }
+
+    // edges as numpy computes them, to fix the bins of values that
+    // the scaling rounds over an edge
+    float *edges = (float *)malloc((bins + 1) * sizeof(float));
+    _checkNull(edges);
+    for (int b = 0; b <= bins; b++)
+        edges[b] = lo + (hi - lo) * ((float)b / (float)bins);
+    edges[bins] = hi;
+    float scale = (float)bins / (hi - lo);
+
+    int maxthreads = 1;
+#ifdef PARALLEL
+    if (n >= SM_PARALLEL_MIN)
+        maxthreads = omp_get_max_threads();
+#endif
+    long *counts = (long *)calloc((long)maxthreads * bins, sizeof(long));
+    _checkNull(counts);
+
+#ifdef PARALLEL
+#pragma omp parallel num_threads(maxthreads) if (maxthreads > 1)
+#endif
+    {
+        int nthreads = 1, tid = 0;
+#ifdef PARALLEL
+        nthreads = omp_get_num_threads();
+        tid = omp_get_thread_num();
+#endif
+        long *mine = counts + (long)tid * bins;
+        for (long i = n * tid / nthreads; i < n * (tid + 1) / nthreads; i++)
+        {
+            float v = src->data[i];
+            if (!(v >= lo && v <= hi))
+                continue;
+
+            int b = (int)((v - lo) * scale);
+            b = (b < bins) ? b : bins - 1;
+            if (v < edges[b])
+                b--;
+            else if (b + 1 < bins && v >= edges[b + 1])
+                b++;
+            mine[b]++;
+        }
+    }
+
+    Array *result = smCreate((int[]){bins}, 1);
+    for (int b = 0; b < bins; b++)
+    {
+        long total = 0;
+        for (int t = 0; t < maxthreads; t++)
+            total += counts[(long)t * bins + b];
+        result->data[b] = (float)total;
+    }
+
+    free(counts);
+    free(edges);
+    if (src != arr)
+        smCleanup(src);
+    return result;
+}
+
+// ------------------- Unique and set operations -------------------
+
+/*
+hash key of a float: its sort key, with -0 made +0 (NaNs already share
+one key), so equal floats have equal keys and sorting the keys sorts
+the values. SM_HASH_EMPTY is a NaN key that never comes out of here.
+*/
+static inline unsigned int __hashKey__(float v)
+{
+    return __sortKey__((v == 0.0f) ? 0.0f : v);
+}
+
+// murmur3 finalizer, so keys of close floats land far apart
+static inline unsigned int __hashMix__(unsigned int k)
+{
+    k ^= k >> 16;
+    k *= 0x85EBCA6Bu;
+    k ^= k >> 13;
+    k *= 0xC2B2AE35u;
+    k ^= k >> 16;
+    return k;
+}
+
+// table a key with hash `h` goes to, partitioned on the top bits
+static inline const HashTable *__hashTable__(const HashTable *tables, int bits, unsigned int h)
+{
+    return tables + (bits ? h >> (32 - bits) : 0);
+}
+
+/*
+slot holding `key` in a table, or the free slot where it goes. the
+slots are probed linearly by groups of SM_HASH_GROUP keys, and the keys
+are stored apart from the ids so a whole group is compared with the key
+in one instruction. keys are never removed, so the first free slot ends
+the search.
+*/
+static inline long __hashProbe__(const HashTable *t, unsigned int key, unsigned int h, bool *found)
+{
+    long g = h & t->mask;
+#if defined(__AVX2__)
+    __m256i vkey = _mm256_set1_epi32((int)key);
+    __m256i vfree = _mm256_set1_epi32((int)SM_HASH_EMPTY);
+#endif
+    for (;;)
+    {
+        const unsigned int *group = t->keys + g * SM_HASH_GROUP;
+#if defined(__AVX2__)
+        __m256i v = _mm256_loadu_si256((const __m256i *)group);
+        int hit = _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(v, vkey)));
+        int empty = _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(v, vfree)));
+        if (hit | empty)
+        {
+            *found = (hit != 0);
+            return g * SM_HASH_GROUP + __builtin_ctz(hit ? hit : empty);
+        }
+#else
+        for (int s = 0; s < SM_HASH_GROUP; s++)
+        {
+            if (group[s] == key || group[s] == SM_HASH_EMPTY)
+            {
+                *found = (group[s] == key);
+                return g * SM_HASH_GROUP + s;
+            }
+        }
+#endif
+        g = (g + 1) & t->mask;
+    }
+}
+
+/*
+an empty table with room for `n` keys, at most half full. it grows as
+keys are inserted, so `n` is only a first guess.
+*/
+HashTable __hashCreate__(long n)
+{
+    long groups = 1;
+    while (groups * SM_HASH_GROUP < 2 * n)
+        groups *= 2;
+
+    HashTable t;
+    t.mask = groups - 1;
+    t.size = 0;
+    t.keys = (unsigned int *)malloc(groups * SM_HASH_GROUP * sizeof(unsigned int));
+    t.ids = (int *)malloc(groups * SM_HASH_GROUP * sizeof(int));
+    _checkNull(t.keys);
+    _checkNull(t.ids);
+    memset(t.keys, 0xFF, groups * SM_HASH_GROUP * sizeof(unsigned int));
+    return t;
+}
+
+/*
+twice the groups, the keys are inserted again from their hashes
+*/
+void __hashGrow__(HashTable *t)
+{
+    HashTable grown = __hashCreate__((t->mask + 1) * SM_HASH_GROUP);
+    for (long s = 0; s < (t->mask + 1) * SM_HASH_GROUP; s++)
+    {
+        if (t->keys[s] == SM_HASH_EMPTY)
+            continue;
+        bool found;
+        long slot = __hashProbe__(&grown, t->keys[s], __hashMix__(t->keys[s]), &found);
+        grown.keys[slot] = t->keys[s];
+        grown.ids[slot] = t->ids[s];
+    }
+    grown.size = t->size;
+
+    free(t->keys);
+    free(t->ids);
+    *t = grown;
+}
+
+/*
+insert `n` keys in order, every key keeps the position of its first
+occurrence as its id: pos[i] for keys[i], or i if `pos` is NULL.
+first[p] gets the id of the key at position p and counts[id] how many
+times it was seen, if they are not NULL.
+
+a batch of keys is hashed and its groups prefetched before any of them
+is probed, so the cache misses of the batch overlap.
+*/
+void __hashInsert__(HashTable *t, const unsigned int *keys, const int *pos, long n, int *first, int *counts)
+{
+    unsigned int h[SM_HASH_BATCH];
+    for (long b = 0; b < n; b += SM_HASH_BATCH)
+    {
+        long m = (n - b < SM_HASH_BATCH) ? n - b : SM_HASH_BATCH;
+        for (long i = 0; i < m; i++)
+        {
+            h[i] = __hashMix__(keys[b + i]);
+            long g = h[i] & t->mask;
+            __builtin_prefetch(t->keys + g * SM_HASH_GROUP, 1);
+            __builtin_prefetch(t->ids + g * SM_HASH_GROUP, 1);
+        }
+
+        for (long i = 0; i < m; i++)
+        {
+            bool found;
+            long s = __hashProbe__(t, keys[b + i], h[i], &found);
+            int p = pos ? pos[b + i] : (int)(b + i);
+            if (!found)
+            {
+                if (2 * (t->size + 1) > (t->mask + 1) * SM_HASH_GROUP)
+                {
+                    __hashGrow__(t);
+                    s = __hashProbe__(t, keys[b + i], h[i], &found);
+                }
+                t->keys[s] = keys[b + i];
+                t->ids[s] = p;
+                t->size++;
+            }
+            if (first != NULL)
+                first[p] = t->ids[s];
+            if (counts != NULL)
+                counts[t->ids[s]]++;
+        }
+    }
+}
+
+/*
+out[i] = 1 if keys[i] is in the tables and 0 otherwise, batched like
+__hashInsert__
+*/
+void __hashLookup__(const HashTable *tables, int bits, const unsigned int *keys, long n, float *out)
+{
+    unsigned int h[SM_HASH_BATCH];
+    for (long b = 0; b < n; b += SM_HASH_BATCH)
+    {
+        long m = (n - b < SM_HASH_BATCH) ? n - b : SM_HASH_BATCH;
+        for (long i = 0; i < m; i++)
+        {
+            h[i] = __hashMix__(keys[b + i]);
+            const HashTable *t = __hashTable__(tables, bits, h[i]);
+            __builtin_prefetch(t->keys + (h[i] & t->mask) * SM_HASH_GROUP);
+        }
+
+        for (long i = 0; i < m; i++)
+        {
+            bool found;
+            __hashProbe__(__hashTable__(tables, bits, h[i]), keys[b + i], h[i], &found);
+            out[b + i] = found ? 1.0f : 0.0f;
+        }
+    }
+}
+
+/*
+hash tables of `keys` (ids, `first` and `counts` as in __hashInsert__),
+1 << *bits of them, a key goes to the table of the top bits of its hash.
+
+small inputs go in one table. large ones are partitioned first, a few
+partitions per thread: every thread counts its block of keys per
+partition, then scatters them in input order to its own range of every
+partition. each partition is then built by a single thread, so the
+tables need no locks, and the first occurrence of a key is still seen
+first.
+*/
+HashTable *__hashBuild__(const unsigned int *keys, long n, int *first, int *counts, int *bits)
+{
+    int maxthreads = 1;
+#ifdef PARALLEL
+    if (n >= SM_PARALLEL_MIN)
+        maxthreads = omp_get_max_threads();
+#endif
+    *bits = 0;
+    while (maxthreads > 1 && (1 << *bits) < 4 * maxthreads)
+        (*bits)++;
+    int parts = 1 << *bits;
+
+    HashTable *tables = (HashTable *)malloc(parts * sizeof(HashTable));
+    _checkNull(tables);
+    if (parts == 1)
+    {
+        tables[0] = __hashCreate__(0);
+        __hashInsert__(tables, keys, NULL, n, first, counts);
+        return tables;
+    }
+
+    int shift = 32 - *bits;
+    unsigned int *pkeys = (unsigned int *)malloc(n * sizeof(unsigned int));
+    int *ppos = (int *)malloc(n * sizeof(int));
+    long *offsets = (long *)calloc((long)parts * maxthreads + 1, sizeof(long));
+    _checkNull(pkeys);
+    _checkNull(ppos);
+    _checkNull(offsets);
+
+#ifdef PARALLEL
+#pragma omp parallel num_threads(maxthreads)
+#endif
+    {
+        int nthreads = 1, tid = 0;
+#ifdef PARALLEL
+        nthreads = omp_get_num_threads();
+        tid = omp_get_thread_num();
+#endif
+        long lo = n * tid / nthreads, hi = n * (tid + 1) / nthreads;
+
+        for (long i = lo; i < hi; i++)
+            offsets[(long)(__hashMix__(keys[i]) >> shift) * maxthreads + tid + 1]++;
+
+#ifdef PARALLEL
+#pragma omp barrier
+#endif
+        if (tid == 0)
+            for (long j = 0; j < (long)parts * maxthreads; j++)
+                offsets[j + 1] += offsets[j];
+#ifdef PARALLEL
+#pragma omp barrier
+#endif
+
+        for (long i = lo; i < hi; i++)
+        {
+            long d = offsets[(long)(__hashMix__(keys[i]) >> shift) * maxthreads + tid]++;
+            pkeys[d] = keys[i];
+            ppos[d] = (int)i;
+        }
+    }
+
+    // every range has moved to the start of the next one, so partition p
+    // now ends at the offset of its last thread
+#ifdef PARALLEL
+#pragma omp parallel for schedule(dynamic, 1) num_threads(maxthreads)
+#endif
+    for (int p = 0; p < parts; p++)
+    {
+        long lo = p ? offsets[(long)p * maxthreads - 1] : 0;
+        long hi = offsets[(long)(p + 1) * maxthreads - 1];
+        tables[p] = __hashCreate__(0);
+        __hashInsert__(tables + p, pkeys + lo, ppos + lo, hi - lo, first, counts);
+    }
+
+    free(offsets);
+    free(ppos);
+    free(pkeys);
+    return tables;
+}
+
+void __hashCleanup__(HashTable *tables, int bits)
+{
+    for (int p = 0; p < (1 << bits); p++)
+    {
+        free(tables[p].keys);
+        free(tables[p].ids);
+    }
+    free(tables);
+}
+
+/*
+the distinct keys of `keys` in sorted order, with the position of their
+first occurrence in `upos`, returns how many there are. `ukeys` and
+`upos` hold up to n. `first` and `counts` as in __hashInsert__.
+*/
+long __hashUnique__(const unsigned int *keys, long n, int *first, int *counts, unsigned int *ukeys, int *upos)
+{
+    int bits;
+    HashTable *tables = __hashBuild__(keys, n, first, counts, &bits);
+
+    long u = 0;
+    for (int p = 0; p < (1 << bits); p++)
+    {
+        const HashTable *t = tables + p;
+        for (long s = 0; s < (t->mask + 1) * SM_HASH_GROUP; s++)
+        {
+            if (t->keys[s] == SM_HASH_EMPTY)
+                continue;
+            ukeys[u] = t->keys[s];
+            upos[u] = t->ids[s];
+            u++;
+        }
+    }
+    __hashCleanup__(tables, bits);
+
+    unsigned int *tmpk = (unsigned int *)malloc((u + 1) * sizeof(unsigned int));
+    int *tmpi = (int *)malloc((u + 1) * sizeof(int));
+    _checkNull(tmpk);
+    _checkNull(tmpi);
+    __sortKeys__(ukeys, upos, u, tmpk, tmpi);
+    free(tmpi);
+    free(tmpk);
+
+    return u;
+}
+
+/*
+hash keys of all the elements of an Array, in C order
+*/
+unsigned int *__hashKeys__(Array *arr)
+{
+    Array *src = __asContiguous__(arr);
+    long n = src->totalsize;
+    unsigned int *keys = (unsigned int *)malloc((n + 1) * sizeof(unsigned int));
+    _checkNull(keys);
+
+#ifdef PARALLEL
+#pragma omp parallel for if (n >= SM_PARALLEL_MIN)
+#endif
+    for (long i = 0; i < n; i++)
+        keys[i] = __hashKey__(src->data[i]);
+
+    if (src != arr)
+        smCleanup(src);
+    return keys;
+}
+
+/*
+sorted distinct values of `arr` (numpy's `unique`), found with a hash
+table instead of a sort of the whole input: only the distinct values
+are sorted, which pays off when there are many repeats. -0 and 0 are the same value, and so are all NaNs (last).
+if not NULL, `counts` gets the number of occurrences of every value and
+`inverse` (shape of `arr`) the position of every element in the result.
+```
+arr = [3, 1, 3, 2, 1, 3]
+smUnique(arr, &counts, &inverse) = [1, 2, 3]
+counts = [2, 1, 3], inverse = [2, 0, 2, 1, 0, 2]
+```
+*/
+Array *smUnique(Array *arr, Array **counts, Array **inverse)
+{
+    long n = arr->totalsize;
+    unsigned int *keys = __hashKeys__(arr);
+    unsigned int *ukeys = (unsigned int *)malloc((n + 1) * sizeof(unsigned int));
+    int *upos = (int *)malloc((n + 1) * sizeof(int));
+    int *first = inverse ? (int *)malloc(n * sizeof(int)) : NULL;
+    int *seen = counts ? (int *)calloc(n, sizeof(int)) : NULL;
+    _checkNull(ukeys);
+    _checkNull(upos);
+    if (inverse)
+        _checkNull(first);
+    if (counts)
+        _checkNull(seen);
+
+    long u = __hashUnique__(keys, n, first, seen, ukeys, upos);
+
+    Array *result = smCreate((int[]){(int)u}, 1);
+    for (long j = 0; j < u; j++)
+        result->data[j] = __sortValue__(ukeys[j]);
+
+    if (counts != NULL)
+    {
+        *counts = smCreate((int[]){(int)u}, 1);
+        for (long j = 0; j < u; j++)
+            (*counts)->data[j] = (float)seen[upos[j]];
+    }
+
+    if (inverse != NULL)
+    {
+        // rank of every first occurrence (in the buffer of the keys, no
+        // longer needed), then of every element
+        int *rank = (int *)ukeys;
+        for (long j = 0; j < u; j++)
+            rank[upos[j]] = (int)j;
+
+        *inverse = smCreate(arr->shape, arr->ndim);
+#ifdef PARALLEL
+#pragma omp parallel for if (n >= SM_PARALLEL_MIN)
+#endif
+        for (long i = 0; i < n; i++)
+            (*inverse)->data[i] = (float)rank[first[i]];
+    }
+
+    free(seen);
+    free(first);
+    free(upos);
+    free(ukeys);
+    free(keys);
+    return result;
+}
+
+/*
+1 where an element of `arr` is one of `values` and 0 elsewhere, with the
+shape of `arr` (numpy's `isin`). `values` goes in a hash table, then the
+elements of `arr` are looked up in parallel. as in numpy a NaN never
+compares equal, so it is not a member even when `values` has a NaN.
+*/
+Array *smIsIn(Array *arr, Array *values)
+{
+    long n = arr->totalsize;
+    unsigned int *vkeys = __hashKeys__(values);
+    int bits;
+    HashTable *tables = __hashBuild__(vkeys, values->totalsize, NULL, NULL, &bits);
+    free(vkeys);
+
+    unsigned int *keys = __hashKeys__(arr);
+    unsigned int nan = __hashKey__(NAN);
+    Array *result = smCreate(arr->shape, arr->ndim);
+    long nblocks = (n + SM_CHUNK - 1) / SM_CHUNK;
+
+#ifdef PARALLEL
+#pragma omp parallel for if (n >= SM_PARALLEL_MIN)
+#endif
+    for (long blk = 0; blk < nblocks; blk++)
+    {
+        long lo = blk * SM_CHUNK, hi = (lo + SM_CHUNK < n) ? lo + SM_CHUNK : n;
+        __hashLookup__(tables, bits, keys + lo, hi - lo, result->data + lo);
+        for (long i = lo; i < hi; i++)
+            if (keys[i] == nan)
+                result->data[i] = 0.0f;
+    }
+
+    free(keys);
+    __hashCleanup__(tables, bits);
+    return result;
+}
+
+/*
+sorted distinct values that are both in `a` and in `b` (numpy's
+`intersect1d`): the distinct values of `a` are looked up in a hash
+table of `b`.
+*/
+Array *smIntersect(Array *a, Array *b)
+{
+    long n = a->totalsize;
+    unsigned int *keys = __hashKeys__(a);
+    unsigned int *ukeys = (unsigned int *)malloc((n + 1) * sizeof(unsigned int));
+    int *upos = (int *)malloc((n + 1) * sizeof(int));
+    _checkNull(ukeys);
+    _checkNull(upos);
+    long u = __hashUnique__(keys, n, NULL, NULL, ukeys, upos);
+    free(keys);
+
+    unsigned int *bkeys = __hashKeys__(b);
+    int bits;
+    HashTable *tables = __hashBuild__(bkeys, b->totalsize, NULL, NULL, &bits);
+    free(bkeys);
+
+    float *found = (float *)malloc((u + 1) * sizeof(float));
+    _checkNull(found);
+    __hashLookup__(tables, bits, ukeys, u, found);
+    __hashCleanup__(tables, bits);
+
+    long k = 0;
+    for (long j = 0; j < u; j++)
+        if (found[j] != 0.0f)
+            ukeys[k++] = ukeys[j];
+
+    Array *result = smCreate((int[]){(int)k}, 1);
+    for (long j = 0; j < k; j++)
+        result->data[j] = __sortValue__(ukeys[j]);
+
+    free(found);
+    free(upos);
+    free(ukeys);
+    return result;
+}
+
+// ------------------- BLAS level 1/2 -------------------
+
+#if defined(__AVX__)
+// horizontal sum of the 8 lanes of a register
+static inline float __hsum256__(__m256 v)
+{
+    __m128 lo = _mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+    lo = _mm_hadd_ps(lo, lo);
+    lo = _mm_hadd_ps(lo, lo);
+    return _mm_cvtss_f32(lo);
+}
+#endif
+
+/*
+dot product of two unit-stride runs. 4 independent vector accumulators
+hide the FMA latency, a single accumulator would be latency bound
+instead of bandwidth bound.
+*/
+float __dotKernel__(const float *a, const float *b, long n)
+{
+    long i = 0;
+    float sum = 0.0f;
+#if defined(__AVX512F__)
+    __m512 acc0 = _mm512_setzero_ps(), acc1 = _mm512_setzero_ps();
+    __m512 acc2 = _mm512_setzero_ps(), acc3 = _mm512_setzero_ps();
+    for (; i + 64 <= n; i += 64)
+    {
+        acc0 = _mm512_fmadd_ps(_mm512_loadu_ps(a + i), _mm512_loadu_ps(b + i), acc0);
+        acc1 = _mm512_fmadd_ps(_mm512_loadu_ps(a + i + 16), _mm512_loadu_ps(b + i + 16), acc1);
+        acc2 = _mm512_fmadd_ps(_mm512_loadu_ps(a + i + 32), _mm512_loadu_ps(b + i + 32), acc2);
+        acc3 = _mm512_fmadd_ps(_mm512_loadu_ps(a + i + 48), _mm512_loadu_ps(b + i + 48), acc3);
+    }
+    for (; i + 16 <= n; i += 16)
+        acc0 = _mm512_fmadd_ps(_mm512_loadu_ps(a + i), _mm512_loadu_ps(b + i), acc0);
+    sum = _mm512_reduce_add_ps(_mm512_add_ps(_mm512_add_ps(acc0, acc1), _mm512_add_ps(acc2, acc3)));
+#elif defined(__AVX2__) && defined(__FMA__)
+    __m256 acc0 = _mm256_setzero_ps(), acc1 = _mm256_setzero_ps();
+    __m256 acc2 = _mm256_setzero_ps(), acc3 = _mm256_setzero_ps();
+    for (; i + 32 <= n; i += 32)
+    {
+        acc0 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i), acc0);
+        acc1 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i + 8), _mm256_loadu_ps(b + i + 8), acc1);
+        acc2 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i + 16), _mm256_loadu_ps(b + i + 16), acc2);
+        acc3 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i + 24), _mm256_loadu_ps(b + i + 24), acc3);
+    }
+    for (; i + 8 <= n; i += 8)
+        acc0 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i), acc0);
+    sum = __hsum256__(_mm256_add_ps(_mm256_add_ps(acc0, acc1), _mm256_add_ps(acc2, acc3)));
+#else
+    float acc[16] = {0};
+    for (; i + 16 <= n; i += 16)
+        for (int u = 0; u < 16; u++)
+            acc[u] += a[i + u] * b[i + u];
+    for (int u = 0; u < 16; u++)
+        sum += acc[u];
+#endif
+    for (; i < n; i++)
+        sum += a[i] * b[i];
+
+    return sum;
+}
+
+/*
+accurate accumulation kernels, both return the sum as a double:
+
+- SM_ACCUM_DOUBLE: products and sums in double. float * float is exact
+  in double, so only the additions round, at double precision.
+- SM_ACCUM_COMPENSATED: float sums that carry the rounding error of
+  every addition along (Neumaier's two-sum, written without branches so
+  it vectorizes). with FMA the rounding error of each product is kept
+  too, which gives the accuracy of a double computation at float width.
+- SM_ACCUM_FLOAT: the plain float kernels.
+*/
+double __sumAcc__(const float *x, long n, Accumulation mode)
+{
+    long i = 0;
+
+    // the float (sum, error) pairs drift on long runs: SM_CHUNK blocks,
+    // added in double
+    if (mode == SM_ACCUM_COMPENSATED && n > SM_CHUNK)
+    {
+        double total = 0.0;
+        for (long lo = 0; lo < n; lo += SM_CHUNK)
+            total += __sumAcc__(x + lo, (n - lo < SM_CHUNK) ? n - lo : SM_CHUNK, mode);
+        return total;
+    }
+
+    if (mode == SM_ACCUM_FLOAT)
+    {
+        float acc[16] = {0};
+        for (; i + 16 <= n; i += 16)
+            for (int u = 0; u < 16; u++)
+                acc[u] += x[i + u];
+        float total = 0.0f;
+        for (int u = 0; u < 16; u++)
+            total += acc[u];
+        for (; i < n; i++)
+            total += x[i];
+        return total;
+    }
+
+    if (mode == SM_ACCUM_DOUBLE)
+    {
+        double acc[8] = {0};
+        for (; i + 8 <= n; i += 8)
+            for (int u = 0; u < 8; u++)
+                acc[u] += x[i + u];
+        double total = 0.0;
+        for (int u = 0; u < 8; u++)
+            total += acc[u];
+        for (; i < n; i++)
+            total += x[i];
+        return total;
+    }
+
+    float s[16] = {0}, c[16] = {0};
+    for (; i + 16 <= n; i += 16)
+    {
+        for (int u = 0; u < 16; u++)
+        {
+            float v = x[i + u];
+            float t = s[u] + v;
+            float z = t - s[u];
+            c[u] += (s[u] - (t - z)) + (v - z);
+            s[u] = t;
+        }
+    }
+
+    double total = 0.0;
+    for (int u = 0; u < 16; u++)
+        total += (double)s[u] + c[u];
+    for (; i < n; i++)
+        total += x[i];
+    return total;
+}
+
+double __dotAcc__(const float *a, const float *b, long n, Accumulation mode)
+{
+    if (mode == SM_ACCUM_FLOAT)
+        return __dotKernel__(a, b, n);
+
+    long i = 0;
+    double total = 0.0;
+
+    // same blocks as __sumAcc__
+    if (mode == SM_ACCUM_COMPENSATED && n > SM_CHUNK)
+    {
+        for (long lo = 0; lo < n; lo += SM_CHUNK)
+            total += __dotAcc__(a + lo, b + lo, (n - lo < SM_CHUNK) ? n - lo : SM_CHUNK, mode);
+        return total;
+    }
+
+    if (mode == SM_ACCUM_DOUBLE)
+    {
+#if defined(__AVX__)
+        __m256d acc0 = _mm256_setzero_pd(), acc1 = _mm256_setzero_pd();
+        __m256d acc2 = _mm256_setzero_pd(), acc3 = _mm256_setzero_pd();
+        for (; i + 16 <= n; i += 16)
+        {
+#if defined(__FMA__)
+            acc0 = _mm256_fmadd_pd(_mm256_cvtps_pd(_mm_loadu_ps(a + i)), _mm256_cvtps_pd(_mm_loadu_ps(b + i)), acc0);
+            acc1 = _mm256_fmadd_pd(_mm256_cvtps_pd(_mm_loadu_ps(a + i + 4)), _mm256_cvtps_pd(_mm_loadu_ps(b + i + 4)), acc1);
+            acc2 = _mm256_fmadd_pd(_mm256_cvtps_pd(_mm_loadu_ps(a + i + 8)), _mm256_cvtps_pd(_mm_loadu_ps(b + i + 8)), acc2);
+            acc3 = _mm256_fmadd_pd(_mm256_cvtps_pd(_mm_loadu_ps(a + i + 12)), _mm256_cvtps_pd(_mm_loadu_ps(b + i + 12)), acc3);
+#else
+            acc0 = _mm256_add_pd(acc0, _mm256_mul_pd(_mm256_cvtps_pd(_mm_loadu_ps(a + i)), _mm256_cvtps_pd(_mm_loadu_ps(b + i))));
+            acc1 = _mm256_add_pd(acc1, _mm256_mul_pd(_mm256_cvtps_pd(_mm_loadu_ps(a + i + 4)), _mm256_cvtps_pd(_mm_loadu_ps(b + i + 4))));
+            acc2 = _mm256_add_pd(acc2, _mm256_mul_pd(_mm256_cvtps_pd(_mm_loadu_ps(a + i + 8)), _mm256_cvtps_pd(_mm_loadu_ps(b + i + 8))));
+            acc3 = _mm256_add_pd(acc3, _mm256_mul_pd(_mm256_cvtps_pd(_mm_loadu_ps(a + i + 12)), _mm256_cvtps_pd(_mm_loadu_ps(b + i + 12))));
+#endif
+        }
+        double lanes[4];
+        _mm256_storeu_pd(lanes, _mm256_add_pd(_mm256_add_pd(acc0, acc1), _mm256_add_pd(acc2, acc3)));
+        total = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+#else
+        double acc[8] = {0};
+        for (; i + 8 <= n; i += 8)
+            for (int u = 0; u < 8; u++)
+                acc[u] += (double)a[i + u] * b[i + u];
+        for (int u = 0; u < 8; u++)
+            total += acc[u];
+#endif
+        for (; i < n; i++)
+            total += (double)a[i] * b[i];
+        return total;
+    }
+
+#if defined(__AVX2__) && defined(__FMA__)
+    __m256 s0 = _mm256_setzero_ps(), c0 = _mm256_setzero_ps();
+    __m256 s1 = _mm256_setzero_ps(), c1 = _mm256_setzero_ps();
+    for (; i + 16 <= n; i += 16)
+    {
+        // two independent (sum, error) chains for latency
+        __m256 va = _mm256_loadu_ps(a + i), vb = _mm256_loadu_ps(b + i);
+        __m256 p = _mm256_mul_ps(va, vb);
+        __m256 t = _mm256_add_ps(s0, p);
+        __m256 z = _mm256_sub_ps(t, s0);
+        __m256 e = _mm256_add_ps(_mm256_sub_ps(s0, _mm256_sub_ps(t, z)), _mm256_sub_ps(p, z));
+        c0 = _mm256_add_ps(c0, _mm256_add_ps(e, _mm256_fmsub_ps(va, vb, p)));
+        s0 = t;
+
+        va = _mm256_loadu_ps(a + i + 8);
+        vb = _mm256_loadu_ps(b + i + 8);
+        p = _mm256_mul_ps(va, vb);
+        t = _mm256_add_ps(s1, p);
+        z = _mm256_sub_ps(t, s1);
+        e = _mm256_add_ps(_mm256_sub_ps(s1, _mm256_sub_ps(t, z)), _mm256_sub_ps(p, z));
+        c1 = _mm256_add_ps(c1, _mm256_add_ps(e, _mm256_fmsub_ps(va, vb, p)));
+        s1 = t;
+    }
+    float sl[16], cl[16];
+    _mm256_storeu_ps(sl, s0);
+    _mm256_storeu_ps(sl + 8, s1);
+    _mm256_storeu_ps(cl, c0);
+    _mm256_storeu_ps(cl + 8, c1);
+#else
+    float sl[16] = {0}, cl[16] = {0};
+    for (; i + 16 <= n; i += 16)
+    {
+        for (int u = 0; u < 16; u++)
+        {
+            float p = a[i + u] * b[i + u];
+            float t = sl[u] + p;
+            float z = t - sl[u];
+            cl[u] += (sl[u] - (t - z)) + (p - z);
+            sl[u] = t;
+        }
+    }
+#endif
+    for (int u = 0; u < 16; u++)
+        total += (double)sl[u] + cl[u];
+    for (; i < n; i++)
+        total += (double)a[i] * b[i];
+    return total;
+}
+
+/*
+select how dot products (smDot, smDotAxis, smGemv), matrix products
+(smMatMul and everything built on the blocked GEMM) and sums (smSum,
+smMean) accumulate, see `Accumulation`. the setting is global: every
+operation reads it once when it starts and hands it down to its kernels
+and threads, so a change only affects operations started after it.
+*/
+void smSetAccumulation(Accumulation mode)
+{
+    __accumulation__ = mode;
+}
+
+Accumulation smGetAccumulation(void)
+{
+    return __accumulation__;
+}
+
+/*
+reduce `inputs` along `axis` with an accurate accumulation: the sum of
+one input or the dot product of two. the axis is moved last and made
+contiguous (one copy, only if it is not already), then every output
+element is one kernel call over a contiguous run. a single run is split
+among threads, the partials are added in double.
+*/
+Array *__PreduceAccurate__(Array **inputs, int nin, int axis, Accumulation mode)
+{
+    Array *arr = inputs[0];
+    if (axis < 0)
+        axis = arr->ndim + axis;
+
+    if (axis < 0 || axis >= arr->ndim)
+    {
+        fprintf(stderr, ">> error: axis out of bounds for reduction.\n");
+        exit(1);
+    }
+    if (nin == 2 && !smCheckShapesEqual(inputs[0], inputs[1]))
+    {
+        fprintf(stderr, ">> error: all Arrays of a reduction must have the same shape.\n");
+        exit(1);
+    }
+
+    int perm[SM_MAXDIMS], res_shape[SM_MAXDIMS];
+    for (int i = 0, j = 0; i < arr->ndim; i++)
+        if (i != axis)
+        {
+            perm[j] = i;
+            res_shape[j++] = arr->shape[i];
+        }
+    perm[arr->ndim - 1] = axis;
+    res_shape[0] = (arr->ndim > 1) ? res_shape[0] : 1;
+
+    Array *res = smCreate(res_shape, (arr->ndim > 1) ? arr->ndim - 1 : 1);
+
+    const float *rows[2];
+    Array *tmp[2] = {NULL, NULL};
+    for (int k = 0; k < nin; k++)
+    {
+        Array *moved = smTransposeView(inputs[k], perm);
+        if (__isContiguousC__(moved))
+            rows[k] = moved->data;
+        else
+        {
+            tmp[k] = smContiguous(moved);
+            rows[k] = tmp[k]->data;
+        }
+        smCleanup(moved);
+    }
+
+    long len = arr->shape[axis];
+    long nrows = res->totalsize;
+
+    if (nrows == 1)
+    {
+        double total = 0.0;
+        long nchunks = (len + SM_CHUNK - 1) / SM_CHUNK;
+
+#ifdef PARALLEL
+#pragma omp parallel for reduction(+ : total) if (len >= SM_PARALLEL_MIN)
+#endif
+        for (long t = 0; t < nchunks; t++)
+        {
+            long lo = t * SM_CHUNK, cnt = (len - lo < SM_CHUNK) ? len - lo : SM_CHUNK;
+            total += (nin == 2) ? __dotAcc__(rows[0] + lo, rows[1] + lo, cnt, mode)
+                                : __sumAcc__(rows[0] + lo, cnt, mode);
+        }
+        res->data[0] = (float)total;
+    }
+    else
+    {
+#ifdef PARALLEL
+#pragma omp parallel for if (nrows * len >= SM_PARALLEL_MIN)
+#endif
+        for (long r = 0; r < nrows; r++)
+            res->data[r] = (float)((nin == 2) ? __dotAcc__(rows[0] + r * len, rows[1] + r * len, len, mode)
+                                              : __sumAcc__(rows[0] + r * len, len, mode));
+    }
+
+    for (int k = 0; k < nin; k++)
+        if (tmp[k])
+            smCleanup(tmp[k]);
+
+    return res;
+}
+
+/*
+4 dot products against the same vector `x` at once, every element of
+`x` is loaded once for 4 rows. this is the inner kernel of GEMV.
+*/
+void __dot4Kernel__(
+    const float *a0, const float *a1, const float *a2, const float *a3,
+    const float *x, long n, float *out)
+{
+    long i = 0;
+    float s0 = 0.0f, s1 = 0.0f, s2 = 0.0f, s3 = 0.0f;
+#if defined(__AVX2__) && defined(__FMA__)
+    __m256 acc0 = _mm256_setzero_ps(), acc1 = _mm256_setzero_ps();
+    __m256 acc2 = _mm256_setzero_ps(), acc3 = _mm256_setzero_ps();
+    for (; i + 8 <= n; i += 8)
+    {
+        __m256 xv = _mm256_loadu_ps(x + i);
+        acc0 = _mm256_fmadd_ps(_mm256_loadu_ps(a0 + i), xv, acc0);
+        acc1 = _mm256_fmadd_ps(_mm256_loadu_ps(a1 + i), xv, acc1);
+        acc2 = _mm256_fmadd_ps(_mm256_loadu_ps(a2 + i), xv, acc2);
+        acc3 = _mm256_fmadd_ps(_mm256_loadu_ps(a3 + i), xv, acc3);
+    }
+    s0 = __hsum256__(acc0);
+    s1 = __hsum256__(acc1);
+    s2 = __hsum256__(acc2);
+    s3 = __hsum256__(acc3);
+#else
+    float acc0[8] = {0}, acc1[8] = {0}, acc2[8] = {0}, acc3[8] = {0};
+    for (; i + 8 <= n; i += 8)
+    {
+        for (int u = 0; u < 8; u++)
+        {
+            acc0[u] += a0[i + u] * x[i + u];
+            acc1[u] += a1[i + u] * x[i + u];
+            acc2[u] += a2[i + u] * x[i + u];
+            acc3[u] += a3[i + u] * x[i + u];
+        }
+    }
+    for (int u = 0; u < 8; u++)
+    {
+        s0 += acc0[u];
+        s1 += acc1[u];
+        s2 += acc2[u];
+        s3 += acc3[u];
+    }
+#endif
+    for (; i < n; i++)
+    {
+        s0 += a0[i] * x[i];
+        s1 += a1[i] * x[i];
+        s2 += a2[i] * x[i];
+        s3 += a3[i] * x[i];
+    }
+
+    out[0] = s0;
+    out[1] = s1;
+    out[2] = s2;
+    out[3] = s3;
+}
+
+/*
+y = A @ x for an (m, n) matrix with element strides rs/cs and unit
+stride x and y. transposed products just swap (m, n) and (rs, cs).
+
+- rows contiguous (cs == 1): 4 rows at a time share the loads of x,
+  rows are spread over threads
+- columns contiguous (rs == 1): y is accumulated 4 columns at a time,
+  every thread owns a range of y, so the matrix is streamed once
+- anything else: plain strided dots
+
+either way A is read exactly once, which is all GEMV can hope for.
+the accurate accumulation modes use `__dotAcc__` for rows, and a double
+y for columns (compensated sums go to it every SM_CHUNK columns).
+*/
+void __sgemv__(int m, int n, const float *a, long rs, long cs, const float *x, float *y, Accumulation mode)
+{
+    if (cs == 1 && mode != SM_ACCUM_FLOAT)
+    {
+#ifdef PARALLEL
+#pragma omp parallel for if ((long)m * n >= SM_PARALLEL_MIN)
+#endif
+        for (int i = 0; i < m; i++)
+            y[i] = (float)__dotAcc__(a + i * rs, x, n, mode);
+        return;
+    }
+
+    if (cs == 1)
+    {
+        long nblocks = (m + 3) / 4;
+#ifdef PARALLEL
+#pragma omp parallel for schedule(static) if ((long)m * n >= SM_PARALLEL_MIN)
+#endif
+        for (long blk = 0; blk < nblocks; blk++)
+        {
+            long i = blk * 4;
+            if (i + 4 <= m)
+                __dot4Kernel__(a + i * rs, a + (i + 1) * rs, a + (i + 2) * rs, a + (i + 3) * rs, x, n, y + i);
+            else
+                for (; i < m; i++)
+                    y[i] = __dotKernel__(a + i * rs, x, n);
+        }
+        return;
+    }
+
+    if (rs == 1)
+    {
+#ifdef PARALLEL
+#pragma omp parallel if ((long)m * n >= SM_PARALLEL_MIN)
+#endif
+        {
+            int nthreads = 1, tid = 0;
+#ifdef PARALLEL
+            nthreads = omp_get_num_threads();
+            tid = omp_get_thread_num();
+#endif
+            // ranges of y in multiples of 16 to keep stores aligned to lines
+            long chunk = ((m + nthreads - 1) / nthreads + 15) / 16 * 16;
+            long i0 = chunk * tid < m ? chunk * tid : m;
+            long i1 = i0 + chunk < m ? i0 + chunk : m;
+
+            for (long i = i0; i < i1; i++)
+                y[i] = 0.0f;
+
+            if (mode != SM_ACCUM_FLOAT)
+            {
+                // y in double, or y plus the rounding errors of its sums
+                double *yd = (double *)calloc(i1 - i0 + 1, sizeof(double));
+                float *err = (float *)calloc(i1 - i0 + 1, sizeof(float));
+                _checkNull(yd);
+                _checkNull(err);
+
+                for (long j = 0; j < n; j++)
+                {
+                    const float *cj = a + j * cs + i0;
+                    float xj = x[j];
+                    if (mode == SM_ACCUM_DOUBLE)
+                        for (long i = 0; i < i1 - i0; i++)
+                            yd[i] += (double)xj * cj[i];
+                    else
+                    {
+                        for (long i = 0; i < i1 - i0; i++)
+                        {
+                            float prod = xj * cj[i];
+                            float t = y[i0 + i] + prod;
+                            float z = t - y[i0 + i];
+                            err[i] += (y[i0 + i] - (t - z)) + (prod - z);
+                            y[i0 + i] = t;
+                        }
+
+                        // every SM_CHUNK columns the compensated sums go to double
+                        if ((j + 1) % SM_CHUNK == 0 || j == n - 1)
+                            for (long i = 0; i < i1 - i0; i++)
+                            {
+                                yd[i] += (double)y[i0 + i] + err[i];
+                                y[i0 + i] = err[i] = 0.0f;
+                            }
+                    }
+                }
+
+                for (long i = 0; i < i1 - i0; i++)
+                    y[i0 + i] = (float)yd[i];
+
+                free(yd);
+                free(err);
+            }
+            else
+            {
+                long j = 0;
+                for (; j + 4 <= n; j += 4)
+                {
+                    const float *c0 = a + j * cs, *c1 = a + (j + 1) * cs;
+                    const float *c2 = a + (j + 2) * cs, *c3 = a + (j + 3) * cs;
+                    float x0 = x[j], x1 = x[j + 1], x2 = x[j + 2], x3 = x[j + 3];
+                    for (long i = i0; i < i1; i++)
+                        y[i] += x0 * c0[i] + x1 * c1[i] + x2 * c2[i] + x3 * c3[i];
+                }
+                for (; j < n; j++)
+                {
+                    const float *c0 = a + j * cs;
+                    for (long i = i0; i < i1; i++)
+                        y[i] += x[j] * c0[i];
+                }
+            }
+        }
+        return;
+    }
+
+#ifdef PARALLEL
+#pragma omp parallel for if ((long)m * n >= SM_PARALLEL_MIN)
+#endif
+    for (int i = 0; i < m; i++)
+    {
+        // the accurate modes accumulate these strided rows in double
+        float sum = 0.0f;
+        double dsum = 0.0;
+        for (int j = 0; j < n; j++)
+        {
+            if (mode == SM_ACCUM_FLOAT)
+                sum += a[i * rs + j * cs] * x[j];
+            else
+                dsum += (double)a[i * rs + j * cs] * x[j];
+        }
+        y[i] = (mode == SM_ACCUM_FLOAT) ? sum : (float)dsum;
+    }
+}
+
+/*
+`__sgemv__` with strided x and y (incx, incy elements apart): vectors
+that are not contiguous go through a buffer
+*/
+void __sgemvStrided__(
+    int m, int n, const float *a, long rs, long cs,
+    const float *x, long incx, float *y, long incy, Accumulation mode)
+{
+    float *xb = NULL, *yb = y;
+    if (incx != 1 && n > 0)
+    {
+        xb = (float *)malloc(n * sizeof(float));
+        _checkNull(xb);
+        for (int k = 0; k < n; k++)
+            xb[k] = x[k * incx];
+        x = xb;
+    }
+    if (incy != 1 && m > 0)
+    {
+        yb = (float *)malloc(m * sizeof(float));
+        _checkNull(yb);
+    }
+
+    __sgemv__(m, n, a, rs, cs, x, yb, mode);
+
+    if (yb != y)
+    {
+        for (int i = 0; i < m; i++)
+            y[i * incy] = yb[i];
+        free(yb);
+    }
+    free(xb);
+}
+
+/*
+matrix-vector product: A @ x, or A.T @ x if `trans` is set.
+A is any 2D Array (C order, F order or a strided view), x a vector.
+*/
+Array *smGemv(Array *a, Array *x, bool trans)
+{
+    if (a->ndim != 2 || x->ndim != 1)
+    {
+        fprintf(stderr, ">> error: gemv needs a matrix and a vector.\n");
+        exit(1);
+    }
+
+    int m = trans ? a->shape[1] : a->shape[0];
+    int n = trans ? a->shape[0] : a->shape[1];
+    long rs = a->strides[trans ? 1 : 0] / a->itemsize;
+    long cs = a->strides[trans ? 0 : 1] / a->itemsize;
+
+    if (x->shape[0] != n)
+    {
+        fprintf(stderr, ">> error: vector length does not match the matrix for gemv.\n");
+        exit(1);
+    }
+
+    int res_shape[] = {m};
+    Array *y = smCreate(res_shape, 1);
+    Array *xc = __asContiguous__(x);
+
+    __sgemv__(m, n, a->data, rs, cs, xc->data, y->data, __accumulation__);
+
+    if (xc != x)
+        smCleanup(xc);
+    return y;
+}
+
+typedef struct
+{
+    float alpha;
+} ScalarContext;
+
+// y += alpha * x
+void __axpyLoop__(float **ptrs, const long *steps, long n, void *ctx)
+{
+    float alpha = ((ScalarContext *)ctx)->alpha;
+    float *y = ptrs[0];
+    const float *x = ptrs[1];
+
+    if (steps[0] == 1 && steps[1] == 1)
+        for (long i = 0; i < n; i++)
+            y[i] += alpha * x[i];
+    else
+        for (long i = 0; i < n; i++)
+            y[i * steps[0]] += alpha * x[i * steps[1]];
+}
+
+// x *= alpha
+void __scalLoop__(float **ptrs, const long *steps, long n, void *ctx)
+{
+    float alpha = ((ScalarContext *)ctx)->alpha;
+    float *x = ptrs[0];
+
+    if (steps[0] == 1)
+        for (long i = 0; i < n; i++)
+            x[i] *= alpha;
+    else
+        for (long i = 0; i < n; i++)
+            x[i * steps[0]] *= alpha;
+}
+
+/*
+y += alpha * x, inplace on y. x is broadcast to the shape of y.
+*/
+void smAxpy(float alpha, Array *x, Array *y)
+{
+    ScalarContext ctx = {alpha};
+    StridedPlan plan;
+    Array *ops[] = {y, x};
+    __planStrided__(&plan, y->shape, y->ndim, ops, 2);
+    __runStrided__(&plan, __axpyLoop__, &ctx);
+}
+
+/*
+x *= alpha, inplace.
+*/
+void smScal(float alpha, Array *x)
+{
+    ScalarContext ctx = {alpha};
+    StridedPlan plan;
+    __planStrided__(&plan, x->shape, x->ndim, &x, 1);
+    __runStrided__(&plan, __scalLoop__, &ctx);
+}
+
+/*
+euclidean norm over all elements of an Array.
+squares are accumulated in double, so large values cannot overflow
+and long vectors keep their precision; the loop is still bandwidth bound.
+*/
+float smNrm2(Array *x)
+{
+    Array *xc = __asContiguous__(x);
+    const float *v = xc->data;
+    long n = xc->totalsize;
+    double total = 0.0;
+
+#ifdef PARALLEL
+#pragma omp parallel for reduction(+ : total) if (n >= SM_PARALLEL_MIN)
+#endif
+    for (long blk = 0; blk < (n + SM_CHUNK - 1) / SM_CHUNK; blk++)
+    {
+        long lo = blk * SM_CHUNK, hi = (lo + SM_CHUNK < n) ? lo + SM_CHUNK : n;
+        double acc[8] = {0};
+        long i = lo;
+        for (; i + 8 <= hi; i += 8)
+            for (int u = 0; u < 8; u++)
+                acc[u] += (double)v[i + u] * v[i + u];
+        for (; i < hi; i++)
+            acc[0] += (double)v[i] * v[i];
+        for (int u = 0; u < 8; u++)
+            total += acc[u];
+    }
+
+    if (xc != x)
+        smCleanup(xc);
+    return (float)sqrt(total);
+}
+
+/*
+sum of absolute values over all elements of an Array.
+honours the accumulation mode like smSum: in the accurate modes the
+absolute values of every chunk go through `__sumAcc__` a small block at
+a time.
+*/
+float smAsum(Array *x)
+{
+    Array *xc = __asContiguous__(x);
+    const float *v = xc->data;
+    long n = xc->totalsize;
+    Accumulation mode = __accumulation__;
+    double total = 0.0;
+
+#ifdef PARALLEL
+#pragma omp parallel for reduction(+ : total) if (n >= SM_PARALLEL_MIN)
+#endif
+    for (long blk = 0; blk < (n + SM_CHUNK - 1) / SM_CHUNK; blk++)
+    {
+        long lo = blk * SM_CHUNK, hi = (lo + SM_CHUNK < n) ? lo + SM_CHUNK : n;
+
+        if (mode != SM_ACCUM_FLOAT)
+        {
+            float absolute[256];
+            for (long i = lo; i < hi; i += 256)
+            {
+                long cnt = (hi - i < 256) ? hi - i : 256;
+                for (long u = 0; u < cnt; u++)
+                    absolute[u] = fabsf(v[i + u]);
+                total += __sumAcc__(absolute, cnt, mode);
+            }
+            continue;
+        }
+
+        float acc[16] = {0};
+        long i = lo;
+        for (; i + 16 <= hi; i += 16)
+            for (int u = 0; u < 16; u++)
+                acc[u] += fabsf(v[i + u]);
+        for (; i < hi; i++)
+            acc[0] += fabsf(v[i]);
+        float part = 0.0f;
+        for (int u = 0; u < 16; u++)
+            part += acc[u];
+        total += part;
+    }
+
+    if (xc != x)
+        smCleanup(xc);
+    return (float)total;
+}
+
+// out += a . b along the reduced axis, or out += a * b elementwise
+void __dotLoop__(float **ptrs, const long *steps, long n, void *ctx)
+{
+    (void)ctx;
+    float *out = ptrs[0];
+    const float *a = ptrs[1], *b = ptrs[2];
+
+    if (steps[0] == 0)
+    {
+        if (steps[1] == 1 && steps[2] == 1)
+            out[0] += __dotKernel__(a, b, n);
+        else
+        {
+            float sum = 0.0f;
+            for (long i = 0; i < n; i++)
+                sum += a[i * steps[1]] * b[i * steps[2]];
+            out[0] += sum;
+        }
+    }
+    else
+        for (long i = 0; i < n; i++)
+            out[i * steps[0]] += a[i * steps[1]] * b[i * steps[2]];
+}
+
+/*
+batched dot product: sum(a * b) along `axis` without the temporary
+product, e.g. row-wise scores of two (N, d) Arrays with axis = -1.
+*/
+Array *smDotAxis(Array *a, Array *b, int axis)
+{
+    return __dotAxis__(a, b, axis, __accumulation__);
+}
+
+// smDotAxis with the accumulation mode of the caller
+Array *__dotAxis__(Array *a, Array *b, int axis, Accumulation mode)
+{
+    Array *inputs[] = {a, b};
+    if (mode != SM_ACCUM_FLOAT)
+        return __PreduceAccurate__(inputs, 2, axis, mode);
+
+    return __PreduceAxis__(inputs, 2, axis, 0.0f, __dotLoop__, __sumLoop__);
+}
+
+// ------------------- Linear algebra -------------------
+
+/*
+the factorizations below are right-looking blocked algorithms on
+row-major matrices: a panel of SM_NB columns is factored with plain
+loops, then the trailing matrix gets one big update through the blocked
+GEMM. all but O(n^2 * SM_NB) of the flops end up in that update, so
+they run at GEMM speed (SIMD, threads) instead of at memory speed.
+*/
+
+/*
+substitution for op(A) X = B with a triangular (n, n) A, B is (n, k)
+and is overwritten by X. columns of B are independent and are split
+among threads; rows of B are walked in the direction of their unit
+stride (axpy form) or columns are (dot form).
+*/
+void __strsmUnblocked__(
+    int n, int k, const float *a, long rsa, long csa,
+    float *b, long rsb, long csb, bool lower, bool unit)
+{
+    bool rowwise = labs(csb) <= labs(rsb);
+    long nchunks = rowwise ? (k + SM_TILE - 1) / SM_TILE : k;
+
+#ifdef PARALLEL
+#pragma omp parallel for if ((long)n * n * k >= SM_PARALLEL_MIN)
+#endif
+    for (long t = 0; t < nchunks; t++)
+    {
+        if (!rowwise)
+        {
+            // one column: every unknown is a dot with the solved ones
+            float *bc = b + t * csb;
+            for (int s = 0; s < n; s++)
+            {
+                int i = lower ? s : n - 1 - s;
+                int j0 = lower ? 0 : i + 1, j1 = lower ? i : n;
+                const float *ai = a + i * rsa;
+                float sum;
+
+                if (csa == 1 && rsb == 1)
+                    sum = __dotKernel__(ai + j0, bc + j0, j1 - j0);
+                else
+                {
+                    sum = 0.0f;
+                    for (int j = j0; j < j1; j++)
+                        sum += ai[j * csa] * bc[j * rsb];
+                }
+
+                float x = bc[i * rsb] - sum;
+                bc[i * rsb] = unit ? x : x / ai[i * csa];
+            }
+            continue;
+        }
+
+        int c0 = (int)t * SM_TILE;
+        int c1 = (c0 + SM_TILE < k) ? c0 + SM_TILE : k;
+
+        for (int s = 0; s < n; s++)
+        {
+            int i = lower ? s : n - 1 - s;
+            const float *ai = a + i * rsa;
+            float *bi = b + i * rsb;
+
+            int j0 = lower ? 0 : i + 1, j1 = lower ? i : n;
+            for (int j = j0; j < j1; j++)
+            {
+                float aij = ai[j * csa];
+                const float *bj = b + j * rsb;
+                for (int c = c0; c < c1; c++)
+                    bi[c * csb] -= aij * bj[c * csb];
+            }
+            if (!unit)
+            {
+                float inv = 1.0f / ai[i * csa];
+                for (int c = c0; c < c1; c++)
+                    bi[c * csb] *= inv;
+            }
+        }
+    }
+}
+
+/*
+blocked triangular solve: diagonal blocks are substituted, the rows
+still to be solved get the solved block subtracted with the GEMM.
+a handful of right hand sides is memory bound, substitution does that
+in a single pass.
+*/
+void __strsm__(
+    int n, int k, const float *a, long rsa, long csa,
+    float *b, long rsb, long csb, bool lower, bool unit, Accumulation mode)
+{
+    if (k < SM_NR || n <= SM_NB)
+    {
+        __strsmUnblocked__(n, k, a, rsa, csa, b, rsb, csb, lower, unit);
+        return;
+    }
+
+    for (int s = 0; s < n; s += SM_NB)
+    {
+        int nb = (n - s < SM_NB) ? n - s : SM_NB;
+        // first row of the block, going down for lower and up for upper
+        int i0 = lower ? s : n - s - nb;
+
+        __strsmUnblocked__(
+            nb, k, a + i0 * rsa + i0 * csa, rsa, csa,
+            b + i0 * rsb, rsb, csb, lower, unit);
+
+        if (lower && i0 + nb < n)
+            __sgemm__(
+                n - i0 - nb, nb, k, -1.0f,
+                a + (i0 + nb) * rsa + i0 * csa, rsa, csa,
+                b + i0 * rsb, rsb, csb,
+                1.0f, b + (i0 + nb) * rsb, rsb, csb, 0, mode);
+        else if (!lower && i0 > 0)
+            __sgemm__(
+                i0, nb, k, -1.0f,
+                a + i0 * csa, rsa, csa,
+                b + i0 * rsb, rsb, csb,
+                1.0f, b, rsb, csb, 0, mode);
+    }
+}
+
+/*
+cholesky factorization A = L @ L.T of a symmetric positive definite
+(n, n) matrix, inplace: the lower triangle becomes L, the upper one is
+zeroed. returns 0, or j + 1 if the leading (j + 1, j + 1) minor is not
+positive definite.
+*/
+int __spotrf__(int n, float *a, long lda, Accumulation mode)
+{
+    for (int k0 = 0; k0 < n; k0 += SM_NB)
+    {
+        int kb = (n - k0 < SM_NB) ? n - k0 : SM_NB;
+
+        // the diagonal block, earlier blocks are already subtracted
+        for (int j = k0; j < k0 + kb; j++)
+        {
+            float *aj = a + j * lda;
+            float d = aj[j] - __dotKernel__(aj + k0, aj + k0, j - k0);
+            if (!(d > 0.0f))
+                return j + 1;
+
+            d = sqrtf(d);
+            aj[j] = d;
+            for (int i = j + 1; i < k0 + kb; i++)
+            {
+                float *ai = a + i * lda;
+                ai[j] = (ai[j] - __dotKernel__(ai + k0, aj + k0, j - k0)) / d;
+            }
+        }
+
+        int rest = n - k0 - kb;
+        if (rest == 0)
+            break;
+
+        // A21 = A21 @ L11^-T, i.e. L11 @ A21.T = A21.T
+        float *a21 = a + (k0 + kb) * lda + k0;
+        __strsm__(kb, rest, a + k0 * lda + k0, lda, 1, a21, 1, lda, true, false, mode);
+
+        // A22 -= A21 @ A21.T, lower triangle only
+        __sgemm__(
+            rest, kb, rest, -1.0f,
+            a21, lda, 1, a21, 1, lda,
+            1.0f, a21 + kb, lda, 1, -1, mode);
+    }
+
+    for (int i = 0; i < n; i++)
+        for (int j = i + 1; j < n; j++)
+            a[i * lda + j] = 0.0f;
+
+    return 0;
+}
+
+/*
+LU factorization with partial pivoting of an (n, n) matrix, inplace:
+A = P @ L @ U with a unit lower L below the diagonal and U on and above
+it (the LAPACK layout). row i was swapped with row piv[i], in order.
+returns 0, or j + 1 if U[j, j] is exactly zero (the factorization is
+still completed).
+*/
+int __sgetrf__(int n, float *a, long lda, int *piv, Accumulation mode)
+{
+    int info = 0;
+
+    for (int k0 = 0; k0 < n; k0 += SM_NB)
+    {
+        int kb = (n - k0 < SM_NB) ? n - k0 : SM_NB;
+
+        // factor the panel of columns [k0, k0 + kb) below the diagonal
+        for (int j = k0; j < k0 + kb; j++)
+        {
+            int p = j;
+            float best = fabsf(a[j * lda + j]);
+            for (int i = j + 1; i < n; i++)
+            {
+                if (fabsf(a[i * lda + j]) > best)
+                {
+                    best = fabsf(a[i * lda + j]);
+                    p = i;
+                }
+            }
+
+            piv[j] = p;
+            if (p != j)
+            {
+                float *rj = a + j * lda, *rp = a + p * lda;
+                for (int c = 0; c < n; c++)
+                {
+                    float tmp = rj[c];
+                    rj[c] = rp[c];
+                    rp[c] = tmp;
+                }
+            }
+
+            float d = a[j * lda + j];
+            if (d == 0.0f)
+            {
+                if (!info)
+                    info = j + 1;
+                continue;
+            }
+
+            float inv = 1.0f / d;
+            const float *uj = a + j * lda;
+            int c1 = k0 + kb;
+
+#ifdef PARALLEL
+#pragma omp parallel for if ((long)(n - j) * (c1 - j) >= SM_PARALLEL_MIN)
+#endif
+            for (int i = j + 1; i < n; i++)
+            {
+                float *ai = a + i * lda;
+                float l = ai[j] * inv;
+                ai[j] = l;
+                for (int c = j + 1; c < c1; c++)
+                    ai[c] -= l * uj[c];
+            }
+        }
+
+        int rest = n - k0 - kb;
+        if (rest == 0)
+            break;
+
+        // U12 = L11^-1 @ A12, then A22 -= L21 @ U12
+        float *a12 = a + k0 * lda + k0 + kb;
+        __strsm__(kb, rest, a + k0 * lda + k0, lda, 1, a12, lda, 1, true, true, mode);
+        __sgemm__(
+            rest, kb, rest, -1.0f,
+            a + (k0 + kb) * lda + k0, lda, 1, a12, lda, 1,
+            1.0f, a12 + kb * lda, lda, 1, 0, mode);
+    }
+
+    return info;
+}
+
+/*
+split a batch of square matrices: number of (n, n) matrices in `arr`
+*/
+long __squareBatch__(Array *arr, const char *name)
+{
+    if (arr->ndim < 2 || arr->shape[arr->ndim - 1] != arr->shape[arr->ndim - 2])
+    {
+        fprintf(stderr, ">> error: %s needs (..., n, n) square matrices.\n", name);
+        exit(1);
+    }
+
+    long nbatch = 1;
+    for (int i = 0; i < arr->ndim - 2; i++)
+        nbatch *= arr->shape[i];
+    return nbatch;
+}
+
+/*
+cholesky factor L of symmetric positive definite matrices (..., n, n),
+A = L @ L.T. only the lower triangle of A is read.
+*/
+Array *smCholesky(Array *a)
+{
+    long nbatch = __squareBatch__(a, "cholesky");
+    int n = a->shape[a->ndim - 1];
+
+    Array *res = smContiguous(a);
+    Accumulation mode = __accumulation__;
+    int failed = 0;
+
+#ifdef PARALLEL
+#pragma omp parallel for reduction(|| : failed) if (n < SM_NB && nbatch * n * n * n >= SM_PARALLEL_MIN)
+#endif
+    for (long bt = 0; bt < nbatch; bt++)
+    {
+        if (__spotrf__(n, res->data + bt * n * n, n, mode))
+            failed = 1;
+    }
+
+    if (failed)
+    {
+        fprintf(stderr, ">> error: matrix is not positive definite for cholesky.\n");
+        exit(1);
+    }
+
+    return res;
+}
+
+/*
+LU factorization with partial pivoting of (..., n, n) matrices.
+returns L (unit diagonal, not stored) and U packed in one Array; if
+`pivots` is not NULL it receives the (..., n) row swaps: row i was
+swapped with row pivots[i], in order.
+*/
+Array *smLU(Array *a, Array **pivots)
+{
+    return __luBatched__(a, pivots, __accumulation__);
+}
+
+// smLU with the accumulation mode of the caller (smSolve)
+Array *__luBatched__(Array *a, Array **pivots, Accumulation mode)
+{
+    long nbatch = __squareBatch__(a, "LU");
+    int n = a->shape[a->ndim - 1];
+
+    Array *res = smContiguous(a);
+    Array *piv = smCreate(a->shape, a->ndim - 1);
+
+    // empty matrices have nothing to factor
+    if (n == 0)
+        nbatch = 0;
+
+#ifdef PARALLEL
+#pragma omp parallel for if (n < SM_NB && nbatch * n * n * n >= SM_PARALLEL_MIN)
+#endif
+    for (long bt = 0; bt < nbatch; bt++)
+    {
+        int *ipiv = (int *)malloc(n * sizeof(int));
+        _checkNull(ipiv);
+
+        __sgetrf__(n, res->data + bt * n * n, n, ipiv, mode);
+        for (int i = 0; i < n; i++)
+            piv->data[bt * n + i] = (float)ipiv[i];
+
+        free(ipiv);
+    }
+
+    if (pivots)
+        *pivots = piv;
+    else
+        smCleanup(piv);
+
+    return res;
+}
+
+typedef struct
+{
+    int n, k;
+    long rsa, csa;
+    bool lower;
+    const float *lu; // smSolve: the LU factors of every matrix, or NULL
+    const float *pivots;
+    Accumulation mode;
+} SolveContext;
+
+/*
+batch loop of the solvers. operand 0 is the right hand side (already a
+copy, solved inplace, rows of k contiguous floats), 1 is the matrix, or
+its LU factors for smSolve.
+*/
+void __solveLoop__(float **ptrs, const long *steps, long count, void *ctx)
+{
+    SolveContext *sv = (SolveContext *)ctx;
+    int n = sv->n, k = sv->k;
+
+    for (long l = 0; l < count; l++)
+    {
+        float *b = ptrs[0] + l * steps[0];
+        const float *a = ptrs[1] + l * steps[1];
+
+        if (!sv->lu)
+        {
+            __strsm__(n, k, a, sv->rsa, sv->csa, b, k, 1, sv->lower, false, sv->mode);
+            continue;
+        }
+
+        // A = P @ L @ U: apply the swaps to B, then L and U substitutions
+        const float *piv = sv->pivots + (a - sv->lu) / n;
+        for (int i = 0; i < n; i++)
+        {
+            int p = (int)piv[i];
+            if (p == i)
+                continue;
+            float *ri = b + i * k, *rp = b + p * k;
+            for (int c = 0; c < k; c++)
+            {
+                float tmp = ri[c];
+                ri[c] = rp[c];
+                rp[c] = tmp;
+            }
+        }
+
+        __strsm__(n, k, a, n, 1, b, k, 1, true, true, sv->mode);
+        __strsm__(n, k, a, n, 1, b, k, 1, false, false, sv->mode);
+    }
+}
+
+/*
+shared driver of smTriSolve and smSolve: the batch axes of the matrices
+(..., n, n) and of the right hand sides (..., n, k) broadcast like
+smMatMul, a vector (n) is solved against every matrix. smSolve factors
+each matrix of `a` once, then every right hand side it is broadcast to
+reuses the factors.
+*/
+Array *__solveBatched__(Array *a, Array *b, bool lower, bool factor)
+{
+    __squareBatch__(a, "solve");
+    int n = a->shape[a->ndim - 1];
+
+    bool vec = (b->ndim == 1);
+    int bnd = b->ndim - (vec ? 1 : 2);
+    if (b->shape[bnd] != n)
+    {
+        fprintf(stderr, ">> error: right hand side does not match the matrix for solve.\n");
+        exit(1);
+    }
+
+    int nd = (a->ndim - 2 > bnd) ? a->ndim - 2 : bnd;
+    int shape[SM_MAXDIMS];
+    for (int i = 0; i < nd; i++)
+    {
+        int ia = i - (nd - (a->ndim - 2)), ib = i - (nd - bnd);
+        int da = (ia >= 0) ? a->shape[ia] : 1;
+        int db = (ib >= 0) ? b->shape[ib] : 1;
+        if (da != db && da != 1 && db != 1)
+        {
+            fprintf(stderr, ">> error: batch dimensions of the matrix and the right hand side are not broadcastable.\n");
+            exit(1);
+        }
+        shape[i] = (da > db) ? da : db;
+    }
+    shape[nd] = n;
+    shape[nd + 1] = vec ? 1 : b->shape[b->ndim - 1];
+
+    // the right hand sides are copied, broadcast, into the result
+    Array *res = smCreate(shape, nd + (vec ? 1 : 2));
+    Array *src = __broadcastView__(b, res->shape, res->ndim);
+    __copyStrided__(res, src);
+    smCleanup(src);
+
+    SolveContext ctx = {
+        n, shape[nd + 1],
+        a->strides[a->ndim - 2] / a->itemsize, a->strides[a->ndim - 1] / a->itemsize,
+        lower, NULL, NULL, __accumulation__};
+
+    if (n == 0 || ctx.k == 0 || res->totalsize == 0)
+        return res;
+
+    Array *lu = NULL, *pivots = NULL;
+    if (factor)
+    {
+        lu = __luBatched__(a, &pivots, ctx.mode);
+        for (long i = 0; i < lu->totalsize / ((long)n * n); i++)
+            for (int j = 0; j < n; j++)
+                if (lu->data[(i * n + j) * n + j] == 0.0f)
+                {
+                    fprintf(stderr, ">> error: matrix is singular for solve.\n");
+                    exit(1);
+                }
+        ctx.lu = lu->data;
+        ctx.pivots = pivots->data;
+    }
+
+    Array *batch[2];
+    if (nd == 0)
+    {
+        int one[] = {1}, zero[] = {0};
+        batch[0] = __createView__(res, res->data, one, zero, 1);
+    }
+    else
+        batch[0] = __createView__(res, res->data, res->shape, res->strides, nd);
+    batch[1] = __batchView__(lu ? lu : a);
+
+    StridedPlan plan;
+    __planStrided__(&plan, batch[0]->shape, batch[0]->ndim, batch, 2);
+    __runBatched__(&plan, __solveLoop__, &ctx, (long)n * n * ctx.k);
+
+    smCleanup(batch[0]);
+    smCleanup(batch[1]);
+    if (lu)
+    {
+        smCleanup(lu);
+        smCleanup(pivots);
+    }
+
+    return res;
+}
+
+/*
+solve A @ X = B for triangular A (lower or upper), batched: A is
+(..., n, n), B is (..., n, k) and their batch axes broadcast against
+each other. a vector B (n) gives a (..., n) result.
+*/
+Array *smTriSolve(Array *a, Array *b, bool lower)
+{
+    return __solveBatched__(a, b, lower, false);
+}
+
+/*
+solve A @ X = B for general square A through an LU factorization with
+partial pivoting, batched like smTriSolve.
+*/
+Array *smSolve(Array *a, Array *b)
+{
+    return __solveBatched__(a, b, true, true);
+}
+
+// ------------------- Einsum -------------------
+
+void __einsumRelease__(EinsumTerm *t)
+{
+    smCleanup(t->arr);
+    if (t->base)
+        smCleanup(t->base);
+}
+
+// element stride of letter `c` in a term, 0 if the term does not have it
+long __einsumStride__(EinsumTerm *t, char c)
+{
+    for (int i = 0; i < t->ndim; i++)
+        if (t->letters[i] == c)
+            return t->arr->strides[i] / t->arr->itemsize;
+    return 0;
+}
+
+bool __einsumHas__(const char *letters, char c)
+{
+    return c != '\0' && strchr(letters, c) != NULL;
+}
+
+/*
+view of a term over `letters` (in that order): letters the term does not
+have get a 0 stride, so several terms can share one loop space.
+*/
+Array *__einsumView__(EinsumTerm *t, const char *letters, const int *sizes)
+{
+    int n = (int)strlen(letters);
+    int shape[SM_MAXDIMS], strides[SM_MAXDIMS];
+    for (int i = 0; i < n; i++)
+    {
+        shape[i] = sizes[(int)letters[i]];
+        strides[i] = (int)__einsumStride__(t, letters[i]) * t->arr->itemsize;
+    }
+
+    if (n == 0)
+    {
+        shape[0] = 1;
+        strides[0] = 0;
+        n = 1;
+    }
+    return __createView__(t->arr, t->arr->data, shape, strides, n);
+}
+
+// order letters by decreasing stride in `t`, i.e. outermost first
+void __einsumSortByStride__(EinsumTerm *t, char *letters)
+{
+    int n = (int)strlen(letters);
+    for (int i = 1; i < n; i++)
+        for (int j = i; j > 0 && labs(__einsumStride__(t, letters[j])) > labs(__einsumStride__(t, letters[j - 1])); j--)
+        {
+            char tmp = letters[j];
+            letters[j] = letters[j - 1];
+            letters[j - 1] = tmp;
+        }
+}
+
+/*
+true if `letters` (outermost first) can be walked as one axis of `t`,
+which then has the stride returned in `stride`. no letters merge to a
+single element.
+*/
+bool __einsumMerge__(EinsumTerm *t, const char *letters, const int *sizes, long *stride)
+{
+    *stride = 0;
+    long expected = -1;
+    for (int i = (int)strlen(letters) - 1; i >= 0; i--)
+    {
+        int size = sizes[(int)letters[i]];
+        if (size == 1)
+            continue;
+
+        long st = __einsumStride__(t, letters[i]);
+        if (expected < 0)
+            *stride = st;
+        else if (st != expected)
+            return false;
+        expected = st * size;
+    }
+
+    return true;
+}
+
+// a new term owning `arr`, with its axes named `letters`
+EinsumTerm __einsumTerm__(Array *arr, const char *letters)
+{
+    EinsumTerm t;
+    t.base = arr;
+    t.arr = __createView__(arr, arr->data, arr->shape, arr->strides, arr->ndim);
+    t.ndim = (int)strlen(letters);
+    strcpy(t.letters, letters);
+    return t;
+}
+
+// materialize a term with its axes in the order of `letters`
+EinsumTerm __einsumCopy__(EinsumTerm *t, const char *letters, const int *sizes)
+{
+    Array *view = __einsumView__(t, letters, sizes);
+    Array *copy = smContiguous(view);
+    smCleanup(view);
+
+    return __einsumTerm__(copy, letters);
+}
+
+/*
+sum a term down to `keep` (letters in output order) with a fused strided
+reduction; without anything to sum it is a (blocked) permuted copy.
+*/
+Array *__einsumReduce__(EinsumTerm *t, const char *keep, const int *sizes)
+{
+    int nk = (int)strlen(keep);
+    int shape[SM_MAXDIMS];
+    for (int i = 0; i < nk; i++)
+        shape[i] = sizes[(int)keep[i]];
+    if (nk == 0)
+        shape[nk++] = 1;
+
+    Array *res = smCreate(shape, nk);
+
+    if ((int)strlen(keep) == t->ndim)
+    {
+        Array *view = __einsumView__(t, keep, sizes);
+        __copyStrided__(res, view);
+        smCleanup(view);
+        return res;
+    }
+
+    for (int i = 0; i < res->totalsize; i++)
+        res->data[i] = 0.0f;
+
+    // both seen over the letters of the term, res 0-strided on the summed ones
+    EinsumTerm out = {res, NULL, (int)strlen(keep), {0}};
+    strcpy(out.letters, keep);
+
+    Array *ops[] = {__einsumView__(&out, t->letters, sizes), __einsumView__(t, t->letters, sizes)};
+    StridedPlan plan;
+    __planStrided__(&plan, ops[0]->shape, ops[0]->ndim, ops, 2);
+    __runReduction__(&plan, __sumLoop__, __sumLoop__, NULL, 0.0f);
+
+    smCleanup(ops[0]);
+    smCleanup(ops[1]);
+    return res;
+}
+
+/*
+contract two terms into one with the letters in `keep`. letters of both
+terms split into
+
+- batch: in both and kept         - K: in both, summed
+- M: only in a (always kept)      - N: only in b (always kept)
+
+and the pair becomes a batched (M, K) @ (K, N) smMatMul on stride
+views: each of M, K, N is walked as one axis when its letters are laid
+out contiguously, M or N letters that are not become extra batch axes
+(broadcast in the other operand). only if the K letters cannot be
+walked the same way in both terms are the two copied.
+without K there is nothing to multiply-add and a fused strided product
+is used instead. without M and N every batch item is a dot product,
+which goes to smDotAxis (`__dotAcc__` rows), and M or N of size 1 end
+up in GEMV through `__matmulStrided__`.
+*/
+EinsumTerm __einsumPair__(EinsumTerm *a, EinsumTerm *b, const char *keep, const int *sizes, Accumulation mode)
+{
+    char batch[SM_MAXDIMS + 1] = {0}, mm[SM_MAXDIMS + 1] = {0};
+    char kk[SM_MAXDIMS + 1] = {0}, nn[SM_MAXDIMS + 1] = {0};
+    int nb = 0, nm = 0, nkk = 0, nnn = 0;
+
+    for (int i = 0; i < a->ndim; i++)
+    {
+        char c = a->letters[i];
+        if (!__einsumHas__(b->letters, c))
+            mm[nm++] = c;
+        else if (__einsumHas__(keep, c))
+            batch[nb++] = c;
+        else
+            kk[nkk++] = c;
+    }
+    for (int i = 0; i < b->ndim; i++)
+        if (!__einsumHas__(a->letters, b->letters[i]))
+            nn[nnn++] = b->letters[i];
+
+    if (nkk == 0)
+    {
+        char all[SM_MAXDIMS + 1];
+        strcpy(all, batch);
+        strcat(all, mm);
+        strcat(all, nn);
+
+        int shape[SM_MAXDIMS];
+        int nd = (int)strlen(all);
+        for (int i = 0; i < nd; i++)
+            shape[i] = sizes[(int)all[i]];
+        if (nd == 0)
+            shape[nd++] = 1;
+
+        Array *res = smCreate(shape, nd);
+        Array *ops[] = {res, __einsumView__(a, all, sizes), __einsumView__(b, all, sizes)};
+        StridedPlan plan;
+        __planStrided__(&plan, res->shape, res->ndim, ops, 3);
+        __runStrided__(&plan, __mulLoop__, NULL);
+
+        smCleanup(ops[1]);
+        smCleanup(ops[2]);
+        return __einsumTerm__(res, all);
+    }
+
+    // K has to be one axis, in the same letter order, in both operands
+    EinsumTerm ta = *a, tb = *b;
+    bool copied = false;
+    long ska, skb;
+
+    __einsumSortByStride__(a, kk);
+    if (!__einsumMerge__(a, kk, sizes, &ska) || !__einsumMerge__(b, kk, sizes, &skb))
+    {
+        __einsumSortByStride__(b, kk);
+        if (!__einsumMerge__(a, kk, sizes, &ska) || !__einsumMerge__(b, kk, sizes, &skb))
+        {
+            char order[SM_MAXDIMS + 1];
+            strcpy(order, batch);
+            strcat(order, mm);
+            strcat(order, kk);
+            ta = __einsumCopy__(a, order, sizes);
+            strcpy(order, batch);
+            strcat(order, kk);
+            strcat(order, nn);
+            tb = __einsumCopy__(b, order, sizes);
+            copied = true;
+
+            __einsumMerge__(&ta, kk, sizes, &ska);
+            __einsumMerge__(&tb, kk, sizes, &skb);
+        }
+    }
+
+    long msize = 1, ksize = 1, nsize = 1;
+    for (int i = 0; mm[i]; i++)
+        msize *= sizes[(int)mm[i]];
+    for (int i = 0; kk[i]; i++)
+        ksize *= sizes[(int)kk[i]];
+    for (int i = 0; nn[i]; i++)
+        nsize *= sizes[(int)nn[i]];
+
+    // a dot product per batch item, over K as the last axis
+    if (msize == 1 && nsize == 1)
+    {
+        char all[SM_MAXDIMS + 1];
+        strcpy(all, batch);
+        strcat(all, mm);
+        strcat(all, nn);
+
+        int nd = (int)strlen(all);
+        int shape[SM_MAXDIMS], astrides[SM_MAXDIMS], bstrides[SM_MAXDIMS];
+        for (int i = 0; i < nd; i++)
+        {
+            shape[i] = sizes[(int)all[i]];
+            astrides[i] = (int)__einsumStride__(&ta, all[i]) * ta.arr->itemsize;
+            bstrides[i] = (int)__einsumStride__(&tb, all[i]) * tb.arr->itemsize;
+        }
+        shape[nd] = (int)ksize;
+        astrides[nd] = (int)ska * ta.arr->itemsize;
+        bstrides[nd] = (int)skb * tb.arr->itemsize;
+
+        Array *av = __createView__(ta.arr, ta.arr->data, shape, astrides, nd + 1);
+        Array *bv = __createView__(tb.arr, tb.arr->data, shape, bstrides, nd + 1);
+        Array *res = __dotAxis__(av, bv, -1, mode);
+        smCleanup(av);
+        smCleanup(bv);
+
+        if (copied)
+        {
+            __einsumRelease__(&ta);
+            __einsumRelease__(&tb);
+        }
+        return __einsumTerm__(res, all);
+    }
+
+    // M and N: one axis if possible, else the longest letter is the
+    // axis and the others are batched
+    char xm[SM_MAXDIMS + 1] = {0}, xn[SM_MAXDIMS + 1] = {0};
+    long sma, snb;
+
+    __einsumSortByStride__(&ta, mm);
+    if (!__einsumMerge__(&ta, mm, sizes, &sma))
+    {
+        int best = 0;
+        for (int i = 1; i < nm; i++)
+            if (sizes[(int)mm[i]] > sizes[(int)mm[best]])
+                best = i;
+        for (int i = 0, j = 0; i < nm; i++)
+            if (i != best)
+                xm[j++] = mm[i];
+        mm[0] = mm[best];
+        mm[1] = '\0';
+        __einsumMerge__(&ta, mm, sizes, &sma);
+    }
+
+    __einsumSortByStride__(&tb, nn);
+    if (!__einsumMerge__(&tb, nn, sizes, &snb))
+    {
+        int best = 0;
+        for (int i = 1; i < nnn; i++)
+            if (sizes[(int)nn[i]] > sizes[(int)nn[best]])
+                best = i;
+        for (int i = 0, j = 0; i < nnn; i++)
+            if (i != best)
+                xn[j++] = nn[i];
+        nn[0] = nn[best];
+        nn[1] = '\0';
+        __einsumMerge__(&tb, nn, sizes, &snb);
+    }
+
+    int nbx = nb + (int)strlen(xm) + (int)strlen(xn);
+    int nd = nbx + 2;
+    int ashape[SM_MAXDIMS], astrides[SM_MAXDIMS], bshape[SM_MAXDIMS], bstrides[SM_MAXDIMS];
+
+    char outer[SM_MAXDIMS + 1];
+    strcpy(outer, batch);
+    strcat(outer, xm);
+    strcat(outer, xn);
+    for (int i = 0; i < nbx; i++)
+    {
+        char c = outer[i];
+        bool ina = __einsumHas__(ta.letters, c), inb = __einsumHas__(tb.letters, c);
+        ashape[i] = ina ? sizes[(int)c] : 1;
+        bshape[i] = inb ? sizes[(int)c] : 1;
+        astrides[i] = (int)__einsumStride__(&ta, c) * ta.arr->itemsize;
+        bstrides[i] = (int)__einsumStride__(&tb, c) * tb.arr->itemsize;
+    }
+
+    // M and N may have lost letters to the batch
+    msize = 1;
+    nsize = 1;
+    for (int i = 0; mm[i]; i++)
+        msize *= sizes[(int)mm[i]];
+    for (int i = 0; nn[i]; i++)
+        nsize *= sizes[(int)nn[i]];
+
+    ashape[nbx] = (int)msize;
+    ashape[nbx + 1] = (int)ksize;
+    astrides[nbx] = (int)sma * ta.arr->itemsize;
+    astrides[nbx + 1] = (int)ska * ta.arr->itemsize;
+    bshape[nbx] = (int)ksize;
+    bshape[nbx + 1] = (int)nsize;
+    bstrides[nbx] = (int)skb * tb.arr->itemsize;
+    bstrides[nbx + 1] = (int)snb * tb.arr->itemsize;
+
+    Array *av = __createView__(ta.arr, ta.arr->data, ashape, astrides, nd);
+    Array *bv = __createView__(tb.arr, tb.arr->data, bshape, bstrides, nd);
+    Array *res = __matmulBatched__(av, bv, mode);
+    smCleanup(av);
+    smCleanup(bv);
+
+    if (copied)
+    {
+        __einsumRelease__(&ta);
+        __einsumRelease__(&tb);
+    }
+
+    // split the M and N axes of the product back into their letters
+    EinsumTerm t;
+    t.base = res;
+    strcpy(t.letters, outer);
+    strcat(t.letters, mm);
+    strcat(t.letters, nn);
+    t.ndim = (int)strlen(t.letters);
+
+    int shape[SM_MAXDIMS], strides[SM_MAXDIMS];
+    for (int i = 0; i < nbx; i++)
+    {
+        shape[i] = res->shape[i];
+        strides[i] = res->strides[i];
+    }
+    for (int g = 0; g < 2; g++)
+    {
+        const char *group = g ? nn : mm;
+        int first = g ? nbx + (int)strlen(mm) : nbx;
+        int st = res->strides[nbx + g];
+        for (int i = (int)strlen(group) - 1; i >= 0; i--)
+        {
+            shape[first + i] = sizes[(int)group[i]];
+            strides[first + i] = st;
+            st *= shape[first + i];
+        }
+    }
+
+    if (t.ndim == 0)
+    {
+        shape[0] = 1;
+        strides[0] = 0;
+    }
+    t.arr = __createView__(res, res->data, shape, strides, t.ndim ? t.ndim : 1);
+    return t;
+}
+
+/*
+einstein summation over `count` Arrays, numpy style:
+```
+smEinsum("bij,bjk->bik", ops, 2)   batched matmul
+smEinsum("ij,ij->i", ops, 2)       row-wise dot products
+smEinsum("ii->", ops, 1)           trace
+smEinsum("ij,jk,kl", ops, 3)       chained matmul, implicit output
+```
+without "->" the output has the letters used exactly once, sorted.
+repeated letters in one operand take its diagonal (a stride view).
+
+operands are contracted pairwise, always picking the pair that is
+cheapest to contract next (product of the sizes of its letters).
+every pairwise contraction with something to sum runs on smMatMul (or
+smDotAxis for plain dot products) over stride views of the operands,
+see `__einsumPair__`.
+a scalar result has shape {1}.
+*/
+Array *smEinsum(const char *subscripts, Array **operands, int count)
+{
+    Accumulation mode = __accumulation__;
+    int sizes[128];
+    for (int i = 0; i < 128; i++)
+        sizes[i] = -1;
+
+    EinsumTerm *terms = (EinsumTerm *)malloc(count * sizeof(EinsumTerm));
+    _checkNull(terms);
+
+    // parse the input terms, collapsing repeated letters into diagonals
+    const char *s = subscripts;
+    int uses[128] = {0};
+    for (int op = 0; op < count; op++)
+    {
+        Array *arr = operands[op];
+        char letters[SM_MAXDIMS + 1];
+        int shape[SM_MAXDIMS], strides[SM_MAXDIMS];
+        int n = 0, axis = 0;
+
+        for (; *s && *s != ',' && *s != '-'; s++)
+        {
+            char c = *s;
+            if (c == ' ')
+                continue;
+            if (!((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z')) || axis >= arr->ndim)
+            {
+                fprintf(stderr, ">> error: invalid einsum subscripts for operand %d.\n", op);
+                exit(1);
+            }
+            if (sizes[(int)c] >= 0 && sizes[(int)c] != arr->shape[axis])
+            {
+                fprintf(stderr, ">> error: size of einsum letter '%c' does not match.\n", c);
+                exit(1);
+            }
+            sizes[(int)c] = arr->shape[axis];
+
+            int j = 0;
+            while (j < n && letters[j] != c)
+                j++;
+            if (j < n)
+                strides[j] += arr->strides[axis];
+            else
+            {
+                letters[n] = c;
+                shape[n] = arr->shape[axis];
+                strides[n] = arr->strides[axis];
+                n++;
+            }
+            uses[(int)c]++;
+            axis++;
+        }
+        letters[n] = '\0';
+
+        if (axis != arr->ndim || (op < count - 1 && *s != ','))
+        {
+            fprintf(stderr, ">> error: einsum subscripts do not match the operands.\n");
+            exit(1);
+        }
+        if (*s == ',')
+            s++;
+
+        terms[op].base = NULL;
+        terms[op].ndim = n;
+        strcpy(terms[op].letters, letters);
+        if (n == 0)
+        {
+            shape[0] = 1;
+            strides[0] = 0;
+        }
+        terms[op].arr = __createView__(arr, arr->data, shape, strides, n ? n : 1);
+    }
+
+    char out[SM_MAXDIMS + 1];
+    int nout = 0;
+    if (s[0] == '-' && s[1] == '>')
+    {
+        for (s += 2; *s; s++)
+        {
+            if (*s == ' ')
+                continue;
+            if (sizes[(int)*s] < 0 || nout >= SM_MAXDIMS || memchr(out, *s, nout))
+            {
+                fprintf(stderr, ">> error: invalid einsum output subscripts.\n");
+                exit(1);
+            }
+            out[nout++] = *s;
+        }
+    }
+    else if (*s)
+    {
+        fprintf(stderr, ">> error: invalid einsum subscripts.\n");
+        exit(1);
+    }
+    else
+    {
+        // implicit output: letters used once, in alphabetical order
+        for (int c = 'A'; c <= 'z'; c++)
+            if (uses[c] == 1 && nout < SM_MAXDIMS)
+                out[nout++] = (char)c;
+    }
+    out[nout] = '\0';
+
+    char needed[SM_MAXDIMS * 2 + 1];
+
+    // sum away letters no one else needs before contracting anything
+    for (int op = 0; op < count; op++)
+    {
+        int n = 0;
+        char keep[SM_MAXDIMS + 1];
+        for (int i = 0; i < terms[op].ndim; i++)
+        {
+            char c = terms[op].letters[i];
+            bool other = __einsumHas__(out, c);
+            for (int j = 0; j < count && !other; j++)
+                other = (j != op) && __einsumHas__(terms[j].letters, c);
+            if (other)
+                keep[n++] = c;
+        }
+        keep[n] = '\0';
+
+        if (n < terms[op].ndim && count > 1)
+        {
+            EinsumTerm reduced = __einsumTerm__(__einsumReduce__(&terms[op], keep, sizes), keep);
+            __einsumRelease__(&terms[op]);
+            terms[op] = reduced;
+        }
+    }
+
+    // greedy pairwise contraction
+    int left = count;
+    while (left > 1)
+    {
+        int bi = 0, bj = 1;
+        double best = -1.0;
+        for (int i = 0; i < left; i++)
+        {
+            for (int j = i + 1; j < left; j++)
+            {
+                double cost = 1.0;
+                for (int l = 0; l < terms[i].ndim; l++)
+                    cost *= sizes[(int)terms[i].letters[l]];
+                for (int l = 0; l < terms[j].ndim; l++)
+                    if (!__einsumHas__(terms[i].letters, terms[j].letters[l]))
+                        cost *= sizes[(int)terms[j].letters[l]];
+                if (best < 0 || cost < best)
+                {
+                    best = cost;
+                    bi = i;
+                    bj = j;
+                }
+            }
+        }
+
+        // letters still needed by the output or the other terms
+        strcpy(needed, out);
+        int n = (int)strlen(needed);
+        for (int k = 0; k < left; k++)
+        {
+            for (int l = 0; k != bi && k != bj && l < terms[k].ndim; l++)
+            {
+                if (!__einsumHas__(needed, terms[k].letters[l]))
+                {
+                    needed[n++] = terms[k].letters[l];
+                    needed[n] = '\0';
+                }
+            }
+        }
+
+        EinsumTerm res = __einsumPair__(&terms[bi], &terms[bj], needed, sizes, mode);
+        __einsumRelease__(&terms[bi]);
+        __einsumRelease__(&terms[bj]);
+
+        terms[bi] = res;
+        terms[bj] = terms[left - 1];
+        left--;
+    }
+
+    // the last term, already laid out as the output: hand over its buffer
+    EinsumTerm *last = &terms[0];
+    Array *res = NULL;
+    if (last->base && last->base->C_ORDER && last->ndim == nout && nout > 0 &&
+        last->base->totalsize == last->arr->totalsize)
+    {
+        Array *view = __einsumView__(last, out, sizes);
+        if (view->data == last->base->data && __isContiguousC__(view))
+        {
+            smReshapeInplace(last->base, view->shape, view->ndim);
+            res = last->base;
+            last->base = NULL;
+        }
+        smCleanup(view);
+    }
+    if (!res)
+        res = __einsumReduce__(last, out, sizes);
+
+    __einsumRelease__(last);
+    free(terms);
+    return res;
+}
+
+// ------------------- Neural network layers -------------------
+
+/*
+fully connected layer: act(x @ w + bias).
+
+x is (..., k) with any number of leading (batch) axes, w is (k, n) and
+can be a strided view, e.g. the transpose of an (n, k) weight. bias has
+n elements or is NULL. the result is (..., n).
+
+the bias and the activation are applied by the GEMM to every tile of
+the output right after its last store, while it is still in L1, so
+there are no temporaries and no extra passes over the result. few rows
+(down to a single input vector) go through gemv instead.
+*/
+Array *smLinear(Array *x, Array *w, Array *bias, Activation act)
+{
+    if (w->ndim != 2 || x->shape[x->ndim - 1] != w->shape[0])
+    {
+        fprintf(stderr, ">> error: shapes not aligned for linear layer.\n");
+        exit(1);
+    }
+
+    int k = w->shape[0], n = w->shape[1];
+    if (bias && bias->totalsize != n)
+    {
+        fprintf(stderr, ">> error: bias must have one element per output feature.\n");
+        exit(1);
+    }
+
+    int shape[SM_MAXDIMS];
+    int m = 1;
+    for (int d = 0; d < x->ndim - 1; d++)
+    {
+        shape[d] = x->shape[d];
+        m *= x->shape[d];
+    }
+    shape[x->ndim - 1] = n;
+
+    Array *result = smCreate(shape, x->ndim);
+    Array *xc = __asContiguous__(x);
+    Array *bc = bias ? __asContiguous__(bias) : NULL;
+    const float *b = bc ? bc->data : NULL;
+
+    long rsw = w->strides[0] / w->itemsize;
+    long csw = w->strides[1] / w->itemsize;
+
+    Accumulation mode = __accumulation__;
+    bool blocked = (long)m * k * n >= SM_PARALLEL_MIN && m >= SM_MR && n >= SM_NR;
+    if (blocked || mode != SM_ACCUM_FLOAT)
+    {
+        __sgemmFused__(m, k, n, 1.0f, xc->data, k, 1, w->data, rsw, csw, 0.0f, result->data, n, 1, 0, b, act, mode);
+    }
+    else
+    {
+        // one row at a time: w.T @ x[i]
+        for (int i = 0; i < m; i++)
+        {
+            __sgemv__(n, k, w->data, csw, rsw, xc->data + (long)i * k, result->data + (long)i * n, mode);
+            __sgemmEpilogue__(result->data + (long)i * n, n, 1, 1, n, b, act);
+        }
+    }
+
+    if (xc != x)
+        smCleanup(xc);
+    if (bc && bc != bias)
+        smCleanup(bc);
+    return result;
+}
+
+/*
+run an axis op: the result has the shape of `arr` except for being
+`trim` elements shorter along `axis` (0 for softmax and friends, the
+window minus one for rolling stats). every 1D run along `axis` is handed
+to `loop` together with where its output goes.
+
+a contiguous axis (the usual last one) gives one run per call. for
+other axes the data is a stack of (n, inner) blocks, whose columns are
+the runs: SM_AXIS_COLS adjacent columns go to one call so the kernel
+can vectorize across them and read whole rows. runs (or groups of
+columns) are spread over threads.
+*/
+Array *__PaxisOp__(Array *arr, int axis, int trim, AxisLoop loop, void *ctx)
+{
+    if (axis < 0)
+        axis = arr->ndim + axis;
+    if (axis < 0 || axis >= arr->ndim)
+    {
+        fprintf(stderr, ">> error: axis out of bounds for normalization.\n");
+        exit(1);
+    }
+
+    long outer = 1, inner = 1, n = arr->shape[axis], m = n - trim;
+    for (int d = 0; d < axis; d++)
+        outer *= arr->shape[d];
+    for (int d = axis + 1; d < arr->ndim; d++)
+        inner *= arr->shape[d];
+
+    int shape[arr->ndim];
+    for (int d = 0; d < arr->ndim; d++)
+        shape[d] = arr->shape[d];
+    shape[axis] = (int)m;
+
+    Array *src = __asContiguous__(arr);
+    Array *result = smCreate(shape, arr->ndim);
+
+    if (inner == 1)
+    {
+#ifdef PARALLEL
+#pragma omp parallel for schedule(dynamic, 16) if (src->totalsize >= SM_PARALLEL_MIN)
+#endif
+        for (long o = 0; o < outer; o++)
+            loop(src->data + o * n, result->data + o * m, n, 1, 1, ctx);
+    }
+    else
+    {
+        long groups = (inner + SM_AXIS_COLS - 1) / SM_AXIS_COLS;
+#ifdef PARALLEL
+#pragma omp parallel for if (src->totalsize >= SM_PARALLEL_MIN)
+#endif
+        for (long t = 0; t < outer * groups; t++)
+        {
+            long o = t / groups, j = t % groups * SM_AXIS_COLS;
+            int width = (inner - j < SM_AXIS_COLS) ? (int)(inner - j) : SM_AXIS_COLS;
+            loop(src->data + o * n * inner + j, result->data + o * m * inner + j, n, inner, width, ctx);
+        }
+    }
+
+    if (src != arr)
+        smCleanup(src);
+    return result;
+}
+
+typedef struct
+{
+    bool log;
+} SoftmaxContext;
+
+#if defined(__AVX2__) && defined(__FMA__)
+/*
+one step of the online softmax recurrence on 8 lanes: the running sum
+of exp(x - max) is rescaled whenever the running max grows
+*/
+static inline void __softmaxStep256__(__m256 *vm, __m256 *vs, __m256 v)
+{
+    __m256 m = _mm256_max_ps(*vm, v);
+    *vs = _mm256_fmadd_ps(*vs, __exp256__(_mm256_sub_ps(*vm, m)), __exp256__(_mm256_sub_ps(v, m)));
+    *vm = m;
+}
+#endif
+
+/*
+softmax (or log-softmax) of each run: the first pass finds the max and
+the sum of exp(x - max) together with the online recurrence, the second
+writes the output. -inf inputs (masked entries) get a probability of 0,
+a NaN makes the whole run NaN.
+*/
+void __softmaxLoop__(const float *x, float *y, long n, long stride, int width, void *ctx)
+{
+    bool log = ((SoftmaxContext *)ctx)->log;
+    if (n == 0)
+        return;
+
+#if defined(__AVX2__) && defined(__FMA__)
+    if (stride == 1)
+    {
+        __m256 vm = _mm256_set1_ps(-INFINITY), vs = _mm256_setzero_ps();
+        float tail[8];
+        long i = 0;
+        for (; i + 8 <= n; i += 8)
+            __softmaxStep256__(&vm, &vs, _mm256_loadu_ps(x + i));
+        if (i < n)
+        {
+            for (int l = 0; l < 8; l++)
+                tail[l] = (i + l < n) ? x[i + l] : -INFINITY;
+            __softmaxStep256__(&vm, &vs, _mm256_loadu_ps(tail));
+        }
+
+        // merge the 8 lanes
+        float m[8], s[8], max = -INFINITY, sum = 0.0f;
+        _mm256_storeu_ps(m, vm);
+        _mm256_storeu_ps(s, vs);
+        for (int l = 0; l < 8; l++)
+            max = (m[l] > max) ? m[l] : max;
+        for (int l = 0; l < 8; l++)
+            if (m[l] != -INFINITY)
+                sum += s[l] * expf(m[l] - max);
+
+        // x - max first: exact for the large entries, log(sum) is small
+        __m256 vmax = _mm256_set1_ps(max);
+        __m256 logsum = _mm256_set1_ps(logf(sum));
+        __m256 inv = _mm256_set1_ps(1.0f / sum);
+        for (i = 0; i + 8 <= n; i += 8)
+        {
+            __m256 v = _mm256_sub_ps(_mm256_loadu_ps(x + i), vmax);
+            v = log ? _mm256_sub_ps(v, logsum) : _mm256_mul_ps(__exp256__(v), inv);
+            _mm256_storeu_ps(y + i, v);
+        }
+        if (i < n)
+        {
+            memcpy(tail, x + i, (n - i) * sizeof(float));
+            __m256 v = _mm256_sub_ps(_mm256_loadu_ps(tail), vmax);
+            v = log ? _mm256_sub_ps(v, logsum) : _mm256_mul_ps(__exp256__(v), inv);
+            _mm256_storeu_ps(tail, v);
+            memcpy(y + i, tail, (n - i) * sizeof(float));
+        }
+        return;
+    }
+
+    if (width == 8)
+    {
+        // 8 columns at once, one lane each
+        __m256 vm = _mm256_set1_ps(-INFINITY), vs = _mm256_setzero_ps();
+        for (long i = 0; i < n; i++)
+            __softmaxStep256__(&vm, &vs, _mm256_loadu_ps(x + i * stride));
+
+        float s[8];
+        _mm256_storeu_ps(s, vs);
+        for (int l = 0; l < 8; l++)
+            s[l] = log ? logf(s[l]) : 1.0f / s[l];
+        __m256 vs2 = _mm256_loadu_ps(s);
+
+        for (long i = 0; i < n; i++)
+        {
+            __m256 v = _mm256_sub_ps(_mm256_loadu_ps(x + i * stride), vm);
+            v = log ? _mm256_sub_ps(v, vs2) : _mm256_mul_ps(__exp256__(v), vs2);
+            _mm256_storeu_ps(y + i * stride, v);
+        }
+        return;
+    }
+#endif
+
+    for (int l = 0; l < width; l++)
+    {
+        float max = -INFINITY, sum = 0.0f;
+        for (long i = 0; i < n; i++)
+        {
+            float v = x[i * stride + l];
+            if (v > max || v != v)
+            {
+                sum = sum * expf(max - v) + 1.0f;
+                max = v;
+            }
+            else if (v > -INFINITY)
+            {
+                sum += expf(v - max);
+            }
+        }
+
+        float logsum = logf(sum), inv = 1.0f / sum;
+        for (long i = 0; i < n; i++)
+        {
+            float v = x[i * stride + l] - max;
+            y[i * stride + l] = log ? v - logsum : expf(v) * inv;
+        }
+    }
+}
+
+/*
+softmax along an axis: exp(x - max) / sum(exp(x - max)), fused into two
+passes over the data
+*/
+Array *smSoftmax(Array *arr, int axis)
+{
+    SoftmaxContext ctx = {false};
+    return __PaxisOp__(arr, axis, 0, __softmaxLoop__, &ctx);
+}
+
+/*
+log of the softmax along an axis: x - max - log(sum(exp(x - max))),
+without the underflow of taking the log of a softmax
+*/
+Array *smLogSoftmax(Array *arr, int axis)
+{
+    SoftmaxContext ctx = {true};
+    return __PaxisOp__(arr, axis, 0, __softmaxLoop__, &ctx);
+}
+
+typedef struct
+{
+    const float *gamma; // one per element along the axis, or NULL
+    const float *beta;
+    float eps;
+} LayerNormContext;
+
+/*
+layer normalization of each run. the first pass sums x - x[0] and its
+square: shifting by any value of the run keeps the variance from
+cancelling out when the mean is large next to the spread. the second
+pass normalizes the shifted values too and applies gamma and beta.
+*/
+void __layerNormLoop__(const float *x, float *y, long n, long stride, int width, void *ctx)
+{
+    LayerNormContext *c = (LayerNormContext *)ctx;
+    if (n == 0)
+        return;
+
+#if defined(__AVX2__) && defined(__FMA__)
+    if (stride == 1)
+    {
+        __m256 vshift = _mm256_set1_ps(x[0]);
+        __m256 s1 = _mm256_setzero_ps(), s2 = _mm256_setzero_ps();
+        long i = 0;
+        for (; i + 8 <= n; i += 8)
+        {
+            __m256 d = _mm256_sub_ps(_mm256_loadu_ps(x + i), vshift);
+            s1 = _mm256_add_ps(s1, d);
+            s2 = _mm256_fmadd_ps(d, d, s2);
+        }
+        float sum = __hsum256__(s1), sumsq = __hsum256__(s2);
+        for (; i < n; i++)
+        {
+            float d = x[i] - x[0];
+            sum += d;
+            sumsq += d * d;
+        }
+
+        // the mean relative to the shift, x - mean is taken as (x - shift) - mean
+        float mean = sum / n;
+        float var = (sumsq - sum * mean) / n;
+        float rstd = 1.0f / sqrtf(((var > 0.0f) ? var : 0.0f) + c->eps);
+
+        __m256 vmean = _mm256_set1_ps(mean), vrstd = _mm256_set1_ps(rstd);
+        for (i = 0; i + 8 <= n; i += 8)
+        {
+            __m256 d = _mm256_sub_ps(_mm256_loadu_ps(x + i), vshift);
+            __m256 v = _mm256_mul_ps(_mm256_sub_ps(d, vmean), vrstd);
+            if (c->gamma)
+                v = _mm256_mul_ps(v, _mm256_loadu_ps(c->gamma + i));
+            if (c->beta)
+                v = _mm256_add_ps(v, _mm256_loadu_ps(c->beta + i));
+            _mm256_storeu_ps(y + i, v);
+        }
+        for (; i < n; i++)
+        {
+            float v = ((x[i] - x[0]) - mean) * rstd;
+            if (c->gamma)
+                v *= c->gamma[i];
+            if (c->beta)
+                v += c->beta[i];
+            y[i] = v;
+        }
+        return;
+    }
+
+    if (width == 8)
+    {
+        __m256 vshift = _mm256_loadu_ps(x);
+        __m256 s1 = _mm256_setzero_ps(), s2 = _mm256_setzero_ps();
+        for (long i = 0; i < n; i++)
+        {
+            __m256 d = _mm256_sub_ps(_mm256_loadu_ps(x + i * stride), vshift);
+            s1 = _mm256_add_ps(s1, d);
+            s2 = _mm256_fmadd_ps(d, d, s2);
+        }
+
+        __m256 vn = _mm256_set1_ps((float)n);
+        __m256 mean = _mm256_div_ps(s1, vn);
+        __m256 var = _mm256_div_ps(_mm256_fnmadd_ps(s1, mean, s2), vn);
+        var = _mm256_max_ps(var, _mm256_setzero_ps());
+        __m256 rstd = _mm256_div_ps(_mm256_set1_ps(1.0f), _mm256_sqrt_ps(_mm256_add_ps(var, _mm256_set1_ps(c->eps))));
+
+        for (long i = 0; i < n; i++)
+        {
+            __m256 d = _mm256_sub_ps(_mm256_loadu_ps(x + i * stride), vshift);
+            __m256 v = _mm256_mul_ps(_mm256_sub_ps(d, mean), rstd);
+            if (c->gamma)
+                v = _mm256_mul_ps(v, _mm256_set1_ps(c->gamma[i]));
+            if (c->beta)
+                v = _mm256_add_ps(v, _mm256_set1_ps(c->beta[i]));
+            _mm256_storeu_ps(y + i * stride, v);
+        }
+        return;
+    }
+#endif
+
+    for (int l = 0; l < width; l++)
+    {
+        float shift = x[l], sum = 0.0f, sumsq = 0.0f;
+        for (long i = 0; i < n; i++)
+        {
+            float d = x[i * stride + l] - shift;
+            sum += d;
+            sumsq += d * d;
+        }
+
+        float mean = sum / n;
+        float var = (sumsq - sum * mean) / n;
+        float rstd = 1.0f / sqrtf(((var > 0.0f) ? var : 0.0f) + c->eps);
+
+        for (long i = 0; i < n; i++)
+        {
+            float v = ((x[i * stride + l] - shift) - mean) * rstd;
+            if (c->gamma)
+                v *= c->gamma[i];
+            if (c->beta)
+                v += c->beta[i];
+            y[i * stride + l] = v;
+        }
+    }
+}
+
+/*
+layer normalization along an axis: (x - mean) / sqrt(var + eps) * gamma
++ beta. gamma and beta have one element per index along the axis and
+can be NULL (1 and 0).
+*/
+Array *smLayerNorm(Array *arr, Array *gamma, Array *beta, int axis, float eps)
+{
+    int ax = (axis < 0) ? arr->ndim + axis : axis;
+    int n = (ax >= 0 && ax < arr->ndim) ? arr->shape[ax] : 0;
+    if ((gamma && gamma->totalsize != n) || (beta && beta->totalsize != n))
+    {
+        fprintf(stderr, ">> error: gamma and beta must have one element per index along the axis.\n");
+        exit(1);
+    }
+
+    Array *g = gamma ? __asContiguous__(gamma) : NULL;
+    Array *b = beta ? __asContiguous__(beta) : NULL;
+
+    LayerNormContext ctx = {g ? g->data : NULL, b ? b->data : NULL, eps};
+    Array *result = __PaxisOp__(arr, axis, 0, __layerNormLoop__, &ctx);
+
+    if (g && g != gamma)
+        smCleanup(g);
+    if (b && b != beta)
+        smCleanup(b);
+    return result;
+}
+
+/*
+x = exp(x - shift) in place, returns the sum. -inf entries become 0.
+*/
+float __expShift__(float *x, long n, float shift)
+{
+    float sum = 0.0f;
+#if defined(__AVX2__) && defined(__FMA__)
+    __m256 vshift = _mm256_set1_ps(shift), acc = _mm256_setzero_ps();
+    long i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+        __m256 e = __exp256__(_mm256_sub_ps(_mm256_loadu_ps(x + i), vshift));
+        _mm256_storeu_ps(x + i, e);
+        acc = _mm256_add_ps(acc, e);
+    }
+    if (i < n)
+    {
+        float tail[8];
+        for (int l = 0; l < 8; l++)
+            tail[l] = (i + l < n) ? x[i + l] : -INFINITY;
+        __m256 e = __exp256__(_mm256_sub_ps(_mm256_loadu_ps(tail), vshift));
+        _mm256_storeu_ps(tail, e);
+        acc = _mm256_add_ps(acc, e);
+        memcpy(x + i, tail, (n - i) * sizeof(float));
+    }
+    sum = __hsum256__(acc);
+#else
+    for (long i = 0; i < n; i++)
+    {
+        x[i] = expf(x[i] - shift);
+        sum += x[i];
+    }
+#endif
+    return sum;
+}
+
+typedef struct
+{
+    int lq, lk, d, dv;
+    float scale;
+    long rsq, csq, rsk, csk, rsv, csv;
+    const float *mask; // (lq, lk) added to the scores, or NULL
+    long rsm, csm;
+    bool causal;
+    float **items; // (out, q, k, v) of every matrix in the batch
+    long count;
+    int chunks; // tasks sharing the query blocks of one matrix
+    Accumulation mode;
+} AttentionContext;
+
+// record where the matrices of every batch item are
+void __attentionCollectLoop__(float **ptrs, const long *steps, long n, void *ctx)
+{
+    AttentionContext *c = (AttentionContext *)ctx;
+    for (long i = 0; i < n; i++)
+        for (int op = 0; op < 4; op++)
+            c->items[(c->count + i) * 4 + op] = ptrs[op] + i * steps[op];
+    c->count += n;
+}
+
+// one microkernel tile of a packed product, in the accumulation mode
+static inline void __attentionTile__(long kc, const float *ap, const float *bp, float *tile, Accumulation mode)
+{
+    if (mode == SM_ACCUM_FLOAT)
+        __sgemmKernel__(kc, ap, bp, tile);
+    else
+    {
+        double dtile[SM_MR * SM_NR];
+        __sgemmKernelAcc__(kc, ap, bp, dtile, mode);
+        for (int t = 0; t < SM_MR * SM_NR; t++)
+            tile[t] = (float)dtile[t];
+    }
+}
+
+/*
+the query blocks chunk, chunk + chunks, ... of one attention output.
+K.T and V are packed into microkernel panels once for the task and
+reused by every block of SM_ATT_BQ query rows, which walks the keys in
+blocks of SM_ATT_BK: the block of scores S = scale * Q @ K.T fits in
+L1/L2, every row keeps its running max and sum of exponentials (online
+softmax) and the output accumulator is rescaled whenever the max grows
+before P @ V of the block is added to it.
+*/
+void __attentionTask__(void *ctx, long item, int chunk)
+{
+    AttentionContext *c = (AttentionContext *)ctx;
+    float *out = c->items[item * 4];
+    const float *q = c->items[item * 4 + 1];
+    const float *k = c->items[item * 4 + 2];
+    const float *v = c->items[item * 4 + 3];
+    int d = c->d, dv = c->dv;
+    Accumulation mode = c->mode;
+
+    int blocks = (c->lq + SM_ATT_BQ - 1) / SM_ATT_BQ;
+    if (chunk >= blocks)
+        return;
+
+    // with a causal mask the keys after the last query row are never seen
+    int last = chunk + (blocks - 1 - chunk) / c->chunks * c->chunks;
+    int lk = (last + 1) * SM_ATT_BQ < c->lq ? (last + 1) * SM_ATT_BQ : c->lq;
+    lk = c->causal && lk < c->lk ? lk : c->lk;
+
+    long kpanels = (lk + SM_NR - 1) / SM_NR, vpanels = (dv + SM_NR - 1) / SM_NR;
+    long mpad = (SM_ATT_BQ + SM_MR - 1) / SM_MR * SM_MR;
+    float *kp = (float *)malloc((kpanels * SM_NR * d + 1) * sizeof(float));
+    float *vp = (float *)malloc(((long)lk * vpanels * SM_NR + 1) * sizeof(float));
+    float *qp = (float *)malloc((mpad * d + 1) * sizeof(float));
+    float *pp = (float *)malloc(mpad * SM_ATT_BK * sizeof(float));
+    float *s = (float *)malloc(SM_ATT_BQ * SM_ATT_BK * sizeof(float));
+    float *acc = (float *)malloc(((size_t)SM_ATT_BQ * dv + 1) * sizeof(float));
+    _checkNull(kp);
+    _checkNull(vp);
+    _checkNull(qp);
+    _checkNull(pp);
+    _checkNull(s);
+    _checkNull(acc);
+
+    // K.T is (d, lk), V is cut along the keys like the blocks of scores
+    for (long jp = 0; jp < kpanels; jp++)
+        __sgemmPackB__(d, lk - (int)jp * SM_NR, k + jp * SM_NR * c->rsk, c->csk, c->rsk, kp + jp * SM_NR * d);
+    for (int j0 = 0; j0 < lk; j0 += SM_ATT_BK)
+    {
+        int bk = (lk - j0 < SM_ATT_BK) ? lk - j0 : SM_ATT_BK;
+        for (long jp = 0; jp < vpanels; jp++)
+            __sgemmPackB__(
+                bk, dv - (int)jp * SM_NR, v + j0 * c->rsv + jp * SM_NR * c->csv, c->rsv, c->csv,
+                vp + (long)j0 * vpanels * SM_NR + jp * SM_NR * bk);
+    }
+
+    for (int blk = chunk; blk < blocks; blk += c->chunks)
+    {
+        int i0 = blk * SM_ATT_BQ;
+        int bq = (c->lq - i0 < SM_ATT_BQ) ? c->lq - i0 : SM_ATT_BQ;
+        int bl = c->causal && i0 + bq < c->lk ? i0 + bq : c->lk;
+        float max[SM_ATT_BQ], sum[SM_ATT_BQ], tile[SM_MR * SM_NR];
+
+        for (int i = 0; i < bq; i++)
+        {
+            max[i] = -INFINITY;
+            sum[i] = 0.0f;
+        }
+        memset(acc, 0, (size_t)bq * dv * sizeof(float));
+        __sgemmPackA__(bq, d, q + i0 * c->rsq, c->rsq, c->csq, qp);
+
+        for (int j0 = 0; j0 < bl; j0 += SM_ATT_BK)
+        {
+            int bk = (bl - j0 < SM_ATT_BK) ? bl - j0 : SM_ATT_BK;
+
+            for (int r0 = 0; r0 < bq; r0 += SM_MR)
+            {
+                int mr = (bq - r0 < SM_MR) ? bq - r0 : SM_MR;
+                for (int c0 = 0; c0 < bk; c0 += SM_NR)
+                {
+                    int nr = (bk - c0 < SM_NR) ? bk - c0 : SM_NR;
+                    __attentionTile__(d, qp + (long)r0 * d, kp + (long)(j0 + c0) * d, tile, mode);
+                    for (int r = 0; r < mr; r++)
+                        for (int j = 0; j < nr; j++)
+                            s[(r0 + r) * SM_ATT_BK + c0 + j] = c->scale * tile[r * SM_NR + j];
+                }
+            }
+
+            for (int i = 0; i < bq; i++)
+            {
+                float *row = s + i * SM_ATT_BK;
+                if (c->mask)
+                    for (int j = 0; j < bk; j++)
+                        row[j] += c->mask[(i0 + i) * c->rsm + (j0 + j) * c->csm];
+                if (c->causal)
+                    for (int j = (i0 + i + 1 > j0) ? i0 + i + 1 - j0 : 0; j < bk; j++)
+                        row[j] = -INFINITY;
+
+                float m = max[i];
+                for (int j = 0; j < bk; j++)
+                    m = (row[j] > m) ? row[j] : m;
+
+                if (m == -INFINITY)
+                {
+                    // nothing visible yet in this row
+                    memset(row, 0, bk * sizeof(float));
+                    continue;
+                }
+
+                float alpha = expf(max[i] - m);
+                sum[i] = sum[i] * alpha + __expShift__(row, bk, m);
+                max[i] = m;
+                if (alpha != 1.0f)
+                    for (int t = 0; t < dv; t++)
+                        acc[i * dv + t] *= alpha;
+            }
+
+            __sgemmPackA__(bq, bk, s, SM_ATT_BK, 1, pp);
+            const float *vb = vp + (long)j0 * vpanels * SM_NR;
+            for (int r0 = 0; r0 < bq; r0 += SM_MR)
+            {
+                int mr = (bq - r0 < SM_MR) ? bq - r0 : SM_MR;
+                for (long jp = 0; jp < vpanels; jp++)
+                {
+                    int c0 = (int)jp * SM_NR;
+                    int nr = (dv - c0 < SM_NR) ? dv - c0 : SM_NR;
+                    __attentionTile__(bk, pp + (long)r0 * bk, vb + jp * SM_NR * bk, tile, mode);
+                    for (int r = 0; r < mr; r++)
+                        for (int j = 0; j < nr; j++)
+                            acc[(r0 + r) * dv + c0 + j] += tile[r * SM_NR + j];
+                }
+            }
+        }
+
+        for (int i = 0; i < bq; i++)
+        {
+            float inv = 1.0f / sum[i];
+            float *dst = out + (long)(i0 + i) * dv;
+            for (int t = 0; t < dv; t++)
+                dst[t] = acc[i * dv + t] * inv;
+        }
+    }
+
+    free(kp);
+    free(vp);
+    free(qp);
+    free(pp);
+    free(s);
+    free(acc);
+}
+
+/*
+scaled dot product attention: softmax(q @ k.T / sqrt(d) + mask) @ v.
+
+q is (..., Lq, d), k (..., Lk, d) and v (..., Lk, dv), usually with
+(batch, heads) in front. k and v can broadcast over the leading axes
+of q (e.g. one head shared by all). any of them can be a strided view,
+such as the transpose of a (batch, L, heads, d) Array. the result is
+(..., Lq, dv).
+
+`mask` is an (Lq, Lk) Array added to the scores (-INFINITY hides a
+key) or NULL. `causal` hides key j from query i when j > i.
+
+the (Lq, Lk) scores are never materialized: see __attentionTask__.
+tasks are (matrix of the batch, every chunks-th block of query rows),
+with just enough chunks per matrix to keep the threads busy.
+*/
+Array *smAttention(Array *q, Array *k, Array *v, Array *mask, bool causal)
+{
+    int nd = q->ndim;
+    if (nd < 2 || k->ndim < 2 || v->ndim < 2)
+    {
+        fprintf(stderr, ">> error: attention needs at least 2 dimensions.\n");
+        exit(1);
+    }
+
+    int lq = q->shape[nd - 2], d = q->shape[nd - 1];
+    int lk = k->shape[k->ndim - 2], dv = v->shape[v->ndim - 1];
+    if (k->shape[k->ndim - 1] != d || v->shape[v->ndim - 2] != lk)
+    {
+        fprintf(stderr, ">> error: shapes of query, key and value do not match for attention.\n");
+        exit(1);
+    }
+    if (mask && (mask->ndim != 2 || mask->shape[0] != lq || mask->shape[1] != lk))
+    {
+        fprintf(stderr, ">> error: attention mask must be (Lq, Lk).\n");
+        exit(1);
+    }
+
+    int shape[SM_MAXDIMS];
+    memcpy(shape, q->shape, nd * sizeof(int));
+    shape[nd - 1] = dv;
+    Array *result = smCreate(shape, nd);
+
+    // the batch axes are planned like an elementwise loop, k and v broadcast
+    Array *batch[] = {__batchView__(result), __batchView__(q), __batchView__(k), __batchView__(v)};
+    StridedPlan plan;
+    __planStrided__(&plan, batch[0]->shape, batch[0]->ndim, batch, 4);
+
+    long nitems = batch[0]->totalsize;
+    AttentionContext ctx = {
+        lq, lk, d, dv, 1.0f / sqrtf((float)d),
+        q->strides[nd - 2] / q->itemsize, q->strides[nd - 1] / q->itemsize,
+        k->strides[k->ndim - 2] / k->itemsize, k->strides[k->ndim - 1] / k->itemsize,
+        v->strides[v->ndim - 2] / v->itemsize, v->strides[v->ndim - 1] / v->itemsize,
+        mask ? mask->data : NULL,
+        mask ? mask->strides[0] / mask->itemsize : 0, mask ? mask->strides[1] / mask->itemsize : 0,
+        causal, (float **)malloc((nitems + 1) * 4 * sizeof(float *)), 0, 1, __accumulation__};
+    _checkNull(ctx.items);
+    __runStridedRange__(&plan, __attentionCollectLoop__, &ctx, 0, __stridedItems__(&plan));
+
+    ctx.chunks = 1;
+#ifdef PARALLEL
+    long blocks = (lq + SM_ATT_BQ - 1) / SM_ATT_BQ;
+    bool threaded = (double)nitems * lq * lk * d >= SM_PARALLEL_MIN;
+    if (threaded && ctx.count < omp_get_max_threads())
+        ctx.chunks = (int)((omp_get_max_threads() + ctx.count - 1) / ctx.count);
+    if (ctx.chunks > blocks)
+        ctx.chunks = (blocks > 0) ? (int)blocks : 1;
+#pragma omp parallel for schedule(dynamic) if (threaded)
+#endif
+    for (long t = 0; t < ctx.count * ctx.chunks; t++)
+        __attentionTask__(&ctx, t / ctx.chunks, (int)(t % ctx.chunks));
+
+    free(ctx.items);
+    for (int i = 0; i < 4; i++)
+        smCleanup(batch[i]);
+    return result;
+}
+
+// ------------------- Convolution and pooling -------------------
+
+/*
+outputs [lo, hi) of a convolution axis read inside the input: output i
+reads input i * stride + off (off = tap * dilation - padding)
+*/
+void __convRange__(int off, int stride, int in, int out, int *lo, int *hi)
+{
+    *lo = (off >= 0) ? 0 : (-off + stride - 1) / stride;
+    *hi = (in - 1 - off < 0) ? 0 : (in - 1 - off) / stride + 1;
+    if (*hi > out)
+        *hi = out;
+    if (*lo > *hi)
+        *lo = *hi;
+}
+
+// output size from the input, kernel, stride, padding and dilation
+void __convOutput__(ConvGeometry *g)
+{
+    if (g->sh < 1 || g->sw < 1 || g->dh < 1 || g->dw < 1 || g->ph < 0 || g->pw < 0)
+    {
+        fprintf(stderr, ">> error: stride and dilation must be positive, padding not negative.\n");
+        exit(1);
+    }
+
+    g->oh = (g->h + 2 * g->ph - g->dh * (g->kh - 1) - 1) / g->sh + 1;
+    g->ow = (g->w + 2 * g->pw - g->dw * (g->kw - 1) - 1) / g->sw + 1;
+    if (g->h + 2 * g->ph < g->dh * (g->kh - 1) + 1 || g->w + 2 * g->pw < g->dw * (g->kw - 1) + 1)
+    {
+        fprintf(stderr, ">> error: kernel is larger than the padded input.\n");
+        exit(1);
+    }
+}
+
+/*
+unfold the channels of one group of one image into a (cg * kh * kw,
+oh * ow) matrix: row (c, i, j) holds the input seen by tap (i, j) of
+channel c at every output position, 0 in the padding
+*/
+void __im2col__(const float *x, const ConvGeometry *g, float *col)
+{
+    int cg = g->c / g->groups;
+    long plane = (long)g->oh * g->ow;
+
+    for (int c = 0; c < cg; c++)
+    {
+        for (int i = 0; i < g->kh; i++)
+        {
+            for (int j = 0; j < g->kw; j++)
+            {
+                float *row = col + ((long)(c * g->kh + i) * g->kw + j) * plane;
+                int offh = i * g->dh - g->ph, offw = j * g->dw - g->pw;
+                int lo, hi;
+                __convRange__(offw, g->sw, g->w, g->ow, &lo, &hi);
+
+                for (int oy = 0; oy < g->oh; oy++)
+                {
+                    float *dst = row + (long)oy * g->ow;
+                    int iy = oy * g->sh + offh;
+                    if (iy < 0 || iy >= g->h)
+                    {
+                        memset(dst, 0, g->ow * sizeof(float));
+                        continue;
+                    }
+
+                    const float *src = x + ((long)c * g->h + iy) * g->w;
+                    memset(dst, 0, lo * sizeof(float));
+                    if (g->sw == 1)
+                        memcpy(dst + lo, src + lo + offw, (hi - lo) * sizeof(float));
+                    else
+                        for (int ox = lo; ox < hi; ox++)
+                            dst[ox] = src[ox * g->sw + offw];
+                    memset(dst + hi, 0, (g->ow - hi) * sizeof(float));
+                }
+            }
+        }
+    }
+}
+
+#if defined(__AVX2__) && defined(__FMA__)
+/*
+8 * nv outputs of row `oy` from x0 on, all of them inside the input for
+every tap (unit stride): they stay in nv registers across the taps, each
+tap costs a load and an FMA per register instead of a load and a store
+of the output row on top
+*/
+static inline void __convTile256__(
+    const float *x, const float *w, float bias, const ConvGeometry *g,
+    int oy, int x0, int nv, float *dst)
+{
+    __m256 acc[SM_CONV_TILE / 8];
+    for (int v = 0; v < nv; v++)
+        acc[v] = _mm256_set1_ps(bias);
+
+    for (int c = 0; c < g->c / g->groups; c++)
+    {
+        for (int i = 0; i < g->kh; i++)
+        {
+            int iy = oy * g->sh + i * g->dh - g->ph;
+            if (iy < 0 || iy >= g->h)
+                continue;
+
+            const float *src = x + ((long)c * g->h + iy) * g->w + x0 - g->pw;
+            const float *wr = w + (c * g->kh + i) * g->kw;
+            for (int j = 0; j < g->kw; j++, src += g->dw)
+            {
+                __m256 wv = _mm256_set1_ps(wr[j]);
+                for (int v = 0; v < nv; v++)
+                    acc[v] = _mm256_fmadd_ps(wv, _mm256_loadu_ps(src + 8 * v), acc[v]);
+            }
+        }
     }
 
-    int result_ndim = (a->ndim > b->ndim) ? a->ndim : b->ndim;
-    int *result_shape = (int *)malloc(result_ndim * sizeof(int));
+    for (int v = 0; v < nv; v++)
+        _mm256_storeu_ps(dst + x0 + 8 * v, acc[v]);
+}
+#endif
+
+/*
+one output channel of one image computed in place, row by row. every
+(channel, tap) adds its weight times a shifted input row to the output
+row, only over the part that is inside the input. with AVX2 and unit
+stride, the middle of a row where every tap is inside is done in tiles
+of SM_CONV_TILE (then half as many) outputs held in registers across
+all the taps. smaller tiles would wait on the FMA latency, the rest of
+the row goes through the row loop.
+*/
+void __convDirect__(const float *x, const float *w, float bias, const ConvGeometry *g, float *out)
+{
+    int cg = g->c / g->groups;
 
-    // broadcast result shape untill last two axes
-    for (int i = 0; i < result_ndim - 2; i++)
+    // valid outputs of every column tap (kw <= SM_CONV_DIRECT), the
+    // tiles cover [xa, xb) where all of them are valid
+    int lo[SM_CONV_DIRECT], hi[SM_CONV_DIRECT];
+    int xa = 0, xb = g->ow;
+    for (int j = 0; j < g->kw; j++)
     {
-        result_shape[i] = (i < a->ndim - 2) ? a->shape[i] : 1;
-        result_shape[i] = (i < b->ndim - 2) ? (result_shape[i] > b->shape[i] ? result_shape[i] : b->shape[i]) : result_shape[i];
+        __convRange__(j * g->dw - g->pw, g->sw, g->w, g->ow, &lo[j], &hi[j]);
+        xa = (lo[j] > xa) ? lo[j] : xa;
+        xb = (hi[j] < xb) ? hi[j] : xb;
     }
-    result_shape[result_ndim - 2] = a->shape[a->ndim - 2];
-    result_shape[result_ndim - 1] = b->shape[b->ndim - 1];
+    int half = SM_CONV_TILE / 2;
+    xb = (xb > xa) ? xa + (xb - xa) / half * half : xa;
+#if !(defined(__AVX2__) && defined(__FMA__))
+    xb = xa;
+#endif
+    if (g->sw != 1)
+        xb = xa;
+    int edges[2][2] = {{0, xa}, {xb, g->ow}};
+
+    for (int oy = 0; oy < g->oh; oy++)
+    {
+        float *dst = out + (long)oy * g->ow;
 
-    Array *result = smCreate(result_shape, result_ndim);
-    free(result_shape);
+#if defined(__AVX2__) && defined(__FMA__)
+        int x0 = xa;
+        for (; x0 + SM_CONV_TILE <= xb; x0 += SM_CONV_TILE)
+            __convTile256__(x, w, bias, g, oy, x0, SM_CONV_TILE / 8, dst);
+        for (; x0 < xb; x0 += half)
+            __convTile256__(x, w, bias, g, oy, x0, half / 8, dst);
+#endif
 
-    int m = a->shape[a->ndim - 2];
-    int n = a->shape[a->ndim - 1];
-    int p = b->shape[b->ndim - 1];
+        for (int e = 0; e < 2; e++)
+            for (int ox = edges[e][0]; ox < edges[e][1]; ox++)
+                dst[ox] = bias;
 
-    // total matmuls to perform
-    int last_two = result->shape[result_ndim - 1] * result->shape[result_ndim - 2];
-    int totalops = result->totalsize / last_two;
+        for (int c = 0; c < cg; c++)
+        {
+            for (int i = 0; i < g->kh; i++)
+            {
+                int iy = oy * g->sh + i * g->dh - g->ph;
+                if (iy < 0 || iy >= g->h)
+                    continue;
 
-    ArrayIndices *idxs = __getArrayIndicesFromShape__(result->shape, result_ndim - 2);
+                const float *in = x + ((long)c * g->h + iy) * g->w;
+                for (int j = 0; j < g->kw; j++)
+                {
+                    float wv = w[(c * g->kh + i) * g->kw + j];
+                    const float *src = in + (j * g->dw - g->pw);
+                    for (int e = 0; e < 2; e++)
+                    {
+                        int a = (lo[j] > edges[e][0]) ? lo[j] : edges[e][0];
+                        int b = (hi[j] < edges[e][1]) ? hi[j] : edges[e][1];
+                        if (g->sw == 1)
+                            for (int ox = a; ox < b; ox++)
+                                dst[ox] += wv * src[ox];
+                        else
+                            for (int ox = a; ox < b; ox++)
+                                dst[ox] += wv * src[ox * g->sw];
+                    }
+                }
+            }
+        }
+    }
+}
 
-    for (int idx = 0; idx < totalops; idx++)
+/*
+2D convolution with the geometry filled in, `ndim` (3 or 4) is the
+rank of the result.
+
+short reductions (cg * kh * kw <= SM_CONV_DIRECT: first layers on RGB,
+depthwise convolutions) use the direct kernel, threaded over (image,
+output channel). longer ones are im2col + GEMM per (image, group):
+W (og, cg * kh * kw) @ col (cg * kh * kw, oh * ow), with the bias
+preloaded into the output (beta = 1). 1x1 convolutions without stride
+or padding skip the im2col, the image already is that matrix. several
+(image, group) pairs are spread over threads, a single one leaves the
+threads to the GEMM.
+*/
+Array *__conv__(Array *x, Array *w, Array *bias, ConvGeometry *g, int ndim)
+{
+    if (g->groups < 1 || g->c % g->groups != 0 || g->o % g->groups != 0)
+    {
+        fprintf(stderr, ">> error: channels must be divisible by groups.\n");
+        exit(1);
+    }
+    if (w->shape[1] != g->c / g->groups)
+    {
+        fprintf(stderr, ">> error: weight channels do not match the input for convolution.\n");
+        exit(1);
+    }
+    if (bias && bias->totalsize != g->o)
     {
-        int *nd_index = idxs->indices[idx];
+        fprintf(stderr, ">> error: bias must have one element per output channel.\n");
+        exit(1);
+    }
+    __convOutput__(g);
 
-        // perform matmul for this slice
-        // note: can be parallelized
-        for (int i = 0; i < m; i++)
+    int shape[] = {g->n, g->o, g->oh, g->ow};
+    if (ndim == 3)
+        shape[2] = g->ow;
+    Array *result = smCreate(shape, ndim);
+
+    Array *xc = __asContiguous__(x);
+    Array *wc = __asContiguous__(w);
+    Array *bc = bias ? __asContiguous__(bias) : NULL;
+
+    int cg = g->c / g->groups, og = g->o / g->groups;
+    long taps = (long)cg * g->kh * g->kw;
+    long plane = (long)g->oh * g->ow, inplane = (long)g->h * g->w;
+
+    if (taps <= SM_CONV_DIRECT)
+    {
+        long tasks = (long)g->n * g->o;
+#ifdef PARALLEL
+#pragma omp parallel for schedule(dynamic) if (tasks * plane * taps >= SM_PARALLEL_MIN)
+#endif
+        for (long t = 0; t < tasks; t++)
         {
-            for (int j = 0; j < p; j++)
+            long img = t / g->o;
+            int oc = (int)(t % g->o), grp = oc / og;
+            __convDirect__(
+                xc->data + (img * g->c + (long)grp * cg) * inplane, wc->data + oc * taps,
+                bc ? bc->data[oc] : 0.0f, g, result->data + t * plane);
+        }
+    }
+    else
+    {
+        bool pointwise = g->kh == 1 && g->kw == 1 && g->sh == 1 && g->sw == 1 && g->ph == 0 && g->pw == 0;
+        long tasks = (long)g->n * g->groups;
+        Accumulation mode = __accumulation__;
+#ifdef PARALLEL
+#pragma omp parallel for schedule(dynamic) if (tasks > 1 && tasks * og * plane * taps >= SM_PARALLEL_MIN)
+#endif
+        for (long t = 0; t < tasks; t++)
+        {
+            long img = t / g->groups;
+            int grp = (int)(t % g->groups);
+            const float *xg = xc->data + (img * g->c + (long)grp * cg) * inplane;
+            float *out = result->data + (img * g->o + (long)grp * og) * plane;
+
+            float *col = NULL;
+            if (!pointwise)
             {
-                float sum = 0.0f;
-                for (int k = 0; k < n; k++)
-                {
-                    // linear 1D index for a and b
-                    int a_index1d = 0, b_index1d = 0;
+                col = (float *)malloc(taps * plane * sizeof(float));
+                _checkNull(col);
+                __im2col__(xg, g, col);
+            }
+
+            for (int oc = 0; oc < og && bc; oc++)
+                for (long e = 0; e < plane; e++)
+                    out[oc * plane + e] = bc->data[grp * og + oc];
+
+            __sgemm__(
+                og, (int)taps, (int)plane, 1.0f, wc->data + (long)grp * og * taps, taps, 1,
+                pointwise ? xg : col, plane, 1, bc ? 1.0f : 0.0f, out, plane, 1, 0, mode);
+            free(col);
+        }
+    }
+
+    if (xc != x)
+        smCleanup(xc);
+    if (wc != w)
+        smCleanup(wc);
+    if (bc && bc != bias)
+        smCleanup(bc);
+    return result;
+}
+
+/*
+1D convolution (cross-correlation, like every deep learning library)
+of x (N, C, L) with w (O, C / groups, K) and an optional bias (O).
+the result is (N, O, (L + 2 padding - dilation (K - 1) - 1) / stride + 1).
+*/
+Array *smConv1d(Array *x, Array *w, Array *bias, int stride, int padding, int dilation, int groups)
+{
+    if (x->ndim != 3 || w->ndim != 3)
+    {
+        fprintf(stderr, ">> error: conv1d needs a (N, C, L) input and a (O, C, K) weight.\n");
+        exit(1);
+    }
+
+    ConvGeometry g = {
+        x->shape[0], x->shape[1], 1, x->shape[2], w->shape[0], groups,
+        1, w->shape[2], 1, stride, 0, padding, 1, dilation, 0, 0};
+    return __conv__(x, w, bias, &g, 3);
+}
+
+/*
+2D convolution of x (N, C, H, W) with w (O, C / groups, KH, KW) and an
+optional bias (O). stride, padding and dilation are the same along H and
+W. the result is (N, O, OH, OW).
+*/
+Array *smConv2d(Array *x, Array *w, Array *bias, int stride, int padding, int dilation, int groups)
+{
+    if (x->ndim != 4 || w->ndim != 4)
+    {
+        fprintf(stderr, ">> error: conv2d needs a (N, C, H, W) input and a (O, C, KH, KW) weight.\n");
+        exit(1);
+    }
+
+    ConvGeometry g = {
+        x->shape[0], x->shape[1], x->shape[2], x->shape[3], w->shape[0], groups,
+        w->shape[2], w->shape[3], stride, stride, padding, padding, dilation, dilation, 0, 0};
+    return __conv__(x, w, bias, &g, 4);
+}
+
+/*
+max or average pooling of (N, C, H, W) over kernel x kernel windows,
+threaded over the (image, channel) planes. every output row is built
+by folding shifted input rows into it, the part of a window that falls
+into the padding is skipped (max) or counts as 0 (average, the sum is
+always divided by kernel * kernel).
+*/
+Array *__pool2d__(Array *x, int kernel, int stride, int padding, bool max)
+{
+    if (x->ndim != 4)
+    {
+        fprintf(stderr, ">> error: pooling needs a (N, C, H, W) input.\n");
+        exit(1);
+    }
+    if (kernel < 1 || 2 * padding > kernel)
+    {
+        fprintf(stderr, ">> error: padding must be at most half the pooling kernel.\n");
+        exit(1);
+    }
+
+    ConvGeometry g = {
+        x->shape[0], x->shape[1], x->shape[2], x->shape[3], x->shape[1], 1,
+        kernel, kernel, stride, stride, padding, padding, 1, 1, 0, 0};
+    __convOutput__(&g);
 
-                    // higher dimensions
-                    for (int d = 0; d < a->ndim - 2; d++)
-                        a_index1d += (nd_index[d] * a->strides[d]);
-                    for (int d = 0; d < b->ndim - 2; d++)
-                        b_index1d += (nd_index[d] * b->strides[d]);
+    int shape[] = {g.n, g.c, g.oh, g.ow};
+    Array *result = smCreate(shape, 4);
+    Array *xc = __asContiguous__(x);
 
-                    // last 2 dimensions
-                    a_index1d += (i * a->strides[a->ndim - 2] + k * a->strides[a->ndim - 1]);
-                    b_index1d += (k * b->strides[b->ndim - 2] + j * b->strides[b->ndim - 1]);
+    long planes = (long)g.n * g.c, plane = (long)g.oh * g.ow, inplane = (long)g.h * g.w;
+    float scale = 1.0f / (kernel * kernel);
 
-                    sum += a->data[a_index1d / a->itemsize] * b->data[b_index1d / b->itemsize];
+#ifdef PARALLEL
+#pragma omp parallel for if (planes * plane * kernel * kernel >= SM_PARALLEL_MIN)
+#endif
+    for (long t = 0; t < planes; t++)
+    {
+        const float *src = xc->data + t * inplane;
+        float *out = result->data + t * plane;
+
+        for (int oy = 0; oy < g.oh; oy++)
+        {
+            float *dst = out + (long)oy * g.ow;
+            for (int ox = 0; ox < g.ow; ox++)
+                dst[ox] = max ? -INFINITY : 0.0f;
+
+            for (int i = 0; i < kernel; i++)
+            {
+                int iy = oy * g.sh + i - g.ph;
+                if (iy < 0 || iy >= g.h)
+                    continue;
+
+                for (int j = 0; j < kernel; j++)
+                {
+                    int offw = j - g.pw, lo, hi;
+                    __convRange__(offw, g.sw, g.w, g.ow, &lo, &hi);
+                    const float *row = src + (long)iy * g.w;
+                    if (max)
+                        for (int ox = lo; ox < hi; ox++)
+                            dst[ox] = (row[ox * g.sw + offw] > dst[ox]) ? row[ox * g.sw + offw] : dst[ox];
+                    else
+                        for (int ox = lo; ox < hi; ox++)
+                            dst[ox] += row[ox * g.sw + offw];
                 }
+            }
+
+            if (!max)
+                for (int ox = 0; ox < g.ow; ox++)
+                    dst[ox] *= scale;
+        }
+    }
+
+    if (xc != x)
+        smCleanup(xc);
+    return result;
+}
+
+/*
+max over kernel x kernel windows of (N, C, H, W)
+*/
+Array *smMaxPool2d(Array *x, int kernel, int stride, int padding)
+{
+    return __pool2d__(x, kernel, stride, padding, true);
+}
+
+/*
+average over kernel x kernel windows of (N, C, H, W), padding counted
+as zeros
+*/
+Array *smAvgPool2d(Array *x, int kernel, int stride, int padding)
+{
+    return __pool2d__(x, kernel, stride, padding, false);
+}
+
+// ------------------- Quantized matmul -------------------
+
+/*
+allocate an uninitialized QArray with `channels` scales and zero points
+*/
+QArray *__createQ8__(const int *shape, int ndim, int axis, int channels, bool isunsigned)
+{
+    QArray *q = (QArray *)malloc(sizeof(QArray));
+    _checkNull(q);
+
+    q->shape = (int *)malloc(ndim * sizeof(int));
+    _checkNull(q->shape);
+    q->ndim = ndim;
+    q->totalsize = 1;
+    for (int d = 0; d < ndim; d++)
+    {
+        q->shape[d] = shape[d];
+        q->totalsize *= shape[d];
+    }
+
+    q->data = (unsigned char *)malloc(q->totalsize + 1);
+    q->scale = (float *)malloc((channels + 1) * sizeof(float));
+    q->zero = (int *)calloc(channels + 1, sizeof(int));
+    _checkNull(q->data);
+    _checkNull(q->scale);
+    _checkNull(q->zero);
+
+    q->axis = axis;
+    q->channels = channels;
+    q->isunsigned = isunsigned;
+    return q;
+}
+
+/*
+free all the memory allocated by a QArray
+*/
+void smCleanupQ8(QArray *q)
+{
+    free(q->data);
+    free(q->shape);
+    free(q->scale);
+    free(q->zero);
+    free(q);
+}
+
+/*
+quantize an Array to 8 bits, value = scale * (q - zero).
 
-                // same as a and b, for result
-                int r_index1d = 0;
-                for (int d = 0; d < a->ndim - 2; d++)
-                    r_index1d += (nd_index[d] * result->strides[d]);
-                r_index1d += (i * result->strides[result->ndim - 2] + j * result->strides[result->ndim - 1]);
+int8 is symmetric: [-max|x|, max|x|] maps to [-127, 127] and zero is 0,
+which is what weights want. uint8 is asymmetric for activations: [min,
+max] (always including 0, so 0 stays exact) maps to [0, 255], in
+every build (see __q8Kernel__ for how AVX2 avoids saturating).
 
-                result->data[r_index1d / result->itemsize] = sum;
+`axis` gives one scale per index along it (per channel), SM_NONE a
+single scale for the whole Array (per tensor).
+*/
+QArray *smQuantize(Array *arr, int axis, bool isunsigned)
+{
+    if (axis != SM_NONE && axis < 0)
+        axis = arr->ndim + axis;
+    if (axis != SM_NONE && (axis < 0 || axis >= arr->ndim))
+    {
+        fprintf(stderr, ">> error: axis out of bounds for quantization.\n");
+        exit(1);
+    }
+
+    // channel of element e: (e / inner) % channels
+    int channels = (axis == SM_NONE) ? 1 : arr->shape[axis];
+    long inner = 1;
+    if (axis != SM_NONE)
+        for (int d = axis + 1; d < arr->ndim; d++)
+            inner *= arr->shape[d];
+
+    QArray *q = __createQ8__(arr->shape, arr->ndim, axis, channels, isunsigned);
+    Array *src = __asContiguous__(arr);
+    long n = src->totalsize;
+
+    float *lo = (float *)calloc(channels + 1, sizeof(float));
+    float *hi = (float *)calloc(channels + 1, sizeof(float));
+    _checkNull(lo);
+    _checkNull(hi);
+
+    for (long e = 0; e < n; e++)
+    {
+        long c = (channels == 1) ? 0 : (e / inner) % channels;
+        float v = src->data[e];
+        lo[c] = (v < lo[c]) ? v : lo[c];
+        hi[c] = (v > hi[c]) ? v : hi[c];
+    }
+
+    for (int c = 0; c < channels; c++)
+    {
+        if (isunsigned)
+        {
+            q->scale[c] = (hi[c] > lo[c]) ? (hi[c] - lo[c]) / SM_Q8_UMAX : 1.0f;
+            long zero = lrintf(-lo[c] / q->scale[c]);
+            q->zero[c] = (int)(zero > SM_Q8_UMAX ? SM_Q8_UMAX : zero);
+        }
+        else
+        {
+            float range = fmaxf(-lo[c], hi[c]);
+            q->scale[c] = (range > 0.0f) ? range / 127.0f : 1.0f;
+            q->zero[c] = 0;
+        }
+    }
+
+    float qmin = isunsigned ? 0.0f : -127.0f;
+    float qmax = isunsigned ? SM_Q8_UMAX : 127.0f;
+
+    // lo is reused for the inverse scales
+    for (int c = 0; c < channels; c++)
+        lo[c] = 1.0f / q->scale[c];
+
+#ifdef PARALLEL
+#pragma omp parallel for if (n >= SM_PARALLEL_MIN)
+#endif
+    for (long e = 0; e < n; e++)
+    {
+        long c = (channels == 1) ? 0 : (e / inner) % channels;
+        // clamped first, then rounded half away from zero
+        float v = src->data[e] * lo[c] + (float)q->zero[c];
+        v = (v < qmin) ? qmin : (v > qmax) ? qmax : v;
+        int r = (int)(v + ((v >= 0.0f) ? 0.5f : -0.5f));
+        if (isunsigned)
+            q->data[e] = (unsigned char)r;
+        else
+            ((signed char *)q->data)[e] = (signed char)r;
+    }
+
+    if (src != arr)
+        smCleanup(src);
+    free(lo);
+    free(hi);
+    return q;
+}
+
+/*
+float Array back from a QArray
+*/
+Array *smDequantize(QArray *q)
+{
+    Array *result = smCreate(q->shape, q->ndim);
+
+    long inner = 1;
+    if (q->axis != SM_NONE)
+        for (int d = q->axis + 1; d < q->ndim; d++)
+            inner *= q->shape[d];
+
+    long n = q->totalsize;
+#ifdef PARALLEL
+#pragma omp parallel for if (n >= SM_PARALLEL_MIN)
+#endif
+    for (long e = 0; e < n; e++)
+    {
+        long c = (e / inner) % q->channels;
+        int v = q->isunsigned ? q->data[e] : ((const signed char *)q->data)[e];
+        result->data[e] = q->scale[c] * (float)(v - q->zero[c]);
+    }
+    return result;
+}
+
+/*
+int8 GEMM of uint8 A (m, k) and int8 B (k, n) into int32 sums, blocked
+like `__sgemm__`: B is packed into SM_QNR-wide column panels, A into
+SM_QMR-high row panels, SM_QKC bytes deep. both are packed in groups of
+4 consecutive k, the unit the integer dot instructions work on:
+
+- AVX-512 VNNI / AVX-VNNI: vpdpbusd adds the 4 uint8 * int8 products
+  straight into an int32 lane
+- AVX2: vpmaddubsw adds them in pairs into int16, vpmaddwd the pairs
+  into int32. a pair of 255 * 127 would saturate int16, so A is packed
+  as the signed a - 128 and multiplied as |a - 128| by B with the sign
+  of a - 128 (vpsignb): pairs stay within 2 * 128 * 127 < 32767 (B
+  never holds -128) and the 128 * sum of B comes back with the zero
+  point of A in the epilogue
+- otherwise plain C
+
+the tile of int32 sums never goes to memory as such: when the last
+slice of k is done it is dequantized (or requantized) right away by
+`__q8Store__`. only for k > SM_QKC are partial sums kept in an int32 C.
+*/
+#if defined(__AVX512VNNI__) && defined(__AVX512VL__)
+#define __Q8DOT__(acc, a, b) acc = _mm256_dpbusd_epi32(acc, a, b)
+#elif defined(__AVXVNNI__)
+#define __Q8DOT__(acc, a, b) acc = _mm256_dpbusd_avx_epi32(acc, a, b)
+#elif defined(__AVX2__)
+// A is packed as a - 128, the product is |a - 128| times b with its sign
+#define SM_Q8_ABIAS 128
+#define __Q8DOT__(acc, a, b)                               \
+    acc = _mm256_add_epi32(acc, _mm256_madd_epi16(         \
+        _mm256_maddubs_epi16(_mm256_abs_epi8(a), _mm256_sign_epi8(b, a)), _mm256_set1_epi16(1)))
+#endif
+#ifndef SM_Q8_ABIAS
+#define SM_Q8_ABIAS 0
+#endif
+
+// SM_QMR rows of A: for every group of 4 k, 4 bytes of each row (less
+// SM_Q8_ABIAS, wrapping to signed, for the AVX2 kernel)
+void __q8PackA__(int rows, int kc, const unsigned char *a, long lda, unsigned char *ap)
+{
+    int groups = (kc + 3) / 4;
+    for (int g = 0; g < groups; g++)
+        for (int r = 0; r < SM_QMR; r++)
+            for (int t = 0; t < 4; t++)
+            {
+                int kk = g * 4 + t;
+                ap[(g * SM_QMR + r) * 4 + t] = (r < rows && kk < kc) ? a[r * lda + kk] ^ SM_Q8_ABIAS : 0;
+            }
+}
+
+// SM_QNR columns of B: for every group of 4 k, 4 bytes of each column
+void __q8PackB__(int kc, int cols, const signed char *b, long ldb, signed char *bp)
+{
+    int groups = (kc + 3) / 4;
+    int nr = (cols < SM_QNR) ? cols : SM_QNR;
+    for (int g = 0; g < groups; g++)
+        for (int t = 0; t < 4; t++)
+        {
+            int kk = g * 4 + t;
+            signed char *dst = bp + g * SM_QNR * 4 + t;
+            int j = 0;
+            if (kk < kc)
+                for (; j < nr; j++)
+                    dst[j * 4] = b[kk * ldb + j];
+            for (; j < SM_QNR; j++)
+                dst[j * 4] = 0;
+        }
+}
+
+void __q8Kernel__(long groups, const unsigned char *ap, const signed char *bp, int *tile)
+{
+#if defined(__AVX2__)
+    __m256i c00 = _mm256_setzero_si256(), c01 = _mm256_setzero_si256();
+    __m256i c10 = _mm256_setzero_si256(), c11 = _mm256_setzero_si256();
+    __m256i c20 = _mm256_setzero_si256(), c21 = _mm256_setzero_si256();
+    __m256i c30 = _mm256_setzero_si256(), c31 = _mm256_setzero_si256();
+
+    for (long g = 0; g < groups; g++)
+    {
+        const signed char *bg = bp + g * SM_QNR * 4;
+        __m256i b0 = _mm256_loadu_si256((const __m256i *)bg);
+        __m256i b1 = _mm256_loadu_si256((const __m256i *)(bg + 32));
+
+        // 4 bytes of a row broadcast straight from memory
+        const float *ag = (const float *)(ap + g * SM_QMR * 4);
+
+        __m256i a = _mm256_castps_si256(_mm256_broadcast_ss(ag));
+        __Q8DOT__(c00, a, b0);
+        __Q8DOT__(c01, a, b1);
+        a = _mm256_castps_si256(_mm256_broadcast_ss(ag + 1));
+        __Q8DOT__(c10, a, b0);
+        __Q8DOT__(c11, a, b1);
+        a = _mm256_castps_si256(_mm256_broadcast_ss(ag + 2));
+        __Q8DOT__(c20, a, b0);
+        __Q8DOT__(c21, a, b1);
+        a = _mm256_castps_si256(_mm256_broadcast_ss(ag + 3));
+        __Q8DOT__(c30, a, b0);
+        __Q8DOT__(c31, a, b1);
+    }
+
+    _mm256_storeu_si256((__m256i *)(tile + 0 * SM_QNR), c00);
+    _mm256_storeu_si256((__m256i *)(tile + 0 * SM_QNR + 8), c01);
+    _mm256_storeu_si256((__m256i *)(tile + 1 * SM_QNR), c10);
+    _mm256_storeu_si256((__m256i *)(tile + 1 * SM_QNR + 8), c11);
+    _mm256_storeu_si256((__m256i *)(tile + 2 * SM_QNR), c20);
+    _mm256_storeu_si256((__m256i *)(tile + 2 * SM_QNR + 8), c21);
+    _mm256_storeu_si256((__m256i *)(tile + 3 * SM_QNR), c30);
+    _mm256_storeu_si256((__m256i *)(tile + 3 * SM_QNR + 8), c31);
+#else
+    for (int t = 0; t < SM_QMR * SM_QNR; t++)
+        tile[t] = 0;
+
+    for (long g = 0; g < groups; g++)
+    {
+        const unsigned char *ag = ap + g * SM_QMR * 4;
+        const signed char *bg = bp + g * SM_QNR * 4;
+        for (int r = 0; r < SM_QMR; r++)
+            for (int j = 0; j < SM_QNR; j++)
+                tile[r * SM_QNR + j] += ag[r * 4] * bg[j * 4] + ag[r * 4 + 1] * bg[j * 4 + 1] +
+                                        ag[r * 4 + 2] * bg[j * 4 + 2] + ag[r * 4 + 3] * bg[j * 4 + 3];
+    }
+#endif
+}
+
+/*
+an (mr, nr) part of a tile at C[i0, j0]: added to the partial sums in
+`cacc` until the `last` slice of k, which goes through the epilogue
+*/
+void __q8Store__(const int *tile, int *cacc, bool last, int i0, int j0, int mr, int nr, int n, const Q8Epilogue *ep)
+{
+    for (int r = 0; r < mr; r++)
+    {
+        int i = i0 + r;
+        const int *src = tile + r * SM_QNR;
+        int *acc = cacc ? cacc + (long)i * n + j0 : NULL;
+
+        if (!last)
+        {
+            for (int j = 0; j < nr; j++)
+                acc[j] += src[j];
+            continue;
+        }
+
+        float rowscale = ep->rowscale[i];
+        int rowzero = ep->rowzero[i];
+        for (int j = 0; j < nr; j++)
+        {
+            int sum = src[j] + (acc ? acc[j] : 0) - rowzero * ep->colsum[j0 + j];
+            float v = rowscale * ep->colscale[j0 + j] * (float)sum;
+            if (ep->out)
+            {
+                ep->out[(long)i * n + j0 + j] = v;
+            }
+            else
+            {
+                v += (float)ep->qzero;
+                v = (v < 0.0f) ? 0.0f : (v > SM_Q8_UMAX) ? SM_Q8_UMAX : v;
+                ep->qout[(long)i * n + j0 + j] = (unsigned char)(v + 0.5f);
+            }
+        }
+    }
+}
+
+void __q8gemm__(int m, int k, int n, const unsigned char *a, const signed char *b, const Q8Epilogue *ep)
+{
+    if (m == 0 || n == 0)
+        return;
+
+    if (k == 0)
+    {
+        // all sums are 0, only the epilogue is left
+        int tile[SM_QMR * SM_QNR] = {0};
+        for (int i0 = 0; i0 < m; i0 += SM_QMR)
+            for (int j0 = 0; j0 < n; j0 += SM_QNR)
+                __q8Store__(
+                    tile, NULL, true, i0, j0,
+                    (m - i0 < SM_QMR) ? m - i0 : SM_QMR, (n - j0 < SM_QNR) ? n - j0 : SM_QNR, n, ep);
+        return;
+    }
+
+    int kcmax = (k < SM_QKC) ? k : SM_QKC;
+    long kpad = (kcmax + 3) / 4 * 4;
+    int ncmax = (n < SM_NC) ? n : SM_NC;
+    long mpad = (m + SM_QMR - 1) / SM_QMR * SM_QMR;
+    long npad = (ncmax + SM_QNR - 1) / SM_QNR * SM_QNR;
+
+    unsigned char *ap = (unsigned char *)malloc(mpad * kpad);
+    signed char *bp = (signed char *)malloc(npad * kpad);
+    _checkNull(ap);
+    _checkNull(bp);
+
+    int *cacc = NULL;
+    if (k > SM_QKC)
+    {
+        cacc = (int *)calloc((size_t)m * n, sizeof(int));
+        _checkNull(cacc);
+    }
+
+#ifdef PARALLEL
+    bool threaded = (double)m * k * n >= SM_PARALLEL_MIN;
+#endif
+
+    for (int jc = 0; jc < n; jc += SM_NC)
+    {
+        int nc = (n - jc < SM_NC) ? n - jc : SM_NC;
+        long npanels = (nc + SM_QNR - 1) / SM_QNR;
+
+        for (int pc = 0; pc < k; pc += SM_QKC)
+        {
+            int kc = (k - pc < SM_QKC) ? k - pc : SM_QKC;
+            long groups = (kc + 3) / 4;
+            bool last = (pc + kc == k);
+
+#ifdef PARALLEL
+#pragma omp parallel for if (threaded)
+#endif
+            for (long jp = 0; jp < npanels; jp++)
+                __q8PackB__(
+                    kc, nc - (int)jp * SM_QNR, b + (long)pc * n + jc + jp * SM_QNR, n,
+                    bp + jp * SM_QNR * groups * 4);
+
+            long mpanels = (m + SM_QMR - 1) / SM_QMR;
+#ifdef PARALLEL
+#pragma omp parallel for if (threaded)
+#endif
+            for (long ip = 0; ip < mpanels; ip++)
+                __q8PackA__(
+                    (m - ip * SM_QMR < SM_QMR) ? m - (int)ip * SM_QMR : SM_QMR, kc,
+                    a + ip * SM_QMR * k + pc, k, ap + ip * SM_QMR * groups * 4);
+
+            // tasks: (block of SM_MC rows, group of SM_JG column panels)
+            long nblocks = (m + SM_MC - 1) / SM_MC;
+            long ngroups = (npanels + SM_JG - 1) / SM_JG;
+
+#ifdef PARALLEL
+#pragma omp parallel for schedule(dynamic) if (threaded)
+#endif
+            for (long t = 0; t < nblocks * ngroups; t++)
+            {
+                int tile[SM_QMR * SM_QNR];
+                long ib = t / ngroups, jg = t % ngroups;
+                long jp1 = (jg + 1) * SM_JG < npanels ? (jg + 1) * SM_JG : npanels;
+
+                for (long jp = jg * SM_JG; jp < jp1; jp++)
+                {
+                    int j0 = jc + (int)jp * SM_QNR;
+                    int nr = (n - j0 < SM_QNR) ? n - j0 : SM_QNR;
+                    int i1 = (ib + 1) * SM_MC < m ? (int)(ib + 1) * SM_MC : m;
+
+                    for (int i0 = (int)ib * SM_MC; i0 < i1; i0 += SM_QMR)
+                    {
+                        int mr = (m - i0 < SM_QMR) ? m - i0 : SM_QMR;
+                        __q8Kernel__(groups, ap + (long)i0 * groups * 4, bp + jp * SM_QNR * groups * 4, tile);
+                        __q8Store__(tile, cacc, last, i0, j0, mr, nr, n, ep);
+                    }
+                }
             }
         }
     }
-    free(idxs);
 
+    free(cacc);
+    free(ap);
+    free(bp);
+}
+
+// operands of the quantized matmul must be uint8 (m, k) @ int8 (k, n)
+void __q8Check__(QArray *a, QArray *b)
+{
+    if (a->ndim != 2 || b->ndim != 2)
+    {
+        fprintf(stderr, ">> error: quantized matmul needs two matrices.\n");
+        exit(1);
+    }
+    if (!a->isunsigned || b->isunsigned)
+    {
+        fprintf(stderr, ">> error: quantized matmul needs a uint8 and an int8 operand.\n");
+        exit(1);
+    }
+    if (a->shape[1] != b->shape[0])
+    {
+        fprintf(stderr, ">> error: shapes not aligned for quantized matmul.\n");
+        exit(1);
+    }
+    if ((a->axis != SM_NONE && a->axis != 0) || (b->axis != SM_NONE && b->axis != 1))
+    {
+        fprintf(stderr, ">> error: quantized matmul needs scales per row of A and per column of B.\n");
+        exit(1);
+    }
+}
+
+/*
+A @ B of two checked QArrays, dequantized into `out` or requantized
+with (scale, zero) into `qout`. B has no zero point, A's ones are
+taken out with the column sums of B:
+sum_k (a - za) * b = sum_k a * b - za * sum_k b
+*/
+void __q8MatMul__(QArray *a, QArray *b, float *out, unsigned char *qout, float scale, int zero)
+{
+    int m = a->shape[0], k = a->shape[1], n = b->shape[1];
+    const signed char *bd = (const signed char *)b->data;
+
+    float *rowscale = (float *)malloc((m + 1) * sizeof(float));
+    int *rowzero = (int *)malloc((m + 1) * sizeof(int));
+    float *colscale = (float *)malloc((n + 1) * sizeof(float));
+    int *colsum = (int *)calloc(n + 1, sizeof(int));
+    _checkNull(rowscale);
+    _checkNull(rowzero);
+    _checkNull(colscale);
+    _checkNull(colsum);
+
+    for (int i = 0; i < m; i++)
+    {
+        int c = (a->axis == SM_NONE) ? 0 : i;
+        rowscale[i] = qout ? a->scale[c] / scale : a->scale[c];
+        rowzero[i] = a->zero[c] - SM_Q8_ABIAS;
+    }
+    for (int j = 0; j < n; j++)
+        colscale[j] = b->scale[(b->axis == SM_NONE) ? 0 : j];
+    for (int kk = 0; kk < k; kk++)
+        for (int j = 0; j < n; j++)
+            colsum[j] += bd[(long)kk * n + j];
+
+    Q8Epilogue ep = {rowscale, rowzero, colscale, colsum, out, qout, zero};
+    __q8gemm__(m, k, n, a->data, bd, &ep);
+
+    free(rowscale);
+    free(rowzero);
+    free(colscale);
+    free(colsum);
+}
+
+/*
+matrix product of quantized matrices with int32 accumulation: uint8 A
+(m, k), per tensor or per row, times int8 B (k, n), per tensor or per
+column (the usual activations @ weights). the result is a float Array.
+*/
+Array *smMatMulQ8(QArray *a, QArray *b)
+{
+    __q8Check__(a, b);
+
+    int shape[] = {a->shape[0], b->shape[1]};
+    Array *result = smCreate(shape, 2);
+    __q8MatMul__(a, b, result->data, NULL, 1.0f, 0);
     return result;
 }
 
 /*
-Apply a given ArrayFunc element-wise to the array, inplace
+same as smMatMulQ8 but the result is requantized to uint8 with the
+given (scale, zero), e.g. as the input of the next layer. zero must be
+in [0, SM_Q8_UMAX] like the zero points of smQuantize.
 */
-void smApplyInplace(Array *arr, ArrayFunc func)
+QArray *smMatMulQ8Requantize(QArray *a, QArray *b, float scale, int zero)
 {
-    for (int i = 0; i < arr->totalsize; i++)
+    __q8Check__(a, b);
+    if (zero < 0 || zero > SM_Q8_UMAX)
     {
-        arr->data[i] = func(arr->data[i]);
+        fprintf(stderr, ">> error: zero point must be in [0, %d] for requantization.\n", SM_Q8_UMAX);
+        exit(1);
     }
+
+    int shape[] = {a->shape[0], b->shape[1]};
+    QArray *result = __createQ8__(shape, 2, SM_NONE, 1, true);
+    result->scale[0] = scale;
+    result->zero[0] = zero;
+    __q8MatMul__(a, b, NULL, result->data, scale, zero);
+    return result;
 }
 
 // --------------------------------------------------------------
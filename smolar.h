@@ -22,9 +22,83 @@ one thing to note here is every Array has only `float` dtype
 #define SMOLAR_H
 
 #include <stdbool.h>
+#include <limits.h>
 
 typedef float (*ArrayFunc)(float);
 
+// memory layout of a new Array
+typedef enum
+{
+    SM_C_ORDER, // row-major, last axis is the fastest
+    SM_F_ORDER  // column-major, first axis is the fastest
+} ArrayOrder;
+
+// how dot products, matrix products and sums accumulate
+typedef enum
+{
+    SM_ACCUM_FLOAT,      // float accumulators, the fastest
+    SM_ACCUM_DOUBLE,     // double accumulators
+    SM_ACCUM_COMPENSATED // float sums carrying their rounding errors
+} Accumulation;
+
+// element-wise activations that can be fused into a matmul, see smLinear
+typedef enum
+{
+    SM_ACT_NONE,
+    SM_ACT_RELU,
+    SM_ACT_GELU, // tanh approximation
+    SM_ACT_TANH,
+    SM_ACT_SIGMOID
+} Activation;
+
+// combine op of a scan, see smCumsum
+typedef enum
+{
+    SM_SCAN_SUM,
+    SM_SCAN_PROD,
+    SM_SCAN_MAX
+} ScanOp;
+
+// elementwise comparisons, see smComparePacked
+typedef enum
+{
+    SM_CMP_GT,
+    SM_CMP_GE,
+    SM_CMP_LT,
+    SM_CMP_LE,
+    SM_CMP_EQ,
+    SM_CMP_NE
+} Comparison;
+
+// metric of smCdist and smKnn
+typedef enum
+{
+    SM_DIST_SQEUCLIDEAN, // ||a - b||^2
+    SM_DIST_COSINE,      // 1 - cos(a, b)
+    SM_DIST_INNER        // a . b, larger is nearer
+} Distance;
+
+/*
+one axis of a slice, see `smSlice`.
+start/stop can be negative (counted from the end) or SM_NONE (whole axis)
+*/
+typedef struct
+{
+    int start;
+    int stop;
+    int step;     // can be negative, never 0
+    bool isindex; // pick the single index `start` and drop the axis
+} SmSlice;
+
+#define SM_NONE INT_MIN
+#define SM_ALL ((SmSlice){SM_NONE, SM_NONE, 1, false})
+#define SM_SLICE(start, stop, step) ((SmSlice){(start), (stop), (step), false})
+#define SM_INDEX(i) ((SmSlice){(i), 0, 1, true})
+
+// limits of the strided loop planner
+#define SM_MAXDIMS 32
+#define SM_MAXOPS 4
+
 typedef struct
 {
     int **indices; // 2D array to hold all possible index combinations
@@ -53,8 +127,125 @@ typedef struct
 
     bool C_ORDER;
     bool F_ORDER;
+    bool OWNDATA; // false for views that share the buffer of another Array
 } Array;
 
+/*
+inner loop of the strided engine: `n` elements, `ptrs[op]` advances by
+`steps[op]` elements per iteration (0 for broadcasted operands)
+*/
+typedef void (*StridedLoop)(float **ptrs, const long *steps, long n, void *ctx);
+
+/*
+kernel of an axis op (softmax, layernorm): `width` independent lanes
+side by side, each with `n` elements along the axis that are `stride`
+apart (width is 1 when the axis itself is contiguous)
+*/
+typedef void (*AxisLoop)(const float *x, float *y, long n, long stride, int width, void *ctx);
+
+typedef struct
+{
+    int ndim;                            // axes left after sorting/merging
+    int nop;                             // operands, 0 is the output
+    int shape[SM_MAXDIMS];               // innermost axis last
+    long strides[SM_MAXOPS][SM_MAXDIMS]; // element strides per operand
+    float *data[SM_MAXOPS];
+} StridedPlan;
+
+/*
+an operand of smEinsum while it is being contracted: `arr` is a view
+with one axis per letter, `base` the temporary that owns its data (NULL
+for the user's Arrays, which are never copied or freed)
+*/
+typedef struct
+{
+    Array *arr;
+    Array *base;
+    int ndim;
+    char letters[SM_MAXDIMS + 1];
+} EinsumTerm;
+
+/*
+an int8 quantized Array: value = scale * (q - zero), elements in C order.
+`data` holds uint8 values if `isunsigned` is set, int8 ones otherwise.
+per-channel Arrays have one scale/zero per index along `axis`, a single
+pair is used when `axis` is SM_NONE.
+*/
+typedef struct
+{
+    unsigned char *data;
+    int *shape;
+    int ndim;
+    int totalsize;
+
+    int axis;
+    int channels; // number of scales and zero points
+    float *scale;
+    int *zero;    // always 0 for int8 data
+    bool isunsigned;
+} QArray;
+
+/*
+a boolean Array packed 1 bit per element in C order: element i is bit
+i % 8 of byte i / 8. see smComparePacked.
+*/
+typedef struct
+{
+    unsigned char *bits;
+    int *shape;
+    int ndim;
+    int totalsize;
+} BitMask;
+
+/*
+what the quantized GEMM does with a finished int32 sum of C[i, j]:
+rowscale[i] * colscale[j] * (sum - rowzero[i] * colsum[j]), written as a
+float to `out` or, with the output zero point added, as uint8 to `qout`
+*/
+typedef struct
+{
+    const float *rowscale;
+    const int *rowzero;
+    const float *colscale;
+    const int *colsum;
+    float *out;
+    unsigned char *qout;
+    int qzero;
+} Q8Epilogue;
+
+/*
+sizes of a 2D convolution or pooling over (N, C, H, W) inputs: kernel
+(kh, kw), stride, padding and dilation per axis, output (oh, ow)
+*/
+typedef struct
+{
+    int n, c, h, w;
+    int o, groups;
+    int kh, kw, sh, sw, ph, pw, dh, dw;
+    int oh, ow;
+} ConvGeometry;
+
+// what a sort along an axis produces, see smSort, smArgSort and smTopK
+typedef struct
+{
+    int k;        // elements kept by a top-k
+    bool indices; // write positions along the axis instead of values
+    bool topk;    // the k largest in descending order instead of a sort
+} SortContext;
+
+/*
+open addressing hash table of float keys (see __hashKey__), probed
+linearly by groups of SM_HASH_GROUP slots. `ids` are kept apart from
+the keys so a group of keys fits one vector register.
+*/
+typedef struct
+{
+    unsigned int *keys; // SM_HASH_EMPTY in free slots
+    int *ids;           // position of the first occurrence of every key
+    long mask;          // number of groups - 1, a power of 2
+    long size;          // keys stored
+} HashTable;
+
 // private
 void __checkOrderC__(Array *arr);
 void __checkOrderF__(Array *arr);
@@ -68,15 +259,198 @@ bool __checkShapeCompatible__(Array *arr, const int *shape, int ndim);
 void __printArrayInternals__(Array *arr, int *s);
 void __printArrayData__(Array *arr);
 void __setArrayMetadata__(Array *arr);
+void __freeArrayIndices__(Array *arr);
+int __linearToOffset__(Array *arr, int index);
+void __recalculateStridesF__(Array *arr);
+bool __isContiguousC__(Array *arr);
+bool __isContiguousF__(Array *arr);
+Array *__createView__(Array *arr, float *data, const int *shape, const int *strides, int ndim);
+int __checkJoinable__(Array **arrays, int count, int axis);
+int *__indicesFromArray__(Array *indices, int len);
+void __gatherFloats__(float *dst, const float *src, const int *idx, long n);
+Array *__asContiguous__(Array *arr);
+int __resolveSlice__(SmSlice slice, int n, int *first);
+void __transposeBlock__(const float *src, long lds, float *dst, long ldd, int rows, int cols);
+void __copyStrided__(Array *dst, Array *src);
+Array *__contiguousView__(Array *arr, float *data, const int *shape, int ndim);
+void __copyToBuffer__(float *buf, Array *src);
+void __planStrided__(StridedPlan *plan, const int *shape, int ndim, Array **ops, int nop);
+long __stridedItems__(StridedPlan *plan);
+void __runStridedRange__(StridedPlan *plan, StridedLoop loop, void *ctx, long start, long end);
+void __runStrided__(StridedPlan *plan, StridedLoop loop, void *ctx);
+void __runReduction__(StridedPlan *plan, StridedLoop loop, StridedLoop combine, void *ctx, float init);
+Array *__PreduceAxis__(Array **inputs, int nin, int axis, float init, StridedLoop loop, StridedLoop combine);
+void __compareLoop__(float **ptrs, const long *steps, long n, void *ctx);
+void __whereLoop__(float **ptrs, const long *steps, long n, void *ctx);
+void __clipLoop__(float **ptrs, const long *steps, long n, void *ctx);
+int __broadcastShapeN__(Array **arrays, int count, int *shape);
+bool __broadcastsTo__(Array *arr, const int *shape, int ndim);
+Array *__broadcastView__(Array *arr, const int *shape, int ndim);
+Array *__Pcompare__(Array *a, Array *b, Comparison op);
+void __maskedSumLoop__(float **ptrs, const long *steps, long n, void *ctx);
+void __maskedMaxLoop__(float **ptrs, const long *steps, long n, void *ctx);
+void __maskedMinLoop__(float **ptrs, const long *steps, long n, void *ctx);
+void __countLoop__(float **ptrs, const long *steps, long n, void *ctx);
+Array *__maskView__(Array *arr, Array *mask);
+Array *__PmaskedReduce__(Array *arr, Array *mask, int axis, float init, StridedLoop loop, StridedLoop combine);
+BitMask *__createMask__(const int *shape, int ndim);
+Array *__packedOperand__(Array *arr, const int *shape, int ndim);
+void __compareBits__(const float *a, long sa, const float *b, long sb, long lo, long hi, Comparison op, unsigned char *bits);
+void __whereBits__(const unsigned char *bits, const float *a, long sa, const float *b, long sb, long lo, long hi, float *out);
+void __rollingSumLoop__(const float *x, float *y, long n, long stride, int width, void *ctx);
+void __rollingVarLoop__(const float *x, float *y, long n, long stride, int width, void *ctx);
+void __rollingExtremeLoop__(const float *x, float *y, long n, long stride, int width, void *ctx);
+Array *__rolling__(Array *arr, int window, int axis, AxisLoop loop, bool mean, bool max);
+float __scanIdentity__(ScanOp op);
+void __scanRun__(const float *x, float *y, long n, float carry, ScanOp op);
+float __scanReduce__(const float *x, long n, ScanOp op);
+void __scanColumns__(const float *x, float *y, long n, long stride, long width, ScanOp op);
+Array *__Pscan__(Array *arr, int axis, ScanOp op);
+void __sortKeys__(unsigned int *keys, int *idx, long n, unsigned int *tmpk, int *tmpi);
+void __heapSiftDown__(unsigned int *keys, int *idx, long size, long i);
+void __heapSortDescending__(unsigned int *keys, int *idx, long k);
+void __topkHeap__(const float *x, long n, long stride, int k, unsigned int *keys, int *idx);
+bool __topkUsesHeap__(int k, long n);
+void __sortWrite__(const unsigned int *keys, const int *idx, long n, SortContext *c, float *y, long stride);
+void __sortLoop__(const float *x, float *y, long n, long stride, int width, void *ctx);
+long __mergeCoRank__(long k, const unsigned int *a, long na, const unsigned int *b, long nb);
+void __mergeRange__(
+    const unsigned int *a, const int *ia, long na,
+    const unsigned int *b, const int *ib, long nb,
+    unsigned int *out, int *iout, long k0, long k1);
+Array *__PsortLarge__(Array *arr, SortContext *c);
+Array *__Psort__(Array *arr, int axis, SortContext *c);
+void __distanceNorms__(const float *x, int rows, int d, Distance metric, float *out);
+void __distanceEpilogue__(float *c, long ldc, int rows, int cols, const float *na, const float *nb, Distance metric);
+void __distanceOperands__(Array *a, Array *b, Array **ac, Array **bc);
+void __knnPush__(const float *dist, int cols, int j0, Distance metric, unsigned int *keys, int *idx, int k);
+int *__segmentIds__(Array *ids, int num_segments, long *counts, bool *sorted);
+void __PsegmentReduce__(const float *data, long n, long inner, const int *ids, int num_segments, bool sorted, bool max, float *out);
+Array *__Psegment__(Array *data, Array *segment_ids, int num_segments, bool mean, bool max);
+HashTable __hashCreate__(long n);
+void __hashGrow__(HashTable *t);
+void __hashInsert__(HashTable *t, const unsigned int *keys, const int *pos, long n, int *first, int *counts);
+void __hashLookup__(const HashTable *tables, int bits, const unsigned int *keys, long n, float *out);
+HashTable *__hashBuild__(const unsigned int *keys, long n, int *first, int *counts, int *bits);
+void __hashCleanup__(HashTable *tables, int bits);
+long __hashUnique__(const unsigned int *keys, long n, int *first, int *counts, unsigned int *ukeys, int *upos);
+unsigned int *__hashKeys__(Array *arr);
+float __dotKernel__(const float *a, const float *b, long n);
+double __sumAcc__(const float *x, long n, Accumulation mode);
+double __dotAcc__(const float *a, const float *b, long n, Accumulation mode);
+Array *__PreduceAccurate__(Array **inputs, int nin, int axis, Accumulation mode);
+void __dot4Kernel__(
+    const float *a0, const float *a1, const float *a2, const float *a3,
+    const float *x, long n, float *out);
+void __sgemv__(int m, int n, const float *a, long rs, long cs, const float *x, float *y, Accumulation mode);
+void __sgemvStrided__(
+    int m, int n, const float *a, long rs, long cs,
+    const float *x, long incx, float *y, long incy, Accumulation mode);
+Array *__dotAxis__(Array *a, Array *b, int axis, Accumulation mode);
+float __activation__(float x, Activation act);
+void __activate__(float *x, long n, Activation act);
+void __sgemmEpilogue__(float *c, long rsc, long csc, int mr, int nr, const float *bias, Activation act);
+void __sgemmKernel__(long kc, const float *ap, const float *bp, float *tile);
+void __sgemmPackA__(int rows, int kc, const float *a, long rsa, long csa, float *ap);
+void __sgemmPackB__(int kc, int cols, const float *b, long rsb, long csb, float *bp);
+void __sgemmStore__(
+    float *c, long rsc, long csc, const float *tile,
+    int mr, int nr, float alpha, float beta, bool first);
+void __sgemmKernelAcc__(long kc, const float *ap, const float *bp, double *tile, Accumulation mode);
+void __sgemmStoreAcc__(
+    float *c, long rsc, long csc, double *cacc, long ldacc,
+    const double *tile, int mr, int nr, float alpha, float beta);
+void __sgemm__(
+    int m, int n, int p, float alpha,
+    const float *a, long rsa, long csa,
+    const float *b, long rsb, long csb,
+    float beta, float *c, long rsc, long csc, int uplo, Accumulation mode);
+void __sgemmFused__(
+    int m, int n, int p, float alpha,
+    const float *a, long rsa, long csa,
+    const float *b, long rsb, long csb,
+    float beta, float *c, long rsc, long csc, int uplo,
+    const float *bias, Activation act, Accumulation mode);
+void __mirrorTriangle__(int m, float *c, long rsc, long csc, bool upper);
+void __ssyrk__(
+    int m, int n, const float *a, long rsa, long csa, float *c, long rsc, long csc, bool upper, Accumulation mode);
+void __syrkLoop__(float **ptrs, const long *steps, long n, void *ctx);
+void __strsmUnblocked__(
+    int n, int k, const float *a, long rsa, long csa,
+    float *b, long rsb, long csb, bool lower, bool unit);
+void __strsm__(
+    int n, int k, const float *a, long rsa, long csa,
+    float *b, long rsb, long csb, bool lower, bool unit, Accumulation mode);
+int __spotrf__(int n, float *a, long lda, Accumulation mode);
+int __sgetrf__(int n, float *a, long lda, int *piv, Accumulation mode);
+long __squareBatch__(Array *arr, const char *name);
+Array *__luBatched__(Array *a, Array **pivots, Accumulation mode);
+void __solveLoop__(float **ptrs, const long *steps, long count, void *ctx);
+Array *__solveBatched__(Array *a, Array *b, bool lower, bool factor);
+void __einsumRelease__(EinsumTerm *t);
+long __einsumStride__(EinsumTerm *t, char c);
+bool __einsumHas__(const char *letters, char c);
+Array *__einsumView__(EinsumTerm *t, const char *letters, const int *sizes);
+void __einsumSortByStride__(EinsumTerm *t, char *letters);
+bool __einsumMerge__(EinsumTerm *t, const char *letters, const int *sizes, long *stride);
+EinsumTerm __einsumTerm__(Array *arr, const char *letters);
+EinsumTerm __einsumCopy__(EinsumTerm *t, const char *letters, const int *sizes);
+Array *__einsumReduce__(EinsumTerm *t, const char *keep, const int *sizes);
+EinsumTerm __einsumPair__(EinsumTerm *a, EinsumTerm *b, const char *keep, const int *sizes, Accumulation mode);
+Array *__PaxisOp__(Array *arr, int axis, int trim, AxisLoop loop, void *ctx);
+void __softmaxLoop__(const float *x, float *y, long n, long stride, int width, void *ctx);
+void __layerNormLoop__(const float *x, float *y, long n, long stride, int width, void *ctx);
+float __expShift__(float *x, long n, float shift);
+void __attentionCollectLoop__(float **ptrs, const long *steps, long n, void *ctx);
+void __attentionTask__(void *ctx, long item, int chunk);
+void __convRange__(int off, int stride, int in, int out, int *lo, int *hi);
+void __convOutput__(ConvGeometry *g);
+void __im2col__(const float *x, const ConvGeometry *g, float *col);
+void __convDirect__(const float *x, const float *w, float bias, const ConvGeometry *g, float *out);
+Array *__conv__(Array *x, Array *w, Array *bias, ConvGeometry *g, int ndim);
+Array *__pool2d__(Array *x, int kernel, int stride, int padding, bool max);
+QArray *__createQ8__(const int *shape, int ndim, int axis, int channels, bool isunsigned);
+void __q8PackA__(int rows, int kc, const unsigned char *a, long lda, unsigned char *ap);
+void __q8PackB__(int kc, int cols, const signed char *b, long ldb, signed char *bp);
+void __q8Kernel__(long groups, const unsigned char *ap, const signed char *bp, int *tile);
+void __q8Store__(const int *tile, int *cacc, bool last, int i0, int j0, int mr, int nr, int n, const Q8Epilogue *ep);
+void __q8gemm__(int m, int k, int n, const unsigned char *a, const signed char *b, const Q8Epilogue *ep);
+void __q8Check__(QArray *a, QArray *b);
+void __q8MatMul__(QArray *a, QArray *b, float *out, unsigned char *qout, float scale, int zero);
+void __matmulStrided__(
+    int m, int n, int p,
+    const float *a, long rsa, long csa,
+    const float *b, long rsb, long csb,
+    float *c, long rsc, long csc, Accumulation mode);
+void __matmulLoop__(float **ptrs, const long *steps, long n, void *ctx);
+Array *__batchView__(Array *arr);
+void __runBatched__(StridedPlan *plan, StridedLoop loop, void *ctx, long work);
+Array *__matmulBatched__(Array *a, Array *b, Accumulation mode);
+Array *__createLike__(const int *shape, int ndim, Array **ops, int nop);
+void __copyLoop__(float **ptrs, const long *steps, long n, void *ctx);
+Array *__PunaryOp__(Array *arr, StridedLoop loop, void *ctx);
+void __addLoop__(float **ptrs, const long *steps, long n, void *ctx);
+void __subLoop__(float **ptrs, const long *steps, long n, void *ctx);
+void __mulLoop__(float **ptrs, const long *steps, long n, void *ctx);
+void __divLoop__(float **ptrs, const long *steps, long n, void *ctx);
+void __powLoop__(float **ptrs, const long *steps, long n, void *ctx);
+void __minimumLoop__(float **ptrs, const long *steps, long n, void *ctx);
+void __maximumLoop__(float **ptrs, const long *steps, long n, void *ctx);
+void __atan2Loop__(float **ptrs, const long *steps, long n, void *ctx);
+Array *__PbinaryOp__(Array *a, Array *b, StridedLoop loop, void *ctx);
+Array *__scalar__(float value);
 int *__broadcastFinalShape__(Array *a, Array *b);
 Array *__broadcastArray__(Array *arr, const int *shape, int ndim);
 
 // creation and management
 Array *smCreate(const int *shape, int ndim);
+Array *smCreateOrder(const int *shape, int ndim, ArrayOrder order);
 void smCleanup(Array *arr);
 Array *smRandom(const int *shape, int ndim);
 Array *smArange(float start, float end, float step);
 void smFromValues(Array *arr, float *values);
+float smGet(Array *arr, int index);
+void smSet(Array *arr, int index, float value);
 
 // information and display
 void smPrintInfo(Array *arr);
@@ -87,14 +461,142 @@ int smCheckShapesEqual(Array *a, Array *b);
 Array *smReshapeNew(Array *arr, const int *shape, int ndim);
 void smReshapeInplace(Array *arr, const int *shape, int ndim);
 Array *smTransposeNew(Array *arr, const int *axes);
+Array *smTransposeView(Array *arr, const int *axes);
+Array *smSlice(Array *arr, const SmSlice *slices);
+Array *smSlidingWindowView(Array *arr, int window, int axis);
+Array *smContiguous(Array *arr);
+Array *smAsFortran(Array *arr);
 Array *smAdd(Array *a, Array *b);
+Array *smSub(Array *a, Array *b);
 Array *smMul(Array *a, Array *b);
+Array *smDiv(Array *a, Array *b);
+Array *smPow(Array *a, Array *b);
+Array *smMinimum(Array *a, Array *b);
+Array *smMaximum(Array *a, Array *b);
+Array *smAtan2(Array *y, Array *x);
+Array *smAddScalar(Array *arr, float value);
+Array *smSubScalar(Array *arr, float value);
+Array *smMulScalar(Array *arr, float value);
+Array *smDivScalar(Array *arr, float value);
+Array *smPowScalar(Array *arr, float value);
+Array *smMinimumScalar(Array *arr, float value);
+Array *smMaximumScalar(Array *arr, float value);
+Array *smAtan2Scalar(Array *y, float x);
 Array *smExpandDims(Array *arr, int axis);
 Array *smSqueeze(Array *arr, int axis);
+Array *smConcat(Array **arrays, int count, int axis);
+Array *smStack(Array **arrays, int count, int axis);
+Array **smSplit(Array *arr, int sections, int axis);
+
+// indexing
+Array *smTake(Array *arr, Array *indices, int axis);
+Array *smTakeAlongAxis(Array *arr, Array *indices, int axis);
+void smScatterAdd(Array *out, Array *indices, Array *src, int axis);
+Array *smMaskSelect(Array *arr, Array *mask);
 Array *smDot(Array *a, Array *b);
 Array *smMatMul(Array *a, Array *b);
+Array *smSyrk(Array *x, bool upper);
 void smApplyInplace(Array *arr, ArrayFunc func);
 
+// reductions
+Array *smSum(Array *arr, int axis);
+Array *smMean(Array *arr, int axis);
+Array *smMax(Array *arr, int axis);
+Array *smMin(Array *arr, int axis);
+
+// comparisons and masks, float masks hold 1s and 0s (nonzero is true)
+Array *smGreater(Array *a, Array *b);
+Array *smGreaterEqual(Array *a, Array *b);
+Array *smLess(Array *a, Array *b);
+Array *smLessEqual(Array *a, Array *b);
+Array *smEqual(Array *a, Array *b);
+Array *smNotEqual(Array *a, Array *b);
+Array *smWhere(Array *cond, Array *a, Array *b);
+Array *smClip(Array *arr, float lo, float hi);
+Array *smMaskedSum(Array *arr, Array *mask, int axis);
+Array *smMaskedMean(Array *arr, Array *mask, int axis);
+Array *smMaskedMax(Array *arr, Array *mask, int axis);
+Array *smMaskedMin(Array *arr, Array *mask, int axis);
+BitMask *smComparePacked(Array *a, Array *b, Comparison op);
+BitMask *smPackMask(Array *mask);
+Array *smUnpackMask(BitMask *mask);
+Array *smWherePacked(BitMask *mask, Array *a, Array *b);
+long smMaskCount(BitMask *mask);
+void smCleanupMask(BitMask *mask);
+
+// rolling windows
+Array *smRollingSum(Array *arr, int window, int axis);
+Array *smRollingMean(Array *arr, int window, int axis);
+Array *smRollingVar(Array *arr, int window, int axis);
+Array *smRollingMin(Array *arr, int window, int axis);
+Array *smRollingMax(Array *arr, int window, int axis);
+
+// scans
+Array *smCumsum(Array *arr, int axis);
+Array *smCumprod(Array *arr, int axis);
+Array *smCummax(Array *arr, int axis);
+
+// sorting
+Array *smSort(Array *arr, int axis);
+Array *smArgSort(Array *arr, int axis);
+Array *smTopK(Array *arr, int k, int axis, Array **indices);
+
+// distances and nearest neighbours, between rows of (n, d) Arrays
+Array *smCdist(Array *a, Array *b, Distance metric);
+Array *smKnn(Array *queries, Array *base, int k, Distance metric, Array **indices);
+
+// segments and histograms, segment ids and values are integral floats
+Array *smSegmentSum(Array *data, Array *segment_ids, int num_segments);
+Array *smSegmentMean(Array *data, Array *segment_ids, int num_segments);
+Array *smSegmentMax(Array *data, Array *segment_ids, int num_segments);
+Array *smBincount(Array *x, Array *weights, int minlength);
+Array *smHistogram(Array *arr, int bins, float lo, float hi);
+
+// unique and set operations, -0 equals 0 and all NaNs are equal (but a
+// NaN is never in smIsIn's values)
+Array *smUnique(Array *arr, Array **counts, Array **inverse);
+Array *smIsIn(Array *arr, Array *values);
+Array *smIntersect(Array *a, Array *b);
+
+// BLAS level 1/2
+void smSetAccumulation(Accumulation mode);
+Accumulation smGetAccumulation(void);
+void smAxpy(float alpha, Array *x, Array *y);
+void smScal(float alpha, Array *x);
+float smNrm2(Array *x);
+float smAsum(Array *x);
+Array *smDotAxis(Array *a, Array *b, int axis);
+Array *smGemv(Array *a, Array *x, bool trans);
+
+// linear algebra
+Array *smCholesky(Array *a);
+Array *smLU(Array *a, Array **pivots);
+Array *smTriSolve(Array *a, Array *b, bool lower);
+Array *smSolve(Array *a, Array *b);
+
+// einsum
+Array *smEinsum(const char *subscripts, Array **operands, int count);
+
+// neural network layers
+Array *smLinear(Array *x, Array *w, Array *bias, Activation act);
+Array *smSoftmax(Array *arr, int axis);
+Array *smLogSoftmax(Array *arr, int axis);
+Array *smLayerNorm(Array *arr, Array *gamma, Array *beta, int axis, float eps);
+Array *smAttention(Array *q, Array *k, Array *v, Array *mask, bool causal);
+
+// convolution and pooling, (N, C, ...) layout
+Array *smConv1d(Array *x, Array *w, Array *bias, int stride, int padding, int dilation, int groups);
+Array *smConv2d(Array *x, Array *w, Array *bias, int stride, int padding, int dilation, int groups);
+Array *smMaxPool2d(Array *x, int kernel, int stride, int padding);
+Array *smAvgPool2d(Array *x, int kernel, int stride, int padding);
+
+// quantization
+QArray *smQuantize(Array *arr, int axis, bool isunsigned);
+Array *smDequantize(QArray *q);
+void smCleanupQ8(QArray *q);
+Array *smMatMulQ8(QArray *a, QArray *b);
+QArray *smMatMulQ8Requantize(QArray *a, QArray *b, float scale, int zero);
+
 // utility functions
 float _getrandomFloat(float min, float max);
 int _getRandomInt(int min, int max);